@@ -380,6 +380,8 @@ static const STP_CALLBACKS stp_callbacks =
 	StpCallback_OnPortRoleChanged,
 	StpCallback_AllocAndZeroMemory,
 	StpCallback_FreeMemory,
+	NULL, // transmitGather
+	NULL, // readClock
 };
 
 static bool read_port_status (size_t stp_port_index, uint32_t& speed, bool& duplex)
@@ -0,0 +1,52 @@
+
+// This file is part of the mstp-lib library, available at https://github.com/adigostin/mstp-lib
+// Copyright (c) 2011-2020 Adi Gostin, distributed under Apache License v2.0.
+
+// Benchmarks for the headless simulator engine: how fast a large topology runs, on one thread and on several.
+
+#include "headless_network.h"
+#include <benchmark/benchmark.h>
+
+// Rings of 8 bridges each, with each ring connected by one cable to the next ring.
+// Contiguous blocks of rings go to the same partition, so few cables cross between partitions.
+static std::vector<headless_bridge*> CreateRingsOfRings (headless_network& network, size_t ringCount)
+{
+	static constexpr size_t RingSize = 8;
+
+	std::vector<headless_bridge*> bridges;
+	for (size_t i = 0; i < ringCount * RingSize; i++)
+	{
+		auto b = network.add_bridge (4, 0, { 0x02, 0, 0, (uint8_t)(i >> 16), (uint8_t)(i >> 8), (uint8_t)i });
+		STP_StartBridge (*b, network.timestamp());
+		bridges.push_back(b);
+	}
+
+	network.distribute_bridges();
+
+	for (size_t ring = 0; ring < ringCount; ring++)
+	{
+		for (size_t i = 0; i < RingSize; i++)
+			network.connect (bridges[ring * RingSize + i], 1, bridges[ring * RingSize + (i + 1) % RingSize], 0);
+
+		if (ring + 1 < ringCount)
+			network.connect (bridges[ring * RingSize + 2], 2, bridges[(ring + 1) * RingSize + 6], 3);
+	}
+
+	return bridges;
+}
+
+// Args: ring count, partition count, whether to simulate link pulses.
+// Each iteration runs the converged network for one simulated second.
+static void BM_RunNetwork (benchmark::State& state)
+{
+	headless_network network ((size_t) state.range(1), state.range(2) != 0);
+	auto bridges = CreateRingsOfRings (network, (size_t) state.range(0));
+	network.run_for (5 * sim_seconds);
+
+	for (auto _ : state)
+		network.run_for (1 * sim_seconds);
+
+	state.counters["bridges"] = (double) bridges.size();
+	state.counters["sim_s/s"] = benchmark::Counter ((double) state.iterations(), benchmark::Counter::kIsRate);
+}
+BENCHMARK (BM_RunNetwork)->Args({64, 1, 0})->Args({64, 2, 0})->Args({64, 4, 0})->Args({64, 8, 0})->Args({64, 1, 1})->Args({64, 4, 1})->Unit(benchmark::kMillisecond)->UseRealTime();
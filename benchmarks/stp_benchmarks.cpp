@@ -0,0 +1,276 @@
+
+// This file is part of the mstp-lib library, available at https://github.com/adigostin/mstp-lib
+// Copyright (c) 2011-2020 Adi Gostin, distributed under Apache License v2.0.
+
+// Benchmarks for the paths the library takes most often: received BPDUs, the one-second tick, transmission,
+// plus the calls whose cost grows with the size of the bridge (creation, changes to the MST Configuration Table).
+
+#include "stp.h"
+#include "internal/stp_bridge.h"
+#include "internal/stp_procedures.h"
+#include <benchmark/benchmark.h>
+#include <stdlib.h>
+#include <string.h>
+#include <deque>
+#include <vector>
+
+// ============================================================================
+// Callbacks. Frames are kept only between SetupLink and the start of the measurement;
+// during the measurement they're built in a static buffer and dropped.
+
+struct FRAME
+{
+	const STP_BRIDGE* from;
+	unsigned int portIndex;
+	std::vector<unsigned char> bpdu;
+};
+
+static unsigned long long allocationCount;
+static bool keepFrames;
+static std::deque<FRAME> frames;
+static unsigned char txBuffer [2048];
+static unsigned int txBufferSize;
+static const STP_BRIDGE* txBridge;
+static unsigned int txPort;
+
+static void* AllocAndZeroMemory (unsigned int size)
+{
+	allocationCount++;
+	return calloc (1, size);
+}
+
+static void FreeMemory (void* p)
+{
+	free (p);
+}
+
+static void* TransmitGetBuffer (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int bpduSize, unsigned int timestamp)
+{
+	txBridge = bridge;
+	txPort = portIndex;
+	txBufferSize = bpduSize;
+	return txBuffer;
+}
+
+static void TransmitReleaseBuffer (const STP_BRIDGE* bridge, void* bufferReturnedByGetBuffer)
+{
+	if (keepFrames)
+	{
+		FRAME frame = { txBridge, txPort, std::vector<unsigned char> (txBuffer, txBuffer + txBufferSize) };
+		frames.push_back (frame);
+	}
+}
+
+static void EnableBpduTrapping (const STP_BRIDGE* bridge, bool enable, unsigned int timestamp) { }
+static void EnableLearning (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex, bool enable, unsigned int timestamp) { }
+static void EnableForwarding (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex, bool enable, unsigned int timestamp) { }
+static void FlushFdb (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex, STP_FLUSH_FDB_TYPE flushType, unsigned int timestamp) { }
+static void DebugStrOut (const STP_BRIDGE* bridge, int portIndex, int treeIndex, const char* nullTerminatedString, unsigned int stringLength, unsigned int flush) { }
+
+static const STP_CALLBACKS callbacks =
+{
+	EnableBpduTrapping,
+	EnableLearning,
+	EnableForwarding,
+	TransmitGetBuffer,
+	TransmitReleaseBuffer,
+	FlushFdb,
+	DebugStrOut,
+	NULL, // onTopologyChange
+	NULL, // onPortRoleChanged
+	AllocAndZeroMemory,
+	FreeMemory,
+	NULL, // transmitGather
+	NULL, // readClock
+};
+
+// ============================================================================
+
+static const unsigned int MaxVlanNumber = 4094;
+
+// All bridges are in the same MST Region: the VLANs are spread over the MSTIs round-robin.
+static STP_BRIDGE* CreateBridge (unsigned int portCount, unsigned int mstiCount, unsigned char addressByte, unsigned int timestamp)
+{
+	const unsigned char address[6] = { 0x02, 0, 0, 0, 0, addressByte };
+	STP_BRIDGE* bridge = STP_CreateBridge (portCount, mstiCount, MaxVlanNumber, &callbacks, address, 256);
+
+	STP_SetStpVersion (bridge, (mstiCount == 0) ? STP_VERSION_RSTP : STP_VERSION_MSTP, timestamp);
+	STP_SetMstConfigName (bridge, "benchmark", timestamp);
+	if (mstiCount != 0)
+	{
+		std::vector<STP_CONFIG_TABLE_ENTRY> table (1 + MaxVlanNumber);
+		for (unsigned int vlanNumber = 1; vlanNumber <= MaxVlanNumber; vlanNumber++)
+			table[vlanNumber].treeIndex = (unsigned char) (1 + (vlanNumber % mstiCount));
+		STP_SetMstConfigTable (bridge, &table[0], (unsigned int) table.size(), timestamp);
+	}
+
+	return bridge;
+}
+
+// Delivers the frames transmitted by any of the two bridges to the other one, until neither has anything more to say.
+static void DeliverFrames (STP_BRIDGE* a, STP_BRIDGE* b, unsigned int timestamp)
+{
+	while (!frames.empty())
+	{
+		FRAME frame = frames.front();
+		frames.pop_front();
+		STP_BRIDGE* to = (frame.from == a) ? b : a;
+		STP_OnBpduReceived (to, 0, &frame.bpdu[0], (unsigned int) frame.bpdu.size(), timestamp);
+	}
+}
+
+// Connects port 0 of the two bridges and runs them until the topology is stable.
+// Returns the last BPDU sent by "from" - a BPDU that carries no news for "to".
+static std::vector<unsigned char> SetupLink (STP_BRIDGE* to, STP_BRIDGE* from, unsigned int& timestamp)
+{
+	keepFrames = true;
+	STP_StartBridge (to, timestamp);
+	STP_StartBridge (from, timestamp);
+	STP_OnPortEnabled (to, 0, 1000, true, timestamp);
+	STP_OnPortEnabled (from, 0, 1000, true, timestamp);
+	DeliverFrames (to, from, timestamp);
+
+	std::vector<unsigned char> lastFromBpdu;
+	for (unsigned int i = 0; i < 10; i++)
+	{
+		timestamp += 1000;
+		STP_OnOneSecondTick (to, timestamp);
+		STP_OnOneSecondTick (from, timestamp);
+
+		for (size_t f = 0; f < frames.size(); f++)
+		{
+			if (frames[f].from == from)
+				lastFromBpdu = frames[f].bpdu;
+		}
+
+		DeliverFrames (to, from, timestamp);
+	}
+
+	keepFrames = false;
+	return lastFromBpdu;
+}
+
+// ============================================================================
+
+// Args: port count, MSTI count
+static void BM_CreateBridge (benchmark::State& state)
+{
+	unsigned int portCount = (unsigned int) state.range(0);
+	unsigned int mstiCount = (unsigned int) state.range(1);
+	const unsigned char address[6] = { 0x02, 0, 0, 0, 0, 1 };
+
+	allocationCount = 0;
+	for (auto _ : state)
+	{
+		STP_BRIDGE* bridge = STP_CreateBridge (portCount, mstiCount, MaxVlanNumber, &callbacks, address, 256);
+		benchmark::DoNotOptimize (bridge);
+		STP_DestroyBridge (bridge);
+	}
+
+	state.counters["allocs/op"] = benchmark::Counter ((double) allocationCount, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK (BM_CreateBridge)->Args({8, 0})->Args({64, 8})->Args({512, 64})->Args({4095, 0})->Args({4095, 64});
+
+// Args: MSTI count (0 for RSTP). The BPDU is the periodic one from the designated bridge on a stable link,
+// which is what a bridge receives most of the time.
+static void BM_OnBpduReceived (benchmark::State& state)
+{
+	unsigned int mstiCount = (unsigned int) state.range(0);
+	unsigned int timestamp = 0;
+	STP_BRIDGE* bridge = CreateBridge (8, mstiCount, 2, timestamp);
+	STP_BRIDGE* peer = CreateBridge (1, mstiCount, 1, timestamp); // lower address, so it's the root
+	std::vector<unsigned char> bpdu = SetupLink (bridge, peer, timestamp);
+
+	allocationCount = 0;
+	for (auto _ : state)
+		STP_OnBpduReceived (bridge, 0, &bpdu[0], (unsigned int) bpdu.size(), timestamp);
+
+	state.counters["allocs/op"] = benchmark::Counter ((double) allocationCount, benchmark::Counter::kAvgIterations);
+	state.SetLabel ((mstiCount == 0) ? "RST BPDU" : "MST BPDU");
+	STP_DestroyBridge (peer);
+	STP_DestroyBridge (bridge);
+}
+BENCHMARK (BM_OnBpduReceived)->Arg(0)->Arg(1)->Arg(8)->Arg(64);
+
+// Args: port count, MSTI count. All ports are enabled and have nothing connected, so they're all designated
+// and forwarding, and they all transmit a BPDU every two seconds.
+static void BM_OnOneSecondTick (benchmark::State& state)
+{
+	unsigned int portCount = (unsigned int) state.range(0);
+	unsigned int mstiCount = (unsigned int) state.range(1);
+	unsigned int timestamp = 0;
+	STP_BRIDGE* bridge = CreateBridge (portCount, mstiCount, 1, timestamp);
+	// Ports enabled before the bridge is started don't run the state machines one at a time.
+	for (unsigned int portIndex = 0; portIndex < portCount; portIndex++)
+		STP_OnPortEnabled (bridge, portIndex, 1000, true, timestamp);
+	STP_StartBridge (bridge, timestamp);
+
+	// Let the ports get past the Forward Delay.
+	for (unsigned int i = 0; i < 40; i++)
+		STP_OnOneSecondTick (bridge, timestamp += 1000);
+
+	allocationCount = 0;
+	for (auto _ : state)
+		STP_OnOneSecondTick (bridge, timestamp += 1000);
+
+	state.counters["allocs/op"] = benchmark::Counter ((double) allocationCount, benchmark::Counter::kAvgIterations);
+	state.counters["ports"] = portCount;
+	STP_DestroyBridge (bridge);
+}
+BENCHMARK (BM_OnOneSecondTick)->Args({8, 0})->Args({64, 0})->Args({512, 0})->Args({4095, 0})->Args({64, 8})->Args({512, 64});
+
+// Args: MSTI count. Alternates between two tables that differ in every entry, so each call
+// recomputes the configuration digest and restarts the state machines.
+static void BM_SetMstConfigTable (benchmark::State& state)
+{
+	unsigned int mstiCount = (unsigned int) state.range(0);
+	unsigned int timestamp = 0;
+	STP_BRIDGE* bridge = CreateBridge (8, mstiCount, 1, timestamp);
+	for (unsigned int portIndex = 0; portIndex < 8; portIndex++)
+		STP_OnPortEnabled (bridge, portIndex, 1000, true, timestamp);
+	STP_StartBridge (bridge, timestamp);
+
+	std::vector<STP_CONFIG_TABLE_ENTRY> tables[2];
+	for (unsigned int t = 0; t < 2; t++)
+	{
+		tables[t].resize (1 + MaxVlanNumber);
+		for (unsigned int vlanNumber = 1; vlanNumber <= MaxVlanNumber; vlanNumber++)
+			tables[t][vlanNumber].treeIndex = (unsigned char) (1 + ((vlanNumber + t) % mstiCount));
+	}
+
+	unsigned int i = 0;
+	allocationCount = 0;
+	for (auto _ : state)
+	{
+		const std::vector<STP_CONFIG_TABLE_ENTRY>& table = tables[i++ % 2];
+		STP_SetMstConfigTable (bridge, &table[0], (unsigned int) table.size(), timestamp);
+	}
+
+	state.counters["allocs/op"] = benchmark::Counter ((double) allocationCount, benchmark::Counter::kAvgIterations);
+	STP_DestroyBridge (bridge);
+}
+BENCHMARK (BM_SetMstConfigTable)->Arg(2)->Arg(16)->Arg(64);
+
+// Args: MSTI count (0 for RSTP), and whether all trees are marked as changed before each call. Without marking,
+// txRstp re-encodes nothing and only copies the cached BPDU (except with STP_USE_FULL_SWEEP, where it always encodes everything).
+static void BM_TxRstp (benchmark::State& state)
+{
+	unsigned int mstiCount = (unsigned int) state.range(0);
+	bool markChanged = (state.range(1) != 0);
+	unsigned int timestamp = 0;
+	STP_BRIDGE* bridge = CreateBridge (1, mstiCount, 1, timestamp);
+	STP_StartBridge (bridge, timestamp);
+	STP_OnPortEnabled (bridge, 0, 1000, true, timestamp);
+
+	allocationCount = 0;
+	for (auto _ : state)
+	{
+		if (markChanged)
+			MarkPortDirty (bridge, 0);
+		txRstp (bridge, (PortIndex) 0, timestamp);
+	}
+
+	state.counters["allocs/op"] = benchmark::Counter ((double) allocationCount, benchmark::Counter::kAvgIterations);
+	STP_DestroyBridge (bridge);
+}
+BENCHMARK (BM_TxRstp)->Args({0, 0})->Args({0, 1})->Args({8, 0})->Args({8, 1})->Args({64, 0})->Args({64, 1});
@@ -15,12 +15,102 @@ static void ComputeMstConfigDigest (STP_BRIDGE* bridge);
 
 // ============================================================================
 
-STP_BRIDGE* STP_CreateBridge (unsigned int portCount,
-							  unsigned int mstiCount,
-							  unsigned int maxVlanNumber,
-							  const STP_CALLBACKS* callbacks,
-							  const unsigned char bridgeAddress[6],
-							  unsigned int debugLogBufferSize)
+// Offsets inside the single memory block that holds a bridge with all its trees and ports.
+struct BRIDGE_MEMORY_LAYOUT
+{
+	unsigned int trees;              // BRIDGE_TREE [1 + mstiCount]
+	unsigned int ports;              // PORT [portCount]
+#if STP_USE_TREE_MAJOR_LAYOUT
+	unsigned int portTrees;          // PORT_TREE [(1 + mstiCount) * portCount], all ports of the CIST, then all ports of MSTI 1 etc.
+	unsigned int treePortBits;       // unsigned int [(1 + mstiCount) * 4 * (portCount + 31) / 32]; see BRIDGE_TREE::unreadyPorts
+#else
+	unsigned int portTrees;          // PORT_TREE [portCount * (1 + mstiCount)], all trees of port 0, then all trees of port 1 etc.
+#endif
+#if !STP_USE_FULL_SWEEP
+	unsigned int dirtyPorts;         // unsigned int [(portCount + 31) / 32]
+	unsigned int dirtyTransmitPorts; // unsigned int [(portCount + 31) / 32]
+	unsigned int timerPorts;         // unsigned int [(portCount + 31) / 32]
+#endif
+#if STP_USE_LOG
+	unsigned int logPorts;           // unsigned int [(portCount + 31) / 32]
+	unsigned int logTrees;           // unsigned int [(1 + mstiCount + 31) / 32]
+#endif
+	unsigned int txFrames;           // unsigned char [portCount * txFrameSize]
+	unsigned int txFrameSize;
+	unsigned int mstConfigTable;     // uint16_nbo [1 + maxVlanNumber]
+	unsigned int size;
+};
+
+// Eight bytes is enough for all our structures on all the platforms we know of.
+static unsigned int AlignUp (unsigned int offset)
+{
+	return (offset + 7) & ~7u;
+}
+
+static void GetMemoryLayout (unsigned int portCount, unsigned int mstiCount, unsigned int maxVlanNumber, BRIDGE_MEMORY_LAYOUT* layout)
+{
+	unsigned int offset = AlignUp (sizeof (STP_BRIDGE));
+
+	layout->trees = offset;
+	offset = AlignUp (offset + (1 + mstiCount) * sizeof (BRIDGE_TREE));
+
+	layout->ports = offset;
+	offset = AlignUp (offset + portCount * sizeof (PORT));
+
+	layout->portTrees = offset;
+	offset = AlignUp (offset + portCount * (1 + mstiCount) * sizeof (PORT_TREE));
+
+#if STP_USE_TREE_MAJOR_LAYOUT
+	layout->treePortBits = offset;
+	offset = AlignUp (offset + (1 + mstiCount) * 4 * (portCount + 31) / 32 * 4);
+#endif
+
+#if !STP_USE_FULL_SWEEP
+	layout->dirtyPorts = offset;
+	offset = AlignUp (offset + (portCount + 31) / 32 * 4);
+
+	layout->dirtyTransmitPorts = offset;
+	offset = AlignUp (offset + (portCount + 31) / 32 * 4);
+
+	layout->timerPorts = offset;
+	offset = AlignUp (offset + (portCount + 31) / 32 * 4);
+#endif
+
+#if STP_USE_LOG
+	layout->logPorts = offset;
+	offset = AlignUp (offset + (portCount + 31) / 32 * 4);
+
+	layout->logTrees = offset;
+	offset = AlignUp (offset + (1 + mstiCount + 31) / 32 * 4);
+#endif
+
+	layout->txFrameSize = AlignUp (sizeof (BPDU_FRAME_HEADER) + sizeof (MSTP_BPDU) + mstiCount * sizeof (MSTI_CONFIG_MESSAGE));
+	layout->txFrames = offset;
+	offset = AlignUp (offset + portCount * layout->txFrameSize);
+
+	layout->mstConfigTable = offset;
+	offset = AlignUp (offset + (1 + maxVlanNumber) * 2);
+
+	layout->size = offset;
+}
+
+unsigned int STP_GetRequiredMemorySize (unsigned int portCount, unsigned int mstiCount, unsigned int maxVlanNumber)
+{
+	BRIDGE_MEMORY_LAYOUT layout;
+	GetMemoryLayout (portCount, mstiCount, maxVlanNumber, &layout);
+	return layout.size;
+}
+
+// ============================================================================
+
+// "memory" must be zeroed and at least STP_GetRequiredMemorySize bytes large.
+static STP_BRIDGE* InitBridge (unsigned char* memory,
+							   unsigned int portCount,
+							   unsigned int mstiCount,
+							   unsigned int maxVlanNumber,
+							   const STP_CALLBACKS* callbacks,
+							   const unsigned char bridgeAddress[6],
+							   unsigned int debugLogBufferSize)
 {
 	// Let's make a few checks on the data types, because we might be compiled with strange
 	// compiler options which will turn upside down all our assumptions about structure layouts.
@@ -38,6 +128,14 @@ STP_BRIDGE* STP_CreateBridge (unsigned int portCount,
 	assert (sizeof(MSTP_BPDU) == 102);
 	assert (sizeof(MSTI_CONFIG_MESSAGE) == 16);
 
+	// The counters index by VALIDATED_BPDU_TYPE the arrays sized by STP_BPDU_TYPE_COUNT.
+	assert ((int) VALIDATED_BPDU_TYPE_UNKNOWN    == (int) STP_BPDU_TYPE_INVALID);
+	assert ((int) VALIDATED_BPDU_TYPE_STP_CONFIG == (int) STP_BPDU_TYPE_CONFIG);
+	assert ((int) VALIDATED_BPDU_TYPE_STP_TCN    == (int) STP_BPDU_TYPE_TCN);
+	assert ((int) VALIDATED_BPDU_TYPE_RST        == (int) STP_BPDU_TYPE_RST);
+	assert ((int) VALIDATED_BPDU_TYPE_MST        == (int) STP_BPDU_TYPE_MST);
+	assert ((int) VALIDATED_BPDU_TYPE_SPT        == (int) STP_BPDU_TYPE_SPT);
+
 	// Upper limit for number of MSTIs is defined in 13.29.28 in 802.1Q-2018:
 	// NOTE-No more than 64 MSTIs may be supported. The parameter sets for all of these can be encoded in a
 	// standard-sized Ethernet frame. The number of MSTIs supported can be zero: an SPT Bridge, for example,
@@ -50,8 +148,10 @@ STP_BRIDGE* STP_CreateBridge (unsigned int portCount,
 
 	assert (maxVlanNumber <= 4094);
 
-	STP_BRIDGE* bridge = (STP_BRIDGE*) callbacks->allocAndZeroMemory (sizeof (STP_BRIDGE));
-	assert (bridge != NULL);
+	BRIDGE_MEMORY_LAYOUT layout;
+	GetMemoryLayout (portCount, mstiCount, maxVlanNumber, &layout);
+
+	STP_BRIDGE* bridge = (STP_BRIDGE*) memory;
 
 	// See "13.6.2 Force Protocol Version" on page 332
 	bridge->ForceProtocolVersion = STP_VERSION_RSTP;
@@ -69,19 +169,40 @@ STP_BRIDGE* STP_CreateBridge (unsigned int portCount,
 	bridge->logBufferUsedSize = 0;
 	bridge->logCurrentPort = -1;
 	bridge->logCurrentTree = -1;
+#if STP_USE_BINARY_LOG
+	bridge->logFormats = (STP_BRIDGE::LOG_FORMAT*) callbacks->allocAndZeroMemory (STP_BRIDGE::LogFormatTableSize * sizeof (STP_BRIDGE::LOG_FORMAT));
+	assert (bridge->logFormats != NULL);
+#endif
 #endif
 
 	// ------------------------------------------------------------------------
 
-	bridge->trees = (BRIDGE_TREE**) callbacks->allocAndZeroMemory ((1 + bridge->mstiCount) * sizeof (BRIDGE_TREE*));
-	assert (bridge->trees != NULL);
+	bridge->trees.items = (BRIDGE_TREE*) (memory + layout.trees);
+	bridge->trees.stride = 1;
+	bridge->ports.items = (PORT*) (memory + layout.ports);
+	bridge->ports.stride = 1;
 
-	bridge->ports = (PORT**) callbacks->allocAndZeroMemory (portCount * sizeof (PORT*));
-	assert (bridge->ports != NULL);
+	PORT_TREE* portTrees = (PORT_TREE*) (memory + layout.portTrees);
+	for (unsigned int treeIndex = 0; treeIndex < (1 + bridge->mstiCount); treeIndex++)
+	{
+		BRIDGE_TREE* tree = bridge->trees [treeIndex];
+	#if STP_USE_TREE_MAJOR_LAYOUT
+		tree->portTrees.items  = &portTrees [treeIndex * portCount];
+		tree->portTrees.stride = 1;
+
+		unsigned int wordCount = (portCount + 31) / 32;
+		unsigned int* bits = (unsigned int*) (memory + layout.treePortBits) + treeIndex * 4 * wordCount;
+		tree->unreadyPorts  = bits;
+		tree->unsyncedPorts = bits + wordCount;
+		tree->rootPorts     = bits + 2 * wordCount;
+		tree->rrWhilePorts  = bits + 3 * wordCount;
+	#else
+		tree->portTrees.items  = &portTrees [treeIndex];
+		tree->portTrees.stride = 1 + mstiCount;
+	#endif
+	}
 
 	// per-bridge CIST vars
-	bridge->trees [CIST_INDEX] = (BRIDGE_TREE*) callbacks->allocAndZeroMemory (sizeof (BRIDGE_TREE));
-	assert (bridge->trees [CIST_INDEX] != NULL);
 	bridge->trees [CIST_INDEX]->SetBridgeIdentifier (0x8000, CIST_INDEX, bridgeAddress);
 	// 13.26.4 in 802.1Q-2018
 	// Defaults from Table 13-5 on page 510 in 802.1Q-2018
@@ -93,8 +214,6 @@ STP_BRIDGE* STP_CreateBridge (unsigned int portCount,
 	// per-bridge MSTI vars
 	for (unsigned int treeIndex = 1; treeIndex < (1 + bridge->mstiCount); treeIndex++)
 	{
-		bridge->trees [treeIndex] = (BRIDGE_TREE*) callbacks->allocAndZeroMemory (sizeof (BRIDGE_TREE));
-		assert (bridge->trees [treeIndex] != NULL);
 		bridge->trees [treeIndex]->SetBridgeIdentifier (0x8000, treeIndex, bridgeAddress);
 		bridge->trees [treeIndex]->BridgeTimes.remainingHops = 20;
 	}
@@ -102,32 +221,44 @@ STP_BRIDGE* STP_CreateBridge (unsigned int portCount,
 	// per-port vars
 	for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
 	{
-		bridge->ports [portIndex] = (PORT*) callbacks->allocAndZeroMemory (sizeof (PORT));
-		assert (bridge->ports [portIndex] != NULL);
-
 		PORT* port = bridge->ports [portIndex];
 
-		port->trees = (PORT_TREE**) callbacks->allocAndZeroMemory ((1 + bridge->mstiCount) * sizeof (PORT_TREE*));
-		assert (port->trees != NULL);
+	#if STP_USE_TREE_MAJOR_LAYOUT
+		port->trees.items  = &portTrees [portIndex];
+		port->trees.stride = portCount;
+	#else
+		port->trees.items  = &portTrees [portIndex * (1 + mstiCount)];
+		port->trees.stride = 1;
+	#endif
 
 		// per-port CIST and MSTI vars
 		for (unsigned int treeIndex = 0; treeIndex < (1 + bridge->mstiCount); treeIndex++)
 		{
-			port->trees[treeIndex] = (PORT_TREE*) callbacks->allocAndZeroMemory (sizeof (PORT_TREE));
-			assert (port->trees[treeIndex] != NULL);
 			port->trees[treeIndex]->portId.Set (0x80, (unsigned short) portIndex + 1);
 			port->trees[treeIndex]->portTimes = bridge->trees[treeIndex]->BridgeTimes;
 			port->trees[treeIndex]->pseudoRootId = bridge->trees[treeIndex]->GetBridgeIdentifier();
+			UpdatePortTreeBits (bridge, portIndex, treeIndex);
 		}
 
 		port->adminPointToPointMAC = STP_ADMIN_P2P_AUTO;
 		port->AutoEdge = true;
 		port->enableBPDUrx = true;
 		port->enableBPDUtx = true;
+
+		port->txFrame = memory + layout.txFrames + portIndex * layout.txFrameSize;
+		BPDU_FRAME_HEADER* header = (BPDU_FRAME_HEADER*) port->txFrame;
+		static const unsigned char BridgeGroupAddress[6] = { 0x01, 0x80, 0xC2, 0x00, 0x00, 0x00 };
+		memcpy (header->destination, BridgeGroupAddress, 6);
+		memcpy (header->source, bridgeAddress, 6);
+		header->dsap = 0x42;
+		header->ssap = 0x42;
+		header->control = 3;
 	}
 
 	bridge->receivedBpduContent = NULL; // see comment at declaration of receivedBpduContent
 
+	SetConvergenceTrigger (bridge, STP_CONVERGENCE_TRIGGER_MANAGEMENT, -1);
+
 	// These were already zeroed by the allocation routine.
 	//bridge->MstConfigId.ConfigurationIdentifierFormatSelector = 0;
 	//bridge->MstConfigId.RevisionLevel = 0;
@@ -135,8 +266,18 @@ STP_BRIDGE* STP_CreateBridge (unsigned int portCount,
 	// Let's set a default name for the MST Config.
 	STP_GetDefaultMstConfigName (bridgeAddress, bridge->MstConfigId.ConfigurationName);
 
-	bridge->mstConfigTable = (uint16_nbo*) callbacks->allocAndZeroMemory ((1 + maxVlanNumber) * 2);
-	assert (bridge->mstConfigTable != NULL);
+	bridge->mstConfigTable = (uint16_nbo*) (memory + layout.mstConfigTable);
+
+#if !STP_USE_FULL_SWEEP
+	bridge->dirtyPorts = (unsigned int*) (memory + layout.dirtyPorts);
+	bridge->dirtyTransmitPorts = (unsigned int*) (memory + layout.dirtyTransmitPorts);
+	bridge->timerPorts = (unsigned int*) (memory + layout.timerPorts);
+#endif
+
+#if STP_USE_LOG
+	bridge->logPorts = (unsigned int*) (memory + layout.logPorts);
+	bridge->logTrees = (unsigned int*) (memory + layout.logTrees);
+#endif
 
 	// The config table is all zeroes now, so all VIDs map to the CIST, no VID mapped to any MSTI.
 	ComputeMstConfigDigest (bridge);
@@ -144,31 +285,52 @@ STP_BRIDGE* STP_CreateBridge (unsigned int portCount,
 	return bridge;
 }
 
-// ============================================================================
-
-void STP_DestroyBridge (STP_BRIDGE* bridge)
+STP_BRIDGE* STP_CreateBridge (unsigned int portCount,
+							  unsigned int mstiCount,
+							  unsigned int maxVlanNumber,
+							  const STP_CALLBACKS* callbacks,
+							  const unsigned char bridgeAddress[6],
+							  unsigned int debugLogBufferSize)
 {
-	bridge->callbacks.freeMemory (bridge->mstConfigTable);
+	unsigned int size = STP_GetRequiredMemorySize (portCount, mstiCount, maxVlanNumber);
+	unsigned char* memory = (unsigned char*) callbacks->allocAndZeroMemory (size);
+	assert (memory != NULL);
 
-	for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
-	{
-		for (unsigned int treeIndex = 0; treeIndex < (1 + bridge->mstiCount); treeIndex++)
-			bridge->callbacks.freeMemory (bridge->ports [portIndex]->trees [treeIndex]);
+	STP_BRIDGE* bridge = InitBridge (memory, portCount, mstiCount, maxVlanNumber, callbacks, bridgeAddress, debugLogBufferSize);
+	bridge->memoryOwnedByLibrary = true;
+	return bridge;
+}
 
-		bridge->callbacks.freeMemory (bridge->ports [portIndex]->trees);
+STP_BRIDGE* STP_CreateBridgeInBuffer (void* buffer,
+									  unsigned int bufferSize,
+									  unsigned int portCount,
+									  unsigned int mstiCount,
+									  unsigned int maxVlanNumber,
+									  const STP_CALLBACKS* callbacks,
+									  const unsigned char bridgeAddress[6],
+									  unsigned int debugLogBufferSize)
+{
+	assert (buffer != NULL);
+	assert (((size_t) buffer & 7) == 0);
+	assert (bufferSize >= STP_GetRequiredMemorySize (portCount, mstiCount, maxVlanNumber));
 
-		bridge->callbacks.freeMemory (bridge->ports [portIndex]);
-	}
+	memset (buffer, 0, bufferSize);
 
-	for (unsigned int treeIndex = 0; treeIndex < (1 + bridge->mstiCount); treeIndex++)
-		bridge->callbacks.freeMemory (bridge->trees [treeIndex]);
+	return InitBridge ((unsigned char*) buffer, portCount, mstiCount, maxVlanNumber, callbacks, bridgeAddress, debugLogBufferSize);
+}
 
-	bridge->callbacks.freeMemory (bridge->ports);
-	bridge->callbacks.freeMemory (bridge->trees);
+// ============================================================================
+
+void STP_DestroyBridge (STP_BRIDGE* bridge)
+{
 #if STP_USE_LOG
 	bridge->callbacks.freeMemory (bridge->logBuffer);
+#if STP_USE_BINARY_LOG
+	bridge->callbacks.freeMemory (bridge->logFormats);
+#endif
 #endif
-	bridge->callbacks.freeMemory (bridge);
+	if (bridge->memoryOwnedByLibrary)
+		bridge->callbacks.freeMemory (bridge);
 }
 
 // ============================================================================
@@ -183,7 +345,9 @@ void STP_StartBridge (STP_BRIDGE* bridge, unsigned int timestamp)
 
 	bridge->started = true;
 
+	SetConvergenceTrigger (bridge, STP_CONVERGENCE_TRIGGER_BRIDGE_STARTED, -1);
 	RestartStateMachines(bridge, timestamp);
+	SetConvergenceTrigger (bridge, STP_CONVERGENCE_TRIGGER_MANAGEMENT, -1);
 
 	LOG (bridge, -1, -1, "Bridge started.\r\n");
 	LOG (bridge, -1, -1, "------------------------------------\r\n");
@@ -250,6 +414,13 @@ void STP_SetBridgeAddress (STP_BRIDGE* bridge, const unsigned char* address, uns
 			bridge->trees[treeIndex]->SetBridgeIdentifier(bid);
 		}
 
+		for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
+		{
+			PORT* port = bridge->ports[portIndex];
+			if (!port->txSourceAddressSet)
+				memcpy (((BPDU_FRAME_HEADER*) port->txFrame)->source, address, 6);
+		}
+
 		if (bridge->started)
 			RecomputePrioritiesAndPortRoles (bridge, CIST_INDEX, timestamp);
 	}
@@ -263,6 +434,15 @@ const struct STP_BRIDGE_ADDRESS* STP_GetBridgeAddress (const struct STP_BRIDGE*
 	return &bridge->trees [CIST_INDEX]->GetBridgeIdentifier().GetAddress();
 }
 
+void STP_SetPortAddress (STP_BRIDGE* bridge, unsigned int portIndex, const unsigned char address[6])
+{
+	assert (portIndex < bridge->portCount);
+
+	PORT* port = bridge->ports[portIndex];
+	memcpy (((BPDU_FRAME_HEADER*) port->txFrame)->source, address, 6);
+	port->txSourceAddressSet = true;
+}
+
 // ============================================================================
 
 // Table 13-4 on page 502 of 802.1Q-2018
@@ -319,8 +499,14 @@ void STP_OnPortEnabled (STP_BRIDGE* bridge, unsigned int portIndex, unsigned int
 			portTree->InternalPortPathCost = port->detectedPortPathCost;
 	}
 
+	MarkPortDirty (bridge, portIndex);
+
 	if (bridge->started)
+	{
+		SetConvergenceTrigger (bridge, STP_CONVERGENCE_TRIGGER_PORT_ENABLED, (int) portIndex);
 		RunStateMachines (bridge, timestamp);
+		SetConvergenceTrigger (bridge, STP_CONVERGENCE_TRIGGER_MANAGEMENT, -1);
+	}
 
 	LOG (bridge, -1, -1, "------------------------------------\r\n");
 	FLUSH_LOG (bridge);
@@ -344,8 +530,14 @@ void STP_OnPortDisabled (STP_BRIDGE* bridge, unsigned int portIndex, unsigned in
 
 		port->portEnabled = false;
 
+		MarkPortDirty (bridge, portIndex);
+
 		if (bridge->started)
+		{
+			SetConvergenceTrigger (bridge, STP_CONVERGENCE_TRIGGER_PORT_DISABLED, (int) portIndex);
 			RunStateMachines (bridge, timestamp);
+			SetConvergenceTrigger (bridge, STP_CONVERGENCE_TRIGGER_MANAGEMENT, -1);
+		}
 	}
 
 	LOG (bridge, -1, -1, "------------------------------------\r\n");
@@ -358,103 +550,225 @@ void STP_OnOneSecondTick (STP_BRIDGE* bridge, unsigned int timestamp)
 {
 	if (bridge->started)
 	{
+		#if STP_USE_COUNTERS
+			unsigned int startTime = ReadCounterClock (bridge);
+		#endif
+
 		LOG (bridge, -1, -1, "{T}: One second:\r\n", timestamp);
 
+		SetConvergenceTrigger (bridge, STP_CONVERGENCE_TRIGGER_TIMER, -1);
+
+#if STP_USE_FULL_SWEEP
 		for (unsigned int givenPort = 0; givenPort < bridge->portCount; givenPort++)
 			bridge->ports [givenPort]->tick = true;
+#else
+		// Ports with all timers stopped would go to TICK and back without anything else changing, so we skip them.
+		// The PortTimers state machine marks dirty only what it decremented.
+		for (unsigned int givenPort = FindNextSetBit (bridge->timerPorts, bridge->portCount, 0);
+			givenPort < bridge->portCount;
+			givenPort = FindNextSetBit (bridge->timerPorts, bridge->portCount, givenPort + 1))
+		{
+			bridge->ports [givenPort]->tick = true;
+			SetBit (bridge->dirtyPorts, givenPort);
+		}
+#endif
 
 		RunStateMachines (bridge, timestamp);
 
+		SetConvergenceTrigger (bridge, STP_CONVERGENCE_TRIGGER_MANAGEMENT, -1);
+
 		LOG (bridge, -1, -1, "------------------------------------\r\n");
 		FLUSH_LOG (bridge);
+
+		#if STP_USE_COUNTERS
+			AddDurationToHistogram (bridge, &bridge->counters.oneSecondTickTime, startTime);
+		#endif
 	}
 }
 
 // ============================================================================
 
-void STP_OnBpduReceived (STP_BRIDGE* bridge, unsigned int portIndex, const unsigned char* bpdu, unsigned int bpduSize, unsigned int timestamp)
+// True when PortReceive and PortInformation are done with the BPDU received on the port.
+// PortInformation can't take rcvdMsg while updtInfo is set and the port is waiting for role selection.
+static bool IsReceivedBpduConsumed (const STP_BRIDGE* bridge, unsigned int portIndex)
 {
-	if (bridge->started)
+	const PORT* port = bridge->ports [portIndex];
+	if (port->rcvdBpdu)
+		return false;
+
+	for (unsigned int treeIndex = 0; treeIndex < bridge->treeCount(); treeIndex++)
+	{
+		if (port->trees [treeIndex]->rcvdMsg)
+			return false;
+	}
+
+	return true;
+}
+
+// Validates and logs one BPDU, then lets the state machines process it.
+static void ReceiveBpdu (STP_BRIDGE* bridge, unsigned int portIndex, const unsigned char* bpdu, unsigned int bpduSize, unsigned int timestamp)
+{
+	if (bridge->ports [portIndex]->portEnabled == false)
+	{
+		LOG (bridge, portIndex, -1, "{T}: WARNING: BPDU received on disabled port {D}. The STP library is discarding it.\r\n", timestamp, 1 + portIndex);
+
+		#if STP_USE_COUNTERS
+			bridge->ports [portIndex]->counters.bpdusDiscarded++;
+		#endif
+	}
+	else
 	{
-		if (bridge->ports [portIndex]->portEnabled == false)
+		LOG (bridge, portIndex, -1, "{T}: BPDU received on Port {D}:\r\n", timestamp, 1 + portIndex);
+
+		enum VALIDATED_BPDU_TYPE type = STP_GetValidatedBpduType (bridge->ForceProtocolVersion, bpdu, bpduSize);
+
+		#if STP_USE_COUNTERS
+			bridge->ports [portIndex]->counters.bpdusReceived [type]++;
+		#endif
+
+		switch (type)
 		{
-			LOG (bridge, -1, -1, "{T}: WARNING: BPDU received on disabled port {D}. The STP library is discarding it.\r\n", timestamp, 1 + portIndex);
+			case VALIDATED_BPDU_TYPE_STP_CONFIG:
+				#if STP_USE_LOG
+					LOG_DETAILS (bridge, portIndex, -1, "Config BPDU:\r\n");
+					LOG_INDENT (bridge);
+					DumpConfigBpdu (bridge, portIndex, -1, (const MSTP_BPDU*) bpdu);
+					LOG_UNINDENT (bridge);
+				#endif
+				break;
+
+			case VALIDATED_BPDU_TYPE_RST:
+				#if STP_USE_LOG
+					LOG_DETAILS (bridge, portIndex, -1, "RSTP BPDU:\r\n");
+					LOG_INDENT (bridge);
+					DumpRstpBpdu (bridge, portIndex, -1, (const MSTP_BPDU*) bpdu);
+					LOG_UNINDENT (bridge);
+				#endif
+				break;
+
+			case VALIDATED_BPDU_TYPE_MST:
+			case VALIDATED_BPDU_TYPE_SPT:
+				#if STP_USE_LOG
+					if (type == VALIDATED_BPDU_TYPE_MST)
+						LOG_DETAILS (bridge, portIndex, -1, "MSTP BPDU:\r\n");
+					else
+						LOG_DETAILS (bridge, portIndex, -1, "SPT BPDU (processed as MSTP):\r\n");
+					LOG_INDENT (bridge);
+					DumpMstpBpdu (bridge, portIndex, -1, (const MSTP_BPDU*) bpdu);
+					LOG_UNINDENT (bridge);
+				#endif
+				break;
+
+			case VALIDATED_BPDU_TYPE_STP_TCN:
+				LOG_DETAILS (bridge, portIndex, -1, "TCN BPDU.\r\n");
+				break;
+
+			case VALIDATED_BPDU_TYPE_UNKNOWN:
+				LOG_DETAILS (bridge, portIndex, -1, "Invalid BPDU received. Discarding it.\r\n");
+				break;
+
+			default:
+				assert(false);
 		}
-		else
+
+		if (type != VALIDATED_BPDU_TYPE_UNKNOWN)
 		{
-			LOG (bridge, -1, -1, "{T}: BPDU received on Port {D}:\r\n", timestamp, 1 + portIndex);
+			assert (bridge->receivedBpduContent == NULL);
+			assert (bridge->receivedBpduType == VALIDATED_BPDU_TYPE_UNKNOWN);
+			assert (bridge->ports [portIndex]->rcvdBpdu == false);
+
+			bridge->receivedBpduContent = (MSTP_BPDU*) bpdu;
+			bridge->receivedBpduType = type;
+			bridge->receivedBpduPort = bridge->ports[portIndex];
+			bridge->ports [portIndex]->rcvdBpdu = true;
+			MarkPortDirty (bridge, portIndex);
+
+			SetConvergenceTrigger (bridge, STP_CONVERGENCE_TRIGGER_BPDU_RECEIVED, (int) portIndex);
+			RunStateMachines (bridge, timestamp);
 
-			enum VALIDATED_BPDU_TYPE type = STP_GetValidatedBpduType (bridge->ForceProtocolVersion, bpdu, bpduSize);
-			switch (type)
+			// Within a batch, PortReceive might find the previous message of the port not yet consumed by
+			// PortInformation, or PortInformation might be waiting for role selection to consume this one.
+			// In both cases we let role selection and PortTransmit run before going on.
+			if (bridge->receivingBpduBatch && !IsReceivedBpduConsumed (bridge, portIndex))
 			{
-				case VALIDATED_BPDU_TYPE_STP_CONFIG:
-					#if STP_USE_LOG
-						LOG (bridge, portIndex, -1, "Config BPDU:\r\n");
-						LOG_INDENT (bridge);
-						DumpConfigBpdu (bridge, portIndex, -1, (const MSTP_BPDU*) bpdu);
-						LOG_UNINDENT (bridge);
-					#endif
-					break;
-
-				case VALIDATED_BPDU_TYPE_RST:
-					#if STP_USE_LOG
-						LOG (bridge, portIndex, -1, "RSTP BPDU:\r\n");
-						LOG_INDENT (bridge);
-						DumpRstpBpdu (bridge, portIndex, -1, (const MSTP_BPDU*) bpdu);
-						LOG_UNINDENT (bridge);
-					#endif
-					break;
-
-				case VALIDATED_BPDU_TYPE_MST:
-				case VALIDATED_BPDU_TYPE_SPT:
-					#if STP_USE_LOG
-						if (type == VALIDATED_BPDU_TYPE_MST)
-							LOG (bridge, portIndex, -1, "MSTP BPDU:\r\n");
-						else
-							LOG (bridge, portIndex, -1, "SPT BPDU (processed as MSTP):\r\n");
-						LOG_INDENT (bridge);
-						DumpMstpBpdu (bridge, portIndex, -1, (const MSTP_BPDU*) bpdu);
-						LOG_UNINDENT (bridge);
-					#endif
-					break;
-
-				case VALIDATED_BPDU_TYPE_STP_TCN:
-					LOG (bridge, portIndex, -1, "TCN BPDU.\r\n");
-					break;
-
-				case VALIDATED_BPDU_TYPE_UNKNOWN:
-					LOG (bridge, portIndex, -1, "Invalid BPDU received. Discarding it.\r\n");
-					break;
-
-				default:
-					assert(false);
+				bridge->receivingBpduBatch = false;
+				RunStateMachines (bridge, timestamp);
+				bridge->receivingBpduBatch = true;
 			}
 
-			if (type != VALIDATED_BPDU_TYPE_UNKNOWN)
-			{
-				assert (bridge->receivedBpduContent == NULL);
-				assert (bridge->receivedBpduType == VALIDATED_BPDU_TYPE_UNKNOWN);
-				assert (bridge->ports [portIndex]->rcvdBpdu == false);
+			bridge->receivedBpduContent = NULL; // to cause an exception on access
+			bridge->receivedBpduType = VALIDATED_BPDU_TYPE_UNKNOWN; // to cause asserts on access
+			bridge->receivedBpduPort = NULL;
 
-				bridge->receivedBpduContent = (MSTP_BPDU*) bpdu;
-				bridge->receivedBpduType = type;
-				bridge->receivedBpduPort = bridge->ports[portIndex];
-				bridge->ports [portIndex]->rcvdBpdu = true;
+			SetConvergenceTrigger (bridge, STP_CONVERGENCE_TRIGGER_MANAGEMENT, -1);
 
-				RunStateMachines (bridge, timestamp);
+			// Check that the state machines did process the BPDU.
+			assert (bridge->ports [portIndex]->rcvdBpdu == false);
+		}
+	}
+}
+
+void STP_OnBpduReceived (STP_BRIDGE* bridge, unsigned int portIndex, const unsigned char* bpdu, unsigned int bpduSize, unsigned int timestamp)
+{
+	if (bridge->started)
+	{
+		#if STP_USE_COUNTERS
+			unsigned int startTime = ReadCounterClock (bridge);
+		#endif
 
-				bridge->receivedBpduContent = NULL; // to cause an exception on access
-				bridge->receivedBpduType = VALIDATED_BPDU_TYPE_UNKNOWN; // to cause asserts on access
-				bridge->receivedBpduPort = NULL;
+		ReceiveBpdu (bridge, portIndex, bpdu, bpduSize, timestamp);
 
-				// Check that the state machines did process the BPDU.
-				assert (bridge->ports [portIndex]->rcvdBpdu == false);
-			}
+		LOG (bridge, -1, -1, "------------------------------------\r\n");
+		FLUSH_LOG (bridge);
+
+		#if STP_USE_COUNTERS
+			AddDurationToHistogram (bridge, &bridge->counters.bpduReceivedTime, startTime);
+		#endif
+	}
+	#if STP_USE_COUNTERS
+	else
+		bridge->counters.bpdusReceivedWhileStopped++;
+	#endif
+}
+
+// ============================================================================
+
+void STP_OnBpdusReceived (STP_BRIDGE* bridge, const STP_RX_BPDU* bpdus, unsigned int bpduCount, unsigned int timestamp)
+{
+	if (bridge->started)
+	{
+		#if STP_USE_COUNTERS
+			unsigned int startTime = ReadCounterClock (bridge);
+		#endif
+
+		// Each BPDU is consumed by PortReceive and PortInformation before we go to the next one,
+		// but role selection and PortTransmit run only once, after the last one.
+		bridge->receivingBpduBatch = true;
+
+		for (unsigned int i = 0; i < bpduCount; i++)
+		{
+			assert (bpdus[i].portIndex < bridge->portCount);
+			ReceiveBpdu (bridge, bpdus[i].portIndex, bpdus[i].bpdu, bpdus[i].bpduSize, timestamp);
 		}
 
+		bridge->receivingBpduBatch = false;
+
+		// Role selection runs for the whole batch here, so what it changes isn't attributed to any one port.
+		SetConvergenceTrigger (bridge, STP_CONVERGENCE_TRIGGER_BPDU_RECEIVED, -1);
+		RunStateMachines (bridge, timestamp);
+		SetConvergenceTrigger (bridge, STP_CONVERGENCE_TRIGGER_MANAGEMENT, -1);
+
 		LOG (bridge, -1, -1, "------------------------------------\r\n");
 		FLUSH_LOG (bridge);
+
+		#if STP_USE_COUNTERS
+			AddDurationToHistogram (bridge, &bridge->counters.bpduReceivedTime, startTime);
+		#endif
 	}
+	#if STP_USE_COUNTERS
+	else
+		bridge->counters.bpdusReceivedWhileStopped += bpduCount;
+	#endif
 }
 
 // ============================================================================
@@ -487,46 +801,137 @@ bool STP_IsLoggingEnabled (const STP_BRIDGE* bridge)
 
 // ============================================================================
 
+void STP_SetLogFilter (STP_BRIDGE* bridge, const unsigned char* portBitmap, const unsigned char* treeBitmap, unsigned int stateMachineMask, STP_LOG_LEVEL maxLevel)
+{
+	#if STP_USE_LOG
+		// A line is dropped or kept as a whole, so the filter must not change in the middle of one.
+		assert (!bridge->loggingEnabled || bridge->logLineStarting);
+
+		for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
+			AssignBit (bridge->logPorts, portIndex, (portBitmap == NULL) || ((portBitmap [portIndex / 8] & (1u << (portIndex % 8))) != 0));
+
+		for (unsigned int treeIndex = 0; treeIndex < 1 + bridge->mstiCount; treeIndex++)
+			AssignBit (bridge->logTrees, treeIndex, (treeBitmap == NULL) || ((treeBitmap [treeIndex / 8] & (1u << (treeIndex % 8))) != 0));
+
+		bridge->logStateMachines = stateMachineMask;
+		bridge->logMaxLevel = maxLevel;
+		bridge->logFiltered = (portBitmap != NULL) || (treeBitmap != NULL)
+			|| ((stateMachineMask & STP_LOG_STATE_MACHINE_ALL) != STP_LOG_STATE_MACHINE_ALL) || (maxLevel < STP_LOG_LEVEL_DETAILS);
+	#endif
+}
+
+// ============================================================================
+
 #if STP_USE_LOG
 template<typename PortTreeArgs>
-static void LogTransition (STP_BRIDGE* bridge, const char* smName, const char* newStateName, PortTreeArgs args);
+static void LogTransition (STP_BRIDGE* bridge, unsigned int stateMachine, const char* smName, const char* newStateName, PortTreeArgs args);
 
 template<>
-void LogTransition (STP_BRIDGE* bridge, const char* smName, const char* newStateName, TreeIndex ti)
+void LogTransition (STP_BRIDGE* bridge, unsigned int stateMachine, const char* smName, const char* newStateName, TreeIndex ti)
 {
-	LOG (bridge, -1, ti, "Bridge: ");
+	LOG_TRANSITION (bridge, -1, ti, stateMachine, "Bridge: ");
 	if (bridge->ForceProtocolVersion >= STP_VERSION_MSTP)
 	{
 		if (ti == CIST_INDEX)
-			LOG (bridge, -1, ti, "CIST: ");
+			LOG_TRANSITION (bridge, -1, ti, stateMachine, "CIST: ");
 		else
-			LOG (bridge, -1, ti, "MST{D}: ", ti);
+			LOG_TRANSITION (bridge, -1, ti, stateMachine, "MST{D}: ", ti);
 	}
 
-	LOG (bridge, -1, ti, "{S}: -> {S}\r\n", smName, newStateName);
+	LOG_TRANSITION (bridge, -1, ti, stateMachine, "{S}: -> {S}\r\n", smName, newStateName);
 }
 
 template<>
-void LogTransition (STP_BRIDGE* bridge, const char* smName, const char* newStateName, PortIndex pi)
+void LogTransition (STP_BRIDGE* bridge, unsigned int stateMachine, const char* smName, const char* newStateName, PortIndex pi)
 {
-	LOG (bridge, pi, -1, "Port {D}: ", 1 + pi);
-	LOG (bridge, pi, -1, "{S}: -> {S}\r\n", smName, newStateName);
+	LOG_TRANSITION (bridge, pi, -1, stateMachine, "Port {D}: ", 1 + pi);
+	LOG_TRANSITION (bridge, pi, -1, stateMachine, "{S}: -> {S}\r\n", smName, newStateName);
 }
 
 template<>
-void LogTransition (STP_BRIDGE* bridge, const char* smName, const char* newStateName, PortAndTree pt)
+void LogTransition (STP_BRIDGE* bridge, unsigned int stateMachine, const char* smName, const char* newStateName, PortAndTree pt)
 {
 	PortIndex pi = pt.portIndex;
 	TreeIndex ti = pt.treeIndex;
-	LOG (bridge, pi, ti, "Port {D}: ", 1 + pi);
+	LOG_TRANSITION (bridge, pi, ti, stateMachine, "Port {D}: ", 1 + pi);
 	if (bridge->ForceProtocolVersion >= STP_VERSION_MSTP)
 	{
 		if (ti == CIST_INDEX)
-			LOG (bridge, pi, ti, "CIST: ");
+			LOG_TRANSITION (bridge, pi, ti, stateMachine, "CIST: ");
 		else
-			LOG (bridge, pi, ti, "MST{D}: ", ti);
+			LOG_TRANSITION (bridge, pi, ti, stateMachine, "MST{D}: ", ti);
 	}
-	LOG (bridge, pi, ti, "{S}: -> {S}\r\n", smName, newStateName);
+	LOG_TRANSITION (bridge, pi, ti, stateMachine, "{S}: -> {S}\r\n", smName, newStateName);
+}
+#endif
+
+// ============================================================================
+
+#if STP_USE_TREE_MAJOR_LAYOUT
+// Per-port and per-bridge state machines write the variables tracked by UpdatePortTreeBits only
+// through procedures that update the bits themselves; per-port-per-tree state machines write them directly.
+template<typename PortTreeArgs>
+static void UpdateBitsAfterTransition (STP_BRIDGE* bridge, PortTreeArgs args) { }
+
+template<>
+void UpdateBitsAfterTransition (STP_BRIDGE* bridge, PortAndTree pt)
+{
+	UpdatePortTreeBits (bridge, pt.portIndex, pt.treeIndex);
+}
+#endif
+
+#if STP_USE_CONVERGENCE_TRACE
+// Packs the variables of a port and tree that make the events of a convergence report. Only the per-port-per-tree
+// state machines write them; the overloads for the others do nothing.
+template<typename PortTreeArgs>
+static unsigned int GetTracedVariables (const STP_BRIDGE* bridge, PortTreeArgs args) { return 0; }
+
+template<>
+unsigned int GetTracedVariables (const STP_BRIDGE* bridge, PortAndTree pt)
+{
+	const PORT_TREE* portTree = bridge->ports [pt.portIndex]->trees [pt.treeIndex];
+	return (unsigned int) portTree->role
+		| (portTree->learning  ? 0x100u : 0)
+		| (portTree->forwarding ? 0x200u : 0)
+		| (portTree->proposing ? 0x400u : 0)
+		| (portTree->proposed  ? 0x800u : 0)
+		| (portTree->agree     ? 0x1000u : 0)
+		| (portTree->agreed    ? 0x2000u : 0);
+}
+
+template<typename PortTreeArgs>
+static void TraceTransition (STP_BRIDGE* bridge, PortTreeArgs args, unsigned int before, unsigned int timestamp) { }
+
+template<>
+void TraceTransition (STP_BRIDGE* bridge, PortAndTree pt, unsigned int before, unsigned int timestamp)
+{
+	unsigned int after = GetTracedVariables (bridge, pt);
+	if (after == before)
+		return;
+
+	if ((after & 0xFF) != (before & 0xFF))
+		AddConvergenceEvent (bridge, pt.portIndex, pt.treeIndex, STP_CONVERGENCE_EVENT_ROLE, after & 0xFF, timestamp);
+
+	if ((after & 0x100) != (before & 0x100))
+		AddConvergenceEvent (bridge, pt.portIndex, pt.treeIndex, STP_CONVERGENCE_EVENT_LEARNING, (after & 0x100) ? 1 : 0, timestamp);
+
+	if ((after & 0x200) != (before & 0x200))
+		AddConvergenceEvent (bridge, pt.portIndex, pt.treeIndex, STP_CONVERGENCE_EVENT_FORWARDING, (after & 0x200) ? 1 : 0, timestamp);
+
+	// Of the handshake flags we're interested only in the moments they get set.
+	unsigned int raised = after & ~before;
+
+	if (raised & 0x400)
+		AddConvergenceEvent (bridge, pt.portIndex, pt.treeIndex, STP_CONVERGENCE_EVENT_PROPOSING, 1, timestamp);
+
+	if (raised & 0x800)
+		AddConvergenceEvent (bridge, pt.portIndex, pt.treeIndex, STP_CONVERGENCE_EVENT_PROPOSED, 1, timestamp);
+
+	if (raised & 0x1000)
+		AddConvergenceEvent (bridge, pt.portIndex, pt.treeIndex, STP_CONVERGENCE_EVENT_AGREE, 1, timestamp);
+
+	if (raised & 0x2000)
+		AddConvergenceEvent (bridge, pt.portIndex, pt.treeIndex, STP_CONVERGENCE_EVENT_AGREED, 1, timestamp);
 }
 #endif
 
@@ -538,16 +943,37 @@ static bool RunStateMachineInstance (STP_BRIDGE* bridge, const StateMachine<Stat
 	volatile bool changed = false;
 
 rep:
+	#if STP_USE_COUNTERS
+		bridge->counters.stateMachineEvaluations++;
+	#endif
+
 	State newState = smInfo.checkConditions (bridge, portTreeArgs, state);
 	if (newState != 0)
 	{
+		#if STP_USE_COUNTERS
+			assert ((unsigned int) newState < STP_MAX_STATE_MACHINE_STATES);
+			bridge->counters.transitions [smInfo.id][newState]++;
+		#endif
+
 		#if STP_USE_LOG
 			const char* newStateName = smInfo.getStateName(newState);
-			LogTransition (bridge, smInfo.smName, newStateName, portTreeArgs);
+			LogTransition (bridge, 1u << smInfo.id, smInfo.smName, newStateName, portTreeArgs);
+		#endif
+
+		#if STP_USE_CONVERGENCE_TRACE
+			unsigned int tracedBefore = GetTracedVariables (bridge, portTreeArgs);
 		#endif
 
 		smInfo.initState (bridge, portTreeArgs, newState, timestamp);
 
+		#if STP_USE_TREE_MAJOR_LAYOUT
+			UpdateBitsAfterTransition (bridge, portTreeArgs);
+		#endif
+
+		#if STP_USE_CONVERGENCE_TRACE
+			TraceTransition (bridge, portTreeArgs, tracedBefore, timestamp);
+		#endif
+
 		state = newState;
 		changed = true;
 		goto rep;
@@ -557,13 +983,35 @@ rep:
 }
 
 // ============================================================================
+// Port Role Selection for a single tree. It writes only variables of that tree, so each tree can be evaluated
+// on its own: a change in an MSTI doesn't need the CIST or the other MSTIs evaluated again. When no port of the
+// tree has reselect set this is a single comparison. The other direction doesn't hold: updtRolesTree for an MSTI
+// reads the selected CIST roles (for Master and external ports), so the CIST must be evaluated before the MSTIs.
+
+static bool RunPortRoleSelection (STP_BRIDGE* bridge, unsigned int treeIndex, unsigned int timestamp)
+{
+	BRIDGE_TREE* tree = bridge->trees[treeIndex];
+	return RunStateMachineInstance (bridge, PortRoleSelection::sm, tree->portRoleSelectionState, timestamp, (TreeIndex) treeIndex);
+}
+
+// ============================================================================
+
+#if STP_USE_FULL_SWEEP
 
 static void RunStateMachines (STP_BRIDGE* bridge, unsigned int timestamp)
 {
+	#if STP_USE_COUNTERS
+		bridge->counters.runStateMachinesCalls++;
+	#endif
+
 	bool changed;
 
 	do
 	{
+		#if STP_USE_COUNTERS
+			bridge->counters.runStateMachinesPasses++;
+		#endif
+
 		changed = false;
 
 		for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
@@ -586,11 +1034,12 @@ static void RunStateMachines (STP_BRIDGE* bridge, unsigned int timestamp)
 			}
 		}
 
+		// See receivingBpduBatch.
+		if (bridge->receivingBpduBatch)
+			continue;
+
 		for (unsigned int treeIndex = 0; treeIndex < bridge->treeCount(); treeIndex++)
-		{
-			BRIDGE_TREE* tree = bridge->trees[treeIndex];
-			changed |= RunStateMachineInstance (bridge, PortRoleSelection::sm, tree->portRoleSelectionState, timestamp, (TreeIndex) treeIndex);
-		}
+			changed |= RunPortRoleSelection (bridge, treeIndex, timestamp);
 
 		// We execute the PortTransmit state machine only after all other state machines have finished executing,
 		// so as to avoid transmitting BPDUs containing results from intermediary calculations.
@@ -604,8 +1053,143 @@ static void RunStateMachines (STP_BRIDGE* bridge, unsigned int timestamp)
 			}
 		}
 	} while (changed);
+
+	#if STP_USE_CONVERGENCE_TRACE
+		// While a batch of BPDUs is being received, or while BEGIN is set, the trees aren't done yet even if they look so.
+		if (!bridge->receivingBpduBatch && !bridge->BEGIN)
+			CheckConvergence (bridge, timestamp);
+	#endif
 }
 
+#else
+
+// Packs the variables of a port and tree that are read by the state machines of other ports for the same tree
+// (by allSynced(), reRooted() and the Port Role Selection state machine), so we can tell when they change.
+static unsigned int GetTreeSharedVariables (const PORT_TREE* portTree)
+{
+	return (portTree->selected ? 1u : 0)
+		| (portTree->synced ? 2u : 0)
+		| (portTree->updtInfo ? 4u : 0)
+		| (portTree->reselect ? 8u : 0)
+		| ((portTree->rrWhile != 0) ? 0x10u : 0)
+		| ((unsigned int) portTree->role << 8)
+		| ((unsigned int) portTree->selectedRole << 16);
+}
+
+// Evaluates only the state machines marked dirty by MarkPortDirty / MarkPortTreeDirty / MarkTreeDirty,
+// in the same order the full sweep would. A state machine that makes a transition on a port marks that port
+// for all trees, and also marks the whole tree if it changed a variable read by other ports of that tree.
+// Everything else - procedures writing variables of other ports, management functions, received BPDUs,
+// timer ticks - marks the ports and trees it touches.
+static void RunStateMachines (STP_BRIDGE* bridge, unsigned int timestamp)
+{
+	#if STP_USE_COUNTERS
+		bridge->counters.runStateMachinesCalls++;
+	#endif
+
+	bool changed;
+
+	do
+	{
+		#if STP_USE_COUNTERS
+			bridge->counters.runStateMachinesPasses++;
+		#endif
+
+		changed = false;
+
+		// Ports marked while we're here are evaluated in this pass if their index is higher than the current one,
+		// or in the next pass otherwise - same as with a sweep through all ports.
+		for (unsigned int portIndex = FindNextSetBit (bridge->dirtyPorts, bridge->portCount, 0);
+			portIndex < bridge->portCount;
+			portIndex = FindNextSetBit (bridge->dirtyPorts, bridge->portCount, portIndex + 1))
+		{
+			ClearBit (bridge->dirtyPorts, portIndex);
+
+			PORT* port = bridge->ports[portIndex];
+
+			// PortTimers marks dirty by itself the state machines that read the timers it decremented.
+			changed |= RunStateMachineInstance (bridge, PortTimers::sm, port->portTimersState, timestamp, (PortIndex) portIndex);
+
+			bool portChanged = false;
+			portChanged |= RunStateMachineInstance (bridge, PortProtocolMigration::sm, port->portProtocolMigrationState, timestamp, (PortIndex) portIndex);
+			portChanged |= RunStateMachineInstance (bridge, PortReceive          ::sm, port->portReceiveState,           timestamp, (PortIndex) portIndex);
+			portChanged |= RunStateMachineInstance (bridge, BridgeDetection      ::sm, port->bridgeDetectionState,       timestamp, (PortIndex) portIndex);
+			if (portChanged)
+			{
+				MarkPortDirty (bridge, portIndex);
+				SetBit (bridge->timerPorts, portIndex);
+				changed = true;
+			}
+
+			for (unsigned int treeIndex = FindNextSetBit (port->dirtyTrees, bridge->treeCount(), 0);
+				treeIndex < bridge->treeCount();
+				treeIndex = FindNextSetBit (port->dirtyTrees, bridge->treeCount(), treeIndex + 1))
+			{
+				ClearBit (port->dirtyTrees, treeIndex);
+
+				PORT_TREE* tree = port->trees[treeIndex];
+				PortAndTree pt = { (PortIndex)portIndex, (TreeIndex)treeIndex };
+				unsigned int sharedBefore = GetTreeSharedVariables (tree);
+				bool treeChanged = false;
+				treeChanged |= RunStateMachineInstance (bridge, PortInformation    ::sm, tree->portInformationState,     timestamp, pt);
+				treeChanged |= RunStateMachineInstance (bridge, PortRoleTransitions::sm, tree->portRoleTransitionsState, timestamp, pt);
+				treeChanged |= RunStateMachineInstance (bridge, PortStateTransition::sm, tree->portStateTransitionState, timestamp, pt);
+				treeChanged |= RunStateMachineInstance (bridge, TopologyChange     ::sm, tree->topologyChangeState,      timestamp, pt);
+				if (treeChanged)
+				{
+					MarkPortDirty (bridge, portIndex);
+					SetBit (bridge->timerPorts, portIndex);
+					SetBit (port->timerTrees, treeIndex);
+					if (GetTreeSharedVariables (tree) != sharedBefore)
+						MarkTreeDirty (bridge, treeIndex);
+					changed = true;
+				}
+			}
+		}
+
+		// See receivingBpduBatch. The dirty bits of role selection and PortTransmit stay set for later.
+		if (bridge->receivingBpduBatch)
+			continue;
+
+		for (unsigned int treeIndex = FindNextSetBit (bridge->dirtyRoleSelectionTrees, bridge->treeCount(), 0);
+			treeIndex < bridge->treeCount();
+			treeIndex = FindNextSetBit (bridge->dirtyRoleSelectionTrees, bridge->treeCount(), treeIndex + 1))
+		{
+			ClearBit (bridge->dirtyRoleSelectionTrees, treeIndex);
+			changed |= RunPortRoleSelection (bridge, treeIndex, timestamp);
+		}
+
+		// We execute the PortTransmit state machine only after all other state machines have finished executing,
+		// so as to avoid transmitting BPDUs containing results from intermediary calculations.
+		// See Note 1 on page 541 of 802.1Q-2018.
+		if (!changed)
+		{
+			for (unsigned int portIndex = FindNextSetBit (bridge->dirtyTransmitPorts, bridge->portCount, 0);
+				portIndex < bridge->portCount;
+				portIndex = FindNextSetBit (bridge->dirtyTransmitPorts, bridge->portCount, portIndex + 1))
+			{
+				ClearBit (bridge->dirtyTransmitPorts, portIndex);
+
+				PORT* port = bridge->ports[portIndex];
+				if (RunStateMachineInstance (bridge, PortTransmit::sm, port->portTransmitState, timestamp, (PortIndex) portIndex))
+				{
+					MarkPortDirtyAfterTransmit (bridge, portIndex);
+					SetBit (bridge->timerPorts, portIndex);
+					changed = true;
+				}
+			}
+		}
+	} while (changed);
+
+	#if STP_USE_CONVERGENCE_TRACE
+		// While a batch of BPDUs is being received, or while BEGIN is set, the trees aren't done yet even if they look so.
+		if (!bridge->receivingBpduBatch && !bridge->BEGIN)
+			CheckConvergence (bridge, timestamp);
+	#endif
+}
+
+#endif
+
 static void RestartStateMachines (STP_BRIDGE* bridge, unsigned int timestamp)
 {
 	for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
@@ -632,8 +1216,10 @@ static void RestartStateMachines (STP_BRIDGE* bridge, unsigned int timestamp)
 		bridge->trees[treeIndex]->portRoleSelectionState = (PortRoleSelection::State)0;
 
 	bridge->BEGIN = true;
+	MarkAllDirty (bridge);
 	RunStateMachines (bridge, timestamp);
 	bridge->BEGIN = false;
+	MarkAllDirty (bridge);
 	RunStateMachines (bridge, timestamp);
 }
 
@@ -642,6 +1228,7 @@ static void RestartStateMachines (STP_BRIDGE* bridge, unsigned int timestamp)
 void STP_SetPortAdminEdge (struct STP_BRIDGE* bridge, unsigned int portIndex, bool adminEdge, unsigned int timestamp)
 {
 	bridge->ports [portIndex]->AdminEdge = adminEdge;
+	MarkPortDirty (bridge, portIndex);
 }
 
 bool STP_GetPortAdminEdge (const struct STP_BRIDGE* bridge, unsigned int portIndex)
@@ -654,6 +1241,7 @@ bool STP_GetPortAdminEdge (const struct STP_BRIDGE* bridge, unsigned int portInd
 void STP_SetPortAutoEdge (struct STP_BRIDGE* bridge, unsigned int portIndex, bool autoEdge, unsigned int timestamp)
 {
 	bridge->ports [portIndex]->AutoEdge = autoEdge;
+	MarkPortDirty (bridge, portIndex);
 }
 
 bool STP_GetPortAutoEdge (const struct STP_BRIDGE* bridge, unsigned int portIndex)
@@ -680,6 +1268,7 @@ void STP_SetAdminPointToPointMAC (struct STP_BRIDGE* bridge, unsigned int portIn
 		if (port->operPointToPointMAC != newOperPointToPointMAC)
 		{
 			port->operPointToPointMAC = newOperPointToPointMAC;
+			MarkPortDirty (bridge, portIndex);
 			if (bridge->started)
 				RunStateMachines (bridge, timestamp);
 		}
@@ -725,8 +1314,11 @@ static void RecomputePrioritiesAndPortRoles (STP_BRIDGE* bridge, unsigned int tr
 			{
 				PORT_TREE* portTree = bridge->ports[portIndex]->trees[treeIndex];
 				portTree->selected = false;
-				portTree->reselect = true;
+				SetReselect (bridge, portIndex, treeIndex, true);
+				UpdatePortTreeBits (bridge, portIndex, treeIndex);
 			}
+
+			MarkTreeDirty (bridge, treeIndex);
 		}
 	}
 	else
@@ -736,8 +1328,11 @@ static void RecomputePrioritiesAndPortRoles (STP_BRIDGE* bridge, unsigned int tr
 		{
 			PORT_TREE* portTree = bridge->ports[portIndex]->trees[treeIndex];
 			portTree->selected = false;
-			portTree->reselect = true;
+			SetReselect (bridge, portIndex, treeIndex, true);
+			UpdatePortTreeBits (bridge, portIndex, treeIndex);
 		}
+
+		MarkTreeDirty (bridge, treeIndex);
 	}
 
 	RunStateMachines (bridge, timestamp);
@@ -853,6 +1448,38 @@ void STP_GetDefaultMstConfigName (const unsigned char bridgeAddress[6], char nam
 	}
 }
 
+// Called after the application changed the MST Configuration Identifier. Outside of a STP_BeginMstConfigChanges /
+// STP_CommitMstConfigChanges pair, recomputes the digest if needed and restarts the state machines right away;
+// inside such a pair, leaves both for the commit.
+static void OnMstConfigIdChanged (STP_BRIDGE* bridge, bool tableChanged, unsigned int timestamp)
+{
+	bridge->mstConfigIdChanged = true;
+	bridge->mstConfigTableChanged |= tableChanged;
+
+	if (bridge->mstConfigChangesOpen)
+	{
+		LOG (bridge, -1, -1, "Change will be applied on commit.\r\n");
+		return;
+	}
+
+	if (bridge->mstConfigTableChanged)
+	{
+		ComputeMstConfigDigest (bridge);
+
+		LOG (bridge, -1, -1, "New digest: 0x{X2}{X2}...{X2}{X2}.\r\n",
+			 bridge->MstConfigId.ConfigurationDigest[0], bridge->MstConfigId.ConfigurationDigest[1],
+			 bridge->MstConfigId.ConfigurationDigest[14], bridge->MstConfigId.ConfigurationDigest[15]);
+	}
+
+	bridge->mstConfigTableChanged = false;
+	bridge->mstConfigIdChanged = false;
+
+	if (bridge->started)
+		RestartStateMachines(bridge, timestamp);
+}
+
+// ============================================================================
+
 void STP_SetMstConfigName (STP_BRIDGE* bridge, const char* name, unsigned int timestamp)
 {
 	assert (strlen (name) <= 32);
@@ -862,8 +1489,7 @@ void STP_SetMstConfigName (STP_BRIDGE* bridge, const char* name, unsigned int ti
 	memset (bridge->MstConfigId.ConfigurationName, 0, 32);
 	memcpy (bridge->MstConfigId.ConfigurationName, name, strlen (name));
 
-	if (bridge->started)
-		RestartStateMachines(bridge, timestamp);
+	OnMstConfigIdChanged (bridge, false, timestamp);
 
 	LOG (bridge, -1, -1, "------------------------------------\r\n");
 	FLUSH_LOG (bridge);
@@ -878,22 +1504,22 @@ void STP_SetMstConfigRevisionLevel (STP_BRIDGE* bridge, unsigned short revisionL
 	bridge->MstConfigId.RevisionLevelHigh = revisionLevel >> 8;
 	bridge->MstConfigId.RevisionLevelLow = revisionLevel & 0xff;
 
-	if (bridge->started)
-		RestartStateMachines(bridge, timestamp);
+	OnMstConfigIdChanged (bridge, false, timestamp);
 
 	LOG (bridge, -1, -1, "------------------------------------\r\n");
 	FLUSH_LOG (bridge);
 }
 
+// ============================================================================
+
 static void ComputeMstConfigDigest (STP_BRIDGE* bridge)
 {
 	HMAC_MD5_CONTEXT context;
 	HMAC_MD5_Init (&context);
 	HMAC_MD5_Update (&context, bridge->mstConfigTable, 2 * (1 + bridge->maxVlanNumber));
 
-	unsigned short zero = 0;
-	for (int i = (1 + bridge->maxVlanNumber); i < 4096; i++)
-		HMAC_MD5_Update (&context, &zero, 2);
+	// VLANs above maxVlanNumber map to the CIST.
+	HMAC_MD5_UpdateZeroes (&context, 2 * (4096 - (1 + bridge->maxVlanNumber)));
 
 	HMAC_MD5_End (&context);
 
@@ -926,14 +1552,7 @@ void STP_SetMstConfigTable (struct STP_BRIDGE* bridge, const STP_CONFIG_TABLE_EN
 
 		memcpy (bridge->mstConfigTable, entries, entryCount * 2);
 
-		ComputeMstConfigDigest (bridge);
-
-		LOG (bridge, -1, -1, "New digest: 0x{X2}{X2}...{X2}{X2}.\r\n",
-			 bridge->MstConfigId.ConfigurationDigest[0], bridge->MstConfigId.ConfigurationDigest[1],
-			 bridge->MstConfigId.ConfigurationDigest[14], bridge->MstConfigId.ConfigurationDigest[15]);
-
-		if (bridge->started)
-			RestartStateMachines(bridge, timestamp);
+		OnMstConfigIdChanged (bridge, true, timestamp);
 	}
 
 	LOG (bridge, -1, -1, "------------------------------------\r\n");
@@ -960,20 +1579,44 @@ void STP_SetMstConfigTableEntry (struct STP_BRIDGE* bridge, unsigned int vlanNum
 
 		bridge->mstConfigTable[vlanNumber] = (unsigned short) treeIndex;
 
-		ComputeMstConfigDigest (bridge);
+		OnMstConfigIdChanged (bridge, true, timestamp);
+	}
 
-		LOG (bridge, -1, -1, "New digest: 0x{X2}{X2}...{X2}{X2}.\r\n",
-			bridge->MstConfigId.ConfigurationDigest[0], bridge->MstConfigId.ConfigurationDigest[1],
-			bridge->MstConfigId.ConfigurationDigest[14], bridge->MstConfigId.ConfigurationDigest[15]);
+	LOG (bridge, -1, -1, "------------------------------------\r\n");
+	FLUSH_LOG (bridge);
+}
 
-		if (bridge->started)
-			RestartStateMachines(bridge, timestamp);
+// ============================================================================
+
+void STP_BeginMstConfigChanges (STP_BRIDGE* bridge)
+{
+	assert (!bridge->mstConfigChangesOpen);
+	bridge->mstConfigChangesOpen = true;
+}
+
+void STP_CommitMstConfigChanges (STP_BRIDGE* bridge, unsigned int timestamp)
+{
+	assert (bridge->mstConfigChangesOpen);
+	bridge->mstConfigChangesOpen = false;
+
+	LOG (bridge, -1, -1, "{T}: Committing MST Config changes... ", timestamp);
+
+	if (!bridge->mstConfigIdChanged)
+	{
+		LOG (bridge, -1, -1, "... nothing changed.\r\n");
+	}
+	else
+	{
+		LOG (bridge, -1, -1, "\r\n");
+		OnMstConfigIdChanged (bridge, false, timestamp);
 	}
 
 	LOG (bridge, -1, -1, "------------------------------------\r\n");
 	FLUSH_LOG (bridge);
 }
 
+// ============================================================================
+
 const STP_CONFIG_TABLE_ENTRY* STP_GetMstConfigTable (STP_BRIDGE* bridge, unsigned int* entryCountOut)
 {
 	*entryCountOut = 1 + bridge->maxVlanNumber;
@@ -1203,7 +1846,7 @@ void STP_MST_CONFIG_ID::Dump (STP_BRIDGE* bridge, int port, int tree) const
 	char namesz [33];
 	memcpy (namesz, ConfigurationName, 32);
 	namesz [32] = 0;
-	LOG (bridge, port, tree, "Name=\"{S}\", Rev={D}, Digest={X2}{X2}..{X2}{X2}\r\n",
+	LOG_DETAILS (bridge, port, tree, "Name=\"{S}\", Rev={D}, Digest={X2}{X2}..{X2}{X2}\r\n",
 		 namesz,
 		 (RevisionLevelHigh << 8) | RevisionLevelLow,
 		 ConfigurationDigest [0], ConfigurationDigest [1], ConfigurationDigest [14], ConfigurationDigest [15]);
@@ -1386,7 +2029,10 @@ extern "C" void STP_SetTxHoldCount (struct STP_BRIDGE* bridge, unsigned int txHo
 	{
 		bridge->TxHoldCount = txHoldCount;
 		for (unsigned int pi = 0; pi < bridge->portCount; pi++)
+		{
 			bridge->ports[pi]->txCount = 0;
+			MarkPortDirty (bridge, pi);
+		}
 	}
 }
 
@@ -10,10 +10,18 @@
 #include <string.h>
 #include <stdint.h>
 
-enum PortIndex { };
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+	#include <emmintrin.h>
+	#define STP_COMPARE_WITH_SSE2 1
+#elif (defined(__GNUC__) || defined(__clang__)) && defined(__BYTE_ORDER__)
+	#define STP_COMPARE_WITH_UINT64 1
+#endif
+
+// The enumerators give these enums the range of an unsigned short; an empty enum may legally hold only 0 and 1.
+enum PortIndex { PORT_INDEX_MAX = 0xFFFF };
 inline PortIndex operator++(PortIndex& x, int) { PortIndex res = x; x = (PortIndex) (x + 1); return res; }
 
-enum TreeIndex { };
+enum TreeIndex { TREE_INDEX_MAX = 0xFFFF };
 inline TreeIndex operator++(TreeIndex& x, int) { TreeIndex res = x; x = (TreeIndex) (x + 1); return res; }
 
 static const TreeIndex CIST_INDEX = (TreeIndex)0;
@@ -165,6 +173,61 @@ struct PRIORITY_VECTOR
 	BRIDGE_ID	DesignatedBridgeId;		// e)
 	PORT_ID		DesignatedPortId;		// f)
 
+	// Returns a negative value if this vector is better than rhs, zero if they are the same, a positive value if it's worse.
+	// All components are in network byte order, so this is a lexicographic comparison of the 34 bytes.
+	int Compare (const PRIORITY_VECTOR& rhs) const
+	{
+		const unsigned char* a = (const unsigned char*) this;
+		const unsigned char* b = (const unsigned char*) &rhs;
+
+	#if STP_COMPARE_WITH_SSE2
+		// Bytes 0 to 31 as two 16-byte blocks, then bytes 32 and 33.
+		for (unsigned int offset = 0; offset < 32; offset += 16)
+		{
+			__m128i va = _mm_loadu_si128 ((const __m128i*) (a + offset));
+			__m128i vb = _mm_loadu_si128 ((const __m128i*) (b + offset));
+			unsigned int differentBytes = ~(unsigned int) _mm_movemask_epi8 (_mm_cmpeq_epi8 (va, vb)) & 0xFFFF;
+			if (differentBytes != 0)
+			{
+				unsigned int i = offset;
+				while ((differentBytes & 1) == 0)
+				{
+					differentBytes >>= 1;
+					i++;
+				}
+
+				return (int) a[i] - (int) b[i];
+			}
+		}
+
+		if (a[32] != b[32])
+			return (int) a[32] - (int) b[32];
+		return (int) a[33] - (int) b[33];
+	#elif STP_COMPARE_WITH_UINT64
+		// Bytes 0 to 31 as four big-endian 64-bit words, then bytes 32 and 33.
+		for (unsigned int offset = 0; offset < 32; offset += 8)
+		{
+			uint64_t wa, wb;
+			memcpy (&wa, a + offset, 8);
+			memcpy (&wb, b + offset, 8);
+			if (wa != wb)
+			{
+			#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+				wa = __builtin_bswap64 (wa);
+				wb = __builtin_bswap64 (wb);
+			#endif
+				return (wa < wb) ? -1 : 1;
+			}
+		}
+
+		if (a[32] != b[32])
+			return (int) a[32] - (int) b[32];
+		return (int) a[33] - (int) b[33];
+	#else
+		return memcmp (a, b, 34);
+	#endif
+	}
+
 	bool operator== (const PRIORITY_VECTOR& rhs) const
 	{
 		return memcmp (this, &rhs, sizeof (*this)) == 0;
@@ -177,22 +240,22 @@ struct PRIORITY_VECTOR
 
 	bool IsBetterThan (const PRIORITY_VECTOR& rhs) const
 	{
-		return memcmp (this, &rhs, sizeof (*this)) < 0;
+		return Compare (rhs) < 0;
 	}
 
 	bool IsBetterThanOrSameAs (const PRIORITY_VECTOR& rhs) const
 	{
-		return memcmp (this, &rhs, sizeof (*this)) <= 0;
+		return Compare (rhs) <= 0;
 	}
 
 	bool IsWorseThan (const PRIORITY_VECTOR& rhs) const
 	{
-		return memcmp (this, &rhs, sizeof (*this)) > 0;
+		return Compare (rhs) > 0;
 	}
 
 	bool IsWorseThanOrSameAs (const PRIORITY_VECTOR& rhs) const
 	{
-		return memcmp (this, &rhs, sizeof (*this)) >= 0;
+		return Compare (rhs) >= 0;
 	}
 
 	bool IsNotBetterThan (const PRIORITY_VECTOR& rhs) const
@@ -222,6 +285,9 @@ struct PRIORITY_VECTOR
 	}
 };
 
+// PRIORITY_VECTOR::Compare relies on this.
+typedef char PRIORITY_VECTOR_SIZE_CHECK [(sizeof (PRIORITY_VECTOR) == 34) ? 1 : -1];
+
 // ============================================================================
 
 struct TIMES
@@ -260,4 +326,67 @@ enum RCVD_INFO
 
 // ============================================================================
 
+// Array of objects placed in the memory block of the bridge, "stride" objects apart. The subscript operator returns a pointer,
+// so that code can access the elements like it did back when bridge->ports and port->trees were arrays of pointers.
+template<typename T>
+struct CONTIGUOUS_ARRAY
+{
+	T* items;
+	unsigned int stride;
+
+	T* operator[] (unsigned int index) const { return &items[index * stride]; }
+};
+
+// ============================================================================
+
+inline bool TestBit (const unsigned int* bits, unsigned int index)
+{
+	return (bits [index / 32] & (1u << (index % 32))) != 0;
+}
+
+inline void SetBit (unsigned int* bits, unsigned int index)
+{
+	bits [index / 32] |= (1u << (index % 32));
+}
+
+inline void ClearBit (unsigned int* bits, unsigned int index)
+{
+	bits [index / 32] &= ~(1u << (index % 32));
+}
+
+inline void AssignBit (unsigned int* bits, unsigned int index, bool value)
+{
+	if (value)
+		bits [index / 32] |= (1u << (index % 32));
+	else
+		bits [index / 32] &= ~(1u << (index % 32));
+}
+
+// Returns the index of the first bit set in "bits" at or after "startIndex", or "bitCount" if there's none.
+inline unsigned int FindNextSetBit (const unsigned int* bits, unsigned int bitCount, unsigned int startIndex)
+{
+	unsigned int i = startIndex;
+	while (i < bitCount)
+	{
+		unsigned int word = bits [i / 32] >> (i % 32);
+		if (word == 0)
+		{
+			i = (i / 32 + 1) * 32;
+			continue;
+		}
+
+		while ((word & 1) == 0)
+		{
+			word >>= 1;
+			i++;
+		}
+
+		return (i < bitCount) ? i : bitCount;
+	}
+
+	return bitCount;
+}
+
+// ============================================================================
+
 #endif
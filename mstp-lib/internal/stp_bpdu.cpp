@@ -240,20 +240,20 @@ enum VALIDATED_BPDU_TYPE STP_GetValidatedBpduType (enum STP_VERSION bridgeStpVer
 #if STP_USE_LOG
 void DumpMstpBpdu (STP_BRIDGE* bridge, int port, int tree, const MSTP_BPDU* bpdu)
 {
-	LOG (bridge, port, tree, "Flags: TC={D}, Proposal={D}, PortRole={S}, Learning={D}, Forwarding={D}, Agreement={D}\r\n",
+	LOG_DETAILS (bridge, port, tree, "Flags: TC={D}, Proposal={D}, PortRole={S}, Learning={D}, Forwarding={D}, Agreement={D}\r\n",
 			(int) GetBpduFlagTc (bpdu->cistFlags),
 			(int) GetBpduFlagProposal (bpdu->cistFlags),
 			GetBpduPortRoleName (GetBpduFlagPortRole (bpdu->cistFlags)),
 			(int) GetBpduFlagLearning (bpdu->cistFlags),
 			(int) GetBpduFlagForwarding (bpdu->cistFlags),
 			(int) GetBpduFlagAgreement (bpdu->cistFlags));
-	LOG (bridge, port, tree, "CIST Root ID                 : {BID}\r\n", &bpdu->cistRootId);
-	LOG (bridge, port, tree, "CIST External Path Cost      : {D7}\r\n",  (int) bpdu->cistExternalPathCost);
-	LOG (bridge, port, tree, "CIST Regional Root ID        : {BID}\r\n", &bpdu->cistRegionalRootId);
-	LOG (bridge, port, tree, "CIST Internal Root Path Cost : {D7}\r\n",  (int) bpdu->cistInternalRootPathCost);
-	LOG (bridge, port, tree, "CIST Bridge ID               : {BID}\r\n", &bpdu->cistBridgeId);
-	LOG (bridge, port, tree, "CIST Port ID                 : {PID}\r\n", &bpdu->cistPortId);
-	LOG (bridge, port, tree, "CIST MessageAge={D}, MaxAge={D}, HelloTime={D}, ForwardDelay={D}, remainingHops={D}\r\n",
+	LOG_DETAILS (bridge, port, tree, "CIST Root ID                 : {BID}\r\n", &bpdu->cistRootId);
+	LOG_DETAILS (bridge, port, tree, "CIST External Path Cost      : {D7}\r\n",  (int) bpdu->cistExternalPathCost);
+	LOG_DETAILS (bridge, port, tree, "CIST Regional Root ID        : {BID}\r\n", &bpdu->cistRegionalRootId);
+	LOG_DETAILS (bridge, port, tree, "CIST Internal Root Path Cost : {D7}\r\n",  (int) bpdu->cistInternalRootPathCost);
+	LOG_DETAILS (bridge, port, tree, "CIST Bridge ID               : {BID}\r\n", &bpdu->cistBridgeId);
+	LOG_DETAILS (bridge, port, tree, "CIST Port ID                 : {PID}\r\n", &bpdu->cistPortId);
+	LOG_DETAILS (bridge, port, tree, "CIST MessageAge={D}, MaxAge={D}, HelloTime={D}, ForwardDelay={D}, remainingHops={D}\r\n",
 		 (int) bpdu->MessageAge / 256,
 		 (int) bpdu->MaxAge / 256,
 		 (int) bpdu->HelloTime / 256,
@@ -270,7 +270,7 @@ void DumpMstpBpdu (STP_BRIDGE* bridge, int port, int tree, const MSTP_BPDU* bpdu
 	MSTI_CONFIG_MESSAGE* mstis = (MSTI_CONFIG_MESSAGE*) &bpdu [1];
 	for (int mstiIndex = 0; mstiIndex < mstiCount; mstiIndex++)
 	{
-		LOG (bridge, port, tree, "MSTI #{D}\r\n", mstiIndex + 1);
+		LOG_DETAILS (bridge, port, tree, "MSTI #{D}\r\n", mstiIndex + 1);
 		LOG_INDENT (bridge);
 		mstis [mstiIndex].Dump (bridge, port, tree);
 		LOG_UNINDENT (bridge);
@@ -281,18 +281,18 @@ void DumpMstpBpdu (STP_BRIDGE* bridge, int port, int tree, const MSTP_BPDU* bpdu
 
 void DumpRstpBpdu (STP_BRIDGE* bridge, int port, int tree, const MSTP_BPDU* bpdu)
 {
-	LOG (bridge, port, tree, "Flags: TC={D}, Proposal={D}, PortRole={S}, Learning={D}, Forwarding={D}, Agreement={D}\r\n",
+	LOG_DETAILS (bridge, port, tree, "Flags: TC={D}, Proposal={D}, PortRole={S}, Learning={D}, Forwarding={D}, Agreement={D}\r\n",
 			(int) GetBpduFlagTc (bpdu->cistFlags),
 			(int) GetBpduFlagProposal (bpdu->cistFlags),
 			GetBpduPortRoleName (GetBpduFlagPortRole (bpdu->cistFlags)),
 			(int) GetBpduFlagLearning (bpdu->cistFlags),
 			(int) GetBpduFlagForwarding (bpdu->cistFlags),
 			(int) GetBpduFlagAgreement (bpdu->cistFlags));
-	LOG (bridge, port, tree, "  Root ID        : {BID}\r\n", &bpdu->cistRootId);
-	LOG (bridge, port, tree, "  Root Path Cost : {D7}\r\n", (int) bpdu->cistExternalPathCost);
-	LOG (bridge, port, tree, "  Bridge ID      : {BID}\r\n", &bpdu->cistRegionalRootId);
-	LOG (bridge, port, tree, "  Port ID        : {PID}\r\n", &bpdu->cistPortId);
-	LOG (bridge, port, tree, "  MessageAge={D}, MaxAge={D}, HelloTime={D}, ForwardDelay={D}\r\n",
+	LOG_DETAILS (bridge, port, tree, "  Root ID        : {BID}\r\n", &bpdu->cistRootId);
+	LOG_DETAILS (bridge, port, tree, "  Root Path Cost : {D7}\r\n", (int) bpdu->cistExternalPathCost);
+	LOG_DETAILS (bridge, port, tree, "  Bridge ID      : {BID}\r\n", &bpdu->cistRegionalRootId);
+	LOG_DETAILS (bridge, port, tree, "  Port ID        : {PID}\r\n", &bpdu->cistPortId);
+	LOG_DETAILS (bridge, port, tree, "  MessageAge={D}, MaxAge={D}, HelloTime={D}, ForwardDelay={D}\r\n",
 		 (int) bpdu->MessageAge / 256,
 		 (int) bpdu->MaxAge / 256,
 		 (int) bpdu->HelloTime / 256,
@@ -301,14 +301,14 @@ void DumpRstpBpdu (STP_BRIDGE* bridge, int port, int tree, const MSTP_BPDU* bpdu
 
 void DumpConfigBpdu (STP_BRIDGE* bridge, int port, int tree, const MSTP_BPDU* bpdu)
 {
-	LOG (bridge, port, tree, "Flags: TC={D}, TCAck={D}\r\n",
+	LOG_DETAILS (bridge, port, tree, "Flags: TC={D}, TCAck={D}\r\n",
 			(int) GetBpduFlagTc    (bpdu->cistFlags),
 			(int) GetBpduFlagTcAck (bpdu->cistFlags));
-	LOG (bridge, port, tree, "  Root ID        : {BID}\r\n", &bpdu->cistRootId);
-	LOG (bridge, port, tree, "  Root Path Cost : {D7}\r\n", (int) bpdu->cistExternalPathCost);
-	LOG (bridge, port, tree, "  Bridge ID      : {BID}\r\n", &bpdu->cistRegionalRootId);
-	LOG (bridge, port, tree, "  Port ID        : {PID}\r\n", &bpdu->cistPortId);
-	LOG (bridge, port, tree, "  MessageAge={D}, MaxAge={D}, HelloTime={D}, ForwardDelay={D}\r\n",
+	LOG_DETAILS (bridge, port, tree, "  Root ID        : {BID}\r\n", &bpdu->cistRootId);
+	LOG_DETAILS (bridge, port, tree, "  Root Path Cost : {D7}\r\n", (int) bpdu->cistExternalPathCost);
+	LOG_DETAILS (bridge, port, tree, "  Bridge ID      : {BID}\r\n", &bpdu->cistRegionalRootId);
+	LOG_DETAILS (bridge, port, tree, "  Port ID        : {PID}\r\n", &bpdu->cistPortId);
+	LOG_DETAILS (bridge, port, tree, "  MessageAge={D}, MaxAge={D}, HelloTime={D}, ForwardDelay={D}\r\n",
 		 (int) bpdu->MessageAge / 256,
 		 (int) bpdu->MaxAge / 256,
 		 (int) bpdu->HelloTime / 256,
@@ -319,7 +319,7 @@ void DumpConfigBpdu (STP_BRIDGE* bridge, int port, int tree, const MSTP_BPDU* bp
 
 void MSTI_CONFIG_MESSAGE::Dump (STP_BRIDGE* bridge, int port, int tree) const
 {
-	LOG (bridge, port, tree, "Flags: TC={D}, Proposal={D}, PortRole={S}, Learning={D}, Forwarding={D}, Agreement={D}, Master={D}\r\n",
+	LOG_DETAILS (bridge, port, tree, "Flags: TC={D}, Proposal={D}, PortRole={S}, Learning={D}, Forwarding={D}, Agreement={D}, Master={D}\r\n",
 			(int) GetBpduFlagTc (flags),
 			(int) GetBpduFlagProposal (flags),
 			GetBpduPortRoleName (GetBpduFlagPortRole (flags)),
@@ -327,10 +327,10 @@ void MSTI_CONFIG_MESSAGE::Dump (STP_BRIDGE* bridge, int port, int tree) const
 			(int) GetBpduFlagForwarding (flags),
 			(int) GetBpduFlagAgreement (flags),
 			(int) GetBpduFlagMaster (flags));
-	LOG (bridge, port, tree, "RegionalRootId       : {BID}\r\n", &RegionalRootId);
-	LOG (bridge, port, tree, "InternalRootPathCost : {D}\r\n", (int)InternalRootPathCost);
-	LOG (bridge, port, tree, "BridgePriority       : 0x{X2}\r\n", BridgePriority);
-	LOG (bridge, port, tree, "PortPriority         : 0x{X2}\r\n", PortPriority);
-	LOG (bridge, port, tree, "RemainingHops        : {D}\r\n", RemainingHops);
+	LOG_DETAILS (bridge, port, tree, "RegionalRootId       : {BID}\r\n", &RegionalRootId);
+	LOG_DETAILS (bridge, port, tree, "InternalRootPathCost : {D}\r\n", (int)InternalRootPathCost);
+	LOG_DETAILS (bridge, port, tree, "BridgePriority       : 0x{X2}\r\n", BridgePriority);
+	LOG_DETAILS (bridge, port, tree, "PortPriority         : 0x{X2}\r\n", PortPriority);
+	LOG_DETAILS (bridge, port, tree, "RemainingHops        : {D}\r\n", RemainingHops);
 }
 #endif
@@ -88,6 +88,19 @@ struct MSTP_BPDU : BPDU_HEADER
 	// MSTI_CONFIG_MESSAGE mstiConfigMessages [0];
 };
 
+// ============================================================================
+// Ethernet header with a Length field, followed by the LLC header, as transmitted in front of every BPDU.
+// The library builds it only for the transmitGather callback.
+struct BPDU_FRAME_HEADER
+{
+	unsigned char destination[6]; // the Bridge Group Address 01-80-C2-00-00-00
+	unsigned char source[6];      // the address of the transmitting port
+	uint16_nbo    length;         // size of the LLC header plus the BPDU
+	unsigned char dsap;           // 0x42
+	unsigned char ssap;           // 0x42
+	unsigned char control;        // 0x03 (UI)
+};
+
 // ============================================================================
 // 14.5 in 802.1Q-2018
 enum VALIDATED_BPDU_TYPE
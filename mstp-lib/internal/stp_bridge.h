@@ -67,6 +67,30 @@ public:
 	}
 
 	PortRoleSelection::State portRoleSelectionState;
+
+	// The per-port variables of this tree, indexed by port. Same objects as bridge->ports[p]->trees[t].
+	CONTIGUOUS_ARRAY<PORT_TREE> portTrees;
+
+#if STP_USE_TREE_MAJOR_LAYOUT
+	// One bit per port for each of the following, kept in sync with the variables in portTrees by UpdatePortTreeBits.
+	unsigned int* unreadyPorts;  // selected is FALSE, or role is not selectedRole, or updtInfo is TRUE
+	unsigned int* unsyncedPorts; // synced is FALSE
+	unsigned int* rootPorts;     // role is RootPort
+	unsigned int* rrWhilePorts;  // rrWhile is not zero
+#endif
+
+	// Number of ports of this tree that have reselect set; kept current by SetReselect. Port Role Selection
+	// runs updtRolesTree and setSelectedTree only for trees where this is not zero, and doesn't look at the ports for it.
+	unsigned int reselectPortCount;
+
+#if STP_USE_CONVERGENCE_TRACE
+	// The reconvergence in progress, or the last one if converged is set, and the last one that changed some port role
+	// or port state. Handshakes that change neither are recorded in the former but don't make it into the latter.
+	// Nothing was recorded yet when eventCount is zero.
+	STP_CONVERGENCE_REPORT convergence;
+	STP_CONVERGENCE_REPORT lastConvergence;
+	bool convergenceChangedPorts;
+#endif
 };
 
 // ============================================================================
@@ -83,6 +107,26 @@ struct STP_BRIDGE
 	bool loggingEnabled;
 	int logCurrentPort;
 	int logCurrentTree;
+	// Set by STP_SetLogFilter; when logFiltered is false, everything is logged and the rest isn't looked at.
+	bool logFiltered;
+	unsigned int logMaxLevel;       // STP_LOG_LEVEL
+	unsigned int logStateMachines;  // STP_LOG_STATE_MACHINE bits
+	unsigned int* logPorts;         // one bit per port
+	unsigned int* logTrees;         // one bit per tree
+#if STP_USE_BINARY_LOG
+	// With the binary log, logBuffer is a ring of records starting at logRingStart and logBufferUsedSize bytes long.
+	// Records refer to their format string by its index in logFormats, a hash table keyed by the string's address.
+	struct LOG_FORMAT
+	{
+		const char* format;
+		unsigned char args[12]; // the directives in the format, as LOG_DIRECTIVE values; zero-terminated
+		bool endsLine;
+		bool text;              // more directives than args can hold, or than a record can; logged as text instead
+	};
+	static const unsigned int LogFormatTableSize = 256;
+	LOG_FORMAT* logFormats;
+	unsigned int logRingStart;
+#endif
 #endif
 
 	bool BEGIN; // Defined in 13.23.1 in 802.1Q-2005. Widely used but definition was removed subsequent versions of the standard.
@@ -96,9 +140,23 @@ struct STP_BRIDGE
 
 	unsigned int treeCount() const { return 1 + ((ForceProtocolVersion >= STP_VERSION_MSTP) ? mstiCount : 0); }
 
-	BRIDGE_TREE** trees;
-	PORT** ports;
+	// All of these point inside the single memory block that holds the bridge; see STP_GetRequiredMemorySize.
+	CONTIGUOUS_ARRAY<BRIDGE_TREE> trees;
+	CONTIGUOUS_ARRAY<PORT> ports;
 	uint16_nbo* mstConfigTable;
+	bool memoryOwnedByLibrary; // false when the application passed the memory to STP_CreateBridgeInBuffer
+
+#if !STP_USE_FULL_SWEEP
+	// Dirty sets used by RunStateMachines to evaluate only the state machines whose input variables were written.
+	unsigned int* dirtyPorts;                 // one bit per port; the per-tree bits are in PORT::dirtyTrees
+	unsigned int* dirtyTransmitPorts;         // one bit per port; PortTransmit is evaluated separately, after all others
+	unsigned int  dirtyRoleSelectionTrees[3]; // one bit per tree
+
+	// One bit per port that might have a non-zero timer. STP_OnOneSecondTick ticks only these ports, and the PortTimers
+	// state machine clears the bit when all timers of the port have expired. Timers are only ever started by
+	// state machine transitions of the port that owns them, so RunStateMachines sets the bit after such transitions.
+	unsigned int* timerPorts;
+#endif
 
 	// 13.26 Per bridge variables
 	// There is one instance per bridge component of the following variable(s):
@@ -110,6 +168,12 @@ struct STP_BRIDGE
 	// are treated as constants by the state machines. If ForceProtocolVersion or MSTConfigId are modified by
 	// management, BEGIN shall be asserted for all state machines.
 
+	// Set between STP_BeginMstConfigChanges and STP_CommitMstConfigChanges; the two flags after it
+	// record what the commit has to do: recompute the digest, and restart the state machines.
+	bool mstConfigChangesOpen;
+	bool mstConfigTableChanged;
+	bool mstConfigIdChanged;
+
 	// If the ISIS-SPB is implemented there is one instance per Bridge component, of the following variable(s),
 	// with that single instance supporting all SPTs:
 	// XXX agreementDigest; // 13.26.k) - 13.26.1
@@ -124,8 +188,189 @@ struct STP_BRIDGE
 	const MSTP_BPDU*		receivedBpduContent;
 	VALIDATED_BPDU_TYPE		receivedBpduType;
 	PORT*                   receivedBpduPort;
+
+	// Set by STP_OnBpdusReceived while it feeds BPDUs to the state machines one by one. RunStateMachines
+	// doesn't run Port Role Selection and PortTransmit while this is set; they run once at the end of the batch.
+	bool receivingBpduBatch;
+
+#if STP_USE_COUNTERS
+	STP_COUNTERS counters; // see STP_GetCounters; the per-port ones are in PORT
+#endif
+
+#if STP_USE_CONVERGENCE_TRACE
+	// What the call into the library currently running is about; see SetConvergenceTrigger.
+	STP_CONVERGENCE_TRIGGER convergenceTrigger;
+	int convergenceTriggerPort;
+#endif
 };
 
+// ============================================================================
+// Code that writes selected, role, selectedRole, updtInfo, synced or rrWhile for some port and tree
+// must call this afterwards. Writes done by state machines while making transitions are handled by RunStateMachineInstance.
+
+inline void UpdatePortTreeBits (STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex)
+{
+#if STP_USE_TREE_MAJOR_LAYOUT
+	BRIDGE_TREE* tree = bridge->trees [treeIndex];
+	const PORT_TREE* portTree = tree->portTrees [portIndex];
+	AssignBit (tree->unreadyPorts,  portIndex, !portTree->selected || (portTree->role != portTree->selectedRole) || portTree->updtInfo);
+	AssignBit (tree->unsyncedPorts, portIndex, !portTree->synced);
+	AssignBit (tree->rootPorts,     portIndex, portTree->role == STP_PORT_ROLE_ROOT);
+	AssignBit (tree->rrWhilePorts,  portIndex, portTree->rrWhile != 0);
+#endif
+}
+
+// ============================================================================
+// All writes to reselect must go through here, to keep BRIDGE_TREE::reselectPortCount current.
+
+inline void SetReselect (STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex, bool reselect)
+{
+	BRIDGE_TREE* tree = bridge->trees [treeIndex];
+	PORT_TREE* portTree = tree->portTrees [portIndex];
+	if (portTree->reselect != reselect)
+	{
+		portTree->reselect = reselect;
+		if (reselect)
+			tree->reselectPortCount++;
+		else
+			tree->reselectPortCount--;
+	}
+}
+
+#if STP_USE_TREE_MAJOR_LAYOUT
+// Returns true if any port other than exceptPort has its bit set. Pass bridge->portCount as exceptPort to check all ports.
+inline bool AnyPortBitSet (const STP_BRIDGE* bridge, const unsigned int* bits, unsigned int exceptPort)
+{
+	for (unsigned int wordIndex = 0; wordIndex < (bridge->portCount + 31) / 32; wordIndex++)
+	{
+		unsigned int word = bits [wordIndex];
+		if (wordIndex == exceptPort / 32)
+			word &= ~(1u << (exceptPort % 32));
+		if (word != 0)
+			return true;
+	}
+
+	return false;
+}
+#endif
+
+#if STP_USE_COUNTERS
+// Start and end of the durations counted in the histograms of STP_COUNTERS. Both do nothing when the application didn't
+// supply the readClock callback. AddDurationToHistogram is in stp_counters.cpp.
+inline unsigned int ReadCounterClock (const STP_BRIDGE* bridge)
+{
+	return (bridge->callbacks.readClock != NULL) ? bridge->callbacks.readClock (bridge) : 0;
+}
+
+void AddDurationToHistogram (STP_BRIDGE* bridge, STP_HISTOGRAM* histogram, unsigned int startTime);
+#endif
 
+// ============================================================================
+// Functions that handle events other than management calls tell the convergence tracer about them with this,
+// before running the state machines, and set it back to STP_CONVERGENCE_TRIGGER_MANAGEMENT and -1 afterwards.
+
+inline void SetConvergenceTrigger (STP_BRIDGE* bridge, STP_CONVERGENCE_TRIGGER trigger, int portIndex)
+{
+#if STP_USE_CONVERGENCE_TRACE
+	bridge->convergenceTrigger = trigger;
+	bridge->convergenceTriggerPort = portIndex;
+#endif
+}
+
+#if STP_USE_CONVERGENCE_TRACE
+// These are in stp_convergence.cpp.
+void AddConvergenceEvent (STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex, STP_CONVERGENCE_EVENT_TYPE type, unsigned int value, unsigned int timestamp);
+void CheckConvergence (STP_BRIDGE* bridge, unsigned int timestamp);
+#endif
+
+#if STP_USE_LOG
+// Called by the LOG macros before they format anything. Port and tree are -1 for lines that aren't specific
+// to a port or tree, and stateMachine is zero for lines that aren't state machine transitions; those pass the respective filters.
+inline bool LogFilterPasses (const STP_BRIDGE* bridge, int port, int tree, unsigned int level, unsigned int stateMachine)
+{
+	if (!bridge->logFiltered)
+		return true;
+
+	return (level <= bridge->logMaxLevel)
+		&& ((stateMachine == 0) || ((bridge->logStateMachines & stateMachine) != 0))
+		&& ((port < 0) || TestBit (bridge->logPorts, (unsigned int) port))
+		&& ((tree < 0) || TestBit (bridge->logTrees, (unsigned int) tree));
+}
+#endif
+
+// ============================================================================
+// Code that writes a variable read by the state machines of some other port or tree - or code outside the state
+// machines that writes any variable read by the state machines - must call one of the functions below, so that
+// RunStateMachines evaluates the affected state machines. State machines making a transition on a port
+// are re-evaluated automatically; see RunStateMachines.
+
+#if STP_USE_FULL_SWEEP
+
+inline void MarkPortDirty     (STP_BRIDGE* bridge, unsigned int portIndex) { }
+inline void MarkPortTreeDirty (STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex) { }
+inline void MarkTreeDirty     (STP_BRIDGE* bridge, unsigned int treeIndex) { }
+inline void MarkAllDirty      (STP_BRIDGE* bridge) { }
+
+#else
+
+// Same as MarkPortDirty, except it keeps the BPDU cached for the port. Meant only for use after
+// transitions of the PortTransmit state machine, which writes none of the variables encoded by txRstp.
+inline void MarkPortDirtyAfterTransmit (STP_BRIDGE* bridge, unsigned int portIndex)
+{
+	bridge->dirtyPorts         [portIndex / 32] |= (1u << (portIndex % 32));
+	bridge->dirtyTransmitPorts [portIndex / 32] |= (1u << (portIndex % 32));
+
+	PORT* port = bridge->ports [portIndex];
+	for (unsigned int treeIndex = 0; treeIndex < (1 + bridge->mstiCount); treeIndex++)
+		port->dirtyTrees [treeIndex / 32] |= (1u << (treeIndex % 32));
+}
+
+// Marks for evaluation the per-port state machines of the given port, as well as the per-tree state machines of the given port for all trees.
+// The variables that might have changed are also the ones txRstp encodes, so this also invalidates the BPDU cached for the port.
+inline void MarkPortDirty (STP_BRIDGE* bridge, unsigned int portIndex)
+{
+	MarkPortDirtyAfterTransmit (bridge, portIndex);
+
+	PORT* port = bridge->ports [portIndex];
+	for (unsigned int treeIndex = 0; treeIndex < (1 + bridge->mstiCount); treeIndex++)
+		port->txStaleTrees [treeIndex / 32] |= (1u << (treeIndex % 32));
+}
+
+// Marks for evaluation the per-port state machines of the given port, and the per-tree state machines of the given port and tree.
+// The state machines of an MSTI read the CIST variables of the same port, so marking a port for the CIST marks it for all trees.
+inline void MarkPortTreeDirty (STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex)
+{
+	if (treeIndex == CIST_INDEX)
+	{
+		MarkPortDirty (bridge, portIndex);
+	}
+	else
+	{
+		bridge->dirtyPorts         [portIndex / 32] |= (1u << (portIndex % 32));
+		bridge->dirtyTransmitPorts [portIndex / 32] |= (1u << (portIndex % 32));
+		bridge->ports [portIndex]->dirtyTrees   [treeIndex / 32] |= (1u << (treeIndex % 32));
+		bridge->ports [portIndex]->txStaleTrees [treeIndex / 32] |= (1u << (treeIndex % 32));
+	}
+}
+
+// Marks for evaluation the Port Role Selection state machine of the given tree, and the state machines of all ports for that tree.
+inline void MarkTreeDirty (STP_BRIDGE* bridge, unsigned int treeIndex)
+{
+	bridge->dirtyRoleSelectionTrees [treeIndex / 32] |= (1u << (treeIndex % 32));
+
+	for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
+		MarkPortTreeDirty (bridge, portIndex, treeIndex);
+}
+
+inline void MarkAllDirty (STP_BRIDGE* bridge)
+{
+	for (unsigned int treeIndex = 0; treeIndex < (1 + bridge->mstiCount); treeIndex++)
+		bridge->dirtyRoleSelectionTrees [treeIndex / 32] |= (1u << (treeIndex % 32));
+
+	for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
+		MarkPortDirty (bridge, portIndex);
+}
+
+#endif
 
 #endif
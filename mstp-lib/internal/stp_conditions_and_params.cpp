@@ -32,10 +32,16 @@ bool allSptAgree (const STP_BRIDGE* bridge)
 //    4) Master Port and synced is TRUE for all ports for the given tree other than the given port.
 bool allSynced (const STP_BRIDGE* bridge, PortIndex givenPort, TreeIndex givenTree)
 {
+	const BRIDGE_TREE* tree = bridge->trees[givenTree];
+
 	// a) For all ports for the given tree, selected is TRUE, the port's role is the same as its selectedRole, and updtInfo is FALSE; and
+#if STP_USE_TREE_MAJOR_LAYOUT
+	if (AnyPortBitSet (bridge, tree->unreadyPorts, bridge->portCount))
+		return false;
+#else
 	for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
 	{
-		const PORT_TREE* portTree = bridge->ports[portIndex]->trees[givenTree];
+		const PORT_TREE* portTree = tree->portTrees[portIndex];
 
 		if (portTree->selected == false)
 			return false;
@@ -46,12 +52,13 @@ bool allSynced (const STP_BRIDGE* bridge, PortIndex givenPort, TreeIndex givenTr
 		if (portTree->updtInfo)
 			return false;
 	}
+#endif
 
 	// Condition b) 3) not yet implemented
 	assert (bridge->ForceProtocolVersion <= STP_VERSION_MSTP);
 
 	// b) The role of the given Port is
-	STP_PORT_ROLE role = bridge->ports[givenPort]->trees[givenTree]->role;
+	STP_PORT_ROLE role = tree->portTrees[givenPort]->role;
 	if ((role == STP_PORT_ROLE_ROOT) || (role == STP_PORT_ROLE_ALTERNATE) || (role == STP_PORT_ROLE_BACKUP))
 	{
 		// Note AG: The standard doesn tell about the BackupPort role. If we follow the letter of the standard, we should
@@ -63,9 +70,16 @@ bool allSynced (const STP_BRIDGE* bridge, PortIndex givenPort, TreeIndex givenTr
 		// So I'm inclined to believe we should treat a Backup port the same as an Alternate port.
 
 		// 1) Root Port or Alternate Port and synced is TRUE for all ports for the given tree other than the Root Port; or
+	#if STP_USE_TREE_MAJOR_LAYOUT
+		for (unsigned int wordIndex = 0; wordIndex < (bridge->portCount + 31) / 32; wordIndex++)
+		{
+			if ((tree->unsyncedPorts[wordIndex] & ~tree->rootPorts[wordIndex]) != 0)
+				return false;
+		}
+	#else
 		for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
 		{
-			const PORT_TREE* portTree = bridge->ports[portIndex]->trees[givenTree];
+			const PORT_TREE* portTree = tree->portTrees[portIndex];
 
 			if (portTree->role == STP_PORT_ROLE_ROOT)
 				continue;
@@ -73,6 +87,7 @@ bool allSynced (const STP_BRIDGE* bridge, PortIndex givenPort, TreeIndex givenTr
 			if (portTree->synced == false)
 				return false;
 		}
+	#endif
 
 		return true;
 	}
@@ -80,18 +95,23 @@ bool allSynced (const STP_BRIDGE* bridge, PortIndex givenPort, TreeIndex givenTr
 	{
 		// 2) Designated Port and synced is TRUE for all ports for the given tree other than the given port; or
 		// 4) Master Port     and synced is TRUE for all ports for the given tree other than the given port.
+	#if STP_USE_TREE_MAJOR_LAYOUT
+		if (AnyPortBitSet (bridge, tree->unsyncedPorts, givenPort))
+			return false;
+	#else
 		for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
 		{
 			if (portIndex == (unsigned int) givenPort)
 				continue;
 
-			const PORT_TREE* portTree = bridge->ports [portIndex]->trees [givenTree];
+			const PORT_TREE* portTree = tree->portTrees [portIndex];
 
 			//LOG (bridge, givenPort, givenTree, "552: Port {D} synced={D}\r\n", portIndex, portTree->synced);
 
 			if (portTree->synced == false)
 				return false;
 		}
+	#endif
 
 		return true;
 	}
@@ -297,16 +317,20 @@ bool rcvdMstiMsg (const STP_BRIDGE* bridge, PortIndex givenPort, TreeIndex given
 // TRUE if the rrWhile timer is clear (zero) for all Ports for the given tree other than the given Port.
 bool reRooted (const STP_BRIDGE* bridge, PortIndex givenPort, TreeIndex givenTree)
 {
+#if STP_USE_TREE_MAJOR_LAYOUT
+	return !AnyPortBitSet (bridge, bridge->trees[givenTree]->rrWhilePorts, givenPort);
+#else
 	for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
 	{
 		if (portIndex == givenPort)
 			continue;
 
-		if (bridge->ports[portIndex]->trees[givenTree]->rrWhile != 0)
+		if (bridge->trees[givenTree]->portTrees[portIndex]->rrWhile != 0)
 			return false;
 	}
 
 	return true;
+#endif
 }
 
 // ============================================================================
@@ -0,0 +1,110 @@
+
+// This file is part of the mstp-lib library, available at https://github.com/adigostin/mstp-lib
+// Copyright (c) 2011-2020 Adi Gostin, distributed under Apache License v2.0.
+
+// This file implements the convergence tracer enabled with STP_USE_CONVERGENCE_TRACE; see STP_GetConvergenceReport.
+
+#include "stp_bridge.h"
+#include <assert.h>
+
+#if STP_USE_CONVERGENCE_TRACE
+
+// Called by RunStateMachineInstance for the changes made by the state machine transitions of a port and tree.
+// The first change after a tree settled starts a new report for that tree.
+void AddConvergenceEvent (STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex, STP_CONVERGENCE_EVENT_TYPE type, unsigned int value, unsigned int timestamp)
+{
+	BRIDGE_TREE* tree = bridge->trees [treeIndex];
+	STP_CONVERGENCE_REPORT* report = &tree->convergence;
+
+	if ((report->eventCount == 0) || report->converged)
+	{
+		tree->convergenceChangedPorts = false;
+		report->trigger = bridge->convergenceTrigger;
+		report->triggerPortIndex = bridge->convergenceTriggerPort;
+		report->startTimestamp = timestamp;
+		report->endTimestamp = 0;
+		report->converged = false;
+		report->eventCount = 0;
+	}
+
+	if (report->eventCount < STP_CONVERGENCE_MAX_EVENTS)
+	{
+		STP_CONVERGENCE_EVENT* event = &report->events [report->eventCount];
+		event->timestamp = timestamp;
+		event->portIndex = (unsigned short) portIndex;
+		event->type = (unsigned char) type;
+		event->value = (unsigned char) value;
+	}
+
+	report->eventCount++;
+
+	if ((type == STP_CONVERGENCE_EVENT_ROLE) || (type == STP_CONVERGENCE_EVENT_LEARNING) || (type == STP_CONVERGENCE_EVENT_FORWARDING))
+		tree->convergenceChangedPorts = true;
+}
+
+// A tree has settled when Port Role Selection and Port Role Transitions are done on all ports
+// and each port is forwarding or discarding as its role requires.
+static bool IsTreeSettled (const STP_BRIDGE* bridge, unsigned int treeIndex)
+{
+	for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
+	{
+		const PORT_TREE* portTree = bridge->ports [portIndex]->trees [treeIndex];
+
+		if (!portTree->selected || portTree->updtInfo || (portTree->role != portTree->selectedRole))
+			return false;
+
+		bool forwardingRole = (portTree->role == STP_PORT_ROLE_ROOT)
+			|| (portTree->role == STP_PORT_ROLE_DESIGNATED)
+			|| (portTree->role == STP_PORT_ROLE_MASTER);
+
+		if ((portTree->learning != forwardingRole) || (portTree->forwarding != forwardingRole))
+			return false;
+	}
+
+	return true;
+}
+
+// Called at the end of RunStateMachines.
+void CheckConvergence (STP_BRIDGE* bridge, unsigned int timestamp)
+{
+	for (unsigned int treeIndex = 0; treeIndex < bridge->treeCount(); treeIndex++)
+	{
+		BRIDGE_TREE* tree = bridge->trees [treeIndex];
+		STP_CONVERGENCE_REPORT* report = &tree->convergence;
+		if ((report->eventCount != 0) && !report->converged && IsTreeSettled (bridge, treeIndex))
+		{
+			report->converged = true;
+			report->endTimestamp = timestamp;
+
+			if (tree->convergenceChangedPorts)
+				tree->lastConvergence = *report;
+		}
+	}
+}
+
+#endif
+
+// ============================================================================
+
+extern "C" bool STP_GetConvergenceReport (const STP_BRIDGE* bridge, unsigned int treeIndex, STP_CONVERGENCE_REPORT* reportOut)
+{
+	assert (treeIndex < bridge->treeCount());
+
+#if STP_USE_CONVERGENCE_TRACE
+	const BRIDGE_TREE* tree = bridge->trees [treeIndex];
+
+	// A reconvergence in progress is reported as soon as it changed some port role or port state.
+	const STP_CONVERGENCE_REPORT* report;
+	if (!tree->convergence.converged && tree->convergenceChangedPorts)
+		report = &tree->convergence;
+	else if (tree->lastConvergence.eventCount != 0)
+		report = &tree->lastConvergence;
+	else
+		return false;
+
+	*reportOut = *report;
+	return true;
+#else
+	return false;
+#endif
+}
@@ -0,0 +1,116 @@
+
+// This file is part of the mstp-lib library, available at https://github.com/adigostin/mstp-lib
+// Copyright (c) 2011-2020 Adi Gostin, distributed under Apache License v2.0.
+
+// This file implements the counters enabled with STP_USE_COUNTERS; see STP_GetCounters.
+
+#include "stp_bridge.h"
+#include <assert.h>
+#include <string.h>
+
+#if STP_USE_COUNTERS
+void AddDurationToHistogram (STP_BRIDGE* bridge, STP_HISTOGRAM* histogram, unsigned int startTime)
+{
+	if (bridge->callbacks.readClock == NULL)
+		return;
+
+	unsigned int duration = bridge->callbacks.readClock (bridge) - startTime;
+
+	unsigned int bucket = 0;
+	while ((bucket < 32) && ((duration >> bucket) != 0))
+		bucket++;
+
+	histogram->count++;
+	histogram->buckets [bucket]++;
+	if (histogram->max < duration)
+		histogram->max = duration;
+}
+#endif
+
+// ============================================================================
+
+extern "C" void STP_GetCounters (const STP_BRIDGE* bridge, STP_COUNTERS* countersOut)
+{
+#if STP_USE_COUNTERS
+	*countersOut = bridge->counters;
+#else
+	memset (countersOut, 0, sizeof (STP_COUNTERS));
+#endif
+}
+
+extern "C" void STP_GetPortCounters (const STP_BRIDGE* bridge, unsigned int portIndex, STP_PORT_COUNTERS* countersOut)
+{
+	assert (portIndex < bridge->portCount);
+
+#if STP_USE_COUNTERS
+	*countersOut = bridge->ports [portIndex]->counters;
+#else
+	memset (countersOut, 0, sizeof (STP_PORT_COUNTERS));
+#endif
+}
+
+extern "C" void STP_ResetCounters (STP_BRIDGE* bridge)
+{
+#if STP_USE_COUNTERS
+	memset (&bridge->counters, 0, sizeof (STP_COUNTERS));
+
+	for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
+		memset (&bridge->ports [portIndex]->counters, 0, sizeof (STP_PORT_COUNTERS));
+#endif
+}
+
+// ============================================================================
+
+#if STP_USE_LOG
+template<typename State, typename PortTreeArgs>
+static const char* GetStateName (const StateMachine<State, PortTreeArgs>& sm, unsigned int state)
+{
+	return sm.getStateName ((State) state);
+}
+#endif
+
+extern "C" const char* STP_GetStateMachineName (enum STP_STATE_MACHINE stateMachine)
+{
+#if STP_USE_LOG
+	switch (stateMachine)
+	{
+		case STP_STATE_MACHINE_PORT_TIMERS:             return PortTimers::sm.smName;
+		case STP_STATE_MACHINE_PORT_RECEIVE:            return PortReceive::sm.smName;
+		case STP_STATE_MACHINE_PORT_PROTOCOL_MIGRATION: return PortProtocolMigration::sm.smName;
+		case STP_STATE_MACHINE_BRIDGE_DETECTION:        return BridgeDetection::sm.smName;
+		case STP_STATE_MACHINE_PORT_TRANSMIT:           return PortTransmit::sm.smName;
+		case STP_STATE_MACHINE_PORT_INFORMATION:        return PortInformation::sm.smName;
+		case STP_STATE_MACHINE_PORT_ROLE_SELECTION:     return PortRoleSelection::sm.smName;
+		case STP_STATE_MACHINE_PORT_ROLE_TRANSITIONS:   return PortRoleTransitions::sm.smName;
+		case STP_STATE_MACHINE_PORT_STATE_TRANSITION:   return PortStateTransition::sm.smName;
+		case STP_STATE_MACHINE_TOPOLOGY_CHANGE:         return TopologyChange::sm.smName;
+		case STP_STATE_MACHINE_L2G_PORT_RECEIVE:        return L2GPortReceive::sm.smName;
+		default:                                        return NULL;
+	}
+#else
+	return NULL;
+#endif
+}
+
+extern "C" const char* STP_GetStateName (enum STP_STATE_MACHINE stateMachine, unsigned int state)
+{
+#if STP_USE_LOG
+	switch (stateMachine)
+	{
+		case STP_STATE_MACHINE_PORT_TIMERS:             return GetStateName (PortTimers::sm, state);
+		case STP_STATE_MACHINE_PORT_RECEIVE:            return GetStateName (PortReceive::sm, state);
+		case STP_STATE_MACHINE_PORT_PROTOCOL_MIGRATION: return GetStateName (PortProtocolMigration::sm, state);
+		case STP_STATE_MACHINE_BRIDGE_DETECTION:        return GetStateName (BridgeDetection::sm, state);
+		case STP_STATE_MACHINE_PORT_TRANSMIT:           return GetStateName (PortTransmit::sm, state);
+		case STP_STATE_MACHINE_PORT_INFORMATION:        return GetStateName (PortInformation::sm, state);
+		case STP_STATE_MACHINE_PORT_ROLE_SELECTION:     return GetStateName (PortRoleSelection::sm, state);
+		case STP_STATE_MACHINE_PORT_ROLE_TRANSITIONS:   return GetStateName (PortRoleTransitions::sm, state);
+		case STP_STATE_MACHINE_PORT_STATE_TRANSITION:   return GetStateName (PortStateTransition::sm, state);
+		case STP_STATE_MACHINE_TOPOLOGY_CHANGE:         return GetStateName (TopologyChange::sm, state);
+		case STP_STATE_MACHINE_L2G_PORT_RECEIVE:        return GetStateName (L2GPortReceive::sm, state);
+		default:                                        return NULL;
+	}
+#else
+	return NULL;
+#endif
+}
@@ -1,4 +1,3 @@
-
 // This file is part of the mstp-lib library, available at https://github.com/adigostin/mstp-lib
 // Copyright (c) 2011-2020 Adi Gostin, distributed under Apache License v2.0.
 
@@ -17,15 +16,245 @@
 
 #if STP_USE_LOG
 
+// ============================================================================
+// Text formatting. The same code formats the arguments passed to STP_Log (text log)
+// and the arguments stored in binary log records (STP_DecodeBinaryLog).
+
+// If format points to a directive, returns it and advances format past it; otherwise returns LOG_DIRECTIVE_NONE.
+static LOG_DIRECTIVE ParseDirective (const char*& format, int& width)
+{
+	width = 0;
+
+	if (*format != '{')
+		return LOG_DIRECTIVE_NONE;
+
+	if (strncmp (format, "{BID}", 5) == 0) { format += 5; return LOG_DIRECTIVE_BRIDGE_ID; }
+	if (strncmp (format, "{PID}", 5) == 0) { format += 5; return LOG_DIRECTIVE_PORT_ID; }
+	if (strncmp (format, "{BA}", 4) == 0)  { format += 4; return LOG_DIRECTIVE_ADDRESS; }
+	if (strncmp (format, "{PVS}", 5) == 0) { format += 5; return LOG_DIRECTIVE_PRIORITY_VECTOR; }
+	if (strncmp (format, "{T}", 3) == 0)   { format += 3; return LOG_DIRECTIVE_TIMESTAMP; }
+	if (strncmp (format, "{TN}", 4) == 0)  { format += 4; return LOG_DIRECTIVE_TREE_NAME; }
+	if (strncmp (format, "{TMS}", 5) == 0) { format += 5; return LOG_DIRECTIVE_TIMES; }
+
+	LOG_DIRECTIVE directive;
+	if (strncmp (format, "{S", 2) == 0)
+		directive = LOG_DIRECTIVE_STRING;
+	else if (strncmp (format, "{D", 2) == 0)
+		directive = LOG_DIRECTIVE_DECIMAL;
+	else if (strncmp (format, "{X", 2) == 0)
+		directive = LOG_DIRECTIVE_HEX;
+	else
+	{
+		assert (false); // not implemented
+		return LOG_DIRECTIVE_NONE;
+	}
+
+	format += 2;
+	while ((*format >= '0') && (*format <= '9'))
+	{
+		width = 10 * width + *format - '0';
+		format++;
+	}
+
+	assert (*format == '}');
+	format++;
+	return directive;
+}
+
+template<typename Writer>
+static void WriteString (Writer& writer, const char* str)
+{
+	while (*str != 0)
+		writer.Put (*str++);
+}
+
+template<typename Writer>
+static void WriteNumber (Writer& writer, const char* printfFormat, int width, int value)
+{
+	char buffer [10];
+	snprintf (buffer, sizeof (buffer), printfFormat, width, value);
+
+	for (unsigned int i = 0; i < sizeof (buffer) && buffer [i] != 0; i++)
+		writer.Put (buffer [i]);
+}
+
+template<typename Writer>
+static void WriteAddress (Writer& writer, const unsigned char* a)
+{
+	for (unsigned int i = 0; i < 6; i++)
+		WriteNumber (writer, "%0*x", 2, a[i]);
+}
+
+template<typename Writer>
+static void WriteBridgeId (Writer& writer, const BRIDGE_ID* bid)
+{
+	WriteNumber (writer, "%0*x", 4, bid->GetPriorityAndMstid());
+	writer.Put ('.');
+	WriteAddress (writer, bid->GetAddress().bytes);
+}
+
+template<typename Writer>
+static void WritePortId (Writer& writer, const PORT_ID* pid)
+{
+	if (pid->IsInitialized ())
+		WriteNumber (writer, "%0*x", 4, pid->GetPortIdentifier ());
+	else
+		WriteString (writer, "(undefined)");
+}
+
+template<typename Writer, typename ArgReader>
+static void WriteDirective (Writer& writer, LOG_DIRECTIVE directive, int width, ArgReader& args)
+{
+	if (directive == LOG_DIRECTIVE_BRIDGE_ID)
+	{
+		WriteBridgeId (writer, args.BridgeId());
+	}
+	else if (directive == LOG_DIRECTIVE_PORT_ID)
+	{
+		WritePortId (writer, args.PortId());
+	}
+	else if (directive == LOG_DIRECTIVE_ADDRESS)
+	{
+		WriteAddress (writer, args.Address());
+	}
+	else if (directive == LOG_DIRECTIVE_PRIORITY_VECTOR)
+	{
+		const PRIORITY_VECTOR* pv = args.PriorityVector();
+		WriteBridgeId (writer, &pv->RootId);
+		writer.Put ('-');
+		WriteNumber (writer, "%0*d", 7, (int) pv->ExternalRootPathCost);
+		writer.Put ('-');
+		WriteBridgeId (writer, &pv->RegionalRootId);
+		writer.Put ('-');
+		WriteNumber (writer, "%0*d", 7, (int) pv->InternalRootPathCost);
+		writer.Put ('-');
+		WriteBridgeId (writer, &pv->DesignatedBridgeId);
+		writer.Put ('-');
+		WritePortId (writer, &pv->DesignatedPortId);
+	}
+	else if (directive == LOG_DIRECTIVE_STRING)
+	{
+		const char* str = args.String();
+		size_t strLen = strlen (str);
+		for (size_t i = strLen; i < (size_t) width; i++)
+			writer.Put (' ');
+
+		WriteString (writer, str);
+	}
+	else if (directive == LOG_DIRECTIVE_TIMESTAMP)
+	{
+		unsigned int v = (unsigned int) args.Int();
+		WriteNumber (writer, "%0*d", 0, (int) (v / 1000));
+		writer.Put ('.');
+		WriteNumber (writer, "%0*d", 3, (int) (v % 1000));
+	}
+	else if (directive == LOG_DIRECTIVE_TREE_NAME)
+	{
+		int i = args.Int();
+		if (i == 0)
+			WriteString (writer, "CIST");
+		else
+		{
+			WriteString (writer, "MST");
+			WriteNumber (writer, "%0*d", 0, i);
+		}
+	}
+	else if (directive == LOG_DIRECTIVE_TIMES)
+	{
+		const TIMES* times = args.Times();
+		WriteString (writer, "MessageAge=");
+		WriteNumber (writer, "%0*d", 0, times->MessageAge);
+		WriteString (writer, ", MaxAge=");
+		WriteNumber (writer, "%0*d", 0, times->MaxAge);
+		WriteString (writer, ", HelloTime=");
+		WriteNumber (writer, "%0*d", 0, times->HelloTime);
+		WriteString (writer, ", FwDelay=");
+		WriteNumber (writer, "%0*d", 0, times->ForwardDelay);
+		WriteString (writer, ", remainingHops=");
+		WriteNumber (writer, "%0*d", 0, times->remainingHops);
+	}
+	else if (directive == LOG_DIRECTIVE_DECIMAL)
+	{
+		WriteNumber (writer, "%0*d", width, args.Int());
+	}
+	else if (directive == LOG_DIRECTIVE_HEX)
+	{
+		WriteNumber (writer, "%0*x", width, args.Int());
+	}
+	else
+		assert (false);
+}
+
+template<typename Writer, typename ArgReader>
+static void Format (Writer& writer, const char* format, ArgReader& args)
+{
+	while (*format != 0)
+	{
+		int width;
+		LOG_DIRECTIVE directive = ParseDirective (format, width);
+		if (directive == LOG_DIRECTIVE_NONE)
+		{
+			writer.Put (*format);
+			format++;
+		}
+		else
+			WriteDirective (writer, directive, width, args);
+	}
+}
+
+// Reads the variable arguments passed to STP_Log.
+class VA_ARG_READER
+{
+	va_list* _ap;
+
+public:
+	VA_ARG_READER (va_list* ap) : _ap(ap) { }
+
+	int                    Int()            { return va_arg (*_ap, int); }
+	const char*            String()         { return va_arg (*_ap, const char*); }
+	const unsigned char*   Address()        { return va_arg (*_ap, const unsigned char*); }
+	const BRIDGE_ID*       BridgeId()       { return va_arg (*_ap, const BRIDGE_ID*); }
+	const PORT_ID*         PortId()         { return va_arg (*_ap, const PORT_ID*); }
+	const PRIORITY_VECTOR* PriorityVector() { return va_arg (*_ap, const PRIORITY_VECTOR*); }
+	const TIMES*           Times()          { return va_arg (*_ap, const TIMES*); }
+};
+
+#if STP_USE_TOKENIZED_LOG
+// Reads the arguments passed to STP_LogTokenized.
+class ARRAY_ARG_READER
+{
+	const LOG_ARG* _args;
+
+public:
+	ARRAY_ARG_READER (const LOG_ARG* args) : _args(args) { }
+
+	int                    Int()            { return (_args++)->i; }
+	const char*            String()         { return (const char*) (_args++)->p; }
+	const unsigned char*   Address()        { return (const unsigned char*) (_args++)->p; }
+	const BRIDGE_ID*       BridgeId()       { return (const BRIDGE_ID*) (_args++)->p; }
+	const PORT_ID*         PortId()         { return (const PORT_ID*) (_args++)->p; }
+	const PRIORITY_VECTOR* PriorityVector() { return (const PRIORITY_VECTOR*) (_args++)->p; }
+	const TIMES*           Times()          { return (const TIMES*) (_args++)->p; }
+};
+#endif
+
+// ============================================================================
+// Text log
+
 void STP_FlushLog (STP_BRIDGE* bridge)
 {
+#if STP_USE_BINARY_LOG
+	// Nothing to do; the records stay in the ring buffer until the application asks for them.
+#else
 	assert (bridge->logBufferUsedSize < bridge->logBufferMaxSize);
 
 	bridge->logBuffer [bridge->logBufferUsedSize] = 0;
 	bridge->callbacks.debugStrOut (bridge, bridge->logCurrentPort, bridge->logCurrentTree, bridge->logBuffer, bridge->logBufferUsedSize, true);
 	bridge->logBufferUsedSize = 0;
+#endif
 }
 
+#if !STP_USE_BINARY_LOG
 static void WriteChar (STP_BRIDGE* bridge, int port, int tree, char c)
 {
 	// We're supposed to have enough space for the character and for a null-terminator,
@@ -97,6 +326,19 @@ static void WriteChar (STP_BRIDGE* bridge, int port, int tree, char c)
 	}
 }
 
+class BRIDGE_LOG_WRITER
+{
+	STP_BRIDGE* _bridge;
+	int _port;
+	int _tree;
+
+public:
+	BRIDGE_LOG_WRITER (STP_BRIDGE* bridge, int port, int tree) : _bridge(bridge), _port(port), _tree(tree) { }
+
+	void Put (char c) { WriteChar (_bridge, _port, _tree, c); }
+};
+#endif
+
 void STP_Indent (STP_BRIDGE* bridge)
 {
 	// This is supposed to be called only at the start of the line.
@@ -116,165 +358,591 @@ void STP_Unindent (STP_BRIDGE* bridge)
 	bridge->logIndent -= STP_BRIDGE::LogIndentSize;
 }
 
-void STP_Log (STP_BRIDGE* bridge, int port, int tree, const char* format, ...)
+// ============================================================================
+// Binary log
+//
+// Each call to STP_Log appends one record to the ring buffer (logBuffer), overwriting the oldest records when full.
+// All multi-byte integers are little-endian, so that a snapshot taken on a device can be decoded on a PC.
+//
+// Record: u16 size (including this header), u16 format index, i16 port, i8 tree, u8 indent, then the arguments:
+//  - {D} {X} {T} {TN}: i32
+//  - {S}: u8 length, the characters (at most BinaryLogMaxStringLength), a null terminator
+//  - {BA}: 6 bytes; {BID}, {PID}, {PVS}: the structure as it is in memory (all its members are big-endian already)
+//  - {TMS}: u16 ForwardDelay, HelloTime, MaxAge, MessageAge, u8 remainingHops
+// A call whose arguments may not fit in a record is formatted right away, and its text logged in "{S}" records.
+//
+// Snapshot: "STPL", u16 version, u16 format count, then for each format u16 index, u16 length (including the null
+// terminator) and the characters, then u32 size of the records and the records, oldest first.
+
+static const unsigned int BinaryLogRecordHeaderSize = 8;
+static const unsigned int BinaryLogMaxStringLength = 63;
+static const unsigned int BinaryLogMaxRecordSize = 512;
+static const unsigned short BinaryLogVersion = 1;
+
+static unsigned int GetU16 (const unsigned char* p)
 {
-	char _buffer [10];
+	return p[0] | (p[1] << 8);
+}
 
-    va_list ap;
-    va_start (ap, format);
+static unsigned int GetU32 (const unsigned char* p)
+{
+	return GetU16 (p) | (GetU16 (p + 2) << 16);
+}
 
-	while (*format != 0)
+// Reads the arguments stored in a binary log record.
+class RECORD_ARG_READER
+{
+	const unsigned char* _p;
+	const unsigned char* _end;
+	bool _error;
+
+	// Records aren't aligned in memory, so we copy the structures here before returning pointers to them.
+	union
 	{
-		if (strncmp (format, "{BID}", 5) == 0)
-		{
-			const BRIDGE_ID* bid = va_arg (ap, BRIDGE_ID*);
-			STP_Log (bridge, port, tree, "{X4}.{BA}", bid->GetPriorityAndMstid(), &bid->GetAddress());
-			format += 5;
-		}
-		else if (strncmp (format, "{PID}", 5) == 0)
+		void* _alignPointer;
+		double _alignDouble;
+		unsigned char _object [sizeof(PRIORITY_VECTOR)];
+	};
+
+	TIMES _times;
+
+	const unsigned char* Take (unsigned int size)
+	{
+		static const unsigned char zeroes [sizeof(PRIORITY_VECTOR)] = { 0 };
+		if (_error || ((unsigned int) (_end - _p) < size))
 		{
-			const PORT_ID* pid = va_arg (ap, PORT_ID*);
-			if (pid->IsInitialized ())
-			{
-				unsigned short id = pid->GetPortIdentifier ();
-				STP_Log (bridge, port, tree, "{X4}", (int) id);
-			}
-			else
-				STP_Log (bridge, port, tree, "(undefined)");
-			format += 5;
+			_error = true;
+			return zeroes;
 		}
-		else if (strncmp (format, "{BA}", 4) == 0)
+
+		const unsigned char* p = _p;
+		_p += size;
+		return p;
+	}
+
+	template<typename T>
+	const T* Object()
+	{
+		memcpy (_object, Take (sizeof(T)), sizeof(T));
+		return (const T*) _object;
+	}
+
+public:
+	RECORD_ARG_READER (const unsigned char* p, const unsigned char* end) : _p(p), _end(end), _error(false) { }
+
+	bool Error() const { return _error; }
+
+	int                    Int()            { return (int) GetU32 (Take (4)); }
+	const unsigned char*   Address()        { return Take (6); }
+	const BRIDGE_ID*       BridgeId()       { return Object<BRIDGE_ID>(); }
+	const PORT_ID*         PortId()         { return Object<PORT_ID>(); }
+	const PRIORITY_VECTOR* PriorityVector() { return Object<PRIORITY_VECTOR>(); }
+
+	const char* String()
+	{
+		unsigned int length = *Take (1);
+		const char* str = (const char*) Take (length + 1);
+		if (_error || (str [length] != 0))
 		{
-			const unsigned char* a = va_arg (ap, unsigned char*);
-			STP_Log (bridge, port, tree, "{X2}{X2}{X2}{X2}{X2}{X2}", a[0], a[1], a[2], a[3], a[4], a[5]);
-			format += 4;
+			_error = true;
+			return "";
 		}
-		else if (strncmp (format, "{PVS}", 5) == 0)
+
+		return str;
+	}
+
+	const TIMES* Times()
+	{
+		const unsigned char* p = Take (9);
+		_times.ForwardDelay  = (unsigned short) GetU16 (p);
+		_times.HelloTime     = (unsigned short) GetU16 (p + 2);
+		_times.MaxAge        = (unsigned short) GetU16 (p + 4);
+		_times.MessageAge    = (unsigned short) GetU16 (p + 6);
+		_times.remainingHops = p[8];
+		return &_times;
+	}
+};
+
+#if STP_USE_BINARY_LOG
+
+static void PutU16 (unsigned char* p, unsigned int value)
+{
+	p[0] = (unsigned char) value;
+	p[1] = (unsigned char) (value >> 8);
+}
+
+static void PutU32 (unsigned char* p, unsigned int value)
+{
+	PutU16 (p, value & 0xFFFF);
+	PutU16 (p + 2, value >> 16);
+}
+
+// The most bytes an argument can take in a record.
+static unsigned int MaxRecordArgSize (LOG_DIRECTIVE directive)
+{
+	switch (directive)
+	{
+		case LOG_DIRECTIVE_STRING:          return 2 + BinaryLogMaxStringLength;
+		case LOG_DIRECTIVE_ADDRESS:         return 6;
+		case LOG_DIRECTIVE_BRIDGE_ID:       return sizeof(BRIDGE_ID);
+		case LOG_DIRECTIVE_PORT_ID:         return sizeof(PORT_ID);
+		case LOG_DIRECTIVE_PRIORITY_VECTOR: return sizeof(PRIORITY_VECTOR);
+		case LOG_DIRECTIVE_TIMES:           return 9;
+		default:                            return 4;
+	}
+}
+
+// Returns the entry for the format, adding it if it's not there yet; returns NULL if the table is full.
+static const STP_BRIDGE::LOG_FORMAT* GetLogFormat (STP_BRIDGE* bridge, const char* format, unsigned int* indexOut)
+{
+	unsigned int index = ((unsigned int) ((size_t) format >> 2) * 2654435761u) >> 24;
+	for (unsigned int probe = 0; probe < STP_BRIDGE::LogFormatTableSize; probe++, index = (index + 1) % STP_BRIDGE::LogFormatTableSize)
+	{
+		STP_BRIDGE::LOG_FORMAT* entry = &bridge->logFormats [index];
+		if (entry->format == format)
 		{
-			const PRIORITY_VECTOR* pv = va_arg (ap, PRIORITY_VECTOR*);
-			STP_Log (bridge, port, tree, "{BID}-{D7}-{BID}-{D7}-{BID}-{PID}",
-					 &pv->RootId,
-					 (int) pv->ExternalRootPathCost,
-					 &pv->RegionalRootId,
-					 (int) pv->InternalRootPathCost,
-					 &pv->DesignatedBridgeId,
-					 &pv->DesignatedPortId);
-			format += 5;
+			*indexOut = index;
+			return entry;
 		}
-		else if (strncmp (format, "{S", 2) == 0)
+
+		if (entry->format == NULL)
 		{
-			format += 2;
-			size_t size = 0;
-			while (true)
+			// First time we see this format. Parse it once, so that STP_Log only has to walk the argument kinds.
+			unsigned int argCount = 0;
+			unsigned int maxRecordSize = BinaryLogRecordHeaderSize;
+			for (const char* f = format; *f != 0; )
 			{
-				char ch = *format;
-				if ((ch < '0') || (ch > '9'))
+				int width;
+				LOG_DIRECTIVE directive = ParseDirective (f, width);
+				if (directive == LOG_DIRECTIVE_NONE)
+				{
+					f++;
+					continue;
+				}
+
+				maxRecordSize += MaxRecordArgSize (directive);
+				if ((argCount == sizeof(entry->args) - 1) || (maxRecordSize > BinaryLogMaxRecordSize))
+				{
+					// The arguments may not fit in a record; the calls with this format will be logged as text.
+					entry->text = true;
 					break;
+				}
 
-				size = 10 * size + ch - '0';
-				format++;
+				entry->args [argCount++] = (unsigned char) directive;
 			}
 
-			assert (*format == '}');
-			format++;
+			entry->args [argCount] = LOG_DIRECTIVE_NONE;
+			size_t length = strlen (format);
+			entry->endsLine = (length > 0) && (format [length - 1] == '\n');
+			entry->format = format;
+			*indexOut = index;
+			return entry;
+		}
+	}
 
-			const char* str = va_arg (ap, const char*);
-			size_t strLen = strlen (str);
+	return NULL;
+}
 
-			size_t paddingSize = (strLen >= size) ? 0 : (size - strLen);
-			for (size_t i = 0; i < paddingSize; i++)
-				WriteChar (bridge, port, tree, ' ');
+static void WriteToRing (STP_BRIDGE* bridge, const unsigned char* record, unsigned int size)
+{
+	if (size > bridge->logBufferMaxSize)
+		return;
 
-			STP_Log (bridge, port, tree, str);
-		}
-		else if (strncmp (format, "{T}", 3) == 0)
-		{
-			unsigned int v = va_arg (ap, unsigned int);
-			STP_Log (bridge, port, tree, "{D}.{D3}", (int) (v / 1000), (int) (v % 1000));
-			format += 3;
-		}
-		/*
-		else if (strncmp (format, "{I}", 3) == 0)
-		{
-			int i = va_arg (ap, int);
-			while (i--)
-				WriteChar (bridge, port, tree, ' ');
+	// Drop the oldest records until the new one fits.
+	while (bridge->logBufferUsedSize + size > bridge->logBufferMaxSize)
+	{
+		unsigned char oldSize [2];
+		oldSize[0] = bridge->logBuffer [bridge->logRingStart];
+		oldSize[1] = bridge->logBuffer [(bridge->logRingStart + 1) % bridge->logBufferMaxSize];
+		unsigned int oldRecordSize = GetU16 (oldSize);
+		bridge->logRingStart = (bridge->logRingStart + oldRecordSize) % bridge->logBufferMaxSize;
+		bridge->logBufferUsedSize -= oldRecordSize;
+	}
 
-			format += 3;
-		}
-		*/
-		else if (strncmp (format, "{TN}", 4) == 0)
-		{
-			int i = va_arg (ap, int);
-			if (i == 0)
-				STP_Log (bridge, port, tree, "CIST");
-			else
-				STP_Log (bridge, port, tree, "MST{D}", i);
+	unsigned int offset = (bridge->logRingStart + bridge->logBufferUsedSize) % bridge->logBufferMaxSize;
+	unsigned int firstPart = bridge->logBufferMaxSize - offset;
+	if (firstPart >= size)
+		memcpy (bridge->logBuffer + offset, record, size);
+	else
+	{
+		memcpy (bridge->logBuffer + offset, record, firstPart);
+		memcpy (bridge->logBuffer, record + firstPart, size - firstPart);
+	}
 
-			format += 4;
-		}
-		else if (strncmp (format, "{TMS}", 5) == 0)
-		{
-			const TIMES* times = va_arg (ap, TIMES*);
-			STP_Log (bridge, port, tree, "MessageAge={D}, MaxAge={D}, HelloTime={D}, FwDelay={D}, remainingHops={D}",
-					  times->MessageAge, times->MaxAge, times->HelloTime, times->ForwardDelay, times->remainingHops);
-			format += 5;
-		}
-		else if (strncmp (format, "{D", 2) == 0)
+	bridge->logBufferUsedSize += size;
+}
+
+// Logs the text of a call whose format has more directives than LOG_FORMAT::args can hold,
+// in records with a single string argument each.
+class TEXT_RECORD_WRITER
+{
+	STP_BRIDGE* _bridge;
+	int _port;
+	int _tree;
+	char _text [BinaryLogMaxStringLength + 1];
+	unsigned int _size;
+
+public:
+	static const char RecordFormat[];
+
+	TEXT_RECORD_WRITER (STP_BRIDGE* bridge, int port, int tree) : _bridge(bridge), _port(port), _tree(tree), _size(0) { }
+
+	void Put (char c)
+	{
+		_text [_size++] = c;
+		if (_size == BinaryLogMaxStringLength)
+			Flush();
+	}
+
+	void Flush()
+	{
+		if (_size == 0)
+			return;
+
+		_text [_size] = 0;
+		STP_Log (_bridge, _port, _tree, RecordFormat, _text);
+		_size = 0;
+	}
+};
+
+const char TEXT_RECORD_WRITER::RecordFormat[] = "{S}";
+
+template<typename ArgReader>
+static void WriteRecord (STP_BRIDGE* bridge, int port, int tree, const char* format, ArgReader& args)
+{
+	unsigned int formatIndex;
+	const STP_BRIDGE::LOG_FORMAT* entry = GetLogFormat (bridge, format, &formatIndex);
+	assert (entry != NULL); // increase LogFormatTableSize
+	if (entry == NULL)
+		return;
+
+	if (entry->text)
+	{
+		TEXT_RECORD_WRITER writer (bridge, port, tree);
+		Format (writer, format, args);
+		writer.Flush();
+		bridge->logLineStarting = entry->endsLine;
+		return;
+	}
+
+	unsigned char record [BinaryLogMaxRecordSize];
+	PutU16 (&record[2], formatIndex);
+	PutU16 (&record[4], (unsigned int) port);
+	record[6] = (unsigned char) tree;
+	record[7] = (unsigned char) bridge->logIndent;
+	unsigned int size = BinaryLogRecordHeaderSize;
+
+	for (const unsigned char* arg = entry->args; *arg != LOG_DIRECTIVE_NONE; arg++)
+	{
+		switch ((LOG_DIRECTIVE) *arg)
 		{
-			format += 2;
-			int size;
-			if (*format >= '0' && *format <= '9')
+			case LOG_DIRECTIVE_DECIMAL:
+			case LOG_DIRECTIVE_HEX:
+			case LOG_DIRECTIVE_TIMESTAMP:
+			case LOG_DIRECTIVE_TREE_NAME:
+				PutU32 (&record[size], (unsigned int) args.Int());
+				size += 4;
+				break;
+
+			case LOG_DIRECTIVE_STRING:
 			{
-				size = *format - '0';
-				format++;
+				const char* str = args.String();
+				size_t length = strlen (str);
+				if (length > BinaryLogMaxStringLength)
+					length = BinaryLogMaxStringLength;
+				record[size] = (unsigned char) length;
+				memcpy (&record[size + 1], str, length);
+				record[size + 1 + length] = 0;
+				size += 2 + (unsigned int) length;
+				break;
 			}
-			else
-				size = 0;
 
-			assert (*format == '}');
-			format++;
+			case LOG_DIRECTIVE_ADDRESS:
+				memcpy (&record[size], args.Address(), 6);
+				size += 6;
+				break;
 
-			int v = va_arg (ap, int);
+			case LOG_DIRECTIVE_BRIDGE_ID:
+				memcpy (&record[size], args.BridgeId(), sizeof(BRIDGE_ID));
+				size += sizeof(BRIDGE_ID);
+				break;
 
-			snprintf (_buffer, sizeof (_buffer), "%0*d", size, v);
+			case LOG_DIRECTIVE_PORT_ID:
+				memcpy (&record[size], args.PortId(), sizeof(PORT_ID));
+				size += sizeof(PORT_ID);
+				break;
 
-			for (unsigned int i = 0; i < sizeof (_buffer) && _buffer [i] != 0; i++)
-				WriteChar (bridge, port, tree, _buffer [i]);
-		}
-		else if (strncmp (format, "{X", 2) == 0)
-		{
-			format += 2;
-			int size;
-			if (*format >= '0' && *format <= '9')
+			case LOG_DIRECTIVE_PRIORITY_VECTOR:
+				memcpy (&record[size], args.PriorityVector(), sizeof(PRIORITY_VECTOR));
+				size += sizeof(PRIORITY_VECTOR);
+				break;
+
+			case LOG_DIRECTIVE_TIMES:
 			{
-				size = *format - '0';
-				format++;
+				const TIMES* times = args.Times();
+				PutU16 (&record[size],     times->ForwardDelay);
+				PutU16 (&record[size + 2], times->HelloTime);
+				PutU16 (&record[size + 4], times->MaxAge);
+				PutU16 (&record[size + 6], times->MessageAge);
+				record[size + 8] = times->remainingHops;
+				size += 9;
+				break;
 			}
-			else
-				size = 0;
 
-			assert (*format == '}');
-			format++;
+			default:
+				assert (false);
+		}
+	}
 
-			int v = va_arg (ap, int);
+	assert (size <= BinaryLogMaxRecordSize);
+	PutU16 (&record[0], size);
+	WriteToRing (bridge, record, size);
 
-			snprintf (_buffer, sizeof (_buffer), "%0*x", size, v);
+	bridge->logLineStarting = entry->endsLine;
+}
 
-			for (unsigned int i = 0; i < sizeof (_buffer) && _buffer [i] != 0; i++)
-				WriteChar (bridge, port, tree, _buffer [i]);
-		}
-		else if (*format == '{')
+void STP_Log (STP_BRIDGE* bridge, int port, int tree, const char* format, ...)
+{
+	va_list ap;
+	va_start (ap, format);
+
+	VA_ARG_READER args (&ap);
+	WriteRecord (bridge, port, tree, format, args);
+
+	va_end (ap);
+}
+
+#if STP_USE_TOKENIZED_LOG
+void STP_LogTokenized (STP_BRIDGE* bridge, int port, int tree, const char* format, const LOG_ARG* args)
+{
+	// The record format doesn't depend on how the arguments were passed, so only the argument reader differs from STP_Log.
+	ARRAY_ARG_READER reader (args);
+	WriteRecord (bridge, port, tree, format, reader);
+}
+#endif
+
+#else
+
+void STP_Log (STP_BRIDGE* bridge, int port, int tree, const char* format, ...)
+{
+	va_list ap;
+	va_start (ap, format);
+
+	BRIDGE_LOG_WRITER writer (bridge, port, tree);
+	VA_ARG_READER args (&ap);
+	Format (writer, format, args);
+
+	va_end (ap);
+}
+
+#if STP_USE_TOKENIZED_LOG
+void STP_LogTokenized (STP_BRIDGE* bridge, int port, int tree, const char* format, const LOG_TOKEN* tokens, unsigned int tokenCount, const LOG_ARG* args)
+{
+	// The compiler already split the format into tokens and checked the arguments against them.
+	BRIDGE_LOG_WRITER writer (bridge, port, tree);
+	ARRAY_ARG_READER reader (args);
+	for (unsigned int i = 0; i < tokenCount; i++)
+	{
+		const LOG_TOKEN& token = tokens[i];
+		if (token.directive == LOG_DIRECTIVE_NONE)
 		{
-			assert (false); // not implemented
+			for (unsigned int c = 0; c < token.length; c++)
+				writer.Put (format [token.offset + c]);
 		}
 		else
+			WriteDirective (writer, (LOG_DIRECTIVE) token.directive, token.width, reader);
+	}
+}
+#endif
+
+#endif
+
+// ============================================================================
+
+// Splits the decoded text into lines and indents them, same as WriteChar does for the text log.
+class DECODED_TEXT_WRITER
+{
+	STP_BINARY_LOG_TEXT_OUT _textOut;
+	void* _context;
+	char _line [256];
+	unsigned int _lineSize;
+	bool _lineStarting;
+	int _linePort;
+	int _lineTree;
+
+	void Output()
+	{
+		_line [_lineSize] = 0;
+		_textOut (_context, _linePort, _lineTree, _line, _lineSize);
+		_lineSize = 0;
+	}
+
+	void Append (char c)
+	{
+		_line [_lineSize++] = c;
+		if (_lineSize == sizeof (_line) - 1)
+			Output();
+	}
+
+public:
+	int port;
+	int tree;
+	unsigned int indent;
+
+	DECODED_TEXT_WRITER (STP_BINARY_LOG_TEXT_OUT textOut, void* context)
+		: _textOut(textOut), _context(context), _lineSize(0), _lineStarting(true), _linePort(-1), _lineTree(-1)
+	{ }
+
+	void Put (char c)
+	{
+		if (_lineStarting && (c != '\n'))
 		{
-			WriteChar (bridge, port, tree, *format);
-			format++;
+			_linePort = port;
+			_lineTree = tree;
+			_lineStarting = false;
+			for (unsigned int i = 0; i < indent; i++)
+				Append (' ');
+		}
+
+		Append (c);
+
+		if (c == '\n')
+		{
+			if (_lineSize > 0)
+				Output();
+			_lineStarting = true;
 		}
 	}
 
-	va_end (ap);
+	void Finish()
+	{
+		if (_lineSize > 0)
+			Output();
+	}
+};
+
+#endif // STP_USE_LOG
+
+// ============================================================================
+
+unsigned int STP_GetBinaryLog (const STP_BRIDGE* bridge, void* buffer, unsigned int bufferSize)
+{
+#if STP_USE_LOG && STP_USE_BINARY_LOG
+	unsigned int requiredSize = 4 + 2 + 2;
+	unsigned int formatCount = 0;
+	for (unsigned int i = 0; i < STP_BRIDGE::LogFormatTableSize; i++)
+	{
+		if (bridge->logFormats[i].format != NULL)
+		{
+			requiredSize += 4 + (unsigned int) strlen (bridge->logFormats[i].format) + 1;
+			formatCount++;
+		}
+	}
+
+	requiredSize += 4 + bridge->logBufferUsedSize;
+
+	if ((buffer == NULL) || (bufferSize < requiredSize))
+		return requiredSize;
+
+	unsigned char* p = (unsigned char*) buffer;
+	memcpy (p, "STPL", 4);
+	PutU16 (p + 4, BinaryLogVersion);
+	PutU16 (p + 6, formatCount);
+	p += 8;
+
+	for (unsigned int i = 0; i < STP_BRIDGE::LogFormatTableSize; i++)
+	{
+		const char* format = bridge->logFormats[i].format;
+		if (format != NULL)
+		{
+			unsigned int length = (unsigned int) strlen (format) + 1;
+			PutU16 (p, i);
+			PutU16 (p + 2, length);
+			memcpy (p + 4, format, length);
+			p += 4 + length;
+		}
+	}
+
+	PutU32 (p, bridge->logBufferUsedSize);
+	p += 4;
+	unsigned int firstPart = bridge->logBufferMaxSize - bridge->logRingStart;
+	if (firstPart >= bridge->logBufferUsedSize)
+		memcpy (p, bridge->logBuffer + bridge->logRingStart, bridge->logBufferUsedSize);
+	else
+	{
+		memcpy (p, bridge->logBuffer + bridge->logRingStart, firstPart);
+		memcpy (p + firstPart, bridge->logBuffer, bridge->logBufferUsedSize - firstPart);
+	}
+
+	return requiredSize;
+#else
+	return 0;
+#endif
 }
+
+// ============================================================================
+
+bool STP_DecodeBinaryLog (const void* binaryLog, unsigned int binaryLogSize, STP_BINARY_LOG_TEXT_OUT textOut, void* context)
+{
+#if STP_USE_LOG
+	const unsigned char* p = (const unsigned char*) binaryLog;
+	const unsigned char* end = p + binaryLogSize;
+
+	if ((binaryLogSize < 8) || (memcmp (p, "STPL", 4) != 0) || (GetU16 (p + 4) != BinaryLogVersion))
+		return false;
+
+	const char* formats [256];
+	for (unsigned int i = 0; i < 256; i++)
+		formats[i] = NULL;
+
+	unsigned int formatCount = GetU16 (p + 6);
+	p += 8;
+	for (unsigned int i = 0; i < formatCount; i++)
+	{
+		if (end - p < 4)
+			return false;
+
+		unsigned int index = GetU16 (p);
+		unsigned int length = GetU16 (p + 2);
+		if ((index >= 256) || (length == 0) || ((unsigned int) (end - p - 4) < length) || (p [4 + length - 1] != 0))
+			return false;
+
+		formats[index] = (const char*) (p + 4);
+		p += 4 + length;
+	}
+
+	if ((end - p < 4) || ((unsigned int) (end - p - 4) < GetU32 (p)))
+		return false;
+
+	end = p + 4 + GetU32 (p);
+	p += 4;
+
+	DECODED_TEXT_WRITER writer (textOut, context);
+	while (p < end)
+	{
+		if (end - p < (int) BinaryLogRecordHeaderSize)
+			return false;
+
+		unsigned int size = GetU16 (p);
+		unsigned int formatIndex = GetU16 (p + 2);
+		if ((size < BinaryLogRecordHeaderSize) || ((unsigned int) (end - p) < size) || (formatIndex >= 256) || (formats [formatIndex] == NULL))
+			return false;
+
+		writer.port = (short) GetU16 (p + 4);
+		writer.tree = (signed char) p[6];
+		writer.indent = p[7];
+
+		RECORD_ARG_READER args (p + BinaryLogRecordHeaderSize, p + size);
+		Format (writer, formats [formatIndex], args);
+		if (args.Error())
+			return false;
+
+		p += size;
+	}
+
+	writer.Finish();
+	return true;
+#else
+	return false;
 #endif
+}
@@ -10,17 +10,301 @@
 #if STP_USE_LOG
 	struct STP_BRIDGE;
 
+	// Directives that can appear in the format strings passed to LOG.
+	enum LOG_DIRECTIVE
+	{
+		LOG_DIRECTIVE_NONE,
+		LOG_DIRECTIVE_BRIDGE_ID,       // {BID} - const BRIDGE_ID*
+		LOG_DIRECTIVE_PORT_ID,         // {PID} - const PORT_ID*
+		LOG_DIRECTIVE_ADDRESS,         // {BA} - const unsigned char*, six bytes
+		LOG_DIRECTIVE_PRIORITY_VECTOR, // {PVS} - const PRIORITY_VECTOR*
+		LOG_DIRECTIVE_STRING,          // {S} or {Sn} - const char*, right-aligned on n chars
+		LOG_DIRECTIVE_TIMESTAMP,       // {T} - integer
+		LOG_DIRECTIVE_TREE_NAME,       // {TN} - integer
+		LOG_DIRECTIVE_TIMES,           // {TMS} - const TIMES*
+		LOG_DIRECTIVE_DECIMAL,         // {D} or {Dn} - integer, zero-padded to n digits
+		LOG_DIRECTIVE_HEX,             // {X} or {Xn} - integer, zero-padded to n digits
+		LOG_DIRECTIVE_INVALID,
+	};
+
 	void STP_Log (STP_BRIDGE* bridge, int port, int tree, const char* format, ...);
 	void STP_FlushLog (STP_BRIDGE* bridge);
 	void STP_Indent (STP_BRIDGE* bridge);
 	void STP_Unindent (STP_BRIDGE* bridge);
 
-	#define LOG(b,p,t,...)		((void) ( !(b)->loggingEnabled || (STP_Log(b,p,t,__VA_ARGS__), 0)))
+	// LOG is for the calls into the library, LOG_TRANSITION for state machine transitions (sm is an STP_LOG_STATE_MACHINE bit),
+	// LOG_DETAILS for everything else. All pieces of a line must use the same macro with the same port and tree,
+	// so that the filter set with STP_SetLogFilter keeps or drops whole lines.
+	#define LOG(b,p,t,...)				LOG_FILTERED(b,p,t,STP_LOG_LEVEL_EVENTS,0,__VA_ARGS__)
+	#define LOG_TRANSITION(b,p,t,sm,...)	LOG_FILTERED(b,p,t,STP_LOG_LEVEL_TRANSITIONS,sm,__VA_ARGS__)
+	#define LOG_DETAILS(b,p,t,...)		LOG_FILTERED(b,p,t,STP_LOG_LEVEL_DETAILS,0,__VA_ARGS__)
+	#define LOG_ENABLED(b,p,t,level,sm)	((b)->loggingEnabled && LogFilterPasses(b,p,t,level,sm))
+
 	#define FLUSH_LOG(b)		((void) ( !(b)->loggingEnabled || (STP_FlushLog(b), 0)))
 	#define LOG_INDENT(b)		((void) ( !(b)->loggingEnabled || (STP_Indent(b), 0)))
 	#define LOG_UNINDENT(b)		((void) ( !(b)->loggingEnabled || (STP_Unindent(b), 0)))
+
+	#if STP_USE_TOKENIZED_LOG
+		#include <type_traits>
+
+		struct BRIDGE_ID;
+		struct PORT_ID;
+		struct PRIORITY_VECTOR;
+		struct TIMES;
+
+		// One piece of a format string: either literal text or a directive.
+		struct LOG_TOKEN
+		{
+			unsigned char  directive; // LOG_DIRECTIVE_NONE for literal text
+			unsigned char  width;
+			unsigned short offset;    // of the text in the format string
+			unsigned short length;
+		};
+
+		// A format string split into its N tokens, computed by the compiler.
+		template<unsigned int N>
+		struct LOG_PROGRAM
+		{
+			LOG_TOKEN tokens [N];
+		};
+
+		// The arguments of a LOG call, in the order of the directives.
+		union LOG_ARG
+		{
+			int         i;
+			const void* p;
+		};
+
+		#if STP_USE_BINARY_LOG
+			// The binary log records the format and the arguments; it has no use for the tokens.
+			void STP_LogTokenized (STP_BRIDGE* bridge, int port, int tree, const char* format, const LOG_ARG* args);
+		#else
+			void STP_LogTokenized (STP_BRIDGE* bridge, int port, int tree, const char* format, const LOG_TOKEN* tokens, unsigned int tokenCount, const LOG_ARG* args);
+		#endif
+
+		// The functions below only run inside the compiler. They're written in the single-return-statement style of C++11 constexpr.
+		namespace LogFormat
+		{
+			constexpr bool StartsWith (const char* s, const char* prefix)
+			{
+				return (*prefix == 0) || ((*s == *prefix) && StartsWith (s + 1, prefix + 1));
+			}
+
+			constexpr unsigned int DigitCount (const char* s)
+			{
+				return ((*s >= '0') && (*s <= '9')) ? 1 + DigitCount (s + 1) : 0;
+			}
+
+			constexpr unsigned int Number (const char* s, unsigned int value)
+			{
+				return ((*s >= '0') && (*s <= '9')) ? Number (s + 1, 10 * value + (*s - '0')) : value;
+			}
+
+			// Offset of the '}' closing the directive that starts at s, or zero if there's none.
+			constexpr unsigned int ClosingBrace (const char* s, unsigned int offset)
+			{
+				return (s[offset] == 0) ? 0 : (s[offset] == '}') ? offset : ClosingBrace (s, offset + 1);
+			}
+
+			// Directives with a width are made of a letter, optional digits and the closing brace.
+			constexpr bool IsWidthDirective (const char* s, char letter)
+			{
+				return (s[1] == letter) && (s[2 + DigitCount (s + 2)] == '}') && (Number (s + 2, 0) <= 255);
+			}
+
+			// s points to a '{'.
+			constexpr LOG_DIRECTIVE DirectiveAt (const char* s)
+			{
+				return StartsWith (s, "{BID}") ? LOG_DIRECTIVE_BRIDGE_ID
+					: StartsWith (s, "{PID}") ? LOG_DIRECTIVE_PORT_ID
+					: StartsWith (s, "{BA}")  ? LOG_DIRECTIVE_ADDRESS
+					: StartsWith (s, "{PVS}") ? LOG_DIRECTIVE_PRIORITY_VECTOR
+					: StartsWith (s, "{T}")   ? LOG_DIRECTIVE_TIMESTAMP
+					: StartsWith (s, "{TN}")  ? LOG_DIRECTIVE_TREE_NAME
+					: StartsWith (s, "{TMS}") ? LOG_DIRECTIVE_TIMES
+					: IsWidthDirective (s, 'S') ? LOG_DIRECTIVE_STRING
+					: IsWidthDirective (s, 'D') ? LOG_DIRECTIVE_DECIMAL
+					: IsWidthDirective (s, 'X') ? LOG_DIRECTIVE_HEX
+					: LOG_DIRECTIVE_INVALID;
+			}
+
+			constexpr unsigned int TextLength (const char* s)
+			{
+				return ((*s == 0) || (*s == '{')) ? 0 : 1 + TextLength (s + 1);
+			}
+
+			constexpr unsigned int TokenLength (const char* s)
+			{
+				return (*s != '{') ? TextLength (s) : (ClosingBrace (s, 0) != 0) ? ClosingBrace (s, 0) + 1 : 1;
+			}
+
+			constexpr LOG_DIRECTIVE TokenDirective (const char* s)
+			{
+				return (*s != '{') ? LOG_DIRECTIVE_NONE : DirectiveAt (s);
+			}
+
+			constexpr unsigned int TokenCount (const char* s)
+			{
+				return (*s == 0) ? 0 : 1 + TokenCount (s + TokenLength (s));
+			}
+
+			constexpr bool IsValid (const char* s)
+			{
+				return (*s == 0) || ((TokenDirective (s) != LOG_DIRECTIVE_INVALID) && IsValid (s + TokenLength (s)));
+			}
+
+			constexpr unsigned int TokenOffset (const char* format, unsigned int index, unsigned int offset)
+			{
+				return ((index == 0) || (format[offset] == 0)) ? offset : TokenOffset (format, index - 1, offset + TokenLength (format + offset));
+			}
+
+			constexpr LOG_TOKEN MakeToken (const char* format, unsigned int offset)
+			{
+				return LOG_TOKEN {
+					(unsigned char) TokenDirective (format + offset),
+					(unsigned char) ((format[offset] == '{') ? Number (format + offset + 2, 0) : 0),
+					(unsigned short) offset,
+					(unsigned short) TokenLength (format + offset) };
+			}
+
+			template<unsigned int... Indexes> struct INDEX_LIST { };
+			template<unsigned int N, unsigned int... Indexes> struct MAKE_INDEX_LIST : MAKE_INDEX_LIST<N - 1, N - 1, Indexes...> { };
+			template<unsigned int... Indexes> struct MAKE_INDEX_LIST<0, Indexes...> { typedef INDEX_LIST<Indexes...> type; };
+
+			template<unsigned int N, unsigned int... Indexes>
+			constexpr LOG_PROGRAM<N> Compile (const char* format, INDEX_LIST<Indexes...>)
+			{
+				return LOG_PROGRAM<N> { { MakeToken (format, TokenOffset (format, Indexes, 0))... } };
+			}
+
+			// N is TokenCount(format), and the format must not be empty.
+			template<unsigned int N>
+			constexpr LOG_PROGRAM<N> Compile (const char* format)
+			{
+				return Compile<N> (format, typename MAKE_INDEX_LIST<N>::type());
+			}
+
+			// ----------------------------------------------------------------
+			// Argument checking
+
+			template<typename T, typename Pointee>
+			struct IS_POINTER_TO
+			{
+				typedef typename std::decay<T>::type D;
+				static const bool value = std::is_pointer<D>::value
+					&& std::is_same<typename std::remove_cv<typename std::remove_pointer<D>::type>::type, Pointee>::value;
+			};
+
+			template<typename T>
+			struct IS_INT
+			{
+				typedef typename std::decay<T>::type D;
+				static const bool value = (std::is_integral<D>::value || std::is_enum<D>::value) && (sizeof(D) <= sizeof(int));
+			};
+
+			template<typename T>
+			constexpr bool ArgMatches (LOG_DIRECTIVE directive)
+			{
+				return (directive == LOG_DIRECTIVE_BRIDGE_ID)       ? IS_POINTER_TO<T, BRIDGE_ID>::value
+					: (directive == LOG_DIRECTIVE_PORT_ID)         ? IS_POINTER_TO<T, PORT_ID>::value
+					: (directive == LOG_DIRECTIVE_ADDRESS)         ? IS_POINTER_TO<T, unsigned char>::value
+					: (directive == LOG_DIRECTIVE_PRIORITY_VECTOR) ? IS_POINTER_TO<T, PRIORITY_VECTOR>::value
+					: (directive == LOG_DIRECTIVE_STRING)          ? IS_POINTER_TO<T, char>::value
+					: (directive == LOG_DIRECTIVE_TIMES)           ? IS_POINTER_TO<T, TIMES>::value
+					: IS_INT<T>::value;
+			}
+
+			// Offset of the first directive at or after offset, or of the terminating null character if there's none.
+			constexpr unsigned int NextDirective (const char* format, unsigned int offset)
+			{
+				return ((format[offset] == 0) || (format[offset] == '{')) ? offset : NextDirective (format, offset + 1);
+			}
+
+			template<typename... Args> struct ARG_TYPES { };
+
+			template<typename... Args>
+			ARG_TYPES<Args...> GetArgTypes (const char* format, const Args&... args);
+
+			constexpr bool ArgsMatch (const char* format, unsigned int offset, ARG_TYPES<>)
+			{
+				return format [NextDirective (format, offset)] == 0;
+			}
+
+			template<typename Arg, typename... Args>
+			constexpr bool ArgsMatch (const char* format, unsigned int offset, ARG_TYPES<Arg, Args...>)
+			{
+				return (format [NextDirective (format, offset)] != 0)
+					&& ArgMatches<Arg> (DirectiveAt (format + NextDirective (format, offset)))
+					&& ArgsMatch (format, NextDirective (format, offset) + TokenLength (format + NextDirective (format, offset)), ARG_TYPES<Args...>());
+			}
+
+			inline LOG_ARG MakeArg (int value)
+			{
+				LOG_ARG arg;
+				arg.i = value;
+				return arg;
+			}
+
+			inline LOG_ARG MakeArg (const void* value)
+			{
+				LOG_ARG arg;
+				arg.p = value;
+				return arg;
+			}
+
+		#if STP_USE_BINARY_LOG
+			template<typename... Args>
+			inline void Log (STP_BRIDGE* bridge, int port, int tree, const char* format, const Args&... args)
+			{
+				// The last element is there only so that the array isn't empty when there are no arguments.
+				const LOG_ARG values [] = { MakeArg (args)..., MakeArg (0) };
+				STP_LogTokenized (bridge, port, tree, format, values);
+			}
+		#else
+			template<unsigned int N, typename... Args>
+			inline void Log (STP_BRIDGE* bridge, int port, int tree, const LOG_PROGRAM<N>& program, const char* format, const Args&... args)
+			{
+				// The last element is there only so that the array isn't empty when there are no arguments.
+				const LOG_ARG values [] = { MakeArg (args)..., MakeArg (0) };
+				STP_LogTokenized (bridge, port, tree, format, program.tokens, N, values);
+			}
+		#endif
+		}
+
+		#define STP_LOG_EXPAND(x) x
+		#define STP_LOG_FORMAT(format, ...) format
+
+		// Each LOG call site gets its own program, sized to the tokens of its format.
+		#if STP_USE_BINARY_LOG
+			#define STP_LOG_TOKENIZED(b,p,t,...) LogFormat::Log (b, p, t, __VA_ARGS__)
+		#else
+			#define STP_LOG_TOKENIZED(b,p,t,...) \
+				do \
+				{ \
+					static constexpr LOG_PROGRAM<LogFormat::TokenCount (STP_LOG_EXPAND(STP_LOG_FORMAT(__VA_ARGS__, 0)))> logProgram \
+						= LogFormat::Compile<LogFormat::TokenCount (STP_LOG_EXPAND(STP_LOG_FORMAT(__VA_ARGS__, 0)))> (STP_LOG_EXPAND(STP_LOG_FORMAT(__VA_ARGS__, 0))); \
+					LogFormat::Log (b, p, t, logProgram, __VA_ARGS__); \
+				} while (0)
+		#endif
+
+		#define LOG_FILTERED(b,p,t,level,sm,...) \
+			do \
+			{ \
+				if (LOG_ENABLED(b,p,t,level,sm)) \
+				{ \
+					static_assert (LogFormat::IsValid (STP_LOG_EXPAND(STP_LOG_FORMAT(__VA_ARGS__, 0))), "Invalid directive in LOG format string."); \
+					static_assert (LogFormat::TokenCount (STP_LOG_EXPAND(STP_LOG_FORMAT(__VA_ARGS__, 0))) > 0, "Empty LOG format string."); \
+					static_assert (LogFormat::ArgsMatch (STP_LOG_EXPAND(STP_LOG_FORMAT(__VA_ARGS__, 0)), 0, decltype(LogFormat::GetArgTypes (__VA_ARGS__))()), "LOG arguments don't match the format string."); \
+					STP_LOG_TOKENIZED (b, p, t, __VA_ARGS__); \
+				} \
+			} while (0)
+	#else
+		#define LOG_FILTERED(b,p,t,level,sm,...)	((void) ( !LOG_ENABLED(b,p,t,level,sm) || (STP_Log(b,p,t,__VA_ARGS__), 0)))
+	#endif
 #else
 	#define LOG(b,p,t,...)		((void)0)
+	#define LOG_TRANSITION(b,p,t,sm,...)	((void)0)
+	#define LOG_DETAILS(b,p,t,...)	((void)0)
 	#define FLUSH_LOG(b)		((void)0)
 	#define LOG_INDENT(b)		((void)0)
 	#define LOG_UNINDENT(b)		((void)0)
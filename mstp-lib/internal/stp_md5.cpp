@@ -276,6 +276,42 @@ void HMAC_MD5_Update (HMAC_MD5_CONTEXT* context, const void* text, unsigned int
 	MD5Update (context, (const unsigned char*) text, text_len);
 }
 
+// Same as HMAC_MD5_Update with a buffer of "count" zero bytes. Whole 64-byte blocks of zeroes are transformed
+// directly, without going byte by byte through the input buffer; this is what makes hashing the unused
+// part of the MST Config Table cheap.
+void HMAC_MD5_UpdateZeroes (HMAC_MD5_CONTEXT* context, unsigned int count)
+{
+	static const unsigned char zeroes [64] = { 0 };
+
+	// Fill up the input buffer if it holds a partial block.
+	unsigned int mdi = (context->i[0] >> 3) & 0x3F;
+	if (mdi != 0)
+	{
+		unsigned int len = (count < 64 - mdi) ? count : (64 - mdi);
+		MD5Update (context, zeroes, len);
+		count -= len;
+	}
+
+	unsigned int blockBytes = count & ~0x3Fu;
+	if (blockBytes != 0)
+	{
+		/* update number of bits */
+		if ((context->i[0] + (blockBytes << 3)) < context->i[0])
+			context->i[1]++;
+		context->i[0] += (blockBytes << 3);
+		context->i[1] += (blockBytes >> 29);
+
+		unsigned int in[16];
+		memset (in, 0, sizeof in);
+		for (unsigned int i = 0; i < blockBytes / 64; i++)
+			Transform (context->buf, in);
+
+		count -= blockBytes;
+	}
+
+	MD5Update (context, zeroes, count);
+}
+
 void HMAC_MD5_End (HMAC_MD5_CONTEXT* context)
 {
 	// finish up 1st pass
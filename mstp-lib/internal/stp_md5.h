@@ -20,6 +20,7 @@ struct HMAC_MD5_CONTEXT : MD5_CTX
 
 void HMAC_MD5_Init (HMAC_MD5_CONTEXT* context);
 void HMAC_MD5_Update (HMAC_MD5_CONTEXT* context, const void* text, unsigned int text_len);
+void HMAC_MD5_UpdateZeroes (HMAC_MD5_CONTEXT* context, unsigned int count);
 void HMAC_MD5_End (HMAC_MD5_CONTEXT* context);
 
 #endif
@@ -155,7 +155,13 @@ struct PORT
 
 
 
-	PORT_TREE** trees;
+	CONTIGUOUS_ARRAY<PORT_TREE> trees;
+
+#if !STP_USE_FULL_SWEEP
+	unsigned int dirtyTrees[3]; // One bit per tree (the CIST and up to 64 MSTIs); see MarkPortTreeDirty in stp_bridge.h.
+	unsigned int timerTrees[3]; // One bit per tree that might have a non-zero timer on this port; see STP_BRIDGE::timerPorts.
+	unsigned int txStaleTrees[3]; // One bit per tree whose part of the BPDU cached in txFrame must be encoded again by txRstp.
+#endif
 
 	STP_ADMIN_P2P adminPointToPointMAC;
 
@@ -179,6 +185,16 @@ struct PORT
 	// Not in the standard. Used by STP_Get/SetAdminExternalPortPathCost.
 	unsigned int adminExternalPortPathCost;
 
+	// Not in the standard. A BPDU_FRAME_HEADER followed by room for the largest BPDU this port can transmit.
+	// txRstp keeps here the last BPDU it built and re-encodes only the parts that changed (see txStaleTrees);
+	// with the transmitGather callback we also hand the application pointers into it instead of copying.
+	unsigned char* txFrame;
+	bool txSourceAddressSet; // set by STP_SetPortAddress; when false, the source address follows the bridge address
+
+#if STP_USE_COUNTERS
+	STP_PORT_COUNTERS counters; // see STP_GetPortCounters
+#endif
+
 	PortTimers::State            portTimersState;
 	PortProtocolMigration::State portProtocolMigrationState;
 	PortReceive::State           portReceiveState;
@@ -10,6 +10,7 @@
 #include "stp_log.h"
 #include <assert.h>
 #include <stddef.h>
+#include <string.h>
 
 #ifdef __GNUC__
 	// For GCC older than 8.x: disable the warning for accessing a field of a non-POD NULL object
@@ -52,8 +53,9 @@ void clearAllRcvdMsgs (STP_BRIDGE* bridge, PortIndex givenPort)
 // Clears reselect for the tree (the CIST or a given MSTI) for all ports of the bridge.
 void clearReselectTree (STP_BRIDGE* bridge, TreeIndex givenTree)
 {
-	for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
-		bridge->ports [portIndex]->trees [givenTree]->reselect = false;
+	const BRIDGE_TREE* tree = bridge->trees [givenTree];
+	for (unsigned int portIndex = 0; (tree->reselectPortCount != 0) && (portIndex < bridge->portCount); portIndex++)
+		SetReselect (bridge, portIndex, givenTree, false);
 }
 
 // ============================================================================
@@ -384,7 +386,7 @@ void rcvMsgs (STP_BRIDGE* bridge, PortIndex givenPort)
 	// the Port Information state machine for that MSTI.
 	if (port->rcvdInternal)
 	{
-		LOG (bridge, -1, -1, "rcvMsgs() -- rcvdInternal==1\r\n");
+		LOG_DETAILS (bridge, -1, -1, "rcvMsgs() -- rcvdInternal==1\r\n");
 
 		// these assert conditions should have been checked while validating the received bpdu
 		size_t version3Length = bridge->receivedBpduContent->Version3Length;
@@ -400,7 +402,7 @@ void rcvMsgs (STP_BRIDGE* bridge, PortIndex givenPort)
 		if (mstiMessageCount > bridge->mstiCount)
 		{
 			// The sender sent us too many MSTI messages. Let's ignore the ones we can't handle.
-			LOG (bridge, -1, -1, "rcvMsgs() -- Ignoring MSTI messages {D}..{D}\r\n", (int)bridge->mstiCount, (int)mstiMessageCount - 1);
+			LOG_DETAILS (bridge, -1, -1, "rcvMsgs() -- Ignoring MSTI messages {D}..{D}\r\n", (int)bridge->mstiCount, (int)mstiMessageCount - 1);
 			mstiMessageCount = bridge->mstiCount;
 		}
 		
@@ -441,7 +443,7 @@ void rcvMsgs (STP_BRIDGE* bridge, PortIndex givenPort)
 	else
 	{
 		// From 13.11 in 802.1Q-2018: An MSTI message priority vector received from a Bridge not in the same MST Region is discarded.
-		LOG (bridge, -1, -1, "rcvMsgs() -- rcvdInternal==0\r\n");
+		LOG_DETAILS (bridge, -1, -1, "rcvMsgs() -- rcvdInternal==0\r\n");
 	}
 }
 
@@ -607,7 +609,7 @@ void recordMastered (STP_BRIDGE* bridge, PortIndex givenPort, TreeIndex givenTre
 			port->mastered = false;
 	}
 
-	LOG (bridge, givenPort, givenTree, "Port {D}: {TN}: recordMastered(): {D}\r\n", 1 + givenPort, givenTree, (int) port->mastered);
+	LOG_DETAILS (bridge, givenPort, givenTree, "Port {D}: {TN}: recordMastered(): {D}\r\n", 1 + givenPort, givenTree, (int) port->mastered);
 }
 
 // ============================================================================
@@ -623,7 +625,7 @@ void recordPriority (STP_BRIDGE* bridge, PortIndex givenPort, TreeIndex givenTre
 
 	portTree->portPriority = portTree->msgPriority;
 
-	LOG (bridge, givenPort, givenTree, "Port {D}: {TN}: recordPriority(): {PVS}\r\n", 1 + givenPort, givenTree, &portTree->portPriority);
+	LOG_DETAILS (bridge, givenPort, givenTree, "Port {D}: {TN}: recordPriority(): {PVS}\r\n", 1 + givenPort, givenTree, &portTree->portPriority);
 }
 
 // ============================================================================
@@ -699,7 +701,10 @@ void recordTimes (STP_BRIDGE* bridge, PortIndex givenPort, TreeIndex givenTree)
 void setReRootTree (STP_BRIDGE* bridge, TreeIndex givenTree)
 {
 	for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
-		bridge->ports [portIndex]->trees [givenTree]->reRoot = true;
+	{
+		bridge->trees [givenTree]->portTrees [portIndex]->reRoot = true;
+		MarkPortTreeDirty (bridge, portIndex, givenTree);
+	}
 }
 
 // ============================================================================
@@ -708,14 +713,16 @@ void setReRootTree (STP_BRIDGE* bridge, TreeIndex givenTree)
 // for all ports in this tree. If reselect is TRUE for any port in this tree, this procedure takes no action.
 void setSelectedTree (STP_BRIDGE* bridge, TreeIndex givenTree)
 {
-	for (unsigned int portIndex = 0;  portIndex < bridge->portCount; portIndex++)
+	if (bridge->trees [givenTree]->reselectPortCount != 0)
+		return;
+
+	for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
 	{
-		if (bridge->ports [portIndex]->trees [givenTree]->reselect)
-			return;
+		bridge->trees [givenTree]->portTrees [portIndex]->selected = true;
+		UpdatePortTreeBits (bridge, portIndex, givenTree);
 	}
 
-	for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
-		bridge->ports [portIndex]->trees [givenTree]->selected = true;
+	MarkTreeDirty (bridge, givenTree);
 }
 
 // ============================================================================
@@ -724,7 +731,10 @@ void setSelectedTree (STP_BRIDGE* bridge, TreeIndex givenTree)
 void setSyncTree (STP_BRIDGE* bridge, TreeIndex givenTree)
 {
 	for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
-		bridge->ports [portIndex]->trees [givenTree]->sync = true;
+	{
+		bridge->trees [givenTree]->portTrees [portIndex]->sync = true;
+		MarkPortTreeDirty (bridge, portIndex, givenTree);
+	}
 }
 
 // ============================================================================
@@ -785,7 +795,10 @@ void setTcPropTree (STP_BRIDGE* bridge, PortIndex givenPort, TreeIndex givenTree
 		for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
 		{
 			if (portIndex != (unsigned int) givenPort)
-				bridge->ports [portIndex]->trees [givenTree]->tcProp = true;
+			{
+				bridge->trees [givenTree]->portTrees [portIndex]->tcProp = true;
+				MarkPortTreeDirty (bridge, portIndex, givenTree);
+			}
 		}
 	}
 }
@@ -797,12 +810,16 @@ void setTcPropTree (STP_BRIDGE* bridge, PortIndex givenPort, TreeIndex givenTree
 // b) Sets the sync variable.
 void syncMaster (STP_BRIDGE* bridge)
 {
+	bool anyPortInternal = false;
+
 	for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
 	{
 		PORT* port = bridge->ports [portIndex];
 
 		if (port->infoInternal)
 		{
+			anyPortInternal = true;
+
 			for (unsigned int treeIndex = 1; treeIndex < bridge->treeCount(); treeIndex++)
 			{
 				PORT_TREE* portTree = port->trees [treeIndex];
@@ -810,9 +827,63 @@ void syncMaster (STP_BRIDGE* bridge)
 				portTree->agreed = false;
 				portTree->synced = false;
 				portTree->sync = true;
+				UpdatePortTreeBits (bridge, portIndex, treeIndex);
 			}
 		}
 	}
+
+	// synced is read by allSynced() for all ports of a tree.
+	if (anyPortInternal)
+	{
+		for (unsigned int treeIndex = 1; treeIndex < bridge->treeCount(); treeIndex++)
+			MarkTreeDirty (bridge, treeIndex);
+	}
+}
+
+// ============================================================================
+// Returns the memory where the txXxx procedures are to build a BPDU of the given size, or NULL if there's none.
+static void* GetTransmitBuffer (STP_BRIDGE* bridge, PortIndex givenPort, unsigned int bpduSize, unsigned int timestamp)
+{
+	if (bridge->callbacks.transmitGather != NULL)
+	{
+		#if !STP_USE_FULL_SWEEP
+			// Only txConfig and txTcn get here; they overwrite the BPDU cached by txRstp.
+			PORT* port = bridge->ports [givenPort];
+			for (unsigned int treeIndex = 0; treeIndex < (1 + bridge->mstiCount); treeIndex++)
+				SetBit (port->txStaleTrees, treeIndex);
+		#endif
+
+		return bridge->ports [givenPort]->txFrame + sizeof (BPDU_FRAME_HEADER);
+	}
+
+	return bridge->callbacks.transmitGetBuffer (bridge, givenPort, bpduSize, timestamp);
+}
+
+// Hands to the application a BPDU built in memory returned by GetTransmitBuffer. With transmitGather we pass three
+// fragments - the Ethernet and LLC headers, the part of the BPDU up to and including the CIST information,
+// and the MSTI Configuration Messages - or only the first two if the BPDU has no MSTI Configuration Messages.
+static void ReleaseTransmitBuffer (STP_BRIDGE* bridge, PortIndex givenPort, void* bpdu, unsigned int bpduSize, unsigned int timestamp)
+{
+	if (bridge->callbacks.transmitGather == NULL)
+	{
+		bridge->callbacks.transmitReleaseBuffer (bridge, bpdu);
+		return;
+	}
+
+	BPDU_FRAME_HEADER* header = (BPDU_FRAME_HEADER*) bridge->ports [givenPort]->txFrame;
+	header->length = (unsigned short) (3 + bpduSize);
+
+	unsigned int cistSize = (bpduSize < sizeof (MSTP_BPDU)) ? bpduSize : (unsigned int) sizeof (MSTP_BPDU);
+
+	STP_TX_FRAGMENT fragments [3];
+	fragments[0].data = header;
+	fragments[0].size = sizeof (BPDU_FRAME_HEADER);
+	fragments[1].data = bpdu;
+	fragments[1].size = cistSize;
+	fragments[2].data = (unsigned char*) bpdu + cistSize;
+	fragments[2].size = bpduSize - cistSize;
+
+	bridge->callbacks.transmitGather (bridge, givenPort, fragments, (fragments[2].size != 0) ? 3 : 2, timestamp);
 }
 
 // ============================================================================
@@ -834,7 +905,7 @@ void txConfig (STP_BRIDGE* bridge, PortIndex givenPort, unsigned int timestamp)
 
 	FLUSH_LOG (bridge);
 
-	MSTP_BPDU* bpdu = (MSTP_BPDU*) bridge->callbacks.transmitGetBuffer (bridge, givenPort, bpduSize, timestamp);
+	MSTP_BPDU* bpdu = (MSTP_BPDU*) GetTransmitBuffer (bridge, givenPort, bpduSize, timestamp);
 	if (bpdu != NULL)
 	{
 		// 14.3.a) in 802.1Q-2018
@@ -862,35 +933,27 @@ void txConfig (STP_BRIDGE* bridge, PortIndex givenPort, unsigned int timestamp)
 		bpdu->HelloTime    = cistTree->portTimes.HelloTime * 256;
 
 		#if STP_USE_LOG
-			LOG (bridge, givenPort, -1, "TX Config BPDU to port {D}:\r\n", 1 + givenPort);
+			LOG_DETAILS (bridge, givenPort, -1, "TX Config BPDU to port {D}:\r\n", 1 + givenPort);
 			LOG_INDENT (bridge);
 			DumpConfigBpdu (bridge, givenPort, -1, bpdu);
 			LOG_UNINDENT (bridge);
 
 			FLUSH_LOG (bridge);
 		#endif
-		bridge->callbacks.transmitReleaseBuffer (bridge, bpdu);
+		#if STP_USE_COUNTERS
+			port->counters.bpdusTransmitted [STP_BPDU_TYPE_CONFIG]++;
+		#endif
+		ReleaseTransmitBuffer (bridge, givenPort, bpdu, bpduSize, timestamp);
 	}
 }
 
 // ============================================================================
 // 13.29.aa) - 13.29.28
-void txRstp (STP_BRIDGE* bridge, PortIndex givenPort, unsigned int timestamp)
-{
-	PORT* port = bridge->ports [givenPort];
-	PORT_TREE* cistTree = port->trees [CIST_INDEX];
-
-	unsigned int bpduSize;
-	if (bridge->ForceProtocolVersion < 3)
-		bpduSize = (unsigned int) offsetof (struct MSTP_BPDU, Version3Length);
-	else
-		bpduSize = sizeof(MSTP_BPDU) + bridge->mstiCount * sizeof(MSTI_CONFIG_MESSAGE);
 
-	FLUSH_LOG (bridge);
-
-	MSTP_BPDU* bpdu = (MSTP_BPDU*) bridge->callbacks.transmitGetBuffer (bridge, givenPort, bpduSize, timestamp);
-	if (bpdu == NULL)
-		return;
+// Encodes octets 1 to 102 (or 1 to 36 for RST BPDUs).
+static void EncodeCistInformation (STP_BRIDGE* bridge, PortIndex givenPort, MSTP_BPDU* bpdu, unsigned int bpduSize)
+{
+	PORT_TREE* cistTree = bridge->ports [givenPort]->trees [CIST_INDEX];
 
 	// octets 1 and 2 - 14.3 in 802.1Q-2018
 	bpdu->protocolId = 0;
@@ -965,58 +1028,108 @@ void txRstp (STP_BRIDGE* bridge, PortIndex givenPort, unsigned int timestamp)
 
 		// octet 102 - 14.4.u) in 802.1Q-2018
 		bpdu->cistRemainingHops = cistTree->designatedTimes.remainingHops;
+	}
+}
 
-		MSTI_CONFIG_MESSAGE* mstiMessage = reinterpret_cast<MSTI_CONFIG_MESSAGE*>(bpdu + 1);
+// 14.4.1 in 802.1Q-2018
+static void EncodeMstiConfigMessage (STP_BRIDGE* bridge, PortIndex givenPort, unsigned int mstiIndex, MSTI_CONFIG_MESSAGE* mstiMessage)
+{
+	const PORT* port = bridge->ports [givenPort];
+	const PORT_TREE* tree = port->trees [1 + mstiIndex];
 
-		// 14.4.1 in 802.1Q-2018
-		for (unsigned int mstiIndex = 0; mstiIndex < bridge->mstiCount; mstiIndex++)
-		{
-			const PORT_TREE* tree = port->trees [1 + mstiIndex];
+	// a)
+	mstiMessage->flags = GetBpduPortRole (tree->role) << 2;
 
-			// a)
-			mstiMessage->flags = GetBpduPortRole (tree->role) << 2;
+	if (tree->agree)
+		mstiMessage->flags |= (unsigned char) 0x40;
 
-			if (tree->agree)
-				mstiMessage->flags |= (unsigned char) 0x40;
+	if (tree->proposing)
+		mstiMessage->flags |= (unsigned char) 2;
 
-			if (tree->proposing)
-				mstiMessage->flags |= (unsigned char) 2;
+	if (tree->tcWhile != 0)
+		mstiMessage->flags |= (unsigned char) 1;
 
-			if (tree->tcWhile != 0)
-				mstiMessage->flags |= (unsigned char) 1;
+	if (port->master)
+		mstiMessage->flags |= (unsigned char) 0x80;
 
-			if (port->master)
-				mstiMessage->flags |= (unsigned char) 0x80;
+	if (tree->learning)
+		mstiMessage->flags |= (unsigned char) 0x10;
 
-			if (tree->learning)
-				mstiMessage->flags |= (unsigned char) 0x10;
+	if (tree->forwarding)
+		mstiMessage->flags |= (unsigned char) 0x20;
 
-			if (tree->forwarding)
-				mstiMessage->flags |= (unsigned char) 0x20;
+	// b) to e)
+	mstiMessage->RegionalRootId       = tree->designatedPriority.RegionalRootId;
+	mstiMessage->InternalRootPathCost = tree->designatedPriority.InternalRootPathCost;
+	mstiMessage->BridgePriority       = bridge->trees[1 + mstiIndex]->GetBridgeIdentifier().GetPriorityWithoutMstid() >> 8;
+	mstiMessage->PortPriority         = tree->portId.GetPriority();
+	// f)
+	mstiMessage->RemainingHops        = tree->designatedTimes.remainingHops;
+}
 
-			// b) to e)
-			mstiMessage->RegionalRootId       = tree->designatedPriority.RegionalRootId;
-			mstiMessage->InternalRootPathCost = tree->designatedPriority.InternalRootPathCost;
-			mstiMessage->BridgePriority       = bridge->trees[1 + mstiIndex]->GetBridgeIdentifier().GetPriorityWithoutMstid() >> 8;
-			mstiMessage->PortPriority         = tree->portId.GetPriority();
-			// f)
-			mstiMessage->RemainingHops        = tree->designatedTimes.remainingHops;
+void txRstp (STP_BRIDGE* bridge, PortIndex givenPort, unsigned int timestamp)
+{
+	PORT* port = bridge->ports [givenPort];
 
-			mstiMessage++;
-		}
+	unsigned int bpduSize;
+	if (bridge->ForceProtocolVersion < 3)
+		bpduSize = (unsigned int) offsetof (struct MSTP_BPDU, Version3Length);
+	else
+		bpduSize = sizeof(MSTP_BPDU) + bridge->mstiCount * sizeof(MSTI_CONFIG_MESSAGE);
+
+	FLUSH_LOG (bridge);
+
+	void* buffer = NULL;
+	if (bridge->callbacks.transmitGather == NULL)
+	{
+		buffer = bridge->callbacks.transmitGetBuffer (bridge, givenPort, bpduSize, timestamp);
+		if (buffer == NULL)
+			return;
 	}
 
+	// We keep the BPDU in txFrame between transmissions, and encode again only the parts
+	// whose source variables might have changed since; see MarkPortDirty and MarkPortTreeDirty.
+	MSTP_BPDU* bpdu = (MSTP_BPDU*) (port->txFrame + sizeof (BPDU_FRAME_HEADER));
+	MSTI_CONFIG_MESSAGE* mstiMessages = reinterpret_cast<MSTI_CONFIG_MESSAGE*>(bpdu + 1);
+
+	#if STP_USE_FULL_SWEEP
+		EncodeCistInformation (bridge, givenPort, bpdu, bpduSize);
+
+		if (bridge->ForceProtocolVersion >= 3)
+		{
+			for (unsigned int mstiIndex = 0; mstiIndex < bridge->mstiCount; mstiIndex++)
+				EncodeMstiConfigMessage (bridge, givenPort, mstiIndex, &mstiMessages[mstiIndex]);
+		}
+	#else
+		if (TestBit (port->txStaleTrees, CIST_INDEX))
+		{
+			EncodeCistInformation (bridge, givenPort, bpdu, bpduSize);
+			ClearBit (port->txStaleTrees, CIST_INDEX);
+		}
+
+		if (bridge->ForceProtocolVersion >= 3)
+		{
+			for (unsigned int treeIndex = FindNextSetBit (port->txStaleTrees, 1 + bridge->mstiCount, 1);
+				treeIndex < 1 + bridge->mstiCount;
+				treeIndex = FindNextSetBit (port->txStaleTrees, 1 + bridge->mstiCount, treeIndex + 1))
+			{
+				EncodeMstiConfigMessage (bridge, givenPort, treeIndex - 1, &mstiMessages[treeIndex - 1]);
+				ClearBit (port->txStaleTrees, treeIndex);
+			}
+		}
+	#endif
+
 	#if STP_USE_LOG
 		if (bridge->ForceProtocolVersion < 3)
 		{
-			LOG (bridge, givenPort, -1, "TX RSTP BPDU to port {D}:\r\n", 1 + givenPort);
+			LOG_DETAILS (bridge, givenPort, -1, "TX RSTP BPDU to port {D}:\r\n", 1 + givenPort);
 			LOG_INDENT (bridge);
 			DumpRstpBpdu (bridge, givenPort, -1, bpdu);
 			LOG_UNINDENT (bridge);
 		}
 		else if (bridge->ForceProtocolVersion == 3)
 		{
-			LOG (bridge, givenPort, -1, "TX MSTP BPDU to port {D}:\r\n", 1 + givenPort);
+			LOG_DETAILS (bridge, givenPort, -1, "TX MSTP BPDU to port {D}:\r\n", 1 + givenPort);
 			LOG_INDENT (bridge);
 			DumpMstpBpdu (bridge, givenPort, -1, bpdu);
 			LOG_UNINDENT (bridge);
@@ -1027,7 +1140,17 @@ void txRstp (STP_BRIDGE* bridge, PortIndex givenPort, unsigned int timestamp)
 		FLUSH_LOG (bridge);
 	#endif
 
-	bridge->callbacks.transmitReleaseBuffer (bridge, bpdu);
+	#if STP_USE_COUNTERS
+		port->counters.bpdusTransmitted [(bridge->ForceProtocolVersion < 3) ? STP_BPDU_TYPE_RST : STP_BPDU_TYPE_MST]++;
+	#endif
+
+	if (buffer != NULL)
+	{
+		memcpy (buffer, bpdu, bpduSize);
+		ReleaseTransmitBuffer (bridge, givenPort, buffer, bpduSize, timestamp);
+	}
+	else
+		ReleaseTransmitBuffer (bridge, givenPort, bpdu, bpduSize, timestamp);
 }
 
 // ============================================================================
@@ -1035,7 +1158,7 @@ void txRstp (STP_BRIDGE* bridge, PortIndex givenPort, unsigned int timestamp)
 void txTcn (STP_BRIDGE* bridge, PortIndex givenPort, unsigned int timestamp)
 {
 	FLUSH_LOG (bridge);
-	BPDU_HEADER* bpdu = (BPDU_HEADER*) bridge->callbacks.transmitGetBuffer (bridge, givenPort, sizeof (BPDU_HEADER), timestamp);
+	BPDU_HEADER* bpdu = (BPDU_HEADER*) GetTransmitBuffer (bridge, givenPort, sizeof (BPDU_HEADER), timestamp);
 	if (bpdu == NULL)
 		return;
 
@@ -1044,10 +1167,14 @@ void txTcn (STP_BRIDGE* bridge, PortIndex givenPort, unsigned int timestamp)
 	bpdu->protocolVersionId = 0;
 	bpdu->bpduType = 0x80;
 
-	LOG (bridge, givenPort, -1, "TX TCN BPDU to port {D}:\r\n", 1 + givenPort);
+	LOG_DETAILS (bridge, givenPort, -1, "TX TCN BPDU to port {D}:\r\n", 1 + givenPort);
+
+	#if STP_USE_COUNTERS
+		bridge->ports [givenPort]->counters.bpdusTransmitted [STP_BPDU_TYPE_TCN]++;
+	#endif
 
 	FLUSH_LOG (bridge);
-	bridge->callbacks.transmitReleaseBuffer (bridge, bpdu);
+	ReleaseTransmitBuffer (bridge, givenPort, bpdu, sizeof (BPDU_HEADER), timestamp);
 }
 
 // ============================================================================
@@ -1208,8 +1335,8 @@ void updtRolesTree (STP_BRIDGE* bridge, TreeIndex givenTree)
 
 	BRIDGE_TREE* bridgeTree = bridge->trees [givenTree];
 
-	LOG (bridge, -1, givenTree, "Tree {D}:\r\n", givenTree);
-	LOG (bridge, -1, givenTree, "  BridgeID: {BID}\r\n", &bridgeTree->GetBridgeIdentifier());
+	LOG_DETAILS (bridge, -1, givenTree, "Tree {D}:\r\n", givenTree);
+	LOG_DETAILS (bridge, -1, givenTree, "  BridgeID: {BID}\r\n", &bridgeTree->GetBridgeIdentifier());
 
 	BRIDGE_ID previousCistRegionalRootIdentifier = bridgeTree->rootPriority.RegionalRootId;
 	uint32_nbo previousCistExternalRootPathCost   = bridgeTree->rootPriority.ExternalRootPathCost;
@@ -1232,14 +1359,14 @@ void updtRolesTree (STP_BRIDGE* bridge, TreeIndex givenTree)
 			PRIORITY_VECTOR rootPathPriority;
 			CalculateRootPathPriorityForPort (bridge, portIndex, givenTree, &rootPathPriority);
 
-			LOG (bridge, -1, givenTree, "  Port {D} root path priority  : {PVS}\r\n", 1 + portIndex, &rootPathPriority);
+			LOG_DETAILS (bridge, -1, givenTree, "  Port {D} root path priority  : {PVS}\r\n", 1 + portIndex, &rootPathPriority);
 
 			// c)
 			if ((rootPathPriority.DesignatedBridgeId.GetAddress () != bridgeTree->GetBridgePriority ().DesignatedBridgeId.GetAddress ())
 				&& (port->restrictedRole == false))
 			{
-				if (rootPathPriority.IsBetterThan (bridgeTree->rootPriority)
-					|| ((rootPathPriority == bridgeTree->rootPriority) && (portTree->portId.IsBetterThan (bridgeTree->rootPortId))))
+				int compare = rootPathPriority.Compare (bridgeTree->rootPriority);
+				if ((compare < 0) || ((compare == 0) && portTree->portId.IsBetterThan (bridgeTree->rootPortId)))
 				{
 					rootPortTree = portTree;
 
@@ -1260,8 +1387,8 @@ void updtRolesTree (STP_BRIDGE* bridge, TreeIndex givenTree)
 		}
 	}
 
-	LOG (bridge, -1, givenTree, "  bridge root priority : {PVS}\r\n", &bridgeTree->rootPriority);
-	LOG (bridge, -1, givenTree, "  root port = {PID}\r\n", &bridgeTree->rootPortId);
+	LOG_DETAILS (bridge, -1, givenTree, "  bridge root priority : {PVS}\r\n", &bridgeTree->rootPriority);
+	LOG_DETAILS (bridge, -1, givenTree, "  root port = {PID}\r\n", &bridgeTree->rootPortId);
 
 	for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
 	{
@@ -1274,7 +1401,7 @@ void updtRolesTree (STP_BRIDGE* bridge, TreeIndex givenTree)
 		// f)
 		portTree->designatedTimes = bridgeTree->rootTimes;
 
-		LOG (bridge, -1, givenTree, "  Port {D} designated priority : {PVS}\r\n", 1 + portIndex, &portTree->designatedPriority);
+		LOG_DETAILS (bridge, -1, givenTree, "  Port {D} designated priority : {PVS}\r\n", 1 + portIndex, &portTree->designatedPriority);
 	}
 
 	// If the root priority vector for the CIST is recalculated, and has a different Regional Root Identifier than that
@@ -1441,8 +1568,12 @@ void updtRolesTree (STP_BRIDGE* bridge, TreeIndex givenTree)
 			}
 		}
 
-		LOG (bridge, -1, givenTree, "Port {D}: {TN}: selectedRole set to {S}\r\n", 1 + portIndex, givenTree, GetPortRoleName (portTree->selectedRole));
+		LOG_DETAILS (bridge, -1, givenTree, "Port {D}: {TN}: selectedRole set to {S}\r\n", 1 + portIndex, givenTree, GetPortRoleName (portTree->selectedRole));
+
+		UpdatePortTreeBits (bridge, portIndex, givenTree);
 	}
+
+	MarkTreeDirty (bridge, givenTree);
 }
 
 // ============================================================================
@@ -1451,5 +1582,10 @@ void updtRolesTree (STP_BRIDGE* bridge, TreeIndex givenTree)
 void updtRolesDisabledTree (STP_BRIDGE* bridge, TreeIndex givenTree)
 {
 	for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
-		bridge->ports [portIndex]->trees [givenTree]->selectedRole = STP_PORT_ROLE_DISABLED;
+	{
+		bridge->trees [givenTree]->portTrees [portIndex]->selectedRole = STP_PORT_ROLE_DISABLED;
+		UpdatePortTreeBits (bridge, portIndex, givenTree);
+	}
+
+	MarkTreeDirty (bridge, givenTree);
 }
@@ -7,6 +7,7 @@
 template<typename State, typename PortTreeArgs>
 struct StateMachine
 {
+	STP_STATE_MACHINE id;
 #if STP_USE_LOG
 	const char* smName;
 	const char* (*getStateName) (State state);
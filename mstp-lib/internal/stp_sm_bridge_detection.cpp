@@ -138,6 +138,7 @@ static void InitState (STP_BRIDGE* bridge, PortIndex givenPort, State state, uns
 
 const StateMachine<BridgeDetection::State, PortIndex> BridgeDetection::sm =
 {
+	STP_STATE_MACHINE_BRIDGE_DETECTION,
 #if STP_USE_LOG
 	"BridgeDetection",
 	&GetStateName,
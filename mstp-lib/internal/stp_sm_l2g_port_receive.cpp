@@ -101,6 +101,7 @@ static void InitState (STP_BRIDGE* bridge, PortIndex givenPort, State state, uns
 
 const StateMachine<State, PortIndex> L2GPortReceive::sm =
 {
+	STP_STATE_MACHINE_L2G_PORT_RECEIVE,
 #if STP_USE_LOG
 	"L2GPortReceive",
 	&GetStateName,
@@ -149,12 +149,12 @@ static void InitState (STP_BRIDGE* bridge, PortAndTree pt, State state, unsigned
 		portTree->rcvdMsg = false;
 		portTree->proposing = portTree->proposed = portTree->agree = portTree->agreed = false;
 		portTree->rcvdInfoWhile = 0;
-		portTree->infoIs = INFO_IS_DISABLED; portTree->reselect = true; portTree->selected = false;
+		portTree->infoIs = INFO_IS_DISABLED; SetReselect (bridge, givenPort, givenTree, true); portTree->selected = false;
 	}
 	else if (state == AGED)
 	{
 		portTree->infoIs = INFO_IS_AGED;
-		portTree->reselect = true;
+		SetReselect (bridge, givenPort, givenTree, true);
 		portTree->selected = false;
 	}
 	else if (state == UPDATE)
@@ -194,7 +194,7 @@ static void InitState (STP_BRIDGE* bridge, PortAndTree pt, State state, unsigned
 		recordTimes (bridge, givenPort, givenTree);
 		updtRcvdInfoWhile (bridge, givenPort, givenTree);
 		portTree->infoIs = INFO_IS_RECEIVED;
-		portTree->reselect = true;
+		SetReselect (bridge, givenPort, givenTree, true);
 		portTree->selected = false;
 		portTree->rcvdMsg = false;
 	}
@@ -236,6 +236,7 @@ static void InitState (STP_BRIDGE* bridge, PortAndTree pt, State state, unsigned
 
 const StateMachine<State, PortAndTree> PortInformation::sm =
 {
+	STP_STATE_MACHINE_PORT_INFORMATION,
 #if STP_USE_LOG
 	"PortInformation",
 	&GetStateName,
@@ -109,6 +109,7 @@ static void InitState (STP_BRIDGE* bridge, PortIndex givenPort, State state, uns
 
 const StateMachine<PortProtocolMigration::State, PortIndex> PortProtocolMigration::sm =
 {
+	STP_STATE_MACHINE_PORT_PROTOCOL_MIGRATION,
 #if STP_USE_LOG
 	"PortProtocolMigration",
 	&GetStateName,
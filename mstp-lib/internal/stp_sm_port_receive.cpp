@@ -95,6 +95,7 @@ static void InitState (STP_BRIDGE* bridge, PortIndex givenPort, State state, uns
 
 const StateMachine<PortReceive::State, PortIndex> PortReceive::sm =
 {
+	STP_STATE_MACHINE_PORT_RECEIVE,
 #if STP_USE_LOG
 	"PortReceive",
 	&GetStateName,
@@ -49,11 +49,8 @@ static State CheckConditions (const STP_BRIDGE* bridge, TreeIndex givenTree, Sta
 
 	if (state == ROLE_SELECTION)
 	{
-		for (unsigned int portIndex = 0; portIndex < bridge->portCount; portIndex++)
-		{
-			if (bridge->ports [portIndex]->trees [givenTree]->reselect)
-				return ROLE_SELECTION;
-		}
+		if (bridge->trees [givenTree]->reselectPortCount != 0)
+			return ROLE_SELECTION;
 
 		return (State)0;
 	}
@@ -82,6 +79,7 @@ static void InitState (STP_BRIDGE* bridge, TreeIndex givenTree, State state, uns
 
 const StateMachine<State, TreeIndex> PortRoleSelection::sm =
 {
+	STP_STATE_MACHINE_PORT_ROLE_SELECTION,
 #if STP_USE_LOG
 	"PortRoleSelection",
 	&GetStateName,
@@ -613,6 +613,7 @@ static void InitState (STP_BRIDGE* bridge, PortAndTree pt, State state, unsigned
 
 const StateMachine<PortRoleTransitions::State, PortAndTree> PortRoleTransitions::sm =
 {
+	STP_STATE_MACHINE_PORT_ROLE_TRANSITIONS,
 #if STP_USE_LOG
 	"PortRoleTransitions",
 	&GetStateName,
@@ -115,6 +115,7 @@ static void InitState (STP_BRIDGE* bridge, PortAndTree pt, State state, unsigned
 
 const StateMachine<PortStateTransition::State, PortAndTree> PortStateTransition::sm =
 {
+	STP_STATE_MACHINE_PORT_STATE_TRANSITION,
 #if STP_USE_LOG
 	"PortStateTransition",
 	&GetStateName,
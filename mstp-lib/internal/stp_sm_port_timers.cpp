@@ -24,6 +24,22 @@ static const char* GetStateName (State state)
 
 // ============================================================================
 
+#if !STP_USE_FULL_SWEEP
+// Decrements the timer if it's running. Sets "decremented" if it did, and "running" if the timer is still running afterwards.
+static void DecrementTimer (unsigned short& timer, bool& decremented, bool& running)
+{
+	if (timer > 0)
+	{
+		timer--;
+		decremented = true;
+		if (timer > 0)
+			running = true;
+	}
+}
+#endif
+
+// ============================================================================
+
 // Returns the new state, or 0 when no transition is to be made.
 static State CheckConditions (const STP_BRIDGE* bridge, PortIndex givenPort, State state)
 {
@@ -73,6 +89,7 @@ static void InitState (STP_BRIDGE* bridge, PortIndex givenPort, State state, uns
 	}
 	else if (state == TICK)
 	{
+#if STP_USE_FULL_SWEEP
 		if (port->helloWhen      > 0) port->helloWhen--;
 		if (port->mDelayWhile    > 0) port->mDelayWhile--;
 		if (port->edgeDelayWhile > 0) port->edgeDelayWhile--;
@@ -86,15 +103,87 @@ static void InitState (STP_BRIDGE* bridge, PortIndex givenPort, State state, uns
 			if (portTree->tcWhile       > 0) portTree->tcWhile--;
 			if (portTree->fdWhile       > 0) portTree->fdWhile--;
 			if (portTree->rcvdInfoWhile > 0) portTree->rcvdInfoWhile--;
-			if (portTree->rrWhile       > 0) portTree->rrWhile--;
+			if (portTree->rrWhile       > 0)
+			{
+				portTree->rrWhile--;
+
+				// reRooted() reads rrWhile for all ports of a tree.
+				if (portTree->rrWhile == 0)
+				{
+					UpdatePortTreeBits (bridge, givenPort, treeIndex);
+					MarkTreeDirty (bridge, treeIndex);
+				}
+			}
 			if (portTree->tcDetected    > 0) portTree->tcDetected--;
 			if (portTree->rbWhile       > 0) portTree->rbWhile--;
 		}
+#else
+		// Some conditions compare timers with non-zero values (fdWhile != forwardDelay, txCount < TxHoldCount etc.),
+		// so every decrement must cause a re-evaluation, not only the one that makes a timer expire. Timers are read
+		// only by the state machines of their own port and tree (except for rrWhile, see below), and those run after
+		// this one for the same port; that's why marking only the tree and PortTransmit is enough here.
+		bool decremented = false;
+		bool running = false;
+		DecrementTimer (port->helloWhen,           decremented, running);
+		DecrementTimer (port->mDelayWhile,         decremented, running);
+		DecrementTimer (port->edgeDelayWhile,      decremented, running);
+		DecrementTimer (port->txCount,             decremented, running);
+		DecrementTimer (port->pseudoInfoHelloWhen, decremented, running);
+		if (decremented)
+			SetBit (bridge->dirtyTransmitPorts, givenPort);
+
+		unsigned int treeCount = bridge->treeCount();
+		for (unsigned int treeIndex = FindNextSetBit (port->timerTrees, treeCount, 0);
+			treeIndex < treeCount;
+			treeIndex = FindNextSetBit (port->timerTrees, treeCount, treeIndex + 1))
+		{
+			PORT_TREE* portTree = port->trees [treeIndex];
+
+			bool treeDecremented = false;
+			bool treeRunning = false;
+
+			// txRstp encodes whether tcWhile is zero.
+			if (portTree->tcWhile == 1)
+				SetBit (port->txStaleTrees, treeIndex);
+
+			DecrementTimer (portTree->tcWhile,       treeDecremented, treeRunning);
+			DecrementTimer (portTree->fdWhile,       treeDecremented, treeRunning);
+			DecrementTimer (portTree->rcvdInfoWhile, treeDecremented, treeRunning);
+			DecrementTimer (portTree->tcDetected,    treeDecremented, treeRunning);
+			DecrementTimer (portTree->rbWhile,       treeDecremented, treeRunning);
+			if (portTree->rrWhile > 0)
+			{
+				portTree->rrWhile--;
+				treeDecremented = true;
+
+				// reRooted() reads rrWhile for all ports of a tree.
+				if (portTree->rrWhile == 0)
+				{
+					UpdatePortTreeBits (bridge, givenPort, treeIndex);
+					MarkTreeDirty (bridge, treeIndex);
+				}
+				else
+					treeRunning = true;
+			}
+
+			if (treeDecremented)
+				SetBit (port->dirtyTrees, treeIndex);
+
+			if (treeRunning)
+				running = true;
+			else
+				ClearBit (port->timerTrees, treeIndex);
+		}
+
+		if (!running)
+			ClearBit (bridge->timerPorts, givenPort);
+#endif
 	}
 }
 
 const StateMachine<State, PortIndex> PortTimers::sm =
 {
+	STP_STATE_MACHINE_PORT_TIMERS,
 #if STP_USE_LOG
 	"PortTimers",
 	&GetStateName,
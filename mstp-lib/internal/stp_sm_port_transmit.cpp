@@ -149,6 +149,7 @@ static void InitState (STP_BRIDGE* bridge, PortIndex givenPort, State state, uns
 
 const StateMachine<PortTransmit::State, PortIndex> PortTransmit::sm =
 {
+	STP_STATE_MACHINE_PORT_TRANSMIT,
 #if STP_USE_LOG
 	"PortTransmit",
 	&GetStateName,
@@ -220,6 +220,7 @@ static void InitState (STP_BRIDGE* bridge, PortAndTree pt, TopologyChange::State
 
 const StateMachine<TopologyChange::State, PortAndTree> TopologyChange::sm =
 {
+	STP_STATE_MACHINE_TOPOLOGY_CHANGE,
 #if STP_USE_LOG
 	"TopologyChange",
 	&GetStateName,
@@ -0,0 +1,515 @@
+// This file is part of the mstp-lib library, available at https://github.com/adigostin/mstp-lib
+// Copyright (c) 2011-2020 Adi Gostin, distributed under Apache License v2.0.
+
+#include "../stp_runtime.h"
+#include <assert.h>
+#include <string.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+// ============================================================================
+
+enum RUNTIME_EVENT_TYPE
+{
+	RUNTIME_EVENT_BPDU,
+	RUNTIME_EVENT_PORT_ENABLED,
+	RUNTIME_EVENT_PORT_DISABLED,
+	RUNTIME_EVENT_TICK,
+	RUNTIME_EVENT_CALL,
+};
+
+struct RUNTIME_EVENT
+{
+	std::atomic<RUNTIME_EVENT*> next;
+	RUNTIME_EVENT_TYPE type;
+	unsigned int timestamp;
+	unsigned int portIndex;
+	unsigned int bpduSize;              // RUNTIME_EVENT_BPDU; the BPDU bytes follow this structure
+	unsigned int speedMegabitsPerSecond;// RUNTIME_EVENT_PORT_ENABLED
+	bool detectedPointToPointMAC;       // RUNTIME_EVENT_PORT_ENABLED
+	STP_RUNTIME_CALL call;              // RUNTIME_EVENT_CALL
+	void* context;                      // RUNTIME_EVENT_CALL
+
+	const unsigned char* bpdu() const { return (const unsigned char*) (this + 1); }
+};
+
+static RUNTIME_EVENT* AllocEvent (RUNTIME_EVENT_TYPE type, unsigned int timestamp, unsigned int extraSize = 0)
+{
+	void* memory = ::operator new (sizeof (RUNTIME_EVENT) + extraSize);
+	RUNTIME_EVENT* e = new (memory) RUNTIME_EVENT();
+	e->type = type;
+	e->timestamp = timestamp;
+	return e;
+}
+
+static void FreeEvent (RUNTIME_EVENT* e)
+{
+	e->~RUNTIME_EVENT();
+	::operator delete (e);
+}
+
+// ============================================================================
+// Intrusive multiple-producer single-consumer queue (D. Vyukov). Push is wait-free. Pop is done only by the worker
+// that currently runs the bridge, and can return NULL for a moment while a producer is between its two steps
+// (see WaitForPush).
+
+struct EVENT_QUEUE
+{
+	std::atomic<RUNTIME_EVENT*> head; // most recently pushed
+	RUNTIME_EVENT* tail;              // next to pop
+	RUNTIME_EVENT stub;
+
+	EVENT_QUEUE()
+	{
+		stub.next.store (nullptr, std::memory_order_relaxed);
+		head.store (&stub, std::memory_order_relaxed);
+		tail = &stub;
+	}
+
+	void Push (RUNTIME_EVENT* e)
+	{
+		e->next.store (nullptr, std::memory_order_relaxed);
+		RUNTIME_EVENT* prev = head.exchange (e, std::memory_order_acq_rel);
+		prev->next.store (e, std::memory_order_release);
+	}
+
+	RUNTIME_EVENT* Pop()
+	{
+		RUNTIME_EVENT* t = tail;
+		RUNTIME_EVENT* next = t->next.load (std::memory_order_acquire);
+		if (t == &stub)
+		{
+			if (next == nullptr)
+				return nullptr;
+			tail = next;
+			t = next;
+			next = next->next.load (std::memory_order_acquire);
+		}
+
+		if (next != nullptr)
+		{
+			tail = next;
+			return t;
+		}
+
+		if (t != head.load (std::memory_order_acquire))
+			return nullptr;
+
+		Push (&stub);
+
+		next = t->next.load (std::memory_order_acquire);
+		if (next != nullptr)
+		{
+			tail = next;
+			return t;
+		}
+
+		return nullptr;
+	}
+};
+
+// ============================================================================
+
+struct STP_RUNTIME_BRIDGE
+{
+	STP_RUNTIME* runtime;
+	STP_BRIDGE* bridge;
+	EVENT_QUEUE queue;
+
+	// Number of events pushed to the queue and not yet processed. Whoever increments it from zero schedules the bridge
+	// on a worker; the worker keeps it scheduled for as long as this doesn't drop back to zero. This is what keeps
+	// the events of a bridge from running on two workers at the same time.
+	std::atomic<unsigned int> queuedCount;
+
+	// Nonzero while the worker sleeps in WaitForPush; the producers wake it when they finish a push.
+	std::atomic<unsigned int> waitingForPush;
+	std::mutex pushMutex;
+	std::condition_variable pushed;
+};
+
+struct RUNTIME_WORKER
+{
+	std::mutex mutex;
+	std::deque<STP_RUNTIME_BRIDGE*> readyBridges; // the owner takes from the front, thieves from the back
+	std::thread thread;
+};
+
+struct STP_RUNTIME
+{
+	std::vector<RUNTIME_WORKER*> workers;
+	std::atomic<unsigned int> nextWorker; // round robin for bridges scheduled from outside the worker threads
+
+	std::atomic<unsigned int> readyCount; // total number of bridges in all readyBridges queues
+	std::atomic<unsigned int> sleepingCount;
+	std::mutex sleepMutex;
+	std::condition_variable wake;
+	bool stopping;
+
+	std::atomic<unsigned int> outstandingEvents;
+	std::atomic<unsigned int> removingCount; // threads in STP_RuntimeRemoveBridge, waiting on "idle" for a queue to drain
+	std::mutex idleMutex;
+	std::condition_variable idle;
+
+	std::mutex bridgesMutex;
+	std::vector<STP_RUNTIME_BRIDGE*> bridges;
+};
+
+// The worker the current thread belongs to, if any. Bridges scheduled from a worker go to that worker's queue,
+// where they're likely to find their memory still in cache; the other workers steal them if they run out of work.
+static thread_local STP_RUNTIME* currentRuntime;
+static thread_local unsigned int currentWorkerIndex;
+
+static const unsigned int MaxEventsPerRun = 64;
+
+// ============================================================================
+
+static void ScheduleBridge (STP_RUNTIME* runtime, STP_RUNTIME_BRIDGE* rb)
+{
+	unsigned int workerIndex;
+	if (currentRuntime == runtime)
+		workerIndex = currentWorkerIndex;
+	else
+		workerIndex = runtime->nextWorker.fetch_add (1, std::memory_order_relaxed) % (unsigned int) runtime->workers.size();
+
+	RUNTIME_WORKER* worker = runtime->workers[workerIndex];
+	{
+		std::lock_guard<std::mutex> lock (worker->mutex);
+		worker->readyBridges.push_back (rb);
+	}
+
+	runtime->readyCount.fetch_add (1);
+	if (runtime->sleepingCount.load() > 0)
+	{
+		// Taking the mutex makes sure a worker that saw readyCount == 0 is already waiting, and gets the notification.
+		{ std::lock_guard<std::mutex> lock (runtime->sleepMutex); }
+		runtime->wake.notify_one();
+	}
+}
+
+static void PostEvent (STP_RUNTIME_BRIDGE* rb, RUNTIME_EVENT* e)
+{
+	STP_RUNTIME* runtime = rb->runtime;
+	runtime->outstandingEvents.fetch_add (1);
+	rb->queue.Push (e);
+
+	// A read-modify-write, not a load, so that it pairs with the exchange in WaitForPush: if it comes first, the worker's
+	// Pop sees this push complete; if it comes second, we see the worker waiting.
+	if (rb->waitingForPush.fetch_add (0) != 0)
+	{
+		{ std::lock_guard<std::mutex> lock (rb->pushMutex); }
+		rb->pushed.notify_one();
+	}
+
+	if (rb->queuedCount.fetch_add (1) == 0)
+		ScheduleBridge (runtime, rb);
+}
+
+static STP_RUNTIME_BRIDGE* TakeBridge (STP_RUNTIME* runtime, unsigned int workerIndex)
+{
+	unsigned int workerCount = (unsigned int) runtime->workers.size();
+	for (unsigned int i = 0; i < workerCount; i++)
+	{
+		RUNTIME_WORKER* worker = runtime->workers[(workerIndex + i) % workerCount];
+		std::lock_guard<std::mutex> lock (worker->mutex);
+		if (!worker->readyBridges.empty())
+		{
+			STP_RUNTIME_BRIDGE* rb;
+			if (i == 0)
+			{
+				rb = worker->readyBridges.front();
+				worker->readyBridges.pop_front();
+			}
+			else
+			{
+				rb = worker->readyBridges.back();
+				worker->readyBridges.pop_back();
+			}
+
+			runtime->readyCount.fetch_sub (1);
+			return rb;
+		}
+	}
+
+	return nullptr;
+}
+
+// ============================================================================
+
+// queuedCount is incremented after the push, so the event is there; but a producer that started pushing before
+// it may still be between its two steps, and Pop can't get past that producer's event until it's linked.
+// That producer may have been preempted, so sleep until it's done rather than spin.
+static RUNTIME_EVENT* WaitForPush (STP_RUNTIME_BRIDGE* rb)
+{
+	std::unique_lock<std::mutex> lock (rb->pushMutex);
+	rb->waitingForPush.exchange (1);
+
+	RUNTIME_EVENT* e;
+	while ((e = rb->queue.Pop()) == nullptr)
+		rb->pushed.wait (lock);
+
+	rb->waitingForPush.store (0);
+	return e;
+}
+
+// All events of a batch have the same timestamp, since STP_OnBpdusReceived takes only one.
+static void FlushBpduBatch (STP_BRIDGE* bridge, RUNTIME_EVENT** events, STP_RX_BPDU* bpdus, unsigned int& count)
+{
+	if (count == 0)
+		return;
+
+	if (count == 1)
+		STP_OnBpduReceived (bridge, bpdus[0].portIndex, bpdus[0].bpdu, bpdus[0].bpduSize, events[0]->timestamp);
+	else
+		STP_OnBpdusReceived (bridge, bpdus, count, events[0]->timestamp);
+
+	for (unsigned int i = 0; i < count; i++)
+		FreeEvent (events[i]);
+
+	count = 0;
+}
+
+// Processes at most MaxEventsPerRun events, then gives the other bridges of this worker a chance.
+static void RunBridge (STP_RUNTIME* runtime, STP_RUNTIME_BRIDGE* rb)
+{
+	unsigned int count = rb->queuedCount.load();
+	if (count > MaxEventsPerRun)
+		count = MaxEventsPerRun;
+
+	RUNTIME_EVENT* batchEvents [MaxEventsPerRun];
+	STP_RX_BPDU batch [MaxEventsPerRun];
+	unsigned int batchCount = 0;
+
+	for (unsigned int i = 0; i < count; i++)
+	{
+		RUNTIME_EVENT* e = rb->queue.Pop();
+		if (e == nullptr)
+			e = WaitForPush (rb);
+
+		if (e->type == RUNTIME_EVENT_BPDU)
+		{
+			if ((batchCount > 0) && (batchEvents[batchCount - 1]->timestamp != e->timestamp))
+				FlushBpduBatch (rb->bridge, batchEvents, batch, batchCount);
+
+			batchEvents[batchCount] = e;
+			batch[batchCount].portIndex = e->portIndex;
+			batch[batchCount].bpdu      = e->bpdu();
+			batch[batchCount].bpduSize  = e->bpduSize;
+			batchCount++;
+			continue;
+		}
+
+		FlushBpduBatch (rb->bridge, batchEvents, batch, batchCount);
+
+		if (e->type == RUNTIME_EVENT_PORT_ENABLED)
+			STP_OnPortEnabled (rb->bridge, e->portIndex, e->speedMegabitsPerSecond, e->detectedPointToPointMAC, e->timestamp);
+		else if (e->type == RUNTIME_EVENT_PORT_DISABLED)
+			STP_OnPortDisabled (rb->bridge, e->portIndex, e->timestamp);
+		else if (e->type == RUNTIME_EVENT_TICK)
+			STP_OnOneSecondTick (rb->bridge, e->timestamp);
+		else if (e->type == RUNTIME_EVENT_CALL)
+			e->call (rb->bridge, e->context, e->timestamp);
+		else
+			assert (false);
+
+		FreeEvent (e);
+	}
+
+	FlushBpduBatch (rb->bridge, batchEvents, batch, batchCount);
+
+	// Once queuedCount drops to zero some other thread may schedule the bridge or remove it, so this is the last access to rb.
+	bool drained = (rb->queuedCount.fetch_sub (count) == count);
+	if (!drained)
+		ScheduleBridge (runtime, rb);
+
+	bool idle = (runtime->outstandingEvents.fetch_sub (count) == count);
+	if (idle || (drained && (runtime->removingCount.load() > 0)))
+	{
+		{ std::lock_guard<std::mutex> lock (runtime->idleMutex); }
+		runtime->idle.notify_all();
+	}
+}
+
+static void WorkerThread (STP_RUNTIME* runtime, unsigned int workerIndex)
+{
+	currentRuntime = runtime;
+	currentWorkerIndex = workerIndex;
+
+	for (;;)
+	{
+		STP_RUNTIME_BRIDGE* rb = TakeBridge (runtime, workerIndex);
+		if (rb != nullptr)
+		{
+			RunBridge (runtime, rb);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock (runtime->sleepMutex);
+		runtime->sleepingCount.fetch_add (1);
+		while ((runtime->readyCount.load() == 0) && !runtime->stopping)
+			runtime->wake.wait (lock);
+		runtime->sleepingCount.fetch_sub (1);
+
+		if (runtime->stopping && (runtime->readyCount.load() == 0))
+			break;
+	}
+
+	currentRuntime = nullptr;
+}
+
+// ============================================================================
+
+STP_RUNTIME* STP_CreateRuntime (unsigned int threadCount)
+{
+	if (threadCount == 0)
+		threadCount = std::thread::hardware_concurrency();
+	if (threadCount == 0)
+		threadCount = 1;
+
+	STP_RUNTIME* runtime = new STP_RUNTIME();
+	runtime->nextWorker = 0;
+	runtime->readyCount = 0;
+	runtime->sleepingCount = 0;
+	runtime->stopping = false;
+	runtime->outstandingEvents = 0;
+	runtime->removingCount = 0;
+
+	for (unsigned int i = 0; i < threadCount; i++)
+		runtime->workers.push_back (new RUNTIME_WORKER());
+
+	// Start the threads only after the workers vector is complete, since they all read it.
+	for (unsigned int i = 0; i < threadCount; i++)
+		runtime->workers[i]->thread = std::thread (WorkerThread, runtime, i);
+
+	return runtime;
+}
+
+void STP_DestroyRuntime (STP_RUNTIME* runtime)
+{
+	assert (currentRuntime != runtime);
+	assert (runtime->bridges.empty()); // call STP_RuntimeRemoveBridge first
+
+	{
+		std::lock_guard<std::mutex> lock (runtime->sleepMutex);
+		runtime->stopping = true;
+	}
+
+	runtime->wake.notify_all();
+
+	// Join all before deleting any: a thread that hasn't exited yet may still look into the queues of the others.
+	for (size_t i = 0; i < runtime->workers.size(); i++)
+		runtime->workers[i]->thread.join();
+
+	for (size_t i = 0; i < runtime->workers.size(); i++)
+		delete runtime->workers[i];
+
+	delete runtime;
+}
+
+unsigned int STP_GetRuntimeThreadCount (const STP_RUNTIME* runtime)
+{
+	return (unsigned int) runtime->workers.size();
+}
+
+// ============================================================================
+
+STP_RUNTIME_BRIDGE* STP_RuntimeAddBridge (STP_RUNTIME* runtime, STP_BRIDGE* bridge)
+{
+	STP_RUNTIME_BRIDGE* rb = new STP_RUNTIME_BRIDGE();
+	rb->runtime = runtime;
+	rb->bridge = bridge;
+	rb->queuedCount = 0;
+	rb->waitingForPush = 0;
+
+	std::lock_guard<std::mutex> lock (runtime->bridgesMutex);
+	runtime->bridges.push_back (rb);
+	return rb;
+}
+
+void STP_RuntimeRemoveBridge (STP_RUNTIME_BRIDGE* rb)
+{
+	STP_RUNTIME* runtime = rb->runtime;
+	assert (currentRuntime != runtime);
+
+	// After this, STP_RuntimeOnOneSecondTick no longer posts to the bridge.
+	{
+		std::lock_guard<std::mutex> lock (runtime->bridgesMutex);
+		for (size_t i = 0; i < runtime->bridges.size(); i++)
+		{
+			if (runtime->bridges[i] == rb)
+			{
+				runtime->bridges.erase (runtime->bridges.begin() + i);
+				break;
+			}
+		}
+	}
+
+	// The application stopped posting to this bridge before calling us; wait for what's already queued.
+	// The worker that drains the queue sees removingCount and wakes us; see the end of RunBridge.
+	runtime->removingCount.fetch_add (1);
+	{
+		std::unique_lock<std::mutex> lock (runtime->idleMutex);
+		while (rb->queuedCount.load() != 0)
+			runtime->idle.wait (lock);
+	}
+	runtime->removingCount.fetch_sub (1);
+
+	delete rb;
+}
+
+// ============================================================================
+
+void STP_RuntimePostBpdu (STP_RUNTIME_BRIDGE* rb, unsigned int portIndex, const unsigned char* bpdu, unsigned int bpduSize, unsigned int timestamp)
+{
+	RUNTIME_EVENT* e = AllocEvent (RUNTIME_EVENT_BPDU, timestamp, bpduSize);
+	e->portIndex = portIndex;
+	e->bpduSize = bpduSize;
+	memcpy ((unsigned char*) (e + 1), bpdu, bpduSize);
+	PostEvent (rb, e);
+}
+
+void STP_RuntimePostPortEnabled (STP_RUNTIME_BRIDGE* rb, unsigned int portIndex, unsigned int speedMegabitsPerSecond, bool detectedPointToPointMAC, unsigned int timestamp)
+{
+	RUNTIME_EVENT* e = AllocEvent (RUNTIME_EVENT_PORT_ENABLED, timestamp);
+	e->portIndex = portIndex;
+	e->speedMegabitsPerSecond = speedMegabitsPerSecond;
+	e->detectedPointToPointMAC = detectedPointToPointMAC;
+	PostEvent (rb, e);
+}
+
+void STP_RuntimePostPortDisabled (STP_RUNTIME_BRIDGE* rb, unsigned int portIndex, unsigned int timestamp)
+{
+	RUNTIME_EVENT* e = AllocEvent (RUNTIME_EVENT_PORT_DISABLED, timestamp);
+	e->portIndex = portIndex;
+	PostEvent (rb, e);
+}
+
+void STP_RuntimePostCall (STP_RUNTIME_BRIDGE* rb, STP_RUNTIME_CALL call, void* context, unsigned int timestamp)
+{
+	RUNTIME_EVENT* e = AllocEvent (RUNTIME_EVENT_CALL, timestamp);
+	e->call = call;
+	e->context = context;
+	PostEvent (rb, e);
+}
+
+// The ticks are queued like any other event, so they reach the bridges in order with their other events;
+// the bridges being scheduled round robin, the ticks of the different bridges run in parallel on all workers.
+void STP_RuntimeOnOneSecondTick (STP_RUNTIME* runtime, unsigned int timestamp)
+{
+	std::lock_guard<std::mutex> lock (runtime->bridgesMutex);
+	for (size_t i = 0; i < runtime->bridges.size(); i++)
+		PostEvent (runtime->bridges[i], AllocEvent (RUNTIME_EVENT_TICK, timestamp));
+}
+
+void STP_RuntimeWaitIdle (STP_RUNTIME* runtime)
+{
+	assert (currentRuntime != runtime);
+
+	std::unique_lock<std::mutex> lock (runtime->idleMutex);
+	while (runtime->outstandingEvents.load() != 0)
+		runtime->idle.wait (lock);
+}
@@ -16,6 +16,48 @@
 	#define STP_USE_LOG 1
 #endif
 
+// When set to 1 (together with STP_USE_LOG), the library doesn't format log text and doesn't call debugStrOut; it stores
+// compact binary records in a ring buffer of debugLogBufferSize bytes instead. Get them with STP_GetBinaryLog
+// and turn them into text - on the device or elsewhere - with STP_DecodeBinaryLog.
+#ifndef STP_USE_BINARY_LOG
+	#define STP_USE_BINARY_LOG 0
+#endif
+
+// When set to 1, the LOG calls inside the library split their format strings into tokens at compile time
+// and check the types of their arguments against the format, so the logging code doesn't parse the formats at run time.
+// Needs C++11. It costs code size - a token table at each LOG call - so it's off by default; with STP_USE_BINARY_LOG,
+// which doesn't format text, only the compile-time checks remain and the tables go away.
+#ifndef STP_USE_TOKENIZED_LOG
+	#define STP_USE_TOKENIZED_LOG 0
+#endif
+
+// When set to 1, the library evaluates all state machines of all ports and trees until none of them makes a transition,
+// instead of evaluating only those whose input variables were written since they were last evaluated. Meant for debugging.
+#ifndef STP_USE_FULL_SWEEP
+	#define STP_USE_FULL_SWEEP 0
+#endif
+
+// When set to 1, the library stores the per-port variables of each tree next to each other (as opposed to the per-tree
+// variables of each port), and keeps the per-port flags read by the "for all ports of the tree" conditions also as bitsets.
+// This speeds up the computations done across all ports of a tree, which matters on bridges with many ports.
+#ifndef STP_USE_TREE_MAJOR_LAYOUT
+	#define STP_USE_TREE_MAJOR_LAYOUT 0
+#endif
+
+// When set to 1, the library counts received and transmitted BPDUs, state machine transitions and passes through the
+// state machines, and - if the application supplies the readClock callback - measures the time spent in STP_OnBpduReceived,
+// STP_OnBpdusReceived and STP_OnOneSecondTick. Read them with STP_GetCounters and STP_GetPortCounters. Takes about 2 KB per bridge.
+#ifndef STP_USE_COUNTERS
+	#define STP_USE_COUNTERS 0
+#endif
+
+// When set to 1, the library records for each tree what started its last reconvergence, the port role and port state changes
+// and proposal/agreement handshakes that followed, and when the tree settled. Read them with STP_GetConvergenceReport.
+// Takes about 600 bytes per tree.
+#ifndef STP_USE_CONVERGENCE_TRACE
+	#define STP_USE_CONVERGENCE_TRACE 0
+#endif
+
 struct STP_BRIDGE;
 
 enum STP_FLUSH_FDB_TYPE
@@ -35,6 +77,13 @@ enum STP_PORT_ROLE
 	STP_PORT_ROLE_MASTER,
 };
 
+// One contiguous piece of a frame passed to the transmitGather callback.
+struct STP_TX_FRAGMENT
+{
+	const void*  data;
+	unsigned int size;
+};
+
 typedef void  (*STP_CALLBACK_ENABLE_BPDU_TRAPPING)          (const struct STP_BRIDGE* bridge, bool enable, unsigned int timestamp);
 typedef void  (*STP_CALLBACK_ENABLE_LEARNING)               (const struct STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex, bool enable, unsigned int timestamp);
 typedef void  (*STP_CALLBACK_ENABLE_FORWARDING)             (const struct STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex, bool enable, unsigned int timestamp);
@@ -46,6 +95,8 @@ typedef void  (*STP_CALLBACK_ON_TOPOLOGY_CHANGE)            (const struct STP_BR
 typedef void  (*STP_CALLBACK_PORT_ROLE_CHANGED)             (const struct STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex, enum STP_PORT_ROLE role, unsigned int timestamp);
 typedef void* (*STP_CALLBACK_ALLOC_AND_ZERO_MEMORY) (unsigned int size);
 typedef void  (*STP_CALLBACK_FREE_MEMORY) (void* p);
+typedef void  (*STP_CALLBACK_TRANSMIT_GATHER)               (const struct STP_BRIDGE* bridge, unsigned int portIndex, const struct STP_TX_FRAGMENT* fragments, unsigned int fragmentCount, unsigned int timestamp);
+typedef unsigned int (*STP_CALLBACK_READ_CLOCK)             (const struct STP_BRIDGE* bridge);
 
 struct STP_CALLBACKS
 {
@@ -60,6 +111,8 @@ struct STP_CALLBACKS
 	STP_CALLBACK_PORT_ROLE_CHANGED           onPortRoleChanged;
 	STP_CALLBACK_ALLOC_AND_ZERO_MEMORY       allocAndZeroMemory;
 	STP_CALLBACK_FREE_MEMORY                 freeMemory;
+	STP_CALLBACK_TRANSMIT_GATHER             transmitGather; // optional; when set, used instead of transmitGetBuffer and transmitReleaseBuffer
+	STP_CALLBACK_READ_CLOCK                  readClock;      // optional; used only for the histograms in STP_COUNTERS
 };
 
 // 11.3 Point-to-point parameters in 802.1AC-2016 (values correspond to ieee8021BridgeBasePortAdminPointToPoint)
@@ -77,6 +130,135 @@ enum STP_VERSION
 	STP_VERSION_MSTP = 3,
 };
 
+// Verbosity levels for STP_SetLogFilter; each level includes the ones before it.
+enum STP_LOG_LEVEL
+{
+	STP_LOG_LEVEL_EVENTS = 1,  // calls into the library (port up/down, BPDU received, configuration changes)
+	STP_LOG_LEVEL_TRANSITIONS, // state machine transitions
+	STP_LOG_LEVEL_DETAILS,     // BPDU contents, priority vector calculations and other procedure internals
+};
+
+// The state machines, in the order they appear in clause 13 of 802.1Q-2018.
+enum STP_STATE_MACHINE
+{
+	STP_STATE_MACHINE_PORT_TIMERS,
+	STP_STATE_MACHINE_PORT_RECEIVE,
+	STP_STATE_MACHINE_PORT_PROTOCOL_MIGRATION,
+	STP_STATE_MACHINE_BRIDGE_DETECTION,
+	STP_STATE_MACHINE_PORT_TRANSMIT,
+	STP_STATE_MACHINE_PORT_INFORMATION,
+	STP_STATE_MACHINE_PORT_ROLE_SELECTION,
+	STP_STATE_MACHINE_PORT_ROLE_TRANSITIONS,
+	STP_STATE_MACHINE_PORT_STATE_TRANSITION,
+	STP_STATE_MACHINE_TOPOLOGY_CHANGE,
+	STP_STATE_MACHINE_L2G_PORT_RECEIVE,
+	STP_STATE_MACHINE_COUNT,
+};
+
+// Bits for the stateMachineMask parameter of STP_SetLogFilter.
+enum STP_LOG_STATE_MACHINE
+{
+	STP_LOG_STATE_MACHINE_PORT_TIMERS             = 1 << STP_STATE_MACHINE_PORT_TIMERS,
+	STP_LOG_STATE_MACHINE_PORT_RECEIVE            = 1 << STP_STATE_MACHINE_PORT_RECEIVE,
+	STP_LOG_STATE_MACHINE_PORT_PROTOCOL_MIGRATION = 1 << STP_STATE_MACHINE_PORT_PROTOCOL_MIGRATION,
+	STP_LOG_STATE_MACHINE_BRIDGE_DETECTION        = 1 << STP_STATE_MACHINE_BRIDGE_DETECTION,
+	STP_LOG_STATE_MACHINE_PORT_TRANSMIT           = 1 << STP_STATE_MACHINE_PORT_TRANSMIT,
+	STP_LOG_STATE_MACHINE_PORT_INFORMATION        = 1 << STP_STATE_MACHINE_PORT_INFORMATION,
+	STP_LOG_STATE_MACHINE_PORT_ROLE_SELECTION     = 1 << STP_STATE_MACHINE_PORT_ROLE_SELECTION,
+	STP_LOG_STATE_MACHINE_PORT_ROLE_TRANSITIONS   = 1 << STP_STATE_MACHINE_PORT_ROLE_TRANSITIONS,
+	STP_LOG_STATE_MACHINE_PORT_STATE_TRANSITION   = 1 << STP_STATE_MACHINE_PORT_STATE_TRANSITION,
+	STP_LOG_STATE_MACHINE_TOPOLOGY_CHANGE         = 1 << STP_STATE_MACHINE_TOPOLOGY_CHANGE,
+	STP_LOG_STATE_MACHINE_L2G_PORT_RECEIVE        = 1 << STP_STATE_MACHINE_L2G_PORT_RECEIVE,
+	STP_LOG_STATE_MACHINE_ALL                     = (1 << STP_STATE_MACHINE_COUNT) - 1,
+};
+
+// The BPDU types told apart by the validation in 14.5 of 802.1Q-2018. Which type a BPDU validates as depends also
+// on the protocol version the bridge runs; for instance an MSTP bridge forced to RSTP sees MST BPDUs as RST BPDUs.
+enum STP_BPDU_TYPE
+{
+	STP_BPDU_TYPE_INVALID,
+	STP_BPDU_TYPE_CONFIG,
+	STP_BPDU_TYPE_TCN,
+	STP_BPDU_TYPE_RST,
+	STP_BPDU_TYPE_MST,
+	STP_BPDU_TYPE_SPT,
+	STP_BPDU_TYPE_COUNT,
+};
+
+// Durations measured with the readClock callback, in the units of that callback.
+// buckets[0] counts the durations of zero, and buckets[n] those from 2^(n-1) to 2^n - 1.
+struct STP_HISTOGRAM
+{
+	unsigned int count;
+	unsigned int max;
+	unsigned int buckets [33];
+};
+
+// One more than the number of states of the state machine with the most states (Port Role Transitions); states start at 1.
+#define STP_MAX_STATE_MACHINE_STATES 34
+
+// Counters are 32 bits and wrap around.
+struct STP_COUNTERS
+{
+	unsigned int bpdusReceivedWhileStopped;
+	unsigned int runStateMachinesCalls;   // times the library ran the state machines for some event
+	unsigned int runStateMachinesPasses;  // passes through the state machines until none of them had a transition left to make
+	unsigned int stateMachineEvaluations; // times the library checked the conditions of one state machine of one port or tree
+	unsigned int transitions [STP_STATE_MACHINE_COUNT][STP_MAX_STATE_MACHINE_STATES]; // by state machine and new state; see STP_GetStateName
+	struct STP_HISTOGRAM bpduReceivedTime;   // one sample per call to STP_OnBpduReceived or STP_OnBpdusReceived
+	struct STP_HISTOGRAM oneSecondTickTime;  // one sample per call to STP_OnOneSecondTick
+};
+
+struct STP_PORT_COUNTERS
+{
+	unsigned int bpdusReceived [STP_BPDU_TYPE_COUNT];    // by the type they validated as; the invalid ones are discarded
+	unsigned int bpdusDiscarded;                         // received while the port was disabled
+	unsigned int bpdusTransmitted [STP_BPDU_TYPE_COUNT];
+};
+
+// What made a tree start reconverging; see STP_GetConvergenceReport.
+enum STP_CONVERGENCE_TRIGGER
+{
+	STP_CONVERGENCE_TRIGGER_MANAGEMENT,     // a call that changed the configuration, such as STP_SetBridgePriority
+	STP_CONVERGENCE_TRIGGER_BRIDGE_STARTED,
+	STP_CONVERGENCE_TRIGGER_PORT_ENABLED,
+	STP_CONVERGENCE_TRIGGER_PORT_DISABLED,
+	STP_CONVERGENCE_TRIGGER_BPDU_RECEIVED,
+	STP_CONVERGENCE_TRIGGER_TIMER,          // a timer expired during STP_OnOneSecondTick; for instance the information received on a port aged out
+};
+
+enum STP_CONVERGENCE_EVENT_TYPE
+{
+	STP_CONVERGENCE_EVENT_ROLE,       // value is the new STP_PORT_ROLE
+	STP_CONVERGENCE_EVENT_LEARNING,   // value is 1 when learning was enabled, 0 when disabled
+	STP_CONVERGENCE_EVENT_FORWARDING, // value is 1 when forwarding was enabled, 0 when disabled
+	STP_CONVERGENCE_EVENT_PROPOSING,  // the port started sending proposals (13.27.50 in 802.1Q-2018)
+	STP_CONVERGENCE_EVENT_PROPOSED,   // the port received a proposal (13.27.49)
+	STP_CONVERGENCE_EVENT_AGREE,      // the port started sending agreements (13.27.3)
+	STP_CONVERGENCE_EVENT_AGREED,     // the port received an agreement (13.27.4)
+};
+
+struct STP_CONVERGENCE_EVENT
+{
+	unsigned int   timestamp;
+	unsigned short portIndex;
+	unsigned char  type;  // STP_CONVERGENCE_EVENT_TYPE
+	unsigned char  value;
+};
+
+#define STP_CONVERGENCE_MAX_EVENTS 32
+
+struct STP_CONVERGENCE_REPORT
+{
+	enum STP_CONVERGENCE_TRIGGER trigger;
+	int          triggerPortIndex; // -1 when the trigger isn't specific to a port
+	unsigned int startTimestamp;   // timestamp of the first event
+	unsigned int endTimestamp;     // timestamp passed to the call after which the tree settled; valid only if converged is true
+	bool         converged;
+	unsigned int eventCount;       // may be larger than STP_CONVERGENCE_MAX_EVENTS; only the first events are kept
+	struct STP_CONVERGENCE_EVENT events [STP_CONVERGENCE_MAX_EVENTS];
+};
+
 // 13.8 in 802.1Q-2018
 struct STP_MST_CONFIG_ID
 {
@@ -113,6 +295,15 @@ struct STP_BRIDGE* STP_CreateBridge (unsigned int portCount,
                                      const struct STP_CALLBACKS* callbacks,
                                      const unsigned char bridgeAddress[6],
                                      unsigned int debugLogBufferSize);
+struct STP_BRIDGE* STP_CreateBridgeInBuffer (void* buffer,
+                                             unsigned int bufferSize,
+                                             unsigned int portCount,
+                                             unsigned int mstiCount,
+                                             unsigned int maxVlanNumber,
+                                             const struct STP_CALLBACKS* callbacks,
+                                             const unsigned char bridgeAddress[6],
+                                             unsigned int debugLogBufferSize);
+unsigned int STP_GetRequiredMemorySize (unsigned int portCount, unsigned int mstiCount, unsigned int maxVlanNumber);
 void STP_DestroyBridge (struct STP_BRIDGE* bridge);
 
 void STP_StartBridge (struct STP_BRIDGE* bridge, unsigned int timestamp);
@@ -122,6 +313,15 @@ bool STP_IsBridgeStarted (const struct STP_BRIDGE* bridge);
 void STP_EnableLogging (struct STP_BRIDGE* bridge, bool enable);
 bool STP_IsLoggingEnabled (const struct STP_BRIDGE* bridge);
 
+// Restricts the log to some ports, trees and state machines. In the bitmaps, bit n of byte n / 8 (least significant bit first)
+// stands for port n and tree n (0 being the CIST); NULL stands for all of them. Bridge-wide log lines pass the port and tree filters.
+// The library checks the filter before formatting anything, so what doesn't pass it costs next to nothing.
+void STP_SetLogFilter (struct STP_BRIDGE* bridge, const unsigned char* portBitmap, const unsigned char* treeBitmap, unsigned int stateMachineMask, enum STP_LOG_LEVEL maxLevel);
+
+typedef void (*STP_BINARY_LOG_TEXT_OUT) (void* context, int portIndex, int treeIndex, const char* nullTerminatedString, unsigned int stringLength);
+unsigned int STP_GetBinaryLog (const struct STP_BRIDGE* bridge, void* buffer, unsigned int bufferSize);
+bool STP_DecodeBinaryLog (const void* binaryLog, unsigned int binaryLogSize, STP_BINARY_LOG_TEXT_OUT textOut, void* context);
+
 unsigned int STP_GetPortCount (const struct STP_BRIDGE* bridge);
 unsigned int STP_GetMstiCount (const struct STP_BRIDGE* bridge);
 
@@ -132,10 +332,23 @@ void STP_SetStpVersion (struct STP_BRIDGE* bridge, enum STP_VERSION version, uns
 // Call this when you receive a BPDU.
 void STP_OnBpduReceived (struct STP_BRIDGE* bridge, unsigned int portIndex, const unsigned char* bpdu, unsigned int bpduSize, unsigned int timestamp);
 
+struct STP_RX_BPDU
+{
+	unsigned int         portIndex;
+	const unsigned char* bpdu;
+	unsigned int         bpduSize;
+};
+
+// Call this instead of STP_OnBpduReceived when you have several BPDUs received at about the same time.
+void STP_OnBpdusReceived (struct STP_BRIDGE* bridge, const struct STP_RX_BPDU* bpdus, unsigned int bpduCount, unsigned int timestamp);
+
 // Call this every time the bridge's MAC address changes while STP is running.
 void STP_SetBridgeAddress (struct STP_BRIDGE* bridge, const unsigned char* address, unsigned int timestamp);
 const struct STP_BRIDGE_ADDRESS* STP_GetBridgeAddress (const struct STP_BRIDGE* bridge);
 
+// Sets the source MAC address in the Ethernet header passed to the transmitGather callback. Not needed otherwise.
+void STP_SetPortAddress (struct STP_BRIDGE* bridge, unsigned int portIndex, const unsigned char address[6]);
+
 // Call these whenever one of the ports changes state (link up/down).
 void STP_OnPortEnabled (struct STP_BRIDGE* bridge, unsigned int portIndex, unsigned int speedMegabitsPerSecond, bool detectedPointToPointMAC, unsigned int timestamp);
 void STP_OnPortDisabled (struct STP_BRIDGE* bridge, unsigned int portIndex, unsigned int timestamp);
@@ -216,6 +429,8 @@ struct STP_CONFIG_TABLE_ENTRY
 void STP_SetMstConfigTable (struct STP_BRIDGE* bridge, const struct STP_CONFIG_TABLE_ENTRY* entries, unsigned int entryCount, unsigned int timestamp);
 void STP_SetMstConfigTableEntry (struct STP_BRIDGE* bridge, unsigned int vlanNumber, unsigned int treeIndex, unsigned int timestamp);
 const struct STP_CONFIG_TABLE_ENTRY* STP_GetMstConfigTable (struct STP_BRIDGE* bridge, unsigned int* entryCountOut);
+void STP_BeginMstConfigChanges (struct STP_BRIDGE* bridge);
+void STP_CommitMstConfigChanges (struct STP_BRIDGE* bridge, unsigned int timestamp);
 unsigned int STP_GetMaxVlanNumber (const struct STP_BRIDGE* bridge);
 unsigned int STP_GetTreeIndexFromVlanNumber (const struct STP_BRIDGE* bridge, unsigned int vlanNumber);
 const struct STP_MST_CONFIG_ID* STP_GetMstConfigId (const struct STP_BRIDGE* bridge);
@@ -258,6 +473,19 @@ void STP_SetTxHoldCount (struct STP_BRIDGE* bridge, unsigned int txHoldCound, un
 unsigned int STP_GetTxHoldCount (const struct STP_BRIDGE* bridge);
 unsigned int STP_GetTxCount (const struct STP_BRIDGE* bridge, unsigned int portIndex);
 
+// The counters are there only when the library is compiled with STP_USE_COUNTERS; otherwise these return zeroes.
+void STP_GetCounters (const struct STP_BRIDGE* bridge, struct STP_COUNTERS* countersOut);
+void STP_GetPortCounters (const struct STP_BRIDGE* bridge, unsigned int portIndex, struct STP_PORT_COUNTERS* countersOut);
+void STP_ResetCounters (struct STP_BRIDGE* bridge);
+
+// Returns the last reconvergence of the tree that changed some port role or port state - or the one in progress, if it did.
+// Returns false when the library is compiled without STP_USE_CONVERGENCE_TRACE, or when there was no such reconvergence yet.
+bool STP_GetConvergenceReport (const struct STP_BRIDGE* bridge, unsigned int treeIndex, struct STP_CONVERGENCE_REPORT* reportOut);
+
+// These return NULL when the library is compiled without STP_USE_LOG.
+const char* STP_GetStateMachineName (enum STP_STATE_MACHINE stateMachine);
+const char* STP_GetStateName (enum STP_STATE_MACHINE stateMachine, unsigned int state);
+
 void  STP_SetApplicationContext (struct STP_BRIDGE* bridge, void* applicationContext);
 void* STP_GetApplicationContext (const struct STP_BRIDGE* bridge);
 
@@ -0,0 +1,58 @@
+// This file is part of the mstp-lib library, available at https://github.com/adigostin/mstp-lib
+// Copyright (c) 2011-2020 Adi Gostin, distributed under Apache License v2.0.
+//
+// Optional layer on top of stp.h for applications that run many bridges in the same process (one per tenant or VRF).
+// It owns a pool of worker threads and runs the events of different bridges in parallel, while the events of any
+// one bridge run one at a time and in the order they were posted. The library itself keeps all its state inside
+// the STP_BRIDGE objects, so that's all the synchronization it needs.
+//
+// The core library is C++03 and has no threads; this layer is C++11 and lives in mstp-lib/runtime.
+// Applications that don't need it shouldn't compile it.
+
+#ifndef MSTP_LIB_RUNTIME_H
+#define MSTP_LIB_RUNTIME_H
+
+#include "stp.h"
+
+struct STP_RUNTIME;
+struct STP_RUNTIME_BRIDGE;
+
+// Signature of the function passed to STP_RuntimePostCall; it is called on a worker thread
+// and may call any STP_xxx function on the bridge passed to it (and on no other bridge).
+typedef void (*STP_RUNTIME_CALL) (struct STP_BRIDGE* bridge, void* context, unsigned int timestamp);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Pass zero as threadCount for one thread per core.
+struct STP_RUNTIME* STP_CreateRuntime (unsigned int threadCount);
+void STP_DestroyRuntime (struct STP_RUNTIME* runtime);
+unsigned int STP_GetRuntimeThreadCount (const struct STP_RUNTIME* runtime);
+
+// After STP_RuntimeAddBridge, the application must no longer call STP_xxx functions on the bridge directly;
+// it posts events instead. The bridge remains owned by the application, which may destroy it
+// only after STP_RuntimeRemoveBridge returns.
+struct STP_RUNTIME_BRIDGE* STP_RuntimeAddBridge (struct STP_RUNTIME* runtime, struct STP_BRIDGE* bridge);
+void STP_RuntimeRemoveBridge (struct STP_RUNTIME_BRIDGE* runtimeBridge);
+
+// These can be called from any thread, including from STP callbacks running on the runtime's worker threads.
+// The BPDU is copied; consecutive BPDUs posted for the same bridge with the same timestamp are passed
+// to STP_OnBpdusReceived in one go, so each BPDU is processed, logged and traced with its own timestamp.
+void STP_RuntimePostBpdu (struct STP_RUNTIME_BRIDGE* runtimeBridge, unsigned int portIndex, const unsigned char* bpdu, unsigned int bpduSize, unsigned int timestamp);
+void STP_RuntimePostPortEnabled (struct STP_RUNTIME_BRIDGE* runtimeBridge, unsigned int portIndex, unsigned int speedMegabitsPerSecond, bool detectedPointToPointMAC, unsigned int timestamp);
+void STP_RuntimePostPortDisabled (struct STP_RUNTIME_BRIDGE* runtimeBridge, unsigned int portIndex, unsigned int timestamp);
+void STP_RuntimePostCall (struct STP_RUNTIME_BRIDGE* runtimeBridge, STP_RUNTIME_CALL call, void* context, unsigned int timestamp);
+
+// Call this once a second instead of calling STP_OnOneSecondTick for each bridge.
+void STP_RuntimeOnOneSecondTick (struct STP_RUNTIME* runtime, unsigned int timestamp);
+
+// Waits until all events posted so far - and all events posted while processing them - have been processed.
+// May not be called from a worker thread.
+void STP_RuntimeWaitIdle (struct STP_RUNTIME* runtime);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -13,8 +13,6 @@ using namespace D2D1;
 
 static constexpr UINT WM_PACKET_RECEIVED = WM_APP + 1;
 
-static constexpr uint8_t BpduDestAddress[6] = { 1, 0x80, 0xC2, 0, 0, 0 };
-
 std::string mac_address_to_string (mac_address address)
 {
 	std::stringstream ss;
@@ -64,6 +62,7 @@ UINT_PTR bridge::_one_second_timer_id;
 std::unordered_set<bridge*> bridge::_created_bridges;
 
 bridge::bridge (size_t port_count, size_t msti_count, mac_address macAddress)
+	: bridge_core (port_count, msti_count, max_vlan_number, &StpCallbacks, macAddress)
 {
 	for (size_t i = 0; i < 1 + msti_count; i++)
 		_trees.push_back (std::make_unique<bridge_tree>(this, i));
@@ -82,9 +81,7 @@ bridge::bridge (size_t port_count, size_t msti_count, mac_address macAddress)
 	_width = std::max (offset, MinWidth);
 	_height = DefaultHeight;
 
-	_stpBridge = STP_CreateBridge ((unsigned int)port_count, (unsigned int)msti_count, max_vlan_number, &StpCallbacks, macAddress.data(), 256);
-	STP_EnableLogging (_stpBridge, true);
-	STP_SetApplicationContext (_stpBridge, this);
+	STP_EnableLogging (_stp_bridge, true);
 
 	for (auto& port : _ports)
 		port->invalidated().add_handler(&OnPortInvalidate, this);
@@ -97,8 +94,8 @@ bridge::bridge (size_t port_count, size_t msti_count, mac_address macAddress)
 		{
 			for (auto bridge : _created_bridges)
 			{
-				if (bridge->project())
-					bridge->OnLinkPulseTick();
+				if (bridge->simulate_link_pulses())
+					bridge->on_link_pulse_tick ((uint32_t) ::GetMessageTime());
 			}
 		};
 		_link_pulse_timer_id = ::SetTimer (nullptr, 0, 16, link_pulse_callback); assert(_link_pulse_timer_id);
@@ -109,7 +106,7 @@ bridge::bridge (size_t port_count, size_t msti_count, mac_address macAddress)
 			for (auto bridge : _created_bridges)
 			{
 				if (bridge->project() && !bridge->project()->simulation_paused())
-					STP_OnOneSecondTick (bridge->_stpBridge, ::GetMessageTime());
+					STP_OnOneSecondTick (bridge->_stp_bridge, ::GetMessageTime());
 			}
 		};
 		_one_second_timer_id = ::SetTimer (nullptr, 0, 1000, one_second_callback); assert(_one_second_timer_id);
@@ -163,7 +160,6 @@ bridge::~bridge()
 
 	for (auto& port : _ports)
 		port->invalidated().remove_handler(&OnPortInvalidate, this);
-	STP_DestroyBridge (_stpBridge);
 }
 
 //static
@@ -173,33 +169,6 @@ void bridge::OnPortInvalidate (void* callbackArg, renderable_object* object)
 	bridge->event_invoker<invalidate_e>()(bridge);
 }
 
-// Checks the wires and computes macOperational for each port on this bridge.
-void bridge::OnLinkPulseTick()
-{
-	uint32_t now = (uint32_t) ::GetMessageTime();
-
-	bool invalidate = false;
-	for (size_t portIndex = 0; portIndex < _ports.size(); portIndex++)
-	{
-		auto port = _ports[portIndex].get();
-		if (port->_missedLinkPulseCounter < port::MissedLinkPulseCounterMax)
-		{
-			port->_missedLinkPulseCounter++;
-			if (port->_missedLinkPulseCounter == port::MissedLinkPulseCounterMax)
-			{
-				port->set_actual_speed(0);
-				STP_OnPortDisabled (_stpBridge, (unsigned int) portIndex, now);
-				invalidate = true;
-			}
-		}
-
-		this->event_invoker<packet_transmit_e>()(this, portIndex, link_pulse_t { now, port->supported_speed() });
-	}
-
-	if (invalidate)
-		this->event_invoker<invalidate_e>()(this);
-}
-
 void bridge::enqueue_received_packet (packet_t&& packet, size_t rxPortIndex)
 {
 	_rxQueue.push ({ rxPortIndex, std::move(packet) });
@@ -208,89 +177,39 @@ void bridge::enqueue_received_packet (packet_t&& packet, size_t rxPortIndex)
 
 void bridge::ProcessReceivedPackets()
 {
-	bool invalidate = false;
-
 	while (!_rxQueue.empty())
 	{
 		size_t rxPortIndex = _rxQueue.front().first;
-		auto port = _ports[rxPortIndex].get();
-		auto sd = std::move(_rxQueue.front().second);
+		auto packet = std::move(_rxQueue.front().second);
 		_rxQueue.pop();
+		on_packet_received (rxPortIndex, std::move(packet));
+	}
+}
 
-		if (std::holds_alternative<link_pulse_t>(sd))
-		{
-			auto lpsd = std::get<link_pulse_t>(sd);
-			bool oldMacOperational = port->_missedLinkPulseCounter < port::MissedLinkPulseCounterMax;
-			port->_missedLinkPulseCounter = 0;
-			if (oldMacOperational == false)
-			{
-				// Send a link pulse right away, to make sure the other port goes up before we send it any frame.
-				this->event_invoker<packet_transmit_e>()(this, rxPortIndex, link_pulse_t { lpsd.timestamp, port->supported_speed() });
+void bridge::transmit (size_t tx_port_index, packet_t&& packet)
+{
+	this->event_invoker<packet_transmit_e>()(this, tx_port_index, std::move(packet));
+}
 
-				auto actual_speed = std::min (lpsd.sender_supported_speed, port->supported_speed());
-				port->set_actual_speed(actual_speed);
+uint32_t bridge::supported_speed (size_t port_index) const
+{
+	return _ports[port_index]->supported_speed();
+}
 
-				STP_OnPortEnabled (_stpBridge, (unsigned int) rxPortIndex, actual_speed, true, lpsd.timestamp);
-				invalidate = true;
-			}
-		}
-		else if (std::holds_alternative<frame_t>(sd))
-		{
-			auto fsd = std::get<frame_t>(sd);
+uint32_t bridge::actual_speed (size_t port_index) const
+{
+	return _ports[port_index]->_actual_speed;
+}
 
-			if (!port->mac_operational())
-			{
-				// The sender must be misbehaving (forgot to send link pulses). Currently the simulator is single-threaded so this shouldn't happen.
-				assert(false);
-			}
-			else
-			{
-				if ((fsd.data.size() >= 6) && (memcmp (&fsd.data[0], BpduDestAddress, 6) == 0))
-				{
-					// It's a BPDU.
-					if (_bpdu_trapping_enabled)
-					{
-						STP_OnBpduReceived (_stpBridge, (unsigned int) rxPortIndex, &fsd.data[21], (unsigned int) (fsd.data.size() - 21), fsd.timestamp);
-					}
-					else
-					{
-						// broadcast it to the other ports.
-						for (size_t txPortIndex = 0; txPortIndex < _ports.size(); txPortIndex++)
-						{
-							if (txPortIndex == rxPortIndex)
-								continue;
-
-							auto txPortAddress = GetPortAddress(txPortIndex);
-
-							// If it already went through this port, we have a loop that would hang our UI.
-							if (std::find (fsd.tx_path_taken.begin(), fsd.tx_path_taken.end(), txPortAddress) != fsd.tx_path_taken.end())
-							{
-								// We don't do anything here; we have code in wire.cpp that shows loops to the user - as thick red wires.
-								//volatile int a = 0;
-							}
-							else
-							{
-								frame_t f;
-								f.timestamp = fsd.timestamp;
-								f.data = fsd.data;
-								f.tx_path_taken = fsd.tx_path_taken;
-								f.tx_path_taken.push_back (txPortAddress);
-
-								this->event_invoker<packet_transmit_e>()(this, txPortIndex, std::move(f));
-							}
-						}
-					}
-				}
-				else
-					assert(false); // not implemented
-			}
-		}
-		else
-			assert(false);
-	}
+void bridge::set_actual_speed (size_t port_index, uint32_t speed)
+{
+	_ports[port_index]->set_actual_speed(speed);
+	this->event_invoker<invalidate_e>()(this);
+}
 
-	if (invalidate)
-		this->event_invoker<invalidate_e>()(this);
+bool bridge::simulate_link_pulses() const
+{
+	return (project() != nullptr) && project()->simulate_link_pulses();
 }
 
 void bridge::set_location(float x, float y)
@@ -305,21 +224,21 @@ void bridge::set_location(float x, float y)
 
 void bridge::render (ID2D1RenderTarget* dc, const drawing_resources& dos, unsigned int vlanNumber, const D2D1_COLOR_F& configIdColor) const
 {
-	auto treeIndex = STP_GetTreeIndexFromVlanNumber (_stpBridge, vlanNumber);
+	auto treeIndex = STP_GetTreeIndexFromVlanNumber (_stp_bridge, vlanNumber);
 
 	std::stringstream text;
 	float bridgeOutlineWidth = OutlineWidth;
-	if (STP_IsBridgeStarted(_stpBridge))
+	if (STP_IsBridgeStarted(_stp_bridge))
 	{
-		auto stpVersion = STP_GetStpVersion(_stpBridge);
-		auto treeIndex = STP_GetTreeIndexFromVlanNumber(_stpBridge, vlanNumber);
-		bool isCistRoot = STP_IsCistRoot(_stpBridge);
-		bool isRegionalRoot = (treeIndex > 0) && STP_IsRegionalRoot(_stpBridge, treeIndex);
+		auto stpVersion = STP_GetStpVersion(_stp_bridge);
+		auto treeIndex = STP_GetTreeIndexFromVlanNumber(_stp_bridge, vlanNumber);
+		bool isCistRoot = STP_IsCistRoot(_stp_bridge);
+		bool isRegionalRoot = (treeIndex > 0) && STP_IsRegionalRoot(_stp_bridge, treeIndex);
 
 		if ((treeIndex == 0) ? isCistRoot : isRegionalRoot)
 			bridgeOutlineWidth *= 2;
 
-		text << std::uppercase << std::setfill('0') << std::setw(4) << std::hex << STP_GetBridgePriority(_stpBridge, treeIndex) << '.' << mac_address_to_string(bridge_address()) << std::endl;
+		text << std::uppercase << std::setfill('0') << std::setw(4) << std::hex << STP_GetBridgePriority(_stp_bridge, treeIndex) << '.' << mac_address_to_string(bridge_address()) << std::endl;
 		text << "STP enabled (" << STP_GetVersionString(stpVersion) << ")" << std::endl;
 		text << (isCistRoot ? "CIST Root Bridge\r\n" : "");
 		if (stpVersion >= STP_VERSION_MSTP)
@@ -379,38 +298,20 @@ renderable_object::ht_result bridge::hit_test (const edge::zoomable_i* zoomable,
 	return {};
 }
 
-std::array<uint8_t, 6> bridge::GetPortAddress (size_t portIndex) const
-{
-	std::array<uint8_t, 6> pa = bridge_address();
-	pa[5]++;
-	if (pa[5] == 0)
-	{
-		pa[4]++;
-		if (pa[4] == 0)
-		{
-			pa[3]++;
-			if (pa[3] == 0)
-				assert(false); // not implemented
-		}
-	}
-
-	return pa;
-}
-
 mac_address bridge::bridge_address() const
 {
 	mac_address address;
 	auto x = sizeof(address);
-	memcpy (address.data(), STP_GetBridgeAddress(_stpBridge)->bytes, 6);
+	memcpy (address.data(), STP_GetBridgeAddress(_stp_bridge)->bytes, 6);
 	return address;
 }
 
 void bridge::set_bridge_address (mac_address address)
 {
-	if (memcmp(STP_GetBridgeAddress(_stpBridge)->bytes, address.data(), 6) != 0)
+	if (memcmp(STP_GetBridgeAddress(_stp_bridge)->bytes, address.data(), 6) != 0)
 	{
 		this->on_property_changing(&bridge_address_property);
-		STP_SetBridgeAddress(_stpBridge, address.data(), GetMessageTime());
+		STP_SetBridgeAddress(_stp_bridge, address.data(), GetMessageTime());
 		this->on_property_changed(&bridge_address_property);
 	}
 }
@@ -486,7 +387,7 @@ void bridge::clear_log()
 
 std::string bridge::mst_config_id_name() const
 {
-	auto configId = STP_GetMstConfigId(_stpBridge);
+	auto configId = STP_GetMstConfigId(_stp_bridge);
 	size_t len = strnlen (configId->ConfigurationName, 32);
 	return std::string(std::begin(configId->ConfigurationName), std::begin(configId->ConfigurationName) + len);
 }
@@ -501,13 +402,13 @@ void bridge::set_mst_config_id_name (std::string value)
 	null_terminated[value.size()] = 0;
 
 	this->on_property_changing(&mst_config_id_name_property);
-	STP_SetMstConfigName (_stpBridge, null_terminated, GetMessageTime());
+	STP_SetMstConfigName (_stp_bridge, null_terminated, GetMessageTime());
 	this->on_property_changed(&mst_config_id_name_property);
 }
 
 uint32_t bridge::GetMstConfigIdRevLevel() const
 {
-	auto id = STP_GetMstConfigId(_stpBridge);
+	auto id = STP_GetMstConfigId(_stp_bridge);
 	return ((unsigned short) id->RevisionLevelHigh << 8) | (unsigned short) id->RevisionLevelLow;
 }
 
@@ -516,14 +417,14 @@ void bridge::SetMstConfigIdRevLevel (uint32_t revLevel)
 	if (GetMstConfigIdRevLevel() != revLevel)
 	{
 		this->on_property_changing(&mst_config_id_rev_level);
-		STP_SetMstConfigRevisionLevel (_stpBridge, revLevel, GetMessageTime());
+		STP_SetMstConfigRevisionLevel (_stp_bridge, revLevel, GetMessageTime());
 		this->on_property_changed(&mst_config_id_rev_level);
 	}
 }
 
 std::string bridge::GetMstConfigIdDigest() const
 {
-	const unsigned char* digest = STP_GetMstConfigId(_stpBridge)->ConfigurationDigest;
+	const unsigned char* digest = STP_GetMstConfigId(_stp_bridge)->ConfigurationDigest;
 	std::stringstream ss;
 	ss << std::uppercase << std::setfill('0') << std::hex
 		<< std::setw(2) << (int) digest[0]  << std::setw(2) << (int) digest[1]  << std::setw(2) << (int) digest[2]  << std::setw(2) << (int) digest[3]
@@ -536,8 +437,9 @@ std::string bridge::GetMstConfigIdDigest() const
 void bridge::SetMstConfigTable (const STP_CONFIG_TABLE_ENTRY* entries, size_t entryCount)
 {
 	this->on_property_changing (&mst_config_id_digest);
-	STP_SetMstConfigTable (_stpBridge, &entries[0], (unsigned int) entryCount, GetMessageTime());
+	STP_SetMstConfigTable (_stp_bridge, &entries[0], (unsigned int) entryCount, GetMessageTime());
 	this->on_property_changed (&mst_config_id_digest);
+	this->event_invoker<forwarding_changed_e>()(this);
 }
 
 void bridge::set_stp_enabled (bool value)
@@ -548,28 +450,30 @@ void bridge::set_stp_enabled (bool value)
 		return;
 	}
 
-	if (value && !STP_IsBridgeStarted(_stpBridge))
+	if (value && !STP_IsBridgeStarted(_stp_bridge))
 	{
 		this->on_property_changing(&stp_enabled_property);
-		STP_StartBridge (_stpBridge, GetMessageTime());
+		STP_StartBridge (_stp_bridge, GetMessageTime());
 		this->on_property_changed(&stp_enabled_property);
+		this->event_invoker<forwarding_changed_e>()(this);
 		this->event_invoker<invalidate_e>()(this);
 	}
-	else if (!value && STP_IsBridgeStarted(_stpBridge))
+	else if (!value && STP_IsBridgeStarted(_stp_bridge))
 	{
 		this->on_property_changing(&stp_enabled_property);
-		STP_StopBridge (_stpBridge, GetMessageTime());
+		STP_StopBridge (_stp_bridge, GetMessageTime());
 		this->on_property_changed(&stp_enabled_property);
+		this->event_invoker<forwarding_changed_e>()(this);
 		this->event_invoker<invalidate_e>()(this);
 	}
 }
 
 void bridge::set_stp_version (STP_VERSION stp_version)
 {
-	if (STP_GetStpVersion(_stpBridge) != stp_version)
+	if (STP_GetStpVersion(_stp_bridge) != stp_version)
 	{
 		this->on_property_changing(&stp_version_property);
-		STP_SetStpVersion(_stpBridge, stp_version, GetMessageTime());
+		STP_SetStpVersion(_stp_bridge, stp_version, GetMessageTime());
 		this->on_property_changed(&stp_version_property);
 	}
 }
@@ -582,7 +486,7 @@ void bridge::set_bridge_max_age (uint32_t value)
 	if (bridge_max_age() != value)
 	{
 		this->on_property_changing (&bridge_max_age_property);
-		STP_SetBridgeMaxAge (_stpBridge, value, ::GetMessageTime());
+		STP_SetBridgeMaxAge (_stp_bridge, value, ::GetMessageTime());
 		this->on_property_changed (&bridge_max_age_property);
 	}
 }
@@ -592,7 +496,7 @@ void bridge::set_bridge_forward_delay (uint32_t value)
 	if (bridge_forward_delay() != value)
 	{
 		this->on_property_changing (&bridge_forward_delay_property);
-		STP_SetBridgeForwardDelay (_stpBridge, value, ::GetMessageTime());
+		STP_SetBridgeForwardDelay (_stp_bridge, value, ::GetMessageTime());
 		this->on_property_changed (&bridge_forward_delay_property);
 	}
 }
@@ -602,7 +506,7 @@ void bridge::set_tx_hold_count (uint32_t value)
 	if (tx_hold_count() != value)
 	{
 		this->on_property_changing(&tx_hold_count_property);
-		STP_SetTxHoldCount(_stpBridge, value, ::GetMessageTime());
+		STP_SetTxHoldCount(_stp_bridge, value, ::GetMessageTime());
 		this->on_property_changed(&tx_hold_count_property);
 	}
 }
@@ -612,35 +516,36 @@ void bridge::set_tx_hold_count (uint32_t value)
 size_t bridge::mst_config_table_get_value_count() const
 {
 	unsigned int entry_count;
-	STP_GetMstConfigTable(_stpBridge, &entry_count);
+	STP_GetMstConfigTable(_stp_bridge, &entry_count);
 	return entry_count;
 }
 
 uint32_t bridge::mst_config_table_get_value(size_t i) const
 {
 	unsigned int entry_count;
-	auto entries = STP_GetMstConfigTable(_stpBridge, &entry_count);
+	auto entries = STP_GetMstConfigTable(_stp_bridge, &entry_count);
 	return entries[i].treeIndex;
 }
 
 void bridge::mst_config_table_set_value(size_t i, uint32_t value)
 {
 	unsigned int entry_count;
-	auto table = STP_GetMstConfigTable (_stpBridge, &entry_count);
+	auto table = STP_GetMstConfigTable (_stp_bridge, &entry_count);
 	assert (i < entry_count);
 	if (table->treeIndex != value)
 	{
 		property_change_args args = { &mst_config_table_property, i, collection_property_change_type::set };
 		this->on_property_changing(args);
-		STP_SetMstConfigTableEntry (_stpBridge, (unsigned int)i, value, ::GetMessageTime());
+		STP_SetMstConfigTableEntry (_stp_bridge, (unsigned int)i, value, ::GetMessageTime());
 		this->on_property_changed(args);
+		this->event_invoker<forwarding_changed_e>()(this);
 	}
 }
 
 bool bridge::mst_config_table_changed() const
 {
 	unsigned int entry_count;
-	const STP_CONFIG_TABLE_ENTRY* entries = STP_GetMstConfigTable (_stpBridge, &entry_count);
+	const STP_CONFIG_TABLE_ENTRY* entries = STP_GetMstConfigTable (_stp_bridge, &entry_count);
 
 	static constexpr STP_CONFIG_TABLE_ENTRY zero = { };
 	for (auto e = entries; e < &entries[entry_count]; e++)
@@ -661,7 +566,10 @@ void bridge::on_deserializing()
 void bridge::on_deserialized()
 {
 	if (_enable_stp_after_deserialize)
-		STP_StartBridge (_stpBridge, ::GetMessageTime());
+	{
+		STP_StartBridge (_stp_bridge, ::GetMessageTime());
+		this->event_invoker<forwarding_changed_e>()(this);
+	}
 	_deserializing = false;
 }
 
@@ -838,70 +746,32 @@ const STP_CALLBACKS bridge::StpCallbacks =
 	&StpCallback_OnPortRoleChanged,
 	&StpCallback_AllocAndZeroMemory,
 	&StpCallback_FreeMemory,
+	nullptr, // transmitGather
+	nullptr, // readClock
 };
 
-void* bridge::StpCallback_AllocAndZeroMemory(unsigned int size)
-{
-	void* p = malloc(size);
-	memset (p, 0, size);
-	return p;
-}
-
-void bridge::StpCallback_FreeMemory(void* p)
-{
-	free(p);
-}
-
-void* bridge::StpCallback_TransmitGetBuffer (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int bpduSize, unsigned int timestamp)
-{
-	auto b = static_cast<class bridge*>(STP_GetApplicationContext(bridge));
-	auto txPort = b->_ports[portIndex].get();
-
-	b->_txPacketData.resize (bpduSize + 21);
-	memcpy (&b->_txPacketData[0], BpduDestAddress, 6);
-	memcpy (&b->_txPacketData[6], &b->GetPortAddress(portIndex)[0], 6);
-	b->_txTransmittingPort = txPort;
-	b->_txTimestamp = timestamp;
-	return &b->_txPacketData[21];
-}
-
-void bridge::StpCallback_TransmitReleaseBuffer (const STP_BRIDGE* bridge, void* bufferReturnedByGetBuffer)
-{
-	auto b = static_cast<class bridge*>(STP_GetApplicationContext(bridge));
-
-	frame_t info;
-	info.data = std::move(b->_txPacketData);
-	info.timestamp = b->_txTimestamp;
-	b->event_invoker<packet_transmit_e>()(b, b->_txTransmittingPort->port_index(), std::move(info));
-}
-
-void bridge::StpCallback_EnableBpduTrapping (const STP_BRIDGE* bridge, bool enable, unsigned int timestamp)
-{
-	auto b = static_cast<class bridge*>(STP_GetApplicationContext(bridge));
-	b->_bpdu_trapping_enabled = enable;
-}
-
 void bridge::StpCallback_EnableLearning (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex, bool enable, unsigned int timestamp)
 {
-	auto b = static_cast<class bridge*>(STP_GetApplicationContext(bridge));
+	auto b = from_stp_bridge<class bridge>(bridge);
 	b->event_invoker<invalidate_e>()(b);
 }
 
 void bridge::StpCallback_EnableForwarding (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex, bool enable, unsigned int timestamp)
 {
-	auto b = static_cast<class bridge*>(STP_GetApplicationContext(bridge));
+	auto b = from_stp_bridge<class bridge>(bridge);
+	b->event_invoker<forwarding_changed_e>()(b);
 	b->event_invoker<invalidate_e>()(b);
 }
 
 void bridge::StpCallback_FlushFdb (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex, enum STP_FLUSH_FDB_TYPE flushType, unsigned int timestamp)
 {
-	auto b = static_cast<class bridge*>(STP_GetApplicationContext(bridge));
+	auto b = from_stp_bridge<class bridge>(bridge);
 	b->_ports[portIndex]->_trees[treeIndex]->flush_fdb(timestamp);
 }
 
 void bridge::StpCallback_DebugStrOut (const STP_BRIDGE* bridge, int portIndex, int treeIndex, const char* nullTerminatedString, unsigned int stringLength, unsigned int flush)
 {
-	auto b = static_cast<class bridge*>(STP_GetApplicationContext(bridge));
+	auto b = from_stp_bridge<class bridge>(bridge);
 
 	if (stringLength > 0)
 	{
@@ -938,13 +808,13 @@ void bridge::StpCallback_DebugStrOut (const STP_BRIDGE* bridge, int portIndex, i
 
 void bridge::StpCallback_OnTopologyChange (const STP_BRIDGE* bridge, unsigned int treeIndex, unsigned int timestamp)
 {
-	auto b = static_cast<class bridge*>(STP_GetApplicationContext(bridge));
+	auto b = from_stp_bridge<class bridge>(bridge);
 	b->_trees[treeIndex]->on_topology_change(timestamp);
 }
 
 void bridge::StpCallback_OnPortRoleChanged (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex, STP_PORT_ROLE role, unsigned int timestamp)
 {
-	auto b = static_cast<class bridge*>(STP_GetApplicationContext(bridge));
+	auto b = from_stp_bridge<class bridge>(bridge);
 	b->event_invoker<invalidate_e>()(b);
 }
 #pragma endregion
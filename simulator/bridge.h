@@ -3,6 +3,7 @@
 // Copyright (c) 2011-2020 Adi Gostin, distributed under Apache License v2.0.
 
 #pragma once
+#include "bridge_core.h"
 #include "bridge_tree.h"
 #include "port.h"
 #include "win32/xml_serializer.h"
@@ -57,7 +58,7 @@ using edge::uint32_property_traits;
 
 struct project_i;
 
-class bridge : public project_child, public edge::deserialize_i
+class bridge : public project_child, public edge::deserialize_i, public bridge_core
 {
 	using base = project_child;
 
@@ -66,8 +67,6 @@ class bridge : public project_child, public edge::deserialize_i
 	float _width;
 	float _height;
 	std::vector<std::unique_ptr<port>> _ports;
-	STP_BRIDGE* _stpBridge = nullptr;
-	bool _bpdu_trapping_enabled = false;
 	static const STP_CALLBACKS StpCallbacks;
 	std::vector<std::unique_ptr<BridgeLogLine>> _logLines;
 	BridgeLogLine _currentLogLine;
@@ -83,11 +82,6 @@ class bridge : public project_child, public edge::deserialize_i
 	static std::unordered_set<bridge*> _created_bridges;
 	HWND _helper_window = nullptr;
 
-	// variables used by TransmitGetBuffer/ReleaseBuffer
-	std::vector<uint8_t> _txPacketData;
-	port*                _txTransmittingPort;
-	unsigned int         _txTimestamp;
-
 public:
 	bridge (size_t port_count, size_t msti_count, mac_address macAddress);
 	virtual ~bridge();
@@ -119,53 +113,49 @@ public:
 	virtual ht_result hit_test (const edge::zoomable_i* zoomable, D2D1_POINT_2F dLocation, float tolerance) override final;
 	virtual D2D1_RECT_F extent() const override { return bounds(); }
 
-	STP_BRIDGE* stp_bridge() const { return _stpBridge; }
-
 	struct log_line_generated_e : public edge::event<log_line_generated_e, bridge*, const BridgeLogLine*> { };
 	struct log_cleared_e : public edge::event<log_cleared_e, bridge*> { };
 	struct packet_transmit_e : public edge::event<packet_transmit_e, bridge*, size_t, packet_t&&> { };
 
+	// Raised when the forwarding state of a port may have changed for some VLAN: on the enableForwarding callback,
+	// when STP is started or stopped (ports of a bridge without STP forward everything), and when the MST Config Table changes.
+	struct forwarding_changed_e : public edge::event<forwarding_changed_e, bridge*> { };
+
 	log_line_generated_e::subscriber log_line_generated() { return log_line_generated_e::subscriber(this); }
 	log_cleared_e::subscriber log_cleared() { return log_cleared_e::subscriber(this); }
 	packet_transmit_e::subscriber packet_transmit() { return packet_transmit_e::subscriber(this); }
+	forwarding_changed_e::subscriber forwarding_changed() { return forwarding_changed_e::subscriber(this); }
 
 	void enqueue_received_packet (packet_t&& packet, size_t rxPortIndex);
 
 	const std::vector<std::unique_ptr<BridgeLogLine>>& GetLogLines() const { return _logLines; }
 	void clear_log();
-	std::array<uint8_t, 6> GetPortAddress (size_t portIndex) const;
 
 	// Property getters and setters.
 	mac_address bridge_address() const;
 	void set_bridge_address (mac_address address);
-	bool stp_enabled() const { return (bool) STP_IsBridgeStarted(_stpBridge); }
+	bool stp_enabled() const { return (bool) STP_IsBridgeStarted(_stp_bridge); }
 	void set_stp_enabled(bool enable);
-	STP_VERSION stp_version() const { return STP_GetStpVersion(_stpBridge); }
+	STP_VERSION stp_version() const { return STP_GetStpVersion(_stp_bridge); }
 	void set_stp_version(STP_VERSION version);
-	size_t port_count() const { return STP_GetPortCount(_stpBridge); }
-	size_t msti_count() const { return STP_GetMstiCount(_stpBridge); }
+	size_t port_count() const { return STP_GetPortCount(_stp_bridge); }
+	size_t msti_count() const { return STP_GetMstiCount(_stp_bridge); }
 	std::string mst_config_id_name() const;
 	void set_mst_config_id_name (std::string mst_config_id_name);
 	uint32_t GetMstConfigIdRevLevel() const;
 	void SetMstConfigIdRevLevel (uint32_t revLevel);
 	std::string GetMstConfigIdDigest() const;
 	void SetMstConfigTable (const STP_CONFIG_TABLE_ENTRY* entries, size_t entryCount);
-	uint32_t bridge_max_age() const { return (uint32_t) STP_GetBridgeMaxAge(_stpBridge); }
+	uint32_t bridge_max_age() const { return (uint32_t) STP_GetBridgeMaxAge(_stp_bridge); }
 	void set_bridge_max_age (uint32_t value);
-	uint32_t bridge_forward_delay() const { return (uint32_t) STP_GetBridgeForwardDelay(_stpBridge); }
+	uint32_t bridge_forward_delay() const { return (uint32_t) STP_GetBridgeForwardDelay(_stp_bridge); }
 	void set_bridge_forward_delay (uint32_t value);
-	uint32_t tx_hold_count() const { return STP_GetTxHoldCount(_stpBridge); }
+	uint32_t tx_hold_count() const { return STP_GetTxHoldCount(_stp_bridge); }
 	void set_tx_hold_count (uint32_t value);
 private:
 	static void OnPortInvalidate (void* callbackArg, renderable_object* object);
-	void OnLinkPulseTick();
 	void ProcessReceivedPackets();
 
-	static void* StpCallback_AllocAndZeroMemory (unsigned int size);
-	static void  StpCallback_FreeMemory (void* p);
-	static void* StpCallback_TransmitGetBuffer        (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int bpduSize, unsigned int timestamp);
-	static void  StpCallback_TransmitReleaseBuffer    (const STP_BRIDGE* bridge, void* bufferReturnedByGetBuffer);
-	static void  StpCallback_EnableBpduTrapping       (const STP_BRIDGE* bridge, bool enable, unsigned int timestamp);
 	static void  StpCallback_EnableLearning           (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex, bool enable, unsigned int timestamp);
 	static void  StpCallback_EnableForwarding         (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex, bool enable, unsigned int timestamp);
 	static void  StpCallback_FlushFdb                 (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex, enum STP_FLUSH_FDB_TYPE flushType, unsigned int timestamp);
@@ -177,6 +167,13 @@ private:
 	virtual void on_deserializing() override final;
 	virtual void on_deserialized() override final;
 
+	// bridge_core
+	virtual void transmit (size_t tx_port_index, packet_t&& packet) override final;
+	virtual uint32_t supported_speed (size_t port_index) const override final;
+	virtual uint32_t actual_speed (size_t port_index) const override final;
+	virtual void set_actual_speed (size_t port_index, uint32_t speed) override final;
+	virtual bool simulate_link_pulses() const override final;
+
 public:
 	float x() const { return _x; }
 	void set_x (float x) { base::set_and_invalidate(&x_property, _x, x); }
@@ -0,0 +1,179 @@
+// This file is part of the mstp-lib library, available at https://github.com/adigostin/mstp-lib
+// Copyright (c) 2011-2020 Adi Gostin, distributed under Apache License v2.0.
+
+#include "bridge_core.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+
+bridge_core::bridge_core (size_t port_count, size_t msti_count, uint16_t max_vlan_number, const STP_CALLBACKS* callbacks, mac_address address)
+	: _missed_link_pulse_counters(port_count, MissedLinkPulseCounterMax)
+	, _stp_bridge(STP_CreateBridge ((unsigned int)port_count, (unsigned int)msti_count, max_vlan_number, callbacks, address.data(), 256))
+{
+	STP_SetApplicationContext (_stp_bridge, this);
+}
+
+bridge_core::~bridge_core()
+{
+	STP_DestroyBridge (_stp_bridge);
+}
+
+mac_address bridge_core::port_address (size_t port_index) const
+{
+	mac_address address;
+	memcpy (address.data(), STP_GetBridgeAddress(_stp_bridge)->bytes, 6);
+	uint32_t low = ((uint32_t)address[3] << 16) | ((uint32_t)address[4] << 8) | address[5];
+	low++;
+	address[3] = (uint8_t)(low >> 16);
+	address[4] = (uint8_t)(low >> 8);
+	address[5] = (uint8_t)low;
+	return address;
+}
+
+void bridge_core::on_link_pulse_tick (uint32_t timestamp)
+{
+	for (size_t port_index = 0; port_index < _missed_link_pulse_counters.size(); port_index++)
+	{
+		auto& counter = _missed_link_pulse_counters[port_index];
+		if (counter < MissedLinkPulseCounterMax)
+		{
+			counter++;
+			if (counter == MissedLinkPulseCounterMax)
+			{
+				set_actual_speed (port_index, 0);
+				STP_OnPortDisabled (_stp_bridge, (unsigned int) port_index, timestamp);
+			}
+		}
+
+		transmit (port_index, link_pulse_t { timestamp, supported_speed(port_index) });
+	}
+}
+
+void bridge_core::on_link_up (size_t port_index, uint32_t peer_supported_speed, uint32_t timestamp)
+{
+	_missed_link_pulse_counters[port_index] = 0;
+	if (!mac_operational(port_index))
+	{
+		auto speed = std::min (peer_supported_speed, supported_speed(port_index));
+		set_actual_speed (port_index, speed);
+		STP_OnPortEnabled (_stp_bridge, (unsigned int) port_index, speed, true, timestamp);
+	}
+}
+
+void bridge_core::on_link_down (size_t port_index, uint32_t timestamp)
+{
+	_missed_link_pulse_counters[port_index] = MissedLinkPulseCounterMax;
+	if (mac_operational(port_index))
+	{
+		set_actual_speed (port_index, 0);
+		STP_OnPortDisabled (_stp_bridge, (unsigned int) port_index, timestamp);
+	}
+}
+
+void bridge_core::on_packet_received (size_t rx_port_index, packet_t&& packet)
+{
+	if (std::holds_alternative<link_pulse_t>(packet))
+	{
+		if (!simulate_link_pulses())
+			return;
+
+		auto& lp = std::get<link_pulse_t>(packet);
+		bool old_mac_operational = _missed_link_pulse_counters[rx_port_index] < MissedLinkPulseCounterMax;
+		_missed_link_pulse_counters[rx_port_index] = 0;
+		if (!old_mac_operational)
+		{
+			// Send a link pulse right away, to make sure the other port goes up before we send it any frame.
+			transmit (rx_port_index, link_pulse_t { lp.timestamp, supported_speed(rx_port_index) });
+
+			auto speed = std::min (lp.sender_supported_speed, supported_speed(rx_port_index));
+			set_actual_speed (rx_port_index, speed);
+			STP_OnPortEnabled (_stp_bridge, (unsigned int) rx_port_index, speed, true, lp.timestamp);
+		}
+	}
+	else
+	{
+		auto& frame = std::get<frame_t>(packet);
+
+		// The cable was unplugged after the frame was sent and before it got here. Real hardware drops such frames too.
+		if (!mac_operational(rx_port_index))
+			return;
+
+		auto& data = frame.data;
+		if ((data.size() < 6) || (memcmp (data.data(), BpduDestAddress, 6) != 0))
+		{
+			assert(false); // not implemented
+			return;
+		}
+
+		if (_bpdu_trapping_enabled)
+		{
+			STP_OnBpduReceived (_stp_bridge, (unsigned int) rx_port_index, data.data() + BpduFrameHeaderSize, (unsigned int) (data.size() - BpduFrameHeaderSize), frame.timestamp);
+		}
+		else
+		{
+			// broadcast it to the other ports.
+			for (size_t tx_port_index = 0; tx_port_index < _missed_link_pulse_counters.size(); tx_port_index++)
+			{
+				if (tx_port_index == rx_port_index)
+					continue;
+
+				auto tx_port_address = port_address(tx_port_index);
+
+				// If it already went through this bridge, we have a loop; stop here, or the frame would circle forever.
+				// (The Windows simulator shows such loops to the user, as thick red wires; see wire.cpp.)
+				if (frame.tx_path_taken.contains(tx_port_address))
+					continue;
+
+				frame_t f;
+				f.timestamp = frame.timestamp;
+				f.data = frame.data;
+				f.tx_path_taken = frame.tx_path_taken.with(tx_port_address);
+				transmit (tx_port_index, std::move(f));
+			}
+		}
+	}
+}
+
+// ============================================================================
+
+void* bridge_core::StpCallback_AllocAndZeroMemory (unsigned int size)
+{
+	void* p = malloc(size);
+	memset (p, 0, size);
+	return p;
+}
+
+void bridge_core::StpCallback_FreeMemory (void* p)
+{
+	free(p);
+}
+
+void* bridge_core::StpCallback_TransmitGetBuffer (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int bpduSize, unsigned int timestamp)
+{
+	auto b = from_stp_bridge<bridge_core>(bridge);
+
+	b->_tx_packet_data = packet_buffer (bpduSize + BpduFrameHeaderSize);
+	uint8_t* data = b->_tx_packet_data.mutable_data();
+	memcpy (&data[0], BpduDestAddress, 6);
+	memcpy (&data[6], b->port_address(portIndex).data(), 6);
+	b->_tx_port_index = portIndex;
+	b->_tx_timestamp = timestamp;
+	return &data[BpduFrameHeaderSize];
+}
+
+void bridge_core::StpCallback_TransmitReleaseBuffer (const STP_BRIDGE* bridge, void* bufferReturnedByGetBuffer)
+{
+	auto b = from_stp_bridge<bridge_core>(bridge);
+
+	frame_t info;
+	info.data = std::move(b->_tx_packet_data);
+	info.timestamp = b->_tx_timestamp;
+	b->transmit (b->_tx_port_index, std::move(info));
+}
+
+void bridge_core::StpCallback_EnableBpduTrapping (const STP_BRIDGE* bridge, bool enable, unsigned int timestamp)
+{
+	auto b = from_stp_bridge<bridge_core>(bridge);
+	b->_bpdu_trapping_enabled = enable;
+}
@@ -0,0 +1,75 @@
+// This file is part of the mstp-lib library, available at https://github.com/adigostin/mstp-lib
+// Copyright (c) 2011-2020 Adi Gostin, distributed under Apache License v2.0.
+
+// The part of a simulated bridge that the Windows simulator and the headless engine have in common: the link state
+// of the ports, the processing of received packets - including the flooding done when STP isn't running -
+// and the STP callbacks that transmit BPDUs. Like packet.h, this file must not depend on anything Windows-specific.
+
+#pragma once
+#include "packet.h"
+#include "stp.h"
+#include <vector>
+
+class bridge_core
+{
+	std::vector<uint32_t> _missed_link_pulse_counters;
+	bool _bpdu_trapping_enabled = false;
+
+	// variables used by TransmitGetBuffer/ReleaseBuffer
+	packet_buffer _tx_packet_data;
+	size_t        _tx_port_index;
+	uint32_t      _tx_timestamp;
+
+protected:
+	STP_BRIDGE* const _stp_bridge;
+
+	// The callbacks must include the StpCallback_ functions below. The application context of the STP bridge
+	// is the bridge_core; the callbacks of the derived classes get back to their object with from_stp_bridge.
+	bridge_core (size_t port_count, size_t msti_count, uint16_t max_vlan_number, const STP_CALLBACKS* callbacks, mac_address address);
+
+	template<typename derived>
+	static derived* from_stp_bridge (const STP_BRIDGE* bridge)
+	{
+		return static_cast<derived*>(static_cast<bridge_core*>(STP_GetApplicationContext(bridge)));
+	}
+
+	// Sends a packet out of a port, to whatever is at the other end of its cable.
+	virtual void transmit (size_t tx_port_index, packet_t&& packet) = 0;
+
+	// The speeds are kept by the derived classes; the Windows simulator shows them as properties of its ports.
+	virtual uint32_t supported_speed (size_t port_index) const = 0;
+	virtual uint32_t actual_speed (size_t port_index) const = 0;
+	virtual void set_actual_speed (size_t port_index, uint32_t speed) = 0;
+
+	// Link pulses can still arrive after the simulation of link pulses was turned off; they mustn't bring up any port then.
+	virtual bool simulate_link_pulses() const = 0;
+
+	static void* StpCallback_AllocAndZeroMemory (unsigned int size);
+	static void  StpCallback_FreeMemory (void* p);
+	static void* StpCallback_TransmitGetBuffer        (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int bpduSize, unsigned int timestamp);
+	static void  StpCallback_TransmitReleaseBuffer    (const STP_BRIDGE* bridge, void* bufferReturnedByGetBuffer);
+	static void  StpCallback_EnableBpduTrapping       (const STP_BRIDGE* bridge, bool enable, unsigned int timestamp);
+
+public:
+	static constexpr uint32_t MissedLinkPulseCounterMax = 3;
+
+	bridge_core (const bridge_core&) = delete;
+	bridge_core& operator= (const bridge_core&) = delete;
+	virtual ~bridge_core();
+
+	STP_BRIDGE* stp_bridge() const { return _stp_bridge; }
+
+	// All ports of a bridge transmit with the same source address, the one after the bridge address, so the flooding
+	// of BPDUs sees a loop when a frame comes back to a bridge it already went through.
+	mac_address port_address (size_t port_index) const;
+	bool mac_operational (size_t port_index) const { return actual_speed(port_index) > 0; }
+
+	// Transmits a link pulse on each port, and takes down the ports that missed MissedLinkPulseCounterMax pulses in a row.
+	void on_link_pulse_tick (uint32_t timestamp);
+
+	// Called as cables are plugged and unplugged, when link pulses aren't simulated.
+	void on_link_up (size_t port_index, uint32_t peer_supported_speed, uint32_t timestamp);
+	void on_link_down (size_t port_index, uint32_t timestamp);
+
+	void on_packet_received (size_t rx_port_index, packet_t&& packet);
+};
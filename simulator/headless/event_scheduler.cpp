@@ -0,0 +1,40 @@
+
+// This file is part of the mstp-lib library, available at https://github.com/adigostin/mstp-lib
+// Copyright (c) 2011-2020 Adi Gostin, distributed under Apache License v2.0.
+
+#include "event_scheduler.h"
+#include <algorithm>
+#include <cassert>
+
+sim_time event_scheduler::next_event_time() const
+{
+	assert (!_events.empty());
+	return _events.front().time;
+}
+
+void event_scheduler::schedule_at (sim_time time, std::function<void()>&& action)
+{
+	assert (time >= _now); // can't schedule in the past
+	_events.push_back ({ time, _next_sequence++, std::move(action) });
+	std::push_heap (_events.begin(), _events.end(), &later);
+}
+
+size_t event_scheduler::run_until (sim_time end)
+{
+	assert (end >= _now);
+
+	size_t count = 0;
+	while (!_events.empty() && (_events.front().time < end))
+	{
+		std::pop_heap (_events.begin(), _events.end(), &later);
+		event e = std::move(_events.back());
+		_events.pop_back();
+
+		_now = e.time;
+		e.action();
+		count++;
+	}
+
+	_now = end;
+	return count;
+}
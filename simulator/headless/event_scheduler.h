@@ -0,0 +1,48 @@
+
+// This file is part of the mstp-lib library, available at https://github.com/adigostin/mstp-lib
+// Copyright (c) 2011-2020 Adi Gostin, distributed under Apache License v2.0.
+
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Simulated time, in microseconds since the start of the simulation.
+using sim_time = uint64_t;
+
+static constexpr sim_time sim_milliseconds = 1000;
+static constexpr sim_time sim_seconds = 1000 * sim_milliseconds;
+
+// Discrete-event scheduler with a virtual clock: time advances from one event to the next,
+// as fast as the events can be processed, regardless of wall-clock time.
+class event_scheduler
+{
+	struct event
+	{
+		sim_time time;
+		uint64_t sequence; // events scheduled for the same time run in the order they were scheduled
+		std::function<void()> action;
+	};
+
+	std::vector<event> _events; // binary heap, earliest event first
+	sim_time _now = 0;
+	uint64_t _next_sequence = 0;
+
+	static bool later (const event& a, const event& b)
+	{
+		return (a.time != b.time) ? (a.time > b.time) : (a.sequence > b.sequence);
+	}
+
+public:
+	sim_time now() const { return _now; }
+	bool empty() const { return _events.empty(); }
+	size_t pending_event_count() const { return _events.size(); }
+	sim_time next_event_time() const;
+
+	void schedule_at (sim_time time, std::function<void()>&& action);
+	void schedule_after (sim_time delay, std::function<void()>&& action) { schedule_at (_now + delay, std::move(action)); }
+
+	// Runs the events scheduled before "end" - including those scheduled by the events themselves -
+	// then advances the clock to "end". Returns the number of events run.
+	size_t run_until (sim_time end);
+};
@@ -0,0 +1,370 @@
+
+// This file is part of the mstp-lib library, available at https://github.com/adigostin/mstp-lib
+// Copyright (c) 2011-2020 Adi Gostin, distributed under Apache License v2.0.
+
+#include "headless_network.h"
+#include <algorithm>
+#include <cassert>
+#include <condition_variable>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <thread>
+
+headless_bridge::headless_bridge (headless_network* network, size_t port_count, size_t msti_count, uint16_t max_vlan_number, mac_address address)
+	: bridge_core(port_count, msti_count, max_vlan_number, &stp_callbacks, address)
+	, _network(network)
+	, _ports(port_count)
+{
+}
+
+mac_address headless_bridge::bridge_address() const
+{
+	mac_address address;
+	memcpy (address.data(), STP_GetBridgeAddress(_stp_bridge)->bytes, 6);
+	return address;
+}
+
+void headless_bridge::transmit (size_t tx_port_index, packet_t&& packet)
+{
+	_network->transmit (this, tx_port_index, std::move(packet));
+}
+
+bool headless_bridge::simulate_link_pulses() const
+{
+	return _network->simulate_link_pulses();
+}
+
+static void StpCallback_EnableLearning (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex, bool enable, unsigned int timestamp)
+{
+}
+
+static void StpCallback_EnableForwarding (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex, bool enable, unsigned int timestamp)
+{
+}
+
+static void StpCallback_FlushFdb (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex, enum STP_FLUSH_FDB_TYPE flushType, unsigned int timestamp)
+{
+}
+
+static void StpCallback_DebugStrOut (const STP_BRIDGE* bridge, int portIndex, int treeIndex, const char* nullTerminatedString, unsigned int stringLength, unsigned int flush)
+{
+}
+
+const STP_CALLBACKS headless_bridge::stp_callbacks =
+{
+	&StpCallback_EnableBpduTrapping,
+	&StpCallback_EnableLearning,
+	&StpCallback_EnableForwarding,
+	&StpCallback_TransmitGetBuffer,
+	&StpCallback_TransmitReleaseBuffer,
+	&StpCallback_FlushFdb,
+	&StpCallback_DebugStrOut,
+	nullptr, // onTopologyChange
+	nullptr, // onPortRoleChanged
+	&StpCallback_AllocAndZeroMemory,
+	&StpCallback_FreeMemory,
+	nullptr, // transmitGather
+	nullptr, // readClock
+};
+
+// ============================================================================
+
+// std::barrier is C++20.
+class thread_barrier
+{
+	std::mutex _mutex;
+	std::condition_variable _cv;
+	size_t const _count;
+	size_t _waiting = 0;
+	size_t _generation = 0;
+
+public:
+	explicit thread_barrier (size_t count)
+		: _count(count)
+	{ }
+
+	void arrive_and_wait()
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		size_t generation = _generation;
+		if (++_waiting == _count)
+		{
+			_waiting = 0;
+			_generation++;
+			_cv.notify_all();
+		}
+		else
+			_cv.wait (lock, [this, generation] { return _generation != generation; });
+	}
+};
+
+headless_network::headless_network (size_t partition_count, bool simulate_link_pulses)
+	: _simulate_link_pulses(simulate_link_pulses)
+{
+	assert (partition_count > 0);
+	for (size_t i = 0; i < partition_count; i++)
+	{
+		auto p = std::make_unique<partition>();
+		if (simulate_link_pulses)
+			schedule_link_pulse_tick (p.get(), link_pulse_period);
+		schedule_one_second_tick (p.get(), one_second_tick_period);
+		_partitions.push_back (std::move(p));
+	}
+}
+
+void headless_network::schedule_link_pulse_tick (partition* p, sim_time time)
+{
+	p->scheduler.schedule_at (time, [this, p]
+	{
+		uint32_t timestamp = (uint32_t) (p->scheduler.now() / sim_milliseconds);
+		for (auto b : p->bridges)
+			b->on_link_pulse_tick (timestamp);
+		schedule_link_pulse_tick (p, p->scheduler.now() + link_pulse_period);
+	});
+}
+
+void headless_network::schedule_one_second_tick (partition* p, sim_time time)
+{
+	p->scheduler.schedule_at (time, [this, p]
+	{
+		uint32_t timestamp = (uint32_t) (p->scheduler.now() / sim_milliseconds);
+		for (auto b : p->bridges)
+			STP_OnOneSecondTick (b->stp_bridge(), timestamp);
+		schedule_one_second_tick (p, p->scheduler.now() + one_second_tick_period);
+	});
+}
+
+headless_bridge* headless_network::add_bridge (size_t port_count, size_t msti_count, mac_address address, uint16_t max_vlan_number)
+{
+	_bridges.push_back (std::make_unique<headless_bridge>(this, port_count, msti_count, max_vlan_number, address));
+	auto b = _bridges.back().get();
+	_partitions[0]->bridges.push_back(b);
+	return b;
+}
+
+void headless_network::set_partition (headless_bridge* bridge, size_t partition_index)
+{
+	// A bridge can't move once it has packets on their way to it in the scheduler of its current partition.
+	assert (!packets_in_flight());
+	assert (partition_index < _partitions.size());
+
+	auto& old_list = _partitions[bridge->_partition_index]->bridges;
+	old_list.erase (std::find (old_list.begin(), old_list.end(), bridge));
+	bridge->_partition_index = partition_index;
+	_partitions[partition_index]->bridges.push_back(bridge);
+}
+
+void headless_network::distribute_bridges()
+{
+	assert (!packets_in_flight());
+
+	for (auto& p : _partitions)
+		p->bridges.clear();
+
+	size_t partition_count = _partitions.size();
+	for (size_t i = 0; i < _bridges.size(); i++)
+	{
+		auto b = _bridges[i].get();
+		b->_partition_index = i * partition_count / _bridges.size();
+		_partitions[b->_partition_index]->bridges.push_back(b);
+	}
+}
+
+void headless_network::connect (headless_bridge* a, size_t a_port_index, headless_bridge* b, size_t b_port_index, sim_time latency)
+{
+	auto& a_port = a->_ports[a_port_index];
+	auto& b_port = b->_ports[b_port_index];
+	assert ((a_port.peer_bridge == nullptr) && (b_port.peer_bridge == nullptr));
+	assert (latency > 0); // used as lookahead between partitions
+
+	a_port.peer_bridge = b;
+	a_port.peer_port_index = b_port_index;
+	a_port.latency = latency;
+	b_port.peer_bridge = a;
+	b_port.peer_port_index = a_port_index;
+	b_port.latency = latency;
+
+	if (!_simulate_link_pulses)
+	{
+		// Both ends go up before any BPDU they send each other reaches the other end.
+		a->on_link_up (a_port_index, b_port.supported_speed, timestamp());
+		b->on_link_up (b_port_index, a_port.supported_speed, timestamp());
+	}
+}
+
+void headless_network::disconnect (headless_bridge* bridge, size_t port_index)
+{
+	auto& port = bridge->_ports[port_index];
+	assert (port.peer_bridge != nullptr);
+
+	auto peer_bridge = port.peer_bridge;
+	auto peer_port_index = port.peer_port_index;
+	peer_bridge->_ports[peer_port_index].peer_bridge = nullptr;
+	port.peer_bridge = nullptr;
+
+	if (!_simulate_link_pulses)
+	{
+		bridge->on_link_down (port_index, timestamp());
+		peer_bridge->on_link_down (peer_port_index, timestamp());
+	}
+}
+
+void headless_network::transmit (headless_bridge* bridge, size_t tx_port_index, packet_t&& packet)
+{
+	auto& tx_port = bridge->_ports[tx_port_index];
+	if (tx_port.peer_bridge == nullptr)
+		return;
+
+	partition* tx_partition = _partitions[bridge->_partition_index].get();
+	sim_time time = tx_partition->scheduler.now() + tx_port.latency;
+	headless_bridge* rx_bridge = tx_port.peer_bridge;
+	size_t rx_port_index = tx_port.peer_port_index;
+
+	if (rx_bridge->_partition_index == bridge->_partition_index)
+		schedule_delivery (tx_partition, time, bridge, tx_port_index, rx_bridge, rx_port_index, std::move(packet));
+	else
+		tx_partition->outbox.push_back ({ time, bridge, tx_port_index, rx_bridge, rx_port_index, std::move(packet) });
+}
+
+void headless_network::schedule_delivery (partition* p, sim_time time, headless_bridge* tx_bridge, size_t tx_port_index, headless_bridge* rx_bridge, size_t rx_port_index, packet_t&& packet)
+{
+	delivery* d;
+	if (!p->free_deliveries.empty())
+	{
+		d = p->free_deliveries.back();
+		p->free_deliveries.pop_back();
+		*d = { tx_bridge, tx_port_index, rx_bridge, rx_port_index, std::move(packet) };
+	}
+	else
+		d = &p->deliveries.emplace_back (delivery { tx_bridge, tx_port_index, rx_bridge, rx_port_index, std::move(packet) });
+
+	p->scheduler.schedule_at (time, [p, d]
+	{
+		auto tx_bridge = d->tx_bridge;
+		auto tx_port_index = d->tx_port_index;
+		auto rx_bridge = d->rx_bridge;
+		auto rx_port_index = d->rx_port_index;
+		auto packet = std::move(d->packet);
+		p->free_deliveries.push_back(d);
+
+		// Drop the packet if the cable was unplugged while the packet was on it.
+		if (rx_bridge->_ports[rx_port_index].peer_bridge != tx_bridge)
+			return;
+		if (rx_bridge->_ports[rx_port_index].peer_port_index != tx_port_index)
+			return;
+
+		rx_bridge->on_packet_received (rx_port_index, std::move(packet));
+	});
+}
+
+bool headless_network::packets_in_flight() const
+{
+	for (auto& p : _partitions)
+	{
+		if (!p->outbox.empty() || (p->deliveries.size() != p->free_deliveries.size()))
+			return true;
+	}
+
+	return false;
+}
+
+// Called between time windows, while no partition is running.
+void headless_network::deliver_outboxes()
+{
+	for (auto& p : _partitions)
+	{
+		for (auto& op : p->outbox)
+		{
+			auto rx_partition = _partitions[op.rx_bridge->_partition_index].get();
+			schedule_delivery (rx_partition, op.time, op.tx_bridge, op.tx_port_index, op.rx_bridge, op.rx_port_index, std::move(op.packet));
+		}
+
+		p->outbox.clear();
+	}
+}
+
+// The shortest time in which a packet can go from one partition to another.
+sim_time headless_network::lookahead() const
+{
+	sim_time result = std::numeric_limits<sim_time>::max();
+	for (auto& b : _bridges)
+	{
+		for (auto& port : b->_ports)
+		{
+			if ((port.peer_bridge != nullptr) && (port.peer_bridge->_partition_index != b->_partition_index))
+				result = std::min (result, port.latency);
+		}
+	}
+
+	return result;
+}
+
+void headless_network::run_until (sim_time end)
+{
+	assert (end >= _now);
+
+	if (_partitions.size() == 1)
+	{
+		_partitions[0]->scheduler.run_until(end);
+		_now = end;
+		return;
+	}
+
+	sim_time lookahead = this->lookahead();
+	size_t partition_count = _partitions.size();
+	thread_barrier barrier (partition_count);
+	sim_time window_end;
+	bool done = false;
+
+	// Partition 0 runs on this thread, the others on threads of their own.
+	auto run_partition = [this, &barrier, &window_end, &done](size_t partition_index)
+	{
+		auto& scheduler = _partitions[partition_index]->scheduler;
+		while (true)
+		{
+			barrier.arrive_and_wait(); // wait for the window to be computed
+			if (done)
+				break;
+			scheduler.run_until(window_end);
+			barrier.arrive_and_wait(); // wait for all partitions to finish the window
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (size_t i = 1; i < partition_count; i++)
+		threads.emplace_back (run_partition, i);
+
+	while (true)
+	{
+		deliver_outboxes();
+
+		// The window ends where the earliest pending event plus the lookahead ends: the partitions can process
+		// events up to there without any packet from another partition arriving in their past.
+		sim_time earliest = end;
+		for (auto& p : _partitions)
+		{
+			if (!p->scheduler.empty())
+				earliest = std::min (earliest, p->scheduler.next_event_time());
+		}
+
+		if (earliest >= end)
+		{
+			done = true;
+			barrier.arrive_and_wait();
+			break;
+		}
+
+		window_end = (end - earliest > lookahead) ? (earliest + lookahead) : end;
+		barrier.arrive_and_wait();
+		_partitions[0]->scheduler.run_until(window_end);
+		barrier.arrive_and_wait();
+	}
+
+	for (auto& t : threads)
+		t.join();
+
+	for (auto& p : _partitions)
+		p->scheduler.run_until(end);
+	_now = end;
+}
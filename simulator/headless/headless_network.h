@@ -0,0 +1,148 @@
+
+// This file is part of the mstp-lib library, available at https://github.com/adigostin/mstp-lib
+// Copyright (c) 2011-2020 Adi Gostin, distributed under Apache License v2.0.
+
+// A simulated network without user interface, running in simulated time. It behaves like the Windows simulator -
+// same link model, same one-second ticks, same packets - but it runs as fast as the CPU allows and on any platform.
+
+#pragma once
+#include "bridge_core.h"
+#include "event_scheduler.h"
+#include <deque>
+#include <memory>
+
+class headless_network;
+
+class headless_bridge : public bridge_core
+{
+	friend class headless_network;
+
+	struct port_state
+	{
+		uint32_t supported_speed = 1000;
+		uint32_t actual_speed = 0;
+
+		// The port at the other end of the cable, if any.
+		headless_bridge* peer_bridge = nullptr;
+		size_t           peer_port_index;
+		sim_time         latency;
+	};
+
+	headless_network* const _network;
+	size_t _partition_index = 0;
+	std::vector<port_state> _ports;
+
+	static const STP_CALLBACKS stp_callbacks;
+
+	virtual void transmit (size_t tx_port_index, packet_t&& packet) override final;
+	virtual void set_actual_speed (size_t port_index, uint32_t speed) override final { _ports[port_index].actual_speed = speed; }
+	virtual bool simulate_link_pulses() const override final;
+
+public:
+	headless_bridge (headless_network* network, size_t port_count, size_t msti_count, uint16_t max_vlan_number, mac_address address);
+
+	operator STP_BRIDGE* () const { return _stp_bridge; }
+
+	size_t partition_index() const { return _partition_index; }
+	size_t port_count() const { return _ports.size(); }
+	mac_address bridge_address() const;
+	virtual uint32_t actual_speed (size_t port_index) const override final { return _ports[port_index].actual_speed; }
+	virtual uint32_t supported_speed (size_t port_index) const override final { return _ports[port_index].supported_speed; }
+	void set_supported_speed (size_t port_index, uint32_t speed) { _ports[port_index].supported_speed = speed; }
+};
+
+// The bridges can be spread over several partitions, each with its own event scheduler and run by its own thread.
+// The partitions are synchronized conservatively, with the latency of the cables between partitions as lookahead:
+// a partition runs ahead only up to the earliest time at which a packet from another partition could reach it.
+// For best results, the cables within a partition should greatly outnumber the cables between partitions.
+class headless_network
+{
+	// A packet sent to a bridge in another partition, waiting for the end of the current time window.
+	struct outgoing_packet
+	{
+		sim_time         time;
+		headless_bridge* tx_bridge;
+		size_t           tx_port_index;
+		headless_bridge* rx_bridge;
+		size_t           rx_port_index;
+		packet_t         packet;
+	};
+
+	// A packet on its way to a bridge of this partition.
+	struct delivery
+	{
+		headless_bridge* tx_bridge;
+		size_t           tx_port_index;
+		headless_bridge* rx_bridge;
+		size_t           rx_port_index;
+		packet_t         packet;
+	};
+
+	struct partition
+	{
+		event_scheduler scheduler;
+		std::vector<headless_bridge*> bridges;
+		std::vector<outgoing_packet> outbox; // written only by the thread running this partition
+
+		// Deliveries are reused once delivered, and the scheduler gets only a pointer to them - small enough
+		// for std::function to store without allocating.
+		std::deque<delivery> deliveries;
+		std::vector<delivery*> free_deliveries;
+	};
+
+	std::vector<std::unique_ptr<partition>> _partitions;
+	std::vector<std::unique_ptr<headless_bridge>> _bridges;
+	sim_time _now = 0;
+	bool const _simulate_link_pulses;
+
+	void schedule_link_pulse_tick (partition* p, sim_time time);
+	void schedule_one_second_tick (partition* p, sim_time time);
+	void schedule_delivery (partition* p, sim_time time, headless_bridge* tx_bridge, size_t tx_port_index, headless_bridge* rx_bridge, size_t rx_port_index, packet_t&& packet);
+	void deliver_outboxes();
+	bool packets_in_flight() const;
+	sim_time lookahead() const;
+
+public:
+	static constexpr sim_time link_pulse_period = 16 * sim_milliseconds;
+	static constexpr sim_time one_second_tick_period = 1 * sim_seconds;
+	static constexpr sim_time default_link_latency = 100; // microseconds
+
+	// Without link pulses, ports go up and down right when cables are plugged and unplugged. With link pulses, they go up
+	// when they receive the first pulse from the other end, and down when they miss MissedLinkPulseCounterMax pulses,
+	// like real hardware - at the cost of a packet every 16 ms on every port.
+	headless_network (size_t partition_count = 1, bool simulate_link_pulses = false);
+	headless_network (const headless_network&) = delete;
+	headless_network& operator= (const headless_network&) = delete;
+
+	size_t partition_count() const { return _partitions.size(); }
+	bool simulate_link_pulses() const { return _simulate_link_pulses; }
+	sim_time now() const { return _now; }
+
+	// The timestamp to pass to the library functions.
+	uint32_t timestamp() const { return (uint32_t) (_now / sim_milliseconds); }
+
+	const std::vector<std::unique_ptr<headless_bridge>>& bridges() const { return _bridges; }
+
+	// New bridges go to the first partition; move them with set_partition or distribute_bridges before connecting them.
+	// (Without link pulses, a connected port goes up and transmits right away.)
+	headless_bridge* add_bridge (size_t port_count, size_t msti_count, mac_address address, uint16_t max_vlan_number = 16);
+
+	void set_partition (headless_bridge* bridge, size_t partition_index);
+
+	// Spreads the bridges over the partitions in contiguous blocks, in the order they were added.
+	// Bridges added one after the other are usually connected to each other, so this keeps most cables within a partition.
+	void distribute_bridges();
+
+	// Plugs a cable between two ports.
+	void connect (headless_bridge* a, size_t a_port_index, headless_bridge* b, size_t b_port_index, sim_time latency = default_link_latency);
+
+	// Unplugs the cable from a port.
+	void disconnect (headless_bridge* bridge, size_t port_index);
+
+	// Delivers a packet to the port at the other end of the cable, if any, after the latency of the cable.
+	void transmit (headless_bridge* bridge, size_t tx_port_index, packet_t&& packet);
+
+	// With more than one partition, the partitions run in parallel, each on its own thread.
+	void run_until (sim_time end);
+	void run_for (sim_time duration) { run_until(_now + duration); }
+};
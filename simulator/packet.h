@@ -0,0 +1,222 @@
+
+// This file is part of the mstp-lib library, available at https://github.com/adigostin/mstp-lib
+// Copyright (c) 2011-2020 Adi Gostin, distributed under Apache License v2.0.
+
+// Packets exchanged between simulated ports. Used by both the Windows simulator and the headless engine,
+// so this file must not depend on anything Windows-specific.
+
+#pragma once
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <variant>
+
+using mac_address = std::array<uint8_t, 6>;
+
+// The bytes of a frame, in a fixed-size block shared by reference count. A BPDU is encoded once into a buffer,
+// then passed around by handle: to the wire, to the receive queue of the bridge at the other end, and to all
+// the ports a bridge without STP floods it to. Freed blocks go to a free list of the thread that freed them
+// and are reused from there, so that in steady state transmitting a frame doesn't allocate.
+class packet_buffer
+{
+	static constexpr size_t capacity = 1536; // room for the largest Ethernet frame
+
+	struct block
+	{
+		std::atomic<uint32_t> ref_count;
+		uint32_t size;
+		block* next_free;
+		uint8_t bytes[capacity];
+	};
+
+	struct free_list
+	{
+		block* first = nullptr;
+
+		~free_list()
+		{
+			while (first != nullptr)
+			{
+				block* next = first->next_free;
+				delete first;
+				first = next;
+			}
+		}
+	};
+
+	static free_list& thread_free_list()
+	{
+		static thread_local free_list list;
+		return list;
+	}
+
+	block* _block = nullptr;
+
+	void add_ref()
+	{
+		if (_block != nullptr)
+			_block->ref_count.fetch_add (1, std::memory_order_relaxed);
+	}
+
+	void release()
+	{
+		if ((_block != nullptr) && (_block->ref_count.fetch_sub (1, std::memory_order_acq_rel) == 1))
+		{
+			auto& list = thread_free_list();
+			_block->next_free = list.first;
+			list.first = _block;
+		}
+
+		_block = nullptr;
+	}
+
+public:
+	packet_buffer() = default;
+
+	// A buffer of "size" bytes, for the caller to fill in through mutable_data() before sharing it.
+	explicit packet_buffer (size_t size)
+	{
+		assert (size <= capacity);
+		auto& list = thread_free_list();
+		if (list.first != nullptr)
+		{
+			_block = list.first;
+			list.first = _block->next_free;
+		}
+		else
+			_block = new block;
+
+		_block->ref_count.store (1, std::memory_order_relaxed);
+		_block->size = (uint32_t)size;
+	}
+
+	packet_buffer (const packet_buffer& other)
+		: _block(other._block)
+	{
+		add_ref();
+	}
+
+	packet_buffer (packet_buffer&& other) noexcept
+		: _block(other._block)
+	{
+		other._block = nullptr;
+	}
+
+	packet_buffer& operator= (const packet_buffer& other)
+	{
+		if (_block != other._block)
+		{
+			release();
+			_block = other._block;
+			add_ref();
+		}
+
+		return *this;
+	}
+
+	packet_buffer& operator= (packet_buffer&& other) noexcept
+	{
+		if (this != &other)
+		{
+			release();
+			_block = other._block;
+			other._block = nullptr;
+		}
+
+		return *this;
+	}
+
+	~packet_buffer() { release(); }
+
+	explicit operator bool() const { return _block != nullptr; }
+	size_t size() const { return _block->size; }
+	const uint8_t* data() const { return _block->bytes; }
+
+	uint8_t* mutable_data()
+	{
+		assert (_block->ref_count.load(std::memory_order_relaxed) == 1); // not yet shared
+		return _block->bytes;
+	}
+};
+
+// ============================================================================
+
+// The addresses of the ports a flooded frame went out of; all ports of a bridge have the same address,
+// so these are in effect the bridges the frame went through. Bridges without STP flood a frame to all their ports,
+// so the path is shared between the copies of the frame, as an immutable list to which each copy
+// adds its own last hop. A small Bloom filter in front of the list makes the common check - a port
+// the frame hasn't been through - cheap; the list is walked only when the filter says "maybe".
+class tx_path_t
+{
+	struct node
+	{
+		mac_address port_address;
+		std::shared_ptr<const node> previous;
+	};
+
+	std::array<uint64_t, 4> _filter = { };
+	std::shared_ptr<const node> _last;
+
+	static uint64_t hash (const mac_address& a)
+	{
+		uint64_t v = ((uint64_t)a[0] << 40) | ((uint64_t)a[1] << 32) | ((uint64_t)a[2] << 24) | ((uint64_t)a[3] << 16) | ((uint64_t)a[4] << 8) | a[5];
+		return v * 0x9E3779B97F4A7C15ull;
+	}
+
+	// Two bits per address, taken from the high bits of the hash.
+	static unsigned int bit0 (uint64_t h) { return (unsigned int)(h >> 56); }
+	static unsigned int bit1 (uint64_t h) { return (unsigned int)(h >> 48) & 0xFF; }
+
+	bool filter_bit (unsigned int bit) const { return (_filter[bit / 64] >> (bit % 64)) & 1; }
+
+public:
+	bool contains (const mac_address& port_address) const
+	{
+		uint64_t h = hash(port_address);
+		if (!filter_bit(bit0(h)) || !filter_bit(bit1(h)))
+			return false;
+
+		for (auto n = _last.get(); n != nullptr; n = n->previous.get())
+		{
+			if (n->port_address == port_address)
+				return true;
+		}
+
+		return false;
+	}
+
+	// Returns this path plus one more hop, leaving this path unchanged.
+	tx_path_t with (const mac_address& port_address) const
+	{
+		tx_path_t result;
+		uint64_t h = hash(port_address);
+		result._filter = _filter;
+		result._filter[bit0(h) / 64] |= 1ull << (bit0(h) % 64);
+		result._filter[bit1(h) / 64] |= 1ull << (bit1(h) % 64);
+		result._last = std::make_shared<const node>(node { port_address, _last });
+		return result;
+	}
+};
+
+struct frame_t
+{
+	uint32_t timestamp;
+	packet_buffer data; // shared by the copies of a flooded frame
+	tx_path_t tx_path_taken;
+};
+
+struct link_pulse_t
+{
+	uint32_t timestamp;
+	uint32_t sender_supported_speed;
+};
+
+using packet_t = std::variant<link_pulse_t, frame_t>;
+
+static constexpr uint8_t BpduDestAddress[6] = { 1, 0x80, 0xC2, 0, 0, 0 };
+
+// Size of the header the simulator places before the BPDU in a frame_t: destination and source address,
+// length/type, LLC header, and some room to spare.
+static constexpr size_t BpduFrameHeaderSize = 21;
@@ -5,25 +5,9 @@
 #pragma once
 #include "renderable_object.h"
 #include "port_tree.h"
+#include "packet.h"
 #include "stp.h"
 
-using mac_address = std::array<uint8_t, 6>;
-
-struct frame_t
-{
-	uint32_t timestamp;
-	std::vector<uint8_t> data;;
-	std::vector<mac_address> tx_path_taken;
-};
-
-struct link_pulse_t
-{
-	uint32_t timestamp;
-	uint32_t sender_supported_speed;
-};
-
-using packet_t = std::variant<link_pulse_t, frame_t>;
-
 extern const char admin_p2p_type_name[];
 extern const nvp admin_p2p_nvps[];
 using admin_p2p_p = edge::enum_property<STP_ADMIN_P2P, admin_p2p_type_name, admin_p2p_nvps>;
@@ -47,9 +31,6 @@ class port : public renderable_object
 	uint32_t _actual_speed = 0;
 	std::vector<std::unique_ptr<port_tree>> _trees;
 
-	static constexpr uint32_t MissedLinkPulseCounterMax = 3;
-	uint32_t _missedLinkPulseCounter = MissedLinkPulseCounterMax;
-
 	static void on_bridge_property_changing (void* arg, object* obj, const property_change_args& args);
 	static void on_bridge_property_changed (void* arg, object* obj, const property_change_args& args);
 
@@ -21,6 +21,15 @@ class project : public edge::object, public project_i
 	mac_address _next_mac_address = next_mac_address_property.default_value.value();
 	bool _simulationPaused = false;
 	bool _changedFlag = false;
+	bool _simulate_link_pulses = simulate_link_pulses_property.default_value.value();
+
+	// For each VLAN number asked about by IsWireForwarding, the ports that are part of a loop.
+	// Computed on first use and thrown away when forwarding changes on some bridge or when wires change.
+	mutable std::unordered_map<uint32_t, std::unordered_set<const port*>> _looping_ports;
+
+	// For each port connected to a wire, the wire and the index of the wire end connected to the port.
+	// Kept in sync by insert_wire, remove_wire and on_wire_point_changed, so that packet delivery doesn't search the wires.
+	std::unordered_map<const port*, std::pair<wire*, size_t>> _wire_ends_by_port;
 
 public:
 	virtual const std::vector<std::unique_ptr<bridge>>& bridges() const override final { return _bridges; }
@@ -39,6 +48,7 @@ public:
 
 		b->invalidated().add_handler (&on_project_child_invalidated, this);
 		b->packet_transmit().add_handler (&on_packet_transmit, this);
+		b->forwarding_changed().add_handler (&on_forwarding_changed, this);
 		this->event_invoker<invalidate_e>()(this);
 	}
 
@@ -55,6 +65,7 @@ public:
 		}))
 			assert(false); // can't remove a connected bridge
 
+		b->forwarding_changed().remove_handler (&on_forwarding_changed, this);
 		b->packet_transmit().remove_handler (&on_packet_transmit, this);
 		b->invalidated().remove_handler (&on_project_child_invalidated, this);
 
@@ -83,7 +94,12 @@ public:
 		static_cast<project_child*>(w)->on_added_to_project(this);
 		this->on_property_changed(args);
 
-		w->invalidated().add_handler (&on_project_child_invalidated, this);
+		add_wire_end_to_index (w, 0);
+		add_wire_end_to_index (w, 1);
+		set_link_state (w->p0(), w->p1(), true);
+		w->point_changed().add_handler (&on_wire_point_changed, this);
+		w->invalidated().add_handler (&on_wire_invalidated, this);
+		_looping_ports.clear();
 		this->event_invoker<invalidate_e>()(this);
 	}
 
@@ -93,7 +109,11 @@ public:
 		wire* w = _wires[index].get();
 		assert(w->_project == this);
 
-		_wires[index]->invalidated().remove_handler (&on_project_child_invalidated, this);
+		_wires[index]->invalidated().remove_handler (&on_wire_invalidated, this);
+		_wires[index]->point_changed().remove_handler (&on_wire_point_changed, this);
+		set_link_state (w->p0(), w->p1(), false);
+		remove_wire_end_from_index (w, w->p0());
+		remove_wire_end_from_index (w, w->p1());
 
 		property_change_args args = { &wires_property, index, collection_property_change_type::remove };
 		this->on_property_changing (args);
@@ -102,10 +122,85 @@ public:
 		_wires.erase (_wires.begin() + index);
 		this->on_property_changed (args);
 
+		_looping_ports.clear();
 		this->event_invoker<invalidate_e>()(this);
 		return result;
 	}
 
+	void add_wire_end_to_index (wire* w, size_t point_index)
+	{
+		auto& end = w->points()[point_index];
+		if (std::holds_alternative<connected_wire_end>(end))
+		{
+			bool inserted = _wire_ends_by_port.insert({ std::get<connected_wire_end>(end), { w, point_index } }).second;
+			assert (inserted); // two wires connected to the same port
+		}
+	}
+
+	void remove_wire_end_from_index (wire* w, const wire_end& end)
+	{
+		if (std::holds_alternative<connected_wire_end>(end))
+		{
+			auto it = _wire_ends_by_port.find(std::get<connected_wire_end>(end));
+			assert ((it != _wire_ends_by_port.end()) && (it->second.first == w));
+			_wire_ends_by_port.erase(it);
+		}
+	}
+
+	static void on_wire_point_changed (void* callbackArg, wire* w, size_t point_index, wire_end old_point)
+	{
+		auto project = static_cast<class project*>(callbackArg);
+		project->set_link_state (old_point, w->points()[1 - point_index], false);
+		project->remove_wire_end_from_index (w, old_point);
+		project->add_wire_end_to_index (w, point_index);
+		project->set_link_state (w->p0(), w->p1(), true);
+	}
+
+	// Without link pulses, the links between ports go up and down as wires are connected and disconnected.
+	// Call this for up only after the wire ends are in the index, as the bridges may start transmitting right away.
+	void set_link_state (const wire_end& a, const wire_end& b, bool up)
+	{
+		if (_simulate_link_pulses)
+			return;
+
+		if (!std::holds_alternative<connected_wire_end>(a) || !std::holds_alternative<connected_wire_end>(b))
+			return;
+
+		auto port_a = std::get<connected_wire_end>(a);
+		auto port_b = std::get<connected_wire_end>(b);
+		if (up)
+		{
+			port_a->bridge()->on_link_up (port_a->port_index(), port_b->supported_speed(), ::GetMessageTime());
+			port_b->bridge()->on_link_up (port_b->port_index(), port_a->supported_speed(), ::GetMessageTime());
+		}
+		else
+		{
+			port_a->bridge()->on_link_down (port_a->port_index(), ::GetMessageTime());
+			port_b->bridge()->on_link_down (port_b->port_index(), ::GetMessageTime());
+		}
+	}
+
+	virtual std::pair<wire*, size_t> GetWireConnectedToPort (const port* port) const override final
+	{
+		auto it = _wire_ends_by_port.find(port);
+		if (it == _wire_ends_by_port.end())
+			return { };
+		return it->second;
+	}
+
+	virtual port* find_connected_port (port* tx_port) const override final
+	{
+		auto it = _wire_ends_by_port.find(tx_port);
+		if (it == _wire_ends_by_port.end())
+			return nullptr;
+
+		auto& other_end = it->second.first->points()[1 - it->second.second];
+		if (std::holds_alternative<connected_wire_end>(other_end))
+			return std::get<connected_wire_end>(other_end);
+		else
+			return nullptr;
+	}
+
 	static void on_packet_transmit (void* callbackArg, bridge* bridge, size_t txPortIndex, packet_t&& pi)
 	{
 		auto project = static_cast<class project*>(callbackArg);
@@ -121,6 +216,138 @@ public:
 		project->event_invoker<invalidate_e>()(project);
 	}
 
+	// A wire is invalidated also when one of its ends is connected to or disconnected from a port.
+	static void on_wire_invalidated (void* callbackArg, renderable_object* object)
+	{
+		auto project = static_cast<class project*>(callbackArg);
+		project->_looping_ports.clear();
+		project->event_invoker<invalidate_e>()(project);
+	}
+
+	static void on_forwarding_changed (void* callbackArg, bridge* b)
+	{
+		auto project = static_cast<class project*>(callbackArg);
+		project->_looping_ports.clear();
+	}
+
+	// A port is part of a loop if a broadcast frame sent from it can come back to it. Think of a graph whose nodes are
+	// the forwarding ports connected by a wire to a forwarding port, and in which a node has an edge to each node of
+	// the bridge at the other end of its wire, other than the port at that end - the ports that bridge floods the frame to.
+	// The looping ports are the nodes of the strongly connected components with a cycle; we find them with Tarjan's algorithm,
+	// made iterative so that long chains of bridges don't overflow the call stack.
+	std::unordered_set<const port*> find_looping_ports (uint32_t vlanNumber) const
+	{
+		std::unordered_map<port*, port*> peers;
+		for (auto& w : _wires)
+		{
+			if (!std::holds_alternative<connected_wire_end>(w->p0()) || !std::holds_alternative<connected_wire_end>(w->p1()))
+				continue;
+
+			auto portA = std::get<connected_wire_end>(w->p0());
+			auto portB = std::get<connected_wire_end>(w->p1());
+			if (portA->IsForwarding(vlanNumber) && portB->IsForwarding(vlanNumber))
+			{
+				peers.insert ({ portA, portB });
+				peers.insert ({ portB, portA });
+			}
+		}
+
+		struct node_state
+		{
+			size_t index;
+			size_t lowlink;
+			bool on_stack;
+		};
+
+		struct call_frame
+		{
+			port* node;
+			port* peer;
+			size_t next_port_index; // index in the ports of the peer's bridge of the next edge to look at
+		};
+
+		std::unordered_map<port*, node_state> states;
+		std::vector<port*> stack;
+		std::vector<call_frame> call_stack;
+		size_t next_index = 0;
+		std::unordered_set<const port*> result;
+
+		auto visit = [&](port* node, port* peer)
+		{
+			states.insert ({ node, { next_index, next_index, true } });
+			next_index++;
+			stack.push_back(node);
+			call_stack.push_back({ node, peer, 0 });
+		};
+
+		for (auto& [start, start_peer] : peers)
+		{
+			if (states.find(start) != states.end())
+				continue;
+
+			visit (start, start_peer);
+			while (!call_stack.empty())
+			{
+				auto& frame = call_stack.back();
+				auto& peer_bridge_ports = frame.peer->bridge()->ports();
+				if (frame.next_port_index < peer_bridge_ports.size())
+				{
+					port* next = peer_bridge_ports[frame.next_port_index++].get();
+					if (next == frame.peer)
+						continue;
+
+					auto next_peer = peers.find(next);
+					if (next_peer == peers.end())
+						continue;
+
+					if (next == frame.node)
+						result.insert(next); // wire between two ports of the same bridge
+
+					auto next_state = states.find(next);
+					if (next_state == states.end())
+						visit (next, next_peer->second);
+					else if (next_state->second.on_stack)
+					{
+						auto& state = states.at(frame.node);
+						state.lowlink = std::min (state.lowlink, next_state->second.index);
+					}
+				}
+				else
+				{
+					port* node = frame.node;
+					call_stack.pop_back();
+
+					auto& state = states.at(node);
+					if (!call_stack.empty())
+					{
+						auto& caller_state = states.at(call_stack.back().node);
+						caller_state.lowlink = std::min (caller_state.lowlink, state.lowlink);
+					}
+
+					if (state.lowlink == state.index)
+					{
+						// node is the root of a component; the component is node and the nodes above it on the stack.
+						size_t component_start = stack.size() - 1;
+						while (stack[component_start] != node)
+							component_start--;
+
+						bool looping = (stack.size() - component_start > 1);
+						for (size_t i = component_start; i < stack.size(); i++)
+						{
+							states.at(stack[i]).on_stack = false;
+							if (looping)
+								result.insert(stack[i]);
+						}
+
+						stack.resize(component_start);
+					}
+				}
+			}
+		}
+
+		return result;
+	}
+
 	virtual invalidate_e::subscriber invalidated() override final { return invalidate_e::subscriber(this); }
 
 	virtual loaded_e::subscriber GetLoadedEvent() override final { return loaded_e::subscriber(this); }
@@ -139,39 +366,10 @@ public:
 
 		if (hasLoop != nullptr)
 		{
-			std::unordered_set<port*> txPorts;
-
-			std::function<bool(port* txPort)> transmitsTo = [this, vlanNumber, &txPorts, &transmitsTo, targetPort=portA](port* txPort) -> bool
-			{
-				if (txPort->IsForwarding(vlanNumber))
-				{
-					auto rx = find_connected_port(txPort);
-					if ((rx != nullptr) && rx->IsForwarding(vlanNumber))
-					{
-						txPorts.insert(txPort);
-
-						for (unsigned int i = 0; i < (unsigned int) rx->bridge()->ports().size(); i++)
-						{
-							if ((i != rx->port_index()) && rx->IsForwarding(vlanNumber))
-							{
-								port* otherTxPort = rx->bridge()->ports()[i].get();
-								if (otherTxPort == targetPort)
-									return true;
-
-								if (txPorts.find(otherTxPort) != txPorts.end())
-									return false;
-
-								if (transmitsTo(otherTxPort))
-									return true;
-							}
-						}
-					}
-				}
-
-				return false;
-			};
-
-			*hasLoop = transmitsTo(portA);
+			auto it = _looping_ports.find(vlanNumber);
+			if (it == _looping_ports.end())
+				it = _looping_ports.insert({ vlanNumber, find_looping_ports(vlanNumber) }).first;
+			*hasLoop = (it->second.find(portA) != it->second.end());
 		}
 
 		return true;
@@ -267,6 +465,34 @@ public:
 
 	virtual bool simulation_paused() const override final { return _simulationPaused; }
 
+	virtual bool simulate_link_pulses() const override final { return _simulate_link_pulses; }
+
+	void set_simulate_link_pulses (bool value)
+	{
+		if (_simulate_link_pulses != value)
+		{
+			this->on_property_changing(&simulate_link_pulses_property);
+			_simulate_link_pulses = value;
+			this->on_property_changed(&simulate_link_pulses_property);
+
+			if (!value)
+			{
+				// From now on the links follow the wires; bring them to where the wires are now.
+				for (auto& b : _bridges)
+				{
+					for (auto& p : b->ports())
+					{
+						auto peer = find_connected_port(p.get());
+						if (peer != nullptr)
+							b->on_link_up (p->port_index(), peer->supported_speed(), ::GetMessageTime());
+						else
+							b->on_link_down (p->port_index(), ::GetMessageTime());
+					}
+				}
+			}
+		}
+	}
+
 	virtual bool GetChangedFlag() const override final { return _changedFlag; }
 
 	virtual void SetChangedFlag (bool changedFlag) override final
@@ -315,6 +541,18 @@ public:
 		mac_address{ 0x00, 0xAA, 0x55, 0xAA, 0x55, 0x80 },
 	};
 
+	static constexpr edge::bool_p simulate_link_pulses_property = {
+		"SimulateLinkPulses",
+		nullptr,
+		"Whether ports exchange link pulses every 16 ms, and go down after missing three of them, like real hardware. "
+			"When false, ports go up and down right when wires are connected and disconnected, "
+			"which makes large projects much lighter to simulate.",
+		ui_visible::yes,
+		&simulate_link_pulses,
+		&set_simulate_link_pulses,
+		false,
+	};
+
 	size_t bridge_count() const { return _bridges.size(); }
 	bridge* bridge_at(size_t index) const { return _bridges[index].get(); }
 	size_t wire_count() const { return _wires.size(); }
@@ -345,7 +583,7 @@ const typed_object_collection_property<project, wire> project::wires_property {
 	&wire_count, &wire_at, &insert_wire, &remove_wire
 };
 
-const property* const project::_properties[] = { &next_mac_address_property, &bridges_property, &wires_property };
+const property* const project::_properties[] = { &next_mac_address_property, &simulate_link_pulses_property, &bridges_property, &wires_property };
 
 const xtype<project> project::_type = { "Project", &base::_type, _properties, nullptr };
 
@@ -33,40 +33,6 @@ extern const project_window_factory_t project_window_factory;
 extern const project_factory_t project_factory;
 
 #pragma region project_i
-std::pair<wire*, size_t> project_i::GetWireConnectedToPort (const class port* port) const
-{
-	for (auto& w : wires())
-	{
-		if (std::holds_alternative<connected_wire_end>(w->p0()) && (std::get<connected_wire_end>(w->p0()) == port))
-			return { w.get(), 0 };
-		else if (std::holds_alternative<connected_wire_end>(w->p1()) && (std::get<connected_wire_end>(w->p1()) == port))
-			return { w.get(), 1 };
-	}
-
-	return { };
-}
-
-port* project_i::find_connected_port (port* tx_port) const
-{
-	for (auto& w : wires())
-	{
-		for (size_t i = 0; i < 2; i++)
-		{
-			auto& thisEnd = w->points()[i];
-			if (std::holds_alternative<connected_wire_end>(thisEnd) && (std::get<connected_wire_end>(thisEnd) == tx_port))
-			{
-				auto& otherEnd = w->points()[1 - i];
-				if (std::holds_alternative<connected_wire_end>(otherEnd))
-					return std::get<connected_wire_end>(otherEnd);
-				else
-					return nullptr;
-			}
-		}
-	}
-
-	return nullptr;
-}
-
 std::unique_ptr<wire> project_i::remove_wire (wire* w)
 {
 	auto& wires = this->wires();
@@ -169,9 +169,12 @@ struct __declspec(novtable) project_i
 	virtual HRESULT save (const wchar_t* filePath) = 0;
 	virtual HRESULT load (const wchar_t* filePath) = 0;
 	virtual bool IsWireForwarding (wire* wire, uint32_t vlanNumber, _Out_opt_ bool* hasLoop) const = 0;
+	virtual std::pair<wire*, size_t> GetWireConnectedToPort (const port* port) const = 0;
+	virtual port* find_connected_port (port* txPort) const = 0;
 	virtual void pause_simulation() = 0;
 	virtual void resume_simulation() = 0;
 	virtual bool simulation_paused() const = 0;
+	virtual bool simulate_link_pulses() const = 0;
 	virtual bool GetChangedFlag() const = 0;
 	virtual void SetChangedFlag (bool projectChangedFlag) = 0;
 	virtual ChangedFlagChangedEvent::subscriber GetChangedFlagChangedEvent() = 0;
@@ -181,8 +184,6 @@ struct __declspec(novtable) project_i
 	virtual property_changing_e::subscriber property_changing() = 0;
 	virtual property_changed_e::subscriber property_changed() = 0;
 
-	std::pair<wire*, size_t> GetWireConnectedToPort (const port* port) const;
-	port* find_connected_port (port* txPort) const;
 	std::unique_ptr<wire> remove_wire (wire* w);
 	std::unique_ptr<bridge> remove_bridge (bridge* b);
 };
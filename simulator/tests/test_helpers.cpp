@@ -75,6 +75,8 @@ const STP_CALLBACKS test_bridge::callbacks =
 	&StpCallback_OnPortRoleChanged,
 	&StpCallback_AllocAndZeroMemory,
 	&StpCallback_FreeMemory,
+	nullptr, // transmitGather
+	nullptr, // readClock
 };
 
 test_bridge::test_bridge (size_t port_count, size_t msti_count, uint16_t max_vlan_number, const std::array<uint8_t, 6>& bridge_address)
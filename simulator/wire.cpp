@@ -93,7 +93,9 @@ void wire::set_point (size_t pointIndex, wire_end point)
 {
 	if (_points[pointIndex] != point)
 	{
+		auto old_point = _points[pointIndex];
 		_points[pointIndex] = point;
+		event_invoker<point_changed_e>()(this, pointIndex, old_point);
 		event_invoker<invalidate_e>()(this);
 	}
 }
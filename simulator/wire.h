@@ -56,6 +56,10 @@ public:
 	wire_end point (size_t i) const { return _points[i]; }
 	void set_point (size_t i, wire_end point);
 
+	// Raised by set_point after it changed an end; the last argument is the end as it was before.
+	struct point_changed_e : public edge::event<point_changed_e, wire*, size_t, wire_end> { };
+	point_changed_e::subscriber point_changed() { return point_changed_e::subscriber(this); }
+
 	wire_end p0() const { return _points[0]; }
 	void set_p0 (wire_end p0) { set_point(0, p0); }
 	void set_p0 (port* p0) { set_point(0, p0); }
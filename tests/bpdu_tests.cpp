@@ -0,0 +1,216 @@
+
+// This file is part of the mstp-lib library, available at https://github.com/adigostin/mstp-lib
+// Copyright (c) 2011-2020 Adi Gostin, distributed under Apache License v2.0.
+
+#include "internal/stp_bpdu.h"
+#include <gtest/gtest.h>
+#include <cstring>
+
+static constexpr uint8_t stp_config_bpdu[35] =  {
+	0, 0,
+	0, // protocolVersionId = LegacySTP
+	0, // bpduType = STP Config
+	0, // cistFlags
+	0, 1, 2, 3, 4, 5, 6, 7, // cistRootId
+	0, 0, 0, 0, // cistExternalPathCost
+	0, 1, 2, 3, 4, 5, 6, 7, // cistRegionalRootId
+	0, 0, // cistPortId
+	0, 0, // MessageAge
+	0, 0, // MaxAge
+	0, 0, // HelloTime
+	0, 0, // ForwardDelay
+};
+
+static constexpr uint8_t tcn_bpdu[4] = { 0, 0, 0, 0x80 };
+
+static constexpr uint8_t rstp_bpdu[36] = {
+	0, 0,
+	2, // protocolVersionId RSTP
+	2, // RST / MST / SPT BPDU
+	0, // cistFlags
+	0, 1, 2, 3, 4, 5, 6, 7, // cistRootId
+	0, 0, 0, 0, // cistExternalPathCost
+	0, 1, 2, 3, 4, 5, 6, 7, // cistRegionalRootId
+	0, 0, // cistPortId
+	0, 0, // MessageAge
+	0, 0, // MaxAge
+	0, 0, // HelloTime
+	0, 0, // ForwardDelay
+	0,    // Version1Length
+};
+
+static constexpr uint8_t mstp_bpdu_without_mstis[102] = {
+	0, 0,
+	3, // protocolVersionId MSTP
+	2, // RST / MST / SPT BPDU
+	0, // cistFlags
+	0, 1, 2, 3, 4, 5, 6, 7, // cistRootId
+	0, 0, 0, 0, // cistExternalPathCost
+	0, 1, 2, 3, 4, 5, 6, 7, // cistRegionalRootId
+	0, 0, // cistPortId
+	0, 0, // MessageAge
+	0, 0, // MaxAge
+	0, 0, // HelloTime
+	0, 0, // ForwardDelay
+	0,    // Version1Length
+	0, 64, // Version3Length
+
+	// mstConfigId
+	0, // ConfigurationIdentifierFormatSelector
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 0, 1, // ConfigurationName
+	0, // RevisionLevelHigh
+	0, // RevisionLevelLow
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 0, 1, 2, 3, 4, 5, // ConfigurationDigest
+
+	0, 0, 0, 0, // cistInternalRootPathCost
+	0, 1, 2, 3, 4, 5, 6, 7, // cistBridgeId
+	0, // cistRemainingHops
+
+	// mstiConfigMessages
+};
+
+static constexpr uint8_t mstp_bpdu_with_mstis[] = {
+	0, 0,
+	3, // protocolVersionId MSTP
+	2, // RST / MST / SPT BPDU
+	0, // cistFlags
+	0, 1, 2, 3, 4, 5, 6, 7, // cistRootId
+	0, 0, 0, 0, // cistExternalPathCost
+	0, 1, 2, 3, 4, 5, 6, 7, // cistRegionalRootId
+	0, 0, // cistPortId
+	0, 0, // MessageAge
+	0, 0, // MaxAge
+	0, 0, // HelloTime
+	0, 0, // ForwardDelay
+	0,    // Version1Length
+	0, 64 + 16, // Version3Length
+
+	// mstConfigId
+	0, // ConfigurationIdentifierFormatSelector
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 0, 1, // ConfigurationName
+	0, // RevisionLevelHigh
+	0, // RevisionLevelLow
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 0, 1, 2, 3, 4, 5, // ConfigurationDigest
+
+	0, 0, 0, 0, // cistInternalRootPathCost
+	0, 1, 2, 3, 4, 5, 6, 7, // cistBridgeId
+	0, // cistRemainingHops
+
+	// mstiConfigMessages
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 0, 1, 2, 3, 4, 5,
+};
+
+TEST(bpdu_tests, validate_truncated_bpdu_header)
+{
+	static constexpr uint8_t bpdu[3] = { };
+	EXPECT_EQ (VALIDATED_BPDU_TYPE_UNKNOWN, STP_GetValidatedBpduType (STP_VERSION_MSTP, bpdu, sizeof(bpdu)));
+}
+
+TEST(bpdu_tests, validate_truncated_stp_config_bpdu)
+{
+	uint8_t bpdu[sizeof(stp_config_bpdu) - 1];
+	memcpy (bpdu, stp_config_bpdu, sizeof(bpdu));
+	EXPECT_EQ (VALIDATED_BPDU_TYPE_UNKNOWN, STP_GetValidatedBpduType (STP_VERSION_MSTP, bpdu, sizeof(bpdu)));
+}
+
+TEST(bpdu_tests, validate_bad_protocol_identifier)
+{
+	static constexpr uint8_t bpdu[36] = { 1, 0, 0, 0 };
+	EXPECT_EQ (VALIDATED_BPDU_TYPE_UNKNOWN, STP_GetValidatedBpduType (STP_VERSION_MSTP, bpdu, sizeof(bpdu)));
+}
+
+TEST(bpdu_tests, validate_bad_bpdu_type)
+{
+	static constexpr uint8_t bpdu[36] = { 0, 0, 0, 1 };
+	EXPECT_EQ (VALIDATED_BPDU_TYPE_UNKNOWN, STP_GetValidatedBpduType (STP_VERSION_MSTP, bpdu, sizeof(bpdu)));
+}
+
+TEST(bpdu_tests, validate_bad_protocol_version_identifier)
+{
+	static constexpr uint8_t bpdu[36] = { 0, 0, 1, 2 };
+	EXPECT_EQ (VALIDATED_BPDU_TYPE_UNKNOWN, STP_GetValidatedBpduType (STP_VERSION_MSTP, bpdu, sizeof(bpdu)));
+}
+
+// ===========================================================================================
+TEST(bpdu_tests, validate_stp_config_bpdu_while_running_mstp)
+{
+	auto type = STP_GetValidatedBpduType (STP_VERSION_MSTP, stp_config_bpdu, sizeof(stp_config_bpdu));
+	EXPECT_EQ (VALIDATED_BPDU_TYPE_STP_CONFIG, type);
+}
+
+TEST(bpdu_tests, validate_tcn_bpdu_while_running_mstp)
+{
+	EXPECT_EQ (VALIDATED_BPDU_TYPE_STP_TCN, STP_GetValidatedBpduType (STP_VERSION_MSTP, tcn_bpdu, sizeof(tcn_bpdu)));
+}
+
+TEST(bpdu_tests, validate_tcn_bpdu_with_padding_while_runing_mstp)
+{
+	uint8_t bpdu[50] = { };
+	memcpy (bpdu, tcn_bpdu, sizeof(tcn_bpdu));
+	EXPECT_EQ (VALIDATED_BPDU_TYPE_STP_TCN, STP_GetValidatedBpduType (STP_VERSION_MSTP, bpdu, sizeof(bpdu)));
+}
+
+// ===========================================================================================
+
+TEST(bpdu_tests, validate_rstp_bpdu_while_running_mstp)
+{
+	auto type = STP_GetValidatedBpduType (STP_VERSION_MSTP, rstp_bpdu, sizeof(rstp_bpdu));
+	EXPECT_EQ (VALIDATED_BPDU_TYPE_RST, type);
+}
+
+TEST(bpdu_tests, validate_truncated_rstp_bpdu_while_running_mstp)
+{
+	uint8_t bpdu [sizeof(rstp_bpdu) - 1];
+	memcpy (bpdu, rstp_bpdu, sizeof(bpdu));
+	auto type = STP_GetValidatedBpduType (STP_VERSION_MSTP, bpdu, sizeof(bpdu));
+	EXPECT_EQ (VALIDATED_BPDU_TYPE_UNKNOWN, type);
+}
+
+// ===========================================================================================
+
+TEST(bpdu_tests, test11)
+{
+	static constexpr uint8_t bpdu[35] = { 0, 0, 3, 2 };
+	EXPECT_EQ (VALIDATED_BPDU_TYPE_RST, STP_GetValidatedBpduType (STP_VERSION_MSTP, bpdu, sizeof(bpdu)));
+}
+
+TEST(bpdu_tests, test12)
+{
+	static constexpr uint8_t bpdu[35] = { 0, 0, 3, 2 };
+	EXPECT_EQ (VALIDATED_BPDU_TYPE_RST, STP_GetValidatedBpduType (STP_VERSION_MSTP, bpdu, sizeof(bpdu)));
+}
+
+TEST(bpdu_tests, validate_rstp_bpdu_while_running_legacy_stp)
+{
+	// Tests validation of a BPDU received from a bridge that runs RSTP, when we're running LegacySTP.
+	auto our_protocol = STP_VERSION_LEGACY_STP;
+	auto type = STP_GetValidatedBpduType (our_protocol, rstp_bpdu, sizeof(rstp_bpdu));
+	EXPECT_EQ (VALIDATED_BPDU_TYPE_RST, type);
+}
+
+TEST(bpdu_tests, validate_mstp_bpdu_while_running_legacy_stp)
+{
+	// Tests validation of a BPDU received from a bridge that runs MSTP, when we're running LegacySTP.
+	auto type = STP_GetValidatedBpduType (STP_VERSION_LEGACY_STP, mstp_bpdu_without_mstis, sizeof(mstp_bpdu_without_mstis));
+	EXPECT_EQ (VALIDATED_BPDU_TYPE_RST, type);
+	type = STP_GetValidatedBpduType (STP_VERSION_LEGACY_STP, mstp_bpdu_with_mstis, sizeof(mstp_bpdu_with_mstis));
+	EXPECT_EQ (VALIDATED_BPDU_TYPE_RST, type);
+}
+
+TEST(bpdu_tests, validate_mstp_bpdu_while_running_rstp)
+{
+	// Tests validation of a BPDU received from a bridge that runs MSTP, when we're running RSTP.
+	auto type = STP_GetValidatedBpduType (STP_VERSION_RSTP, mstp_bpdu_without_mstis, sizeof(mstp_bpdu_without_mstis));
+	EXPECT_EQ (VALIDATED_BPDU_TYPE_RST, type);
+}
+
+TEST(bpdu_tests, validate_mstp_bpdu_while_running_mstp)
+{
+	// Tests validation of a BPDU received from a bridge that runs MSTP, when we're running MSTP.
+	auto type = STP_GetValidatedBpduType (STP_VERSION_MSTP, mstp_bpdu_without_mstis, sizeof(mstp_bpdu_without_mstis));
+	EXPECT_EQ (VALIDATED_BPDU_TYPE_MST, type);
+
+	static_assert (sizeof(mstp_bpdu_with_mstis) > 102);
+	type = STP_GetValidatedBpduType (STP_VERSION_MSTP, mstp_bpdu_with_mstis, sizeof(mstp_bpdu_with_mstis));
+	EXPECT_EQ (VALIDATED_BPDU_TYPE_MST, type);
+}
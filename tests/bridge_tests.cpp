@@ -0,0 +1,305 @@
+
+// This file is part of the mstp-lib library, available at https://github.com/adigostin/mstp-lib
+// Copyright (c) 2011-2020 Adi Gostin, distributed under Apache License v2.0.
+
+// The tests of simulator/tests/bridge_tests.cpp that don't need the Simulator's bridge class.
+
+#include "test_helpers.h"
+#include <gtest/gtest.h>
+#include <cstdlib>
+#include <cstring>
+#include <set>
+
+TEST(bridge_tests, undefined_role_test)
+{
+	STP_PORT_ROLE role_from_callback = STP_PORT_ROLE_UNDEFINED;
+	test_bridge bridge (4, 0, 0, { 0x10, 0x20, 0x30, 0x40, 0x50, 0x60 });
+	bridge.port_role_changed = [&role_from_callback](size_t portIndex, size_t treeIndex, enum STP_PORT_ROLE role)
+	{
+		role_from_callback = role;
+	};
+
+	EXPECT_EQ (STP_PORT_ROLE_UNDEFINED, role_from_callback);
+
+	STP_StartBridge(bridge, 0);
+
+	EXPECT_EQ (STP_PORT_ROLE_DISABLED, role_from_callback);
+}
+
+TEST(bridge_tests, receive_more_mstis_on_same_mst_config)
+{
+	size_t port_count = 4;
+	size_t msti_count = 5;
+	test_bridge bridge0 (port_count, msti_count, 16, { 0x10, 0x20, 0x30, 0x40, 0x50, 0x60 });
+	STP_SetStpVersion (bridge0, STP_VERSION_MSTP, 0);
+	STP_SetMstConfigName (bridge0, "ABC", 0);
+	STP_StartBridge (bridge0, 0);
+	STP_OnPortEnabled (bridge0, 0, 100, true, 0);
+
+	msti_count = 4;
+	test_bridge bridge1 (port_count, msti_count, 16, { 0x10, 0x20, 0x30, 0x40, 0x50, 0x70 });
+	STP_SetStpVersion (bridge1, STP_VERSION_MSTP, 0);
+	STP_SetMstConfigName (bridge1, "ABC", 0);
+	STP_StartBridge (bridge1, 0);
+	STP_OnPortEnabled (bridge1, 0, 100, true, 0);
+
+	exchange_bpdus (bridge0, 0, bridge1, 0); // shouldn't crash
+}
+
+TEST(bridge_tests, test_designated_bridge_priority_on_msti)
+{
+	test_bridge bridge (4, 4, 16, { 0x10, 0x20, 0x30, 0x40, 0x50, 0x60 });
+	STP_SetStpVersion (bridge, STP_VERSION_MSTP, 0);
+	STP_SetBridgePriority (bridge, 1, 0x6000, 0);
+	STP_StartBridge (bridge, 0);
+
+	// First 8 bytes are RootId and for MSTIs must always be zero (see definition of PRIORITY_VECTOR in stp_base_types.h)
+	unsigned char rpv[36];
+	STP_GetRootPriorityVector(bridge, 1, rpv);
+	uint64_t root_id;
+	memcpy (&root_id, rpv, 8);
+	EXPECT_EQ (0ull, root_id);
+}
+
+// Creates two bridges in buffers of exactly the size STP_GetRequiredMemorySize reports (built with
+// -DMSTP_LIB_SANITIZE=address, this catches any access past the end), and lets them converge.
+TEST(bridge_tests, bridge_in_buffer_of_required_size)
+{
+	struct config { size_t port_count; size_t msti_count; uint16_t max_vlan_number; };
+	static const config configs[] = { { 1, 0, 0 }, { 2, 1, 16 }, { 5, 3, 100 }, { 33, 8, 4094 }, { 64, 64, 4094 } };
+
+	for (const config& c : configs)
+	{
+		SCOPED_TRACE(testing::Message() << c.port_count << " ports, " << c.msti_count << " MSTIs, VLANs up to " << c.max_vlan_number);
+
+		size_t size = STP_GetRequiredMemorySize ((unsigned int)c.port_count, (unsigned int)c.msti_count, c.max_vlan_number);
+		void* buffer0 = malloc(size);
+		void* buffer1 = malloc(size);
+		int live_blocks_before = test_bridge::live_memory_blocks;
+
+		{
+			test_bridge bridge0 (c.port_count, c.msti_count, c.max_vlan_number, { 0x10, 0x20, 0x30, 0x40, 0x50, 0x60 }, buffer0, size);
+			test_bridge bridge1 (c.port_count, c.msti_count, c.max_vlan_number, { 0x10, 0x20, 0x30, 0x40, 0x50, 0x70 }, buffer1, size);
+			ASSERT_EQ ((STP_BRIDGE*)bridge0, buffer0);
+			ASSERT_EQ ((STP_BRIDGE*)bridge1, buffer1);
+
+			// Same MST Region on both bridges, with VLANs spread over all trees, so that the whole config table is written.
+			std::vector<STP_CONFIG_TABLE_ENTRY> table (1 + c.max_vlan_number);
+			for (size_t vlan = 1; vlan <= c.max_vlan_number; vlan++)
+				table[vlan].treeIndex = (unsigned char) (vlan % (1 + c.msti_count));
+
+			for (test_bridge* b : { &bridge0, &bridge1 })
+			{
+				STP_SetStpVersion (*b, STP_VERSION_MSTP, 0);
+				STP_SetMstConfigName (*b, "buffer", 0);
+				STP_SetMstConfigTable (*b, table.data(), (unsigned int)table.size(), 0);
+				STP_StartBridge (*b, 0);
+			}
+
+			// The first and the last ports of the bridges are connected to each other.
+			size_t last = c.port_count - 1;
+			for (test_bridge* b : { &bridge0, &bridge1 })
+			{
+				STP_OnPortEnabled (*b, 0, 100, true, 0);
+				if (last != 0)
+					STP_OnPortEnabled (*b, (unsigned int)last, 100, true, 0);
+			}
+
+			for (unsigned int timestamp = 0; timestamp < 3000; timestamp += 1000)
+			{
+				exchange_bpdus (bridge0, 0, bridge1, 0);
+				if (last != 0)
+					exchange_bpdus (bridge0, last, bridge1, last);
+				STP_OnOneSecondTick (bridge0, timestamp);
+				STP_OnOneSecondTick (bridge1, timestamp);
+			}
+
+			for (unsigned int tree = 0; tree <= c.msti_count; tree++)
+			{
+				EXPECT_EQ (STP_PORT_ROLE_DESIGNATED, STP_GetPortRole (bridge0, 0, tree));
+				EXPECT_EQ (STP_PORT_ROLE_ROOT, STP_GetPortRole (bridge1, 0, tree));
+				if (last != 0)
+				{
+					EXPECT_EQ (STP_PORT_ROLE_DESIGNATED, STP_GetPortRole (bridge0, (unsigned int)last, tree));
+					EXPECT_EQ (STP_PORT_ROLE_ALTERNATE, STP_GetPortRole (bridge1, (unsigned int)last, tree));
+				}
+			}
+		}
+
+		// STP_DestroyBridge freed what the library allocated, but not the buffers.
+		EXPECT_EQ (live_blocks_before, test_bridge::live_memory_blocks);
+		free (buffer0);
+		free (buffer1);
+	}
+}
+
+TEST(bridge_tests, batched_mst_config_changes_same_as_one_at_a_time)
+{
+	test_bridge one_at_a_time (4, 2, 16, { 0x10, 0x20, 0x30, 0x40, 0x50, 0x60 });
+	test_bridge batched       (4, 2, 16, { 0x10, 0x20, 0x30, 0x40, 0x50, 0x60 });
+
+	// The state machines restart with all port roles Disabled, so we count the restarts by the Disabled roles of an enabled port.
+	size_t restarts_one_at_a_time = 0;
+	size_t restarts_batched = 0;
+	one_at_a_time.port_role_changed = [&](size_t portIndex, size_t treeIndex, STP_PORT_ROLE role)
+	{
+		if ((portIndex == 0) && (treeIndex == 0) && (role == STP_PORT_ROLE_DISABLED))
+			restarts_one_at_a_time++;
+	};
+	batched.port_role_changed = [&](size_t portIndex, size_t treeIndex, STP_PORT_ROLE role)
+	{
+		if ((portIndex == 0) && (treeIndex == 0) && (role == STP_PORT_ROLE_DISABLED))
+			restarts_batched++;
+	};
+
+	for (test_bridge* b : { &one_at_a_time, &batched })
+	{
+		STP_SetStpVersion (*b, STP_VERSION_MSTP, 0);
+		STP_StartBridge (*b, 0);
+		STP_OnPortEnabled (*b, 0, 100, true, 0);
+	}
+
+	ASSERT_TRUE (*STP_GetMstConfigId(one_at_a_time) == *STP_GetMstConfigId(batched));
+	STP_MST_CONFIG_ID initial_id = *STP_GetMstConfigId(batched);
+	restarts_one_at_a_time = 0;
+	restarts_batched = 0;
+
+	STP_SetMstConfigName (one_at_a_time, "REGION", 1000);
+	STP_SetMstConfigRevisionLevel (one_at_a_time, 7, 1000);
+	STP_SetMstConfigTableEntry (one_at_a_time, 5, 1, 1000);
+	STP_SetMstConfigTableEntry (one_at_a_time, 6, 2, 1000);
+	STP_SetMstConfigTableEntry (one_at_a_time, 16, 2, 1000);
+
+	STP_BeginMstConfigChanges (batched);
+	STP_SetMstConfigName (batched, "REGION", 1000);
+	STP_SetMstConfigRevisionLevel (batched, 7, 1000);
+	STP_SetMstConfigTableEntry (batched, 5, 1, 1000);
+	STP_SetMstConfigTableEntry (batched, 6, 2, 1000);
+	STP_SetMstConfigTableEntry (batched, 16, 2, 1000);
+	EXPECT_EQ (0u, restarts_batched);
+	EXPECT_EQ (0, memcmp (initial_id.ConfigurationDigest, STP_GetMstConfigId(batched)->ConfigurationDigest, 16));
+	STP_CommitMstConfigChanges (batched, 1000);
+
+	EXPECT_EQ (5u, restarts_one_at_a_time);
+	EXPECT_EQ (1u, restarts_batched);
+	EXPECT_TRUE (*STP_GetMstConfigId(one_at_a_time) == *STP_GetMstConfigId(batched));
+	EXPECT_NE (0, memcmp (initial_id.ConfigurationDigest, STP_GetMstConfigId(batched)->ConfigurationDigest, 16));
+	EXPECT_STREQ ("REGION", STP_GetMstConfigId(batched)->ConfigurationName);
+	EXPECT_EQ (1u, STP_GetTreeIndexFromVlanNumber (batched, 5));
+	EXPECT_EQ (2u, STP_GetTreeIndexFromVlanNumber (batched, 16));
+
+	// A commit with nothing changed doesn't restart anything.
+	STP_BeginMstConfigChanges (batched);
+	STP_SetMstConfigTableEntry (batched, 5, 1, 2000);
+	STP_CommitMstConfigChanges (batched, 2000);
+	EXPECT_EQ (1u, restarts_batched);
+}
+
+// Runs two bridges with the same address and configuration, one transmitting through transmitGetBuffer and the other
+// through transmitGather, connected on port 0 to the same peer, and checks that the frames from transmitGather
+// are the headers followed by the BPDUs from transmitGetBuffer.
+static void check_transmit_gather (STP_VERSION version, size_t msti_count, std::array<uint8_t, 6> port0_address, std::set<uint16_t>& bpdu_types_seen)
+{
+	const std::array<uint8_t, 6> address = { 0x10, 0x20, 0x30, 0x40, 0x50, 0x70 };
+	test_bridge peer          (2, msti_count, 16, { 0x10, 0x20, 0x30, 0x40, 0x50, 0x60 });
+	test_bridge twin_get      (2, msti_count, 16, address);
+	test_bridge twin_gather   (2, msti_count, 16, address, true);
+	STP_SetPortAddress (twin_gather, 0, port0_address.data());
+
+	for (test_bridge* b : { &peer, &twin_get, &twin_gather })
+	{
+		STP_SetStpVersion (*b, version, 0);
+		STP_SetMstConfigName (*b, "gather", 0);
+		for (unsigned int vlan = 1; vlan <= msti_count; vlan++)
+			STP_SetMstConfigTableEntry (*b, vlan, vlan, 0);
+		STP_StartBridge (*b, 0);
+		STP_OnPortEnabled (*b, 0, 100, true, 0);
+	}
+
+	// Port 1 of the twins isn't connected; it becomes Designated, which eventually makes them report a topology change.
+	STP_OnPortEnabled (twin_get, 1, 100, true, 0);
+	STP_OnPortEnabled (twin_gather, 1, 100, true, 0);
+
+	for (unsigned int timestamp = 0; timestamp <= 40000; timestamp += 1000)
+	{
+		bool delivered;
+		do
+		{
+			delivered = false;
+			for (size_t port = 0; port < 2; port++)
+			{
+				auto& bpdus = twin_get.tx_queues[port];
+				auto& frames = twin_gather.tx_frames[port];
+				ASSERT_EQ (bpdus.size(), frames.size());
+				while (!bpdus.empty())
+				{
+					const std::vector<uint8_t>& bpdu = bpdus.front();
+					const std::vector<uint8_t>& frame = frames.front();
+					const std::array<uint8_t, 6>& source = (port == 0) ? port0_address : address;
+					uint16_t length = (uint16_t) (3 + bpdu.size());
+
+					std::vector<uint8_t> expected = { 0x01, 0x80, 0xC2, 0x00, 0x00, 0x00 };
+					expected.insert (expected.end(), source.begin(), source.end());
+					expected.insert (expected.end(), { (uint8_t) (length >> 8), (uint8_t) length, 0x42, 0x42, 0x03 });
+					expected.insert (expected.end(), bpdu.begin(), bpdu.end());
+					EXPECT_EQ (expected, frame);
+
+					bpdu_types_seen.insert ((uint16_t) ((bpdu[2] << 8) | bpdu[3])); // protocol version and BPDU type
+
+					if (port == 0)
+					{
+						STP_OnBpduReceived (peer, 0, bpdu.data(), (unsigned int) bpdu.size(), timestamp);
+						delivered = true;
+					}
+
+					bpdus.pop();
+					frames.pop();
+					twin_gather.tx_queues[port].pop();
+				}
+			}
+
+			while (!peer.tx_queues[0].empty())
+			{
+				std::vector<uint8_t> bpdu = std::move(peer.tx_queues[0].front());
+				peer.tx_queues[0].pop();
+				STP_OnBpduReceived (twin_get, 0, bpdu.data(), (unsigned int) bpdu.size(), timestamp);
+				STP_OnBpduReceived (twin_gather, 0, bpdu.data(), (unsigned int) bpdu.size(), timestamp);
+				delivered = true;
+			}
+		} while (delivered);
+
+		for (test_bridge* b : { &peer, &twin_get, &twin_gather })
+			STP_OnOneSecondTick (*b, timestamp);
+	}
+
+	EXPECT_EQ (STP_PORT_ROLE_ROOT, STP_GetPortRole (twin_gather, 0, 0));
+}
+
+TEST(bridge_tests, transmit_gather_rstp)
+{
+	std::set<uint16_t> bpdu_types;
+	check_transmit_gather (STP_VERSION_RSTP, 0, { 0x10, 0x20, 0x30, 0x40, 0x50, 0x70 }, bpdu_types);
+	EXPECT_EQ (std::set<uint16_t>({ 0x0202 }), bpdu_types); // RST
+}
+
+TEST(bridge_tests, transmit_gather_mstp)
+{
+	std::set<uint16_t> bpdu_types;
+	check_transmit_gather (STP_VERSION_MSTP, 3, { 0x10, 0x20, 0x30, 0x40, 0x50, 0x70 }, bpdu_types);
+	EXPECT_EQ (std::set<uint16_t>({ 0x0302 }), bpdu_types); // MST
+}
+
+TEST(bridge_tests, transmit_gather_legacy_stp)
+{
+	std::set<uint16_t> bpdu_types;
+	check_transmit_gather (STP_VERSION_LEGACY_STP, 0, { 0x10, 0x20, 0x30, 0x40, 0x50, 0x70 }, bpdu_types);
+	EXPECT_EQ (std::set<uint16_t>({ 0x0000, 0x0080 }), bpdu_types); // Config and TCN
+}
+
+TEST(bridge_tests, transmit_gather_after_set_port_address)
+{
+	std::set<uint16_t> bpdu_types;
+	check_transmit_gather (STP_VERSION_MSTP, 2, { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 }, bpdu_types);
+	check_transmit_gather (STP_VERSION_LEGACY_STP, 0, { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 }, bpdu_types);
+	EXPECT_EQ (std::set<uint16_t>({ 0x0000, 0x0080, 0x0302 }), bpdu_types);
+}
@@ -0,0 +1,262 @@
+// This file is part of the mstp-lib library, available at https://github.com/adigostin/mstp-lib
+// Copyright (c) 2011-2020 Adi Gostin, distributed under Apache License v2.0.
+
+// Tests of the counters of STP_GetCounters and STP_GetPortCounters. They are built only with the library compiled with STP_USE_COUNTERS.
+
+#include "test_helpers.h"
+#include <gtest/gtest.h>
+#include <array>
+#include <string>
+
+namespace
+{
+	using bpdu_counts = std::array<unsigned int, STP_BPDU_TYPE_COUNT>;
+
+	// The type a bridge running the same protocol version as the sender validates a BPDU as.
+	STP_BPDU_TYPE bpdu_type (const std::vector<uint8_t>& bpdu)
+	{
+		if (bpdu[3] == 0x00)
+			return STP_BPDU_TYPE_CONFIG;
+		if (bpdu[3] == 0x80)
+			return STP_BPDU_TYPE_TCN;
+		return (bpdu[2] >= 3) ? STP_BPDU_TYPE_MST : STP_BPDU_TYPE_RST;
+	}
+
+	// Two bridges with their ports 0 connected together; port 1 of each leads to no other bridge.
+	// The BPDUs transmitted on each port are counted by type here, the same as the library should count them.
+	struct two_bridges
+	{
+		test_bridge a { 2, 0, 16, { 0x02, 0, 0, 0, 0, 0x10 } };
+		test_bridge b { 2, 0, 16, { 0x02, 0, 0, 0, 0, 0x20 } };
+		bpdu_counts transmitted [2][2] = { }; // by bridge and port
+		unsigned int timestamp = 0;
+
+		void deliver()
+		{
+			test_bridge* bridges[2] = { &a, &b };
+			bool delivered;
+			do
+			{
+				delivered = false;
+				for (size_t bi = 0; bi < 2; bi++)
+				{
+					for (size_t port_index = 0; port_index < 2; port_index++)
+					{
+						auto& queue = bridges[bi]->tx_queues[port_index];
+						for (; !queue.empty(); queue.pop())
+						{
+							transmitted[bi][port_index][bpdu_type(queue.front())]++;
+							if (port_index == 0)
+							{
+								STP_OnBpduReceived (*bridges[1 - bi], 0, queue.front().data(), (unsigned int)queue.front().size(), timestamp);
+								delivered = true;
+							}
+						}
+					}
+				}
+			} while (delivered);
+		}
+
+		void run (unsigned int seconds)
+		{
+			for (unsigned int s = 0; s < seconds; s++)
+			{
+				deliver();
+				timestamp += 1000;
+				STP_OnOneSecondTick (a, timestamp);
+				STP_OnOneSecondTick (b, timestamp);
+			}
+
+			deliver();
+		}
+	};
+
+	bpdu_counts received_counts (const STP_BRIDGE* bridge, unsigned int port_index)
+	{
+		STP_PORT_COUNTERS counters;
+		STP_GetPortCounters (bridge, port_index, &counters);
+		bpdu_counts res;
+		std::copy (std::begin(counters.bpdusReceived), std::end(counters.bpdusReceived), res.begin());
+		return res;
+	}
+
+	bpdu_counts transmitted_counts (const STP_BRIDGE* bridge, unsigned int port_index)
+	{
+		STP_PORT_COUNTERS counters;
+		STP_GetPortCounters (bridge, port_index, &counters);
+		bpdu_counts res;
+		std::copy (std::begin(counters.bpdusTransmitted), std::end(counters.bpdusTransmitted), res.begin());
+		return res;
+	}
+}
+
+// Each bridge must count by type what it transmitted on each port and what the other bridge received from it.
+// Port 1 of bridge b goes forwarding some time after port 0, so with legacy STP b sends TCN BPDUs towards the root a.
+TEST(counters_tests, bpdus_counted_by_type)
+{
+	for (STP_VERSION version : { STP_VERSION_LEGACY_STP, STP_VERSION_RSTP, STP_VERSION_MSTP })
+	{
+		SCOPED_TRACE(version);
+		two_bridges n;
+		for (test_bridge* b : { &n.a, &n.b })
+		{
+			STP_SetStpVersion (*b, version, 0);
+			STP_StartBridge (*b, 0);
+			STP_OnPortEnabled (*b, 0, 100, true, 0);
+		}
+		STP_OnPortEnabled (n.b, 1, 100, true, 0);
+		n.run (60);
+
+		STP_BPDU_TYPE main_type = (version == STP_VERSION_LEGACY_STP) ? STP_BPDU_TYPE_CONFIG
+			: (version == STP_VERSION_RSTP) ? STP_BPDU_TYPE_RST : STP_BPDU_TYPE_MST;
+		EXPECT_GT (n.transmitted[0][0][main_type], 0u);
+		EXPECT_GT (n.transmitted[1][1][main_type], 0u);
+		if (version == STP_VERSION_LEGACY_STP)
+		{
+			EXPECT_GT (n.transmitted[1][0][STP_BPDU_TYPE_TCN], 0u);
+		}
+
+		EXPECT_EQ (n.transmitted[0][0], transmitted_counts(n.a, 0));
+		EXPECT_EQ (n.transmitted[0][1], transmitted_counts(n.a, 1));
+		EXPECT_EQ (n.transmitted[1][0], transmitted_counts(n.b, 0));
+		EXPECT_EQ (n.transmitted[1][1], transmitted_counts(n.b, 1));
+		EXPECT_EQ (n.transmitted[1][0], received_counts(n.a, 0));
+		EXPECT_EQ (n.transmitted[0][0], received_counts(n.b, 0));
+		EXPECT_EQ (bpdu_counts{ }, received_counts(n.a, 1));
+		EXPECT_EQ (bpdu_counts{ }, received_counts(n.b, 1));
+	}
+}
+
+// BPDUs that fail validation are counted as invalid, those received on a disabled port as discarded,
+// and those received while the bridge is stopped only bridge-wide.
+TEST(counters_tests, bpdus_invalid_discarded_and_while_stopped)
+{
+	test_bridge bridge (2, 0, 16, { 0x02, 0, 0, 0, 0, 0x10 });
+	STP_StartBridge (bridge, 0);
+	STP_OnPortEnabled (bridge, 0, 100, true, 0);
+
+	const uint8_t short_bpdu[4] = { };
+	STP_OnBpduReceived (bridge, 0, short_bpdu, sizeof(short_bpdu), 0);
+	STP_OnBpduReceived (bridge, 1, short_bpdu, sizeof(short_bpdu), 0);
+	STP_StopBridge (bridge, 0);
+	STP_OnBpduReceived (bridge, 0, short_bpdu, sizeof(short_bpdu), 0);
+	STP_RX_BPDU batch[2] = { { 0, short_bpdu, sizeof(short_bpdu) }, { 1, short_bpdu, sizeof(short_bpdu) } };
+	STP_OnBpdusReceived (bridge, batch, 2, 0);
+
+	STP_PORT_COUNTERS port0, port1;
+	STP_GetPortCounters (bridge, 0, &port0);
+	STP_GetPortCounters (bridge, 1, &port1);
+	EXPECT_EQ ((bpdu_counts{ 1, 0, 0, 0, 0, 0 }), received_counts(bridge, 0));
+	EXPECT_EQ (0u, port0.bpdusDiscarded);
+	EXPECT_EQ (bpdu_counts{ }, received_counts(bridge, 1));
+	EXPECT_EQ (1u, port1.bpdusDiscarded);
+
+	STP_COUNTERS counters;
+	STP_GetCounters (bridge, &counters);
+	EXPECT_EQ (3u, counters.bpdusReceivedWhileStopped);
+
+	STP_ResetCounters (bridge);
+	STP_GetCounters (bridge, &counters);
+	STP_GetPortCounters (bridge, 1, &port1);
+	EXPECT_EQ (0u, counters.bpdusReceivedWhileStopped);
+	EXPECT_EQ (0u, port1.bpdusDiscarded);
+	EXPECT_EQ (bpdu_counts{ }, received_counts(bridge, 0));
+}
+
+// The transition counters must agree with the transitions in the log, the lines ending in " <state machine>: -> <state>".
+TEST(counters_tests, transitions_same_as_logged)
+{
+#if !STP_USE_LOG || STP_USE_BINARY_LOG
+	GTEST_SKIP() << "Needs the text log.";
+#else
+	two_bridges n;
+	std::string log;
+	n.a.debug_str_out = [&log](int portIndex, int treeIndex, const char* str, unsigned int length) { log.append (str, length); };
+	STP_EnableLogging (n.a, true);
+	for (test_bridge* b : { &n.a, &n.b })
+	{
+		STP_StartBridge (*b, 0);
+		STP_OnPortEnabled (*b, 0, 100, true, 0);
+	}
+	STP_OnPortEnabled (n.a, 1, 100, true, 0);
+	n.run (10);
+	STP_SetBridgePriority (n.b, 0, 0x1000, n.timestamp);
+	n.run (10);
+
+	STP_COUNTERS counters;
+	STP_GetCounters (n.a, &counters);
+	unsigned int total = 0;
+	for (unsigned int sm = 0; sm < STP_STATE_MACHINE_COUNT; sm++)
+	{
+		for (unsigned int state = 1; state < STP_MAX_STATE_MACHINE_STATES; state++)
+		{
+			const char* state_name = STP_GetStateName ((STP_STATE_MACHINE)sm, state);
+			if (state_name == nullptr)
+				continue;
+
+			std::string line_end = " " + std::string(STP_GetStateMachineName((STP_STATE_MACHINE)sm)) + ": -> " + state_name + "\r\n";
+			unsigned int logged = 0;
+			for (size_t i = log.find(line_end); i != std::string::npos; i = log.find(line_end, i + 1))
+				logged++;
+
+			EXPECT_EQ (logged, counters.transitions[sm][state]) << line_end;
+			total += logged;
+		}
+	}
+
+	EXPECT_GT (total, 50u);
+	EXPECT_GT (counters.runStateMachinesCalls, 0u);
+	EXPECT_GE (counters.runStateMachinesPasses, counters.runStateMachinesCalls);
+	EXPECT_GT (counters.stateMachineEvaluations, counters.runStateMachinesPasses);
+#endif
+}
+
+// With a fake clock that moves forward by a given step at each read, each call measures exactly that step.
+// buckets[0] counts zeroes, and buckets[n] the durations from 2^(n-1) to 2^n - 1.
+TEST(counters_tests, histograms_bucket_durations)
+{
+	test_bridge bridge (2, 0, 16, { 0x02, 0, 0, 0, 0, 0x10 });
+	unsigned int now = 0x12345678;
+	unsigned int step = 0;
+	bridge.read_clock = [&]() { unsigned int res = now; now += step; return res; };
+	STP_StartBridge (bridge, 0);
+	STP_OnPortEnabled (bridge, 0, 100, true, 0);
+
+	const unsigned int tick_durations[] = { 0, 1, 2, 3, 4, 1000, 1023, 1024, 0x80000000u, 0xFFFFFFFFu };
+	for (unsigned int duration : tick_durations)
+	{
+		step = duration;
+		STP_OnOneSecondTick (bridge, 0);
+	}
+
+	const uint8_t short_bpdu[4] = { };
+	step = 7;
+	STP_OnBpduReceived (bridge, 0, short_bpdu, sizeof(short_bpdu), 0);
+	step = 8;
+	STP_RX_BPDU batch[2] = { { 0, short_bpdu, sizeof(short_bpdu) }, { 0, short_bpdu, sizeof(short_bpdu) } };
+	STP_OnBpdusReceived (bridge, batch, 2, 0);
+
+	STP_COUNTERS counters;
+	STP_GetCounters (bridge, &counters);
+
+	STP_HISTOGRAM expected_tick = { };
+	expected_tick.count = 10;
+	expected_tick.max = 0xFFFFFFFFu;
+	expected_tick.buckets[0] = 1;  // 0
+	expected_tick.buckets[1] = 1;  // 1
+	expected_tick.buckets[2] = 2;  // 2, 3
+	expected_tick.buckets[3] = 1;  // 4
+	expected_tick.buckets[10] = 2; // 1000, 1023
+	expected_tick.buckets[11] = 1; // 1024
+	expected_tick.buckets[32] = 2; // 0x80000000, 0xFFFFFFFF
+	EXPECT_EQ (expected_tick.count, counters.oneSecondTickTime.count);
+	EXPECT_EQ (expected_tick.max, counters.oneSecondTickTime.max);
+	for (unsigned int i = 0; i < 33; i++)
+		EXPECT_EQ (expected_tick.buckets[i], counters.oneSecondTickTime.buckets[i]) << "bucket " << i;
+
+	// One sample per call, not per BPDU.
+	EXPECT_EQ (2u, counters.bpduReceivedTime.count);
+	EXPECT_EQ (8u, counters.bpduReceivedTime.max);
+	for (unsigned int i = 0; i < 33; i++)
+		EXPECT_EQ ((i == 3 || i == 4) ? 1u : 0u, counters.bpduReceivedTime.buckets[i]) << "bucket " << i;
+}
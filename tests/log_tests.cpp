@@ -0,0 +1,594 @@
+// This file is part of the mstp-lib library, available at https://github.com/adigostin/mstp-lib
+// Copyright (c) 2011-2020 Adi Gostin, distributed under Apache License v2.0.
+
+// Tests of the library's log.
+
+#include "stp.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <queue>
+#include <string>
+#include <vector>
+
+#ifdef MSTP_LIB_BINARY_LOG_MODULE
+	#include <dlfcn.h>
+
+	// Internal to the library, not part of stp.h; the tests call it directly only to log formats the library doesn't have.
+	void STP_Log (STP_BRIDGE* bridge, int port, int tree, const char* format, ...);
+#endif
+
+namespace
+{
+	struct log_line
+	{
+		int port;
+		int tree;
+		std::string text;
+
+		bool operator== (const log_line& other) const { return (port == other.port) && (tree == other.tree) && (text == other.text); }
+	};
+
+	void PrintTo (const log_line& line, std::ostream* os)
+	{
+		*os << "port " << line.port << ", tree " << line.tree << ": \"" << line.text << "\"";
+	}
+
+	// Joins the strings passed to debugStrOut or to STP_DecodeBinaryLog's callback into lines, each with the port and tree
+	// given with its first characters. The text log passes the lines in pieces when they don't fit its buffer.
+	class log_lines
+	{
+		log_line _current;
+
+	public:
+		std::vector<log_line> lines;
+
+		void add (int port, int tree, const char* str, unsigned int length)
+		{
+			for (unsigned int i = 0; i < length; i++)
+			{
+				if (_current.text.empty())
+				{
+					_current.port = port;
+					_current.tree = tree;
+				}
+
+				_current.text.push_back (str[i]);
+				if (str[i] == '\n')
+				{
+					lines.push_back (std::move(_current));
+					_current.text.clear();
+				}
+			}
+		}
+
+		void finish()
+		{
+			if (!_current.text.empty())
+				lines.push_back (std::move(_current));
+			_current.text.clear();
+		}
+	};
+
+	// The functions of stp.h used by the tests below, taken either from the library linked with the tests or from a module
+	// that contains the library compiled with other options.
+	#define STP_API_FUNCTIONS(X) \
+		X(CreateBridge) X(DestroyBridge) X(SetStpVersion) X(SetMstConfigName) X(SetMstConfigTableEntry) X(EnableLogging) \
+		X(StartBridge) X(OnPortEnabled) X(OnPortDisabled) X(OnBpduReceived) X(OnOneSecondTick) X(SetBridgePriority) X(GetBinaryLog)
+
+	struct stp_api
+	{
+		#define X(name) decltype(&STP_##name) name;
+		STP_API_FUNCTIONS(X)
+		#undef X
+	};
+
+	const stp_api linked_api =
+	{
+		#define X(name) &STP_##name,
+		STP_API_FUNCTIONS(X)
+		#undef X
+	};
+
+	// A triangle of MSTP bridges with two MSTIs, run through a fixed sequence of events. Since the callbacks can't call
+	// STP_GetApplicationContext of the module's library, they find their bridge in a map.
+	class triangle
+	{
+		struct bridge_state
+		{
+			STP_BRIDGE* bridge;
+			std::map<unsigned int, std::queue<std::vector<uint8_t>>> tx_queues;
+			std::vector<uint8_t> tx_buffer;
+			unsigned int tx_port;
+			log_lines text_log;
+		};
+
+		static std::map<const STP_BRIDGE*, bridge_state*> states;
+
+		static void* TransmitGetBuffer (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int bpduSize, unsigned int timestamp)
+		{
+			bridge_state* s = states.at(bridge);
+			s->tx_port = portIndex;
+			s->tx_buffer.resize (bpduSize);
+			return s->tx_buffer.data();
+		}
+
+		static void TransmitReleaseBuffer (const STP_BRIDGE* bridge, void* bufferReturnedByGetBuffer)
+		{
+			bridge_state* s = states.at(bridge);
+			s->tx_queues[s->tx_port].push (std::move(s->tx_buffer));
+		}
+
+		static void DebugStrOut (const STP_BRIDGE* bridge, int portIndex, int treeIndex, const char* nullTerminatedString, unsigned int stringLength, unsigned int flush)
+		{
+			states.at(bridge)->text_log.add (portIndex, treeIndex, nullTerminatedString, stringLength);
+		}
+
+		static void EnableBpduTrapping (const STP_BRIDGE* bridge, bool enable, unsigned int timestamp) { }
+		static void EnableLearning (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex, bool enable, unsigned int timestamp) { }
+		static void EnableForwarding (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex, bool enable, unsigned int timestamp) { }
+		static void FlushFdb (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex, enum STP_FLUSH_FDB_TYPE flushType, unsigned int timestamp) { }
+		static void OnTopologyChange (const STP_BRIDGE* bridge, unsigned int treeIndex, unsigned int timestamp) { }
+		static void OnPortRoleChanged (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex, STP_PORT_ROLE role, unsigned int timestamp) { }
+		static void* AllocAndZeroMemory (unsigned int size) { return calloc (1, size); }
+		static void FreeMemory (void* p) { free (p); }
+
+		static const STP_CALLBACKS callbacks;
+
+		const stp_api& _api;
+		bridge_state _bridges [3];
+		unsigned int _timestamp = 0;
+
+		void deliver()
+		{
+			// Port 0 of each bridge is connected to port 1 of the next one; port 2 leads to no other bridge.
+			bool delivered;
+			do
+			{
+				delivered = false;
+				for (unsigned int bi = 0; bi < 3; bi++)
+				{
+					for (unsigned int port_index = 0; port_index < 3; port_index++)
+					{
+						auto& queue = _bridges[bi].tx_queues[port_index];
+						for (; !queue.empty(); queue.pop())
+						{
+							if (port_index < 2)
+							{
+								unsigned int peer = (port_index == 0) ? (bi + 1) % 3 : (bi + 2) % 3;
+								_api.OnBpduReceived (_bridges[peer].bridge, 1 - port_index, queue.front().data(), (unsigned int)queue.front().size(), _timestamp);
+								delivered = true;
+							}
+						}
+					}
+				}
+			} while (delivered);
+		}
+
+		void run (unsigned int seconds)
+		{
+			for (unsigned int s = 0; s < seconds; s++)
+			{
+				deliver();
+				_timestamp += 1000;
+				for (auto& b : _bridges)
+					_api.OnOneSecondTick (b.bridge, _timestamp);
+			}
+
+			deliver();
+		}
+
+	public:
+		triangle (const stp_api& api, unsigned int debug_log_buffer_size)
+			: _api(api)
+		{
+			for (unsigned int bi = 0; bi < 3; bi++)
+			{
+				const unsigned char address[6] = { 0x02, 0, 0, 0, 0, (unsigned char)(0x10 + bi) };
+				_bridges[bi].bridge = _api.CreateBridge (3, 2, 16, &callbacks, address, debug_log_buffer_size);
+				states[_bridges[bi].bridge] = &_bridges[bi];
+			}
+		}
+
+		~triangle()
+		{
+			for (auto& b : _bridges)
+			{
+				states.erase (b.bridge);
+				_api.DestroyBridge (b.bridge);
+			}
+		}
+
+		STP_BRIDGE* operator[] (size_t i) const { return _bridges[i].bridge; }
+
+		std::vector<log_line> text_log (size_t i)
+		{
+			_bridges[i].text_log.finish();
+			return _bridges[i].text_log.lines;
+		}
+
+		void run_scenario()
+		{
+			for (auto& b : _bridges)
+			{
+				_api.EnableLogging (b.bridge, true);
+				_api.SetStpVersion (b.bridge, STP_VERSION_MSTP, _timestamp);
+				_api.SetMstConfigName (b.bridge, "log", _timestamp);
+				_api.SetMstConfigTableEntry (b.bridge, 1, 1, _timestamp);
+				_api.SetMstConfigTableEntry (b.bridge, 2, 2, _timestamp);
+				_api.StartBridge (b.bridge, _timestamp);
+				for (unsigned int port_index = 0; port_index < 3; port_index++)
+					_api.OnPortEnabled (b.bridge, port_index, 100, true, _timestamp);
+			}
+
+			run (20);
+			_api.SetBridgePriority (_bridges[2].bridge, 1, 0x1000, _timestamp);
+			run (10);
+			_api.OnPortDisabled (_bridges[0].bridge, 0, _timestamp);
+			_api.OnPortDisabled (_bridges[1].bridge, 0, _timestamp);
+			run (10);
+		}
+	};
+
+	std::map<const STP_BRIDGE*, triangle::bridge_state*> triangle::states;
+
+	const STP_CALLBACKS triangle::callbacks =
+	{
+		&EnableBpduTrapping,
+		&EnableLearning,
+		&EnableForwarding,
+		&TransmitGetBuffer,
+		&TransmitReleaseBuffer,
+		&FlushFdb,
+		&DebugStrOut,
+		&OnTopologyChange,
+		&OnPortRoleChanged,
+		&AllocAndZeroMemory,
+		&FreeMemory,
+		nullptr, // transmitGather
+		nullptr, // readClock
+	};
+
+#ifdef MSTP_LIB_BINARY_LOG_MODULE
+	// The library compiled with STP_USE_BINARY_LOG=1.
+	class binary_log_module
+	{
+		void* _handle;
+
+	public:
+		stp_api api;
+
+		binary_log_module()
+		{
+			_handle = dlopen (MSTP_LIB_BINARY_LOG_MODULE, RTLD_NOW | RTLD_LOCAL);
+			EXPECT_NE (nullptr, _handle) << dlerror();
+			#define X(name) api.name = _handle ? reinterpret_cast<decltype(&STP_##name)>(dlsym (_handle, "STP_" #name)) : nullptr;
+			STP_API_FUNCTIONS(X)
+			#undef X
+		}
+
+		~binary_log_module()
+		{
+			if (_handle)
+				dlclose (_handle);
+		}
+
+		bool loaded() const { return _handle != nullptr; }
+		void* handle() const { return _handle; }
+	};
+
+	// Takes a snapshot of the binary log of a bridge created by the module, and decodes it with the library linked with the tests.
+	std::vector<log_line> decode_binary_log (const stp_api& api, STP_BRIDGE* bridge)
+	{
+		std::vector<uint8_t> snapshot (api.GetBinaryLog (bridge, nullptr, 0));
+		EXPECT_GT (snapshot.size(), 0u);
+		EXPECT_EQ (snapshot.size(), api.GetBinaryLog (bridge, snapshot.data(), (unsigned int)snapshot.size()));
+
+		log_lines decoded;
+		auto text_out = [](void* context, int portIndex, int treeIndex, const char* str, unsigned int length)
+		{
+			static_cast<log_lines*>(context)->add (portIndex, treeIndex, str, length);
+		};
+		EXPECT_TRUE (STP_DecodeBinaryLog (snapshot.data(), (unsigned int)snapshot.size(), text_out, &decoded));
+		decoded.finish();
+		return decoded.lines;
+	}
+#endif
+}
+
+// The same topology runs once on bridges with the text log and once on bridges with the binary log.
+// Decoding the binary log must give the text log: same lines, with the same port, tree and indentation.
+TEST(log_tests, decoded_binary_log_same_as_text_log)
+{
+#if !defined(MSTP_LIB_BINARY_LOG_MODULE) || STP_USE_BINARY_LOG || !STP_USE_LOG
+	GTEST_SKIP() << "Needs the text log here and the binary log in a module.";
+#else
+	binary_log_module module;
+	ASSERT_TRUE (module.loaded());
+
+	triangle text (linked_api, 256);
+	text.run_scenario();
+	triangle binary (module.api, 1 << 20);
+	binary.run_scenario();
+
+	for (size_t bi = 0; bi < 3; bi++)
+	{
+		SCOPED_TRACE(testing::Message() << "bridge " << bi);
+		auto text_lines = text.text_log(bi);
+		auto decoded_lines = decode_binary_log (module.api, binary[bi]);
+		ASSERT_GT (text_lines.size(), 100u);
+		EXPECT_EQ (text_lines.size(), decoded_lines.size());
+		for (size_t i = 0; i < std::min(text_lines.size(), decoded_lines.size()); i++)
+			ASSERT_EQ (text_lines[i], decoded_lines[i]) << "line " << i;
+
+		// The attribution and the indentation must have been exercised.
+		bool port_lines = false, tree_lines = false, indented_lines = false;
+		for (auto& line : text_lines)
+		{
+			port_lines |= (line.port >= 0);
+			tree_lines |= (line.tree > 0);
+			indented_lines |= (line.text[0] == ' ');
+		}
+
+		EXPECT_TRUE (port_lines);
+		EXPECT_TRUE (tree_lines);
+		EXPECT_TRUE (indented_lines);
+	}
+#endif
+}
+
+// With a ring buffer too small for the whole scenario, the decoded log must be the end of the text log.
+// Its first line may be the end of a line whose first records were overwritten.
+TEST(log_tests, decoded_binary_log_after_ring_wraparound)
+{
+#if !defined(MSTP_LIB_BINARY_LOG_MODULE) || STP_USE_BINARY_LOG || !STP_USE_LOG
+	GTEST_SKIP() << "Needs the text log here and the binary log in a module.";
+#else
+	binary_log_module module;
+	ASSERT_TRUE (module.loaded());
+
+	triangle text (linked_api, 256);
+	text.run_scenario();
+	triangle binary (module.api, 4096);
+	binary.run_scenario();
+
+	for (size_t bi = 0; bi < 3; bi++)
+	{
+		SCOPED_TRACE(testing::Message() << "bridge " << bi);
+		auto text_lines = text.text_log(bi);
+		auto decoded_lines = decode_binary_log (module.api, binary[bi]);
+		ASSERT_GT (decoded_lines.size(), 10u);
+		ASSERT_LT (decoded_lines.size(), text_lines.size() / 2);
+
+		size_t first = text_lines.size() - decoded_lines.size();
+		for (size_t i = 1; i < decoded_lines.size(); i++)
+			ASSERT_EQ (text_lines[first + i], decoded_lines[i]) << "line " << first + i;
+
+		const log_line& partial = decoded_lines[0];
+		const log_line& full = text_lines[first];
+		EXPECT_EQ (full.port, partial.port);
+		EXPECT_EQ (full.tree, partial.tree);
+		std::string tail = partial.text.substr (partial.text.find_first_not_of (' '));
+		ASSERT_LE (tail.size(), full.text.size());
+		EXPECT_EQ (tail, full.text.substr (full.text.size() - tail.size()));
+	}
+#endif
+}
+
+// A format with more directives than a binary log record has room for, or whose arguments may not fit in one,
+// is logged as text. The decoded log must still be the text log.
+TEST(log_tests, decoded_binary_log_same_as_text_log_for_large_formats)
+{
+#if !defined(MSTP_LIB_BINARY_LOG_MODULE) || STP_USE_BINARY_LOG || !STP_USE_LOG
+	GTEST_SKIP() << "Needs the text log here and the binary log in a module.";
+#else
+	binary_log_module module;
+	ASSERT_TRUE (module.loaded());
+
+	// The module's STP_Log, by its mangled name.
+	auto module_log = reinterpret_cast<decltype(&STP_Log)>(dlsym (module.handle(), "_Z7STP_LogP10STP_BRIDGEiiPKcz"));
+	ASSERT_NE (nullptr, module_log);
+
+	triangle text (linked_api, 256);
+	triangle binary (module.api, 1 << 16);
+	struct
+	{
+		STP_BRIDGE* bridge;
+		const stp_api& api;
+		decltype(&STP_Log) log;
+	} const logs[] = { { text[0], linked_api, &STP_Log }, { binary[0], module.api, module_log } };
+
+	const char* s = "a string of sixty characters, almost as long as they can be.";
+	for (auto& l : logs)
+	{
+		l.api.EnableLogging (l.bridge, true);
+		l.log (l.bridge, 1, 0, "{D} {D} {D} {D} {D} {D} {D} {D} {D} {D} {D} {D} {S}\r\n", 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, "thirteen");
+		l.log (l.bridge, 2, 1, "{S} {S} {S} {S} {S} {S} {S} {S}\r\n", s, s, s, s, s, s, s, s);
+		l.log (l.bridge, -1, -1, "{D} {S}\r\n", 1, "small");
+	}
+
+	auto text_lines = text.text_log(0);
+	ASSERT_EQ (3u, text_lines.size());
+	EXPECT_EQ ("1 2 3 4 5 6 7 8 9 10 11 12 thirteen\r\n", text_lines[0].text);
+	EXPECT_EQ (text_lines, decode_binary_log (module.api, binary[0]));
+#endif
+}
+
+namespace
+{
+	// Returns the state machine whose transition a line of the text log shows, or STP_STATE_MACHINE_COUNT for other lines.
+	STP_STATE_MACHINE transition_state_machine (const log_line& line)
+	{
+		for (unsigned int sm = 0; sm < STP_STATE_MACHINE_COUNT; sm++)
+		{
+			if (line.text.find (std::string(STP_GetStateMachineName((STP_STATE_MACHINE)sm)) + ": -> ") != std::string::npos)
+				return (STP_STATE_MACHINE)sm;
+		}
+
+		return STP_STATE_MACHINE_COUNT;
+	}
+
+	// Whether the lines of a filtered log are all whole lines of the unfiltered one, in the same order.
+	bool whole_lines_of (const std::vector<log_line>& filtered, const std::vector<log_line>& unfiltered)
+	{
+		size_t i = 0;
+		for (auto& line : filtered)
+		{
+			if (line.text.empty() || (line.text.back() != '\n'))
+				return false;
+			while ((i < unfiltered.size()) && !(unfiltered[i] == line))
+				i++;
+			if (i == unfiltered.size())
+				return false;
+			i++;
+		}
+
+		return true;
+	}
+
+	// Runs the scenario of the triangle with the same filter set on all bridges and returns the text logs.
+	std::vector<std::vector<log_line>> filtered_text_logs (const unsigned char* portBitmap, const unsigned char* treeBitmap, unsigned int stateMachineMask, STP_LOG_LEVEL maxLevel)
+	{
+		triangle t (linked_api, 256);
+		for (size_t bi = 0; bi < 3; bi++)
+			STP_SetLogFilter (t[bi], portBitmap, treeBitmap, stateMachineMask, maxLevel);
+		t.run_scenario();
+		return { t.text_log(0), t.text_log(1), t.text_log(2) };
+	}
+
+	std::vector<std::vector<log_line>> unfiltered_text_logs()
+	{
+		triangle t (linked_api, 256);
+		t.run_scenario();
+		return { t.text_log(0), t.text_log(1), t.text_log(2) };
+	}
+}
+
+// A filter that lets everything through - whether cleared or set to all ports, trees and state machines -
+// must give exactly the log of a bridge on which STP_SetLogFilter was never called.
+TEST(log_tests, filter_passing_all_keeps_log_unchanged)
+{
+#if STP_USE_BINARY_LOG || !STP_USE_LOG
+	GTEST_SKIP() << "Needs the text log.";
+#else
+	auto unfiltered = unfiltered_text_logs();
+
+	triangle cleared (linked_api, 256);
+	const unsigned char port0 = 0x01;
+	for (size_t bi = 0; bi < 3; bi++)
+	{
+		STP_SetLogFilter (cleared[bi], &port0, &port0, STP_LOG_STATE_MACHINE_PORT_TIMERS, STP_LOG_LEVEL_EVENTS);
+		STP_SetLogFilter (cleared[bi], nullptr, nullptr, STP_LOG_STATE_MACHINE_ALL, STP_LOG_LEVEL_DETAILS);
+	}
+	cleared.run_scenario();
+
+	const unsigned char all = 0xFF;
+	auto all_set = filtered_text_logs (&all, &all, STP_LOG_STATE_MACHINE_ALL, STP_LOG_LEVEL_DETAILS);
+
+	for (size_t bi = 0; bi < 3; bi++)
+	{
+		SCOPED_TRACE(testing::Message() << "bridge " << bi);
+		ASSERT_GT (unfiltered[bi].size(), 100u);
+		EXPECT_EQ (unfiltered[bi], cleared.text_log(bi));
+		EXPECT_EQ (unfiltered[bi], all_set[bi]);
+	}
+#endif
+}
+
+// A port or tree filter keeps exactly the lines of the selected ports and trees, plus those not specific to a port or tree.
+TEST(log_tests, port_and_tree_filters_keep_whole_lines)
+{
+#if STP_USE_BINARY_LOG || !STP_USE_LOG
+	GTEST_SKIP() << "Needs the text log.";
+#else
+	auto unfiltered = unfiltered_text_logs();
+
+	const unsigned char port1 = 0x02;
+	const unsigned char trees0and2 = 0x05;
+	auto port_filtered = filtered_text_logs (&port1, nullptr, STP_LOG_STATE_MACHINE_ALL, STP_LOG_LEVEL_DETAILS);
+	auto tree_filtered = filtered_text_logs (nullptr, &trees0and2, STP_LOG_STATE_MACHINE_ALL, STP_LOG_LEVEL_DETAILS);
+
+	for (size_t bi = 0; bi < 3; bi++)
+	{
+		SCOPED_TRACE(testing::Message() << "bridge " << bi);
+		std::vector<log_line> expected_port, expected_tree;
+		for (auto& line : unfiltered[bi])
+		{
+			if ((line.port < 0) || (line.port == 1))
+				expected_port.push_back (line);
+			if ((line.tree < 0) || (line.tree == 0) || (line.tree == 2))
+				expected_tree.push_back (line);
+		}
+
+		ASSERT_LT (expected_port.size(), unfiltered[bi].size());
+		ASSERT_LT (expected_tree.size(), unfiltered[bi].size());
+		EXPECT_EQ (expected_port, port_filtered[bi]);
+		EXPECT_EQ (expected_tree, tree_filtered[bi]);
+	}
+#endif
+}
+
+// A state machine filter drops exactly the transitions of the other state machines.
+TEST(log_tests, state_machine_filter_keeps_whole_lines)
+{
+#if STP_USE_BINARY_LOG || !STP_USE_LOG
+	GTEST_SKIP() << "Needs the text log.";
+#else
+	auto unfiltered = unfiltered_text_logs();
+
+	const unsigned int mask = STP_LOG_STATE_MACHINE_PORT_ROLE_SELECTION | STP_LOG_STATE_MACHINE_PORT_ROLE_TRANSITIONS;
+	auto filtered = filtered_text_logs (nullptr, nullptr, mask, STP_LOG_LEVEL_DETAILS);
+
+	for (size_t bi = 0; bi < 3; bi++)
+	{
+		SCOPED_TRACE(testing::Message() << "bridge " << bi);
+		std::vector<log_line> expected;
+		size_t kept_transitions = 0;
+		for (auto& line : unfiltered[bi])
+		{
+			STP_STATE_MACHINE sm = transition_state_machine (line);
+			if (sm == STP_STATE_MACHINE_COUNT)
+				expected.push_back (line);
+			else if ((mask & (1u << sm)) != 0)
+			{
+				expected.push_back (line);
+				kept_transitions++;
+			}
+		}
+
+		ASSERT_GT (kept_transitions, 0u);
+		ASSERT_LT (expected.size(), unfiltered[bi].size());
+		EXPECT_EQ (expected, filtered[bi]);
+	}
+#endif
+}
+
+// Each level keeps whole lines of the levels above it: all transitions at STP_LOG_LEVEL_TRANSITIONS, none at STP_LOG_LEVEL_EVENTS.
+TEST(log_tests, level_filter_keeps_whole_lines)
+{
+#if STP_USE_BINARY_LOG || !STP_USE_LOG
+	GTEST_SKIP() << "Needs the text log.";
+#else
+	auto details = unfiltered_text_logs();
+	auto transitions = filtered_text_logs (nullptr, nullptr, STP_LOG_STATE_MACHINE_ALL, STP_LOG_LEVEL_TRANSITIONS);
+	auto events = filtered_text_logs (nullptr, nullptr, STP_LOG_STATE_MACHINE_ALL, STP_LOG_LEVEL_EVENTS);
+
+	for (size_t bi = 0; bi < 3; bi++)
+	{
+		SCOPED_TRACE(testing::Message() << "bridge " << bi);
+		ASSERT_FALSE (events[bi].empty());
+		EXPECT_LT (events[bi].size(), transitions[bi].size());
+		EXPECT_LT (transitions[bi].size(), details[bi].size());
+		EXPECT_TRUE (whole_lines_of (events[bi], transitions[bi]));
+		EXPECT_TRUE (whole_lines_of (transitions[bi], details[bi]));
+
+		auto is_transition = [](const log_line& line) { return transition_state_machine(line) != STP_STATE_MACHINE_COUNT; };
+		EXPECT_EQ (0, std::count_if (events[bi].begin(), events[bi].end(), is_transition));
+		EXPECT_EQ (std::count_if (details[bi].begin(), details[bi].end(), is_transition),
+		           std::count_if (transitions[bi].begin(), transitions[bi].end(), is_transition));
+	}
+#endif
+}
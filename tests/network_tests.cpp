@@ -0,0 +1,281 @@
+
+// This file is part of the mstp-lib library, available at https://github.com/adigostin/mstp-lib
+// Copyright (c) 2011-2020 Adi Gostin, distributed under Apache License v2.0.
+
+// Topology tests on the headless simulator engine.
+
+#include "test_helpers.h"
+#include "headless_network.h"
+#include <gtest/gtest.h>
+#include <random>
+
+// Bridges whose ports 0 and 1 are connected in a ring: port 1 of each bridge to port 0 of the next.
+// The bridges are spread over the partitions of the network before they're connected.
+static std::vector<headless_bridge*> create_ring (headless_network& network, size_t bridge_count, STP_VERSION version)
+{
+	std::vector<headless_bridge*> bridges;
+	for (size_t i = 0; i < bridge_count; i++)
+	{
+		auto b = network.add_bridge (4, 0, { 0x10, 0x20, 0x30, 0x40, (uint8_t)(i >> 3), (uint8_t)(i << 5) });
+		STP_SetStpVersion (*b, version, network.timestamp());
+		STP_StartBridge (*b, network.timestamp());
+		bridges.push_back(b);
+	}
+
+	network.distribute_bridges();
+	for (size_t i = 0; i < bridge_count; i++)
+		network.connect (bridges[i], 1, bridges[(i + 1) % bridge_count], 0);
+
+	return bridges;
+}
+
+static size_t count_ports_with_role (const std::vector<headless_bridge*>& bridges, STP_PORT_ROLE role)
+{
+	size_t count = 0;
+	for (auto b : bridges)
+	{
+		for (size_t port_index = 0; port_index < b->port_count(); port_index++)
+		{
+			if (STP_GetPortRole(*b, (unsigned int)port_index, 0) == role)
+				count++;
+		}
+	}
+
+	return count;
+}
+
+// Checks that all ports are either Alternate and discarding, or Root/Designated and forwarding.
+static void expect_stable (const std::vector<headless_bridge*>& bridges)
+{
+	for (auto b : bridges)
+	{
+		for (unsigned int port_index = 0; port_index < (unsigned int)b->port_count(); port_index++)
+		{
+			if (!b->mac_operational(port_index))
+				continue;
+
+			auto role = STP_GetPortRole(*b, port_index, 0);
+			bool forwarding = STP_GetPortForwarding(*b, port_index, 0);
+			if (role == STP_PORT_ROLE_ALTERNATE)
+				EXPECT_FALSE (forwarding);
+			else
+			{
+				EXPECT_TRUE ((role == STP_PORT_ROLE_ROOT) || (role == STP_PORT_ROLE_DESIGNATED));
+				EXPECT_TRUE (forwarding);
+			}
+		}
+	}
+}
+
+TEST(network_tests, test_port_roles)
+{
+	headless_network network;
+	auto bridge0 = network.add_bridge (4, 0, { 0x10, 0x20, 0x30, 0x40, 0x50, 0x60 });
+	auto bridge1 = network.add_bridge (4, 0, { 0x10, 0x20, 0x30, 0x40, 0x50, 0x70 });
+	STP_StartBridge (*bridge0, network.timestamp());
+	STP_StartBridge (*bridge1, network.timestamp());
+
+	network.connect (bridge0, 0, bridge1, 0);
+	network.connect (bridge0, 1, bridge1, 1);
+	network.run_for (1 * sim_seconds);
+
+	EXPECT_EQ (STP_PORT_ROLE_DESIGNATED, STP_GetPortRole(*bridge0, 0, 0));
+	EXPECT_EQ (STP_PORT_ROLE_DESIGNATED, STP_GetPortRole(*bridge0, 1, 0));
+	EXPECT_EQ (STP_PORT_ROLE_ROOT,       STP_GetPortRole(*bridge1, 0, 0));
+	EXPECT_EQ (STP_PORT_ROLE_ALTERNATE,  STP_GetPortRole(*bridge1, 1, 0));
+}
+
+TEST(network_tests, ring_reconverges_after_cable_unplugged)
+{
+	headless_network network;
+	auto bridges = create_ring (network, 8, STP_VERSION_RSTP);
+	network.run_for (5 * sim_seconds);
+	EXPECT_EQ (1u, count_ports_with_role(bridges, STP_PORT_ROLE_ALTERNATE));
+	expect_stable (bridges);
+
+	// Bridge 0 is the root; the Alternate port is port 1 of the bridge halfway around the ring.
+	size_t alternate_bridge = bridges.size() / 2;
+	ASSERT_EQ (STP_PORT_ROLE_ALTERNATE, STP_GetPortRole(*bridges[alternate_bridge], 1, 0));
+
+	// Unplug the cable between the root bridge and the next one. The ring becomes a chain, without Alternate ports.
+#if STP_USE_CONVERGENCE_TRACE
+	uint32_t unplug_timestamp = network.timestamp();
+#endif
+	network.disconnect (bridges[0], 1);
+	network.run_for (5 * sim_seconds);
+	EXPECT_FALSE (bridges[0]->mac_operational(1));
+	EXPECT_FALSE (bridges[1]->mac_operational(0));
+	EXPECT_EQ (0u, count_ports_with_role(bridges, STP_PORT_ROLE_ALTERNATE));
+	expect_stable (bridges);
+
+#if STP_USE_CONVERGENCE_TRACE
+	// The bridges from the root to the one with the Alternate port reconverged after the unplugging, and are done reconverging.
+	// The root did because its port went down; the bridge with the Alternate port did because of the worse information
+	// it received on its old Root Port, port 0. The bridges past the Alternate port didn't have to reconverge.
+	for (size_t i = 0; i < bridges.size(); i++)
+	{
+		SCOPED_TRACE(testing::Message() << "bridge " << i);
+		STP_CONVERGENCE_REPORT report;
+		ASSERT_TRUE (STP_GetConvergenceReport(*bridges[i], 0, &report));
+		EXPECT_TRUE (report.converged);
+		EXPECT_LE (report.startTimestamp, report.endTimestamp);
+		EXPECT_LE (report.endTimestamp, network.timestamp());
+		if (i <= alternate_bridge)
+			EXPECT_GE (report.startTimestamp, unplug_timestamp);
+		else
+			EXPECT_LT (report.startTimestamp, unplug_timestamp);
+	}
+
+	STP_CONVERGENCE_REPORT report;
+	STP_GetConvergenceReport (*bridges[0], 0, &report);
+	EXPECT_EQ (STP_CONVERGENCE_TRIGGER_PORT_DISABLED, report.trigger);
+	EXPECT_EQ (1, report.triggerPortIndex);
+
+	STP_GetConvergenceReport (*bridges[alternate_bridge], 0, &report);
+	EXPECT_EQ (STP_CONVERGENCE_TRIGGER_BPDU_RECEIVED, report.trigger);
+	EXPECT_EQ (0, report.triggerPortIndex);
+#endif
+}
+
+TEST(network_tests, link_goes_down_when_cable_unplugged)
+{
+	headless_network network;
+	auto bridges = create_ring (network, 4, STP_VERSION_RSTP);
+	EXPECT_TRUE (bridges[0]->mac_operational(1));
+	EXPECT_TRUE (bridges[1]->mac_operational(0));
+
+	network.disconnect (bridges[0], 1);
+	EXPECT_FALSE (bridges[0]->mac_operational(1));
+	EXPECT_FALSE (bridges[1]->mac_operational(0));
+}
+
+TEST(network_tests, link_goes_down_after_missed_link_pulses)
+{
+	headless_network network (1, true);
+	auto bridges = create_ring (network, 4, STP_VERSION_RSTP);
+	EXPECT_FALSE (bridges[0]->mac_operational(1));
+	network.run_for (100 * sim_milliseconds);
+	EXPECT_TRUE (bridges[0]->mac_operational(1));
+	EXPECT_TRUE (bridges[1]->mac_operational(0));
+
+	network.disconnect (bridges[0], 1);
+	network.run_for (headless_network::link_pulse_period);
+	EXPECT_TRUE (bridges[0]->mac_operational(1));
+	network.run_for (headless_bridge::MissedLinkPulseCounterMax * headless_network::link_pulse_period);
+	EXPECT_FALSE (bridges[0]->mac_operational(1));
+	EXPECT_FALSE (bridges[1]->mac_operational(0));
+
+	network.run_for (5 * sim_seconds);
+	EXPECT_EQ (0u, count_ports_with_role(bridges, STP_PORT_ROLE_ALTERNATE));
+	expect_stable (bridges);
+}
+
+TEST(network_tests, bpdus_flooded_by_bridge_without_stp)
+{
+	headless_network network;
+	auto bridge0 = network.add_bridge (4, 0, { 0x10, 0x20, 0x30, 0x40, 0x50, 0x60 });
+	auto hub     = network.add_bridge (4, 0, { 0x10, 0x20, 0x30, 0x40, 0x50, 0x80 });
+	auto bridge1 = network.add_bridge (4, 0, { 0x10, 0x20, 0x30, 0x40, 0x50, 0x70 });
+	STP_StartBridge (*bridge0, network.timestamp());
+	STP_StartBridge (*bridge1, network.timestamp());
+
+	network.connect (bridge0, 0, hub, 0);
+	network.connect (hub, 1, bridge1, 0);
+	network.run_for (1 * sim_seconds);
+
+	EXPECT_EQ (STP_PORT_ROLE_DESIGNATED, STP_GetPortRole(*bridge0, 0, 0));
+	EXPECT_EQ (STP_PORT_ROLE_ROOT,       STP_GetPortRole(*bridge1, 0, 0));
+}
+
+// Bridges without STP flood BPDUs to all their ports; in a loop of such bridges, a BPDU must stop when it gets back to a bridge it already went through.
+TEST(network_tests, bpdus_flooded_in_loop_of_bridges_without_stp)
+{
+	headless_network network;
+	auto bridge0 = network.add_bridge (4, 0, { 0x10, 0x20, 0x30, 0x40, 0x50, 0x60 });
+	auto bridge1 = network.add_bridge (4, 0, { 0x10, 0x20, 0x30, 0x40, 0x50, 0x70 });
+	STP_StartBridge (*bridge0, network.timestamp());
+	STP_StartBridge (*bridge1, network.timestamp());
+
+	std::vector<headless_bridge*> hubs;
+	for (uint8_t i = 0; i < 4; i++)
+		hubs.push_back (network.add_bridge (4, 0, { 0x10, 0x20, 0x30, 0x40, 0x50, (uint8_t)(0x80 + 0x10 * i) }));
+	for (size_t i = 0; i < hubs.size(); i++)
+		network.connect (hubs[i], 1, hubs[(i + 1) % hubs.size()], 0);
+
+	network.connect (bridge0, 0, hubs[0], 2);
+	network.connect (hubs[2], 2, bridge1, 0);
+	network.run_for (5 * sim_seconds);
+
+	// The BPDUs of bridge0 go around the loop both ways and stop when they get back to hubs[0], so they don't reach
+	// bridge0 again; if they did, its port would become Backup. They do reach bridge1, which makes bridge0 its root.
+	EXPECT_EQ (STP_PORT_ROLE_DESIGNATED, STP_GetPortRole(*bridge0, 0, 0));
+	EXPECT_EQ (STP_PORT_ROLE_ROOT,       STP_GetPortRole(*bridge1, 0, 0));
+}
+
+TEST(network_tests, ten_minutes_of_cable_churn)
+{
+	headless_network network;
+	auto bridges = create_ring (network, 16, STP_VERSION_RSTP);
+
+	// Every few seconds, unplug a random cable of the ring, or plug back the one unplugged earlier.
+	std::mt19937 rng (1);
+	headless_bridge* unplugged = nullptr;
+	while (network.now() < 10 * 60 * sim_seconds)
+	{
+		network.run_for ((1 + rng() % 10) * sim_seconds);
+		if (unplugged == nullptr)
+		{
+			unplugged = bridges[rng() % bridges.size()];
+			network.disconnect (unplugged, 1);
+		}
+		else
+		{
+			auto next = bridges[(std::find(bridges.begin(), bridges.end(), unplugged) - bridges.begin() + 1) % bridges.size()];
+			network.connect (unplugged, 1, next, 0);
+			unplugged = nullptr;
+		}
+	}
+
+	if (unplugged != nullptr)
+	{
+		auto next = bridges[(std::find(bridges.begin(), bridges.end(), unplugged) - bridges.begin() + 1) % bridges.size()];
+		network.connect (unplugged, 1, next, 0);
+	}
+
+	network.run_for (10 * sim_seconds);
+	EXPECT_EQ (1u, count_ports_with_role(bridges, STP_PORT_ROLE_ALTERNATE));
+	expect_stable (bridges);
+}
+
+// A ring spread over several partitions, run in parallel, must end up with the same port roles as when run on a single thread.
+TEST(network_tests, partitioned_ring_same_as_sequential)
+{
+	static constexpr size_t bridge_count = 16;
+
+	auto run_ring = [](size_t partition_count)
+	{
+		headless_network network (partition_count);
+		auto bridges = create_ring (network, bridge_count, STP_VERSION_RSTP);
+		network.run_for (10 * sim_seconds);
+		EXPECT_EQ (1u, count_ports_with_role(bridges, STP_PORT_ROLE_ALTERNATE));
+		expect_stable (bridges);
+
+		network.disconnect (bridges[bridge_count / 2], 1);
+		network.run_for (10 * sim_seconds);
+		EXPECT_EQ (0u, count_ports_with_role(bridges, STP_PORT_ROLE_ALTERNATE));
+		expect_stable (bridges);
+
+		std::vector<STP_PORT_ROLE> roles;
+		for (auto b : bridges)
+		{
+			for (unsigned int port_index = 0; port_index < (unsigned int)b->port_count(); port_index++)
+				roles.push_back (STP_GetPortRole(*b, port_index, 0));
+		}
+
+		return roles;
+	};
+
+	auto sequential_roles = run_ring(1);
+	EXPECT_EQ (sequential_roles, run_ring(4));
+	EXPECT_EQ (sequential_roles, run_ring(7));
+}
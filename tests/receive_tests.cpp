@@ -0,0 +1,293 @@
+// This file is part of the mstp-lib library, available at https://github.com/adigostin/mstp-lib
+// Copyright (c) 2011-2020 Adi Gostin, distributed under Apache License v2.0.
+
+// Tests that STP_OnBpdusReceived ends in the same state as STP_OnBpduReceived called for each BPDU.
+
+#include "test_helpers.h"
+#include <gtest/gtest.h>
+#include <memory>
+#include <set>
+
+namespace
+{
+	// A bridge whose ports are each connected to port 0 of a neighbor bridge. Port 1 of neighbor 2n is connected
+	// to port 1 of neighbor 2n + 1, so the bridge sees loops. The bridge receives BPDUs either one by one with
+	// STP_OnBpduReceived, or all those delivered together with one call to STP_OnBpdusReceived.
+	class star
+	{
+	public:
+		bool batched = false;
+		test_bridge center;
+		std::vector<std::unique_ptr<test_bridge>> neighbors;
+		std::vector<std::set<std::vector<uint8_t>>> center_transmitted; // distinct BPDUs, per port
+
+		star (size_t port_count, size_t msti_count, STP_VERSION version)
+			: center (port_count, msti_count, 16, { 0x10, 0x20, 0x30, 0x40, 0x50, 0x80 })
+			, center_transmitted (port_count)
+		{
+			for (size_t i = 0; i < port_count; i++)
+				neighbors.push_back (std::make_unique<test_bridge>(2, msti_count, 16, std::array<uint8_t, 6>{ 0x10, 0x20, 0x30, 0x40, 0x50, (uint8_t)(0x60 + 0x20 * (i % 2) + i) }));
+
+			for (test_bridge* b : all())
+			{
+				STP_SetStpVersion (*b, version, 0);
+				STP_SetMstConfigName (*b, "batch", 0);
+				for (unsigned int vlan = 1; vlan <= msti_count; vlan++)
+					STP_SetMstConfigTableEntry (*b, vlan, vlan, 0);
+				STP_StartBridge (*b, 0);
+			}
+		}
+
+		std::vector<test_bridge*> all()
+		{
+			std::vector<test_bridge*> res = { &center };
+			for (auto& n : neighbors)
+				res.push_back (n.get());
+			return res;
+		}
+
+		void enable_port (size_t port_index, unsigned int timestamp)
+		{
+			STP_OnPortEnabled (center, (unsigned int)port_index, 100, true, timestamp);
+			STP_OnPortEnabled (*neighbors[port_index], 0, 100, true, timestamp);
+		}
+
+		void disable_port (size_t port_index, unsigned int timestamp)
+		{
+			STP_OnPortDisabled (center, (unsigned int)port_index, timestamp);
+			STP_OnPortDisabled (*neighbors[port_index], 0, timestamp);
+			center.tx_queues[port_index] = { };
+			neighbors[port_index]->tx_queues[0] = { };
+		}
+
+		void enable_neighbor_links (unsigned int timestamp)
+		{
+			for (auto& n : neighbors)
+				STP_OnPortEnabled (*n, 1, 100, true, timestamp);
+		}
+
+		using received_bpdus = std::vector<std::pair<size_t, std::vector<uint8_t>>>;
+
+		// Takes the BPDUs transmitted so far by the neighbors towards the center, indexed by center port.
+		received_bpdus take_from_neighbors()
+		{
+			received_bpdus res;
+			for (size_t port_index = 0; port_index < neighbors.size(); port_index++)
+			{
+				auto& queue = neighbors[port_index]->tx_queues[0];
+				for (; !queue.empty(); queue.pop())
+					res.push_back ({ port_index, std::move(queue.front()) });
+			}
+
+			return res;
+		}
+
+		void receive (const received_bpdus& bpdus, unsigned int timestamp)
+		{
+			if (batched)
+			{
+				std::vector<STP_RX_BPDU> batch;
+				for (auto& b : bpdus)
+					batch.push_back ({ (unsigned int)b.first, b.second.data(), (unsigned int)b.second.size() });
+				STP_OnBpdusReceived (center, batch.data(), (unsigned int)batch.size(), timestamp);
+			}
+			else
+			{
+				for (auto& b : bpdus)
+					STP_OnBpduReceived (center, (unsigned int)b.first, b.second.data(), (unsigned int)b.second.size(), timestamp);
+			}
+		}
+
+		// Delivers the BPDUs transmitted so far by the neighbors to the center, and the other way around.
+		// Returns false if there were none.
+		bool deliver (unsigned int timestamp)
+		{
+			auto to_center = take_from_neighbors();
+			receive (to_center, timestamp);
+
+			bool delivered = !to_center.empty();
+
+			for (size_t port_index = 0; port_index < neighbors.size(); port_index++)
+			{
+				auto& queue = center.tx_queues[port_index];
+				for (; !queue.empty(); queue.pop())
+				{
+					center_transmitted[port_index].insert (queue.front());
+					STP_OnBpduReceived (*neighbors[port_index], 0, queue.front().data(), (unsigned int)queue.front().size(), timestamp);
+					delivered = true;
+				}
+			}
+
+			for (size_t i = 0; i + 1 < neighbors.size(); i += 2)
+				delivered |= exchange_bpdus (*neighbors[i], 1, *neighbors[i + 1], 1);
+
+			return delivered;
+		}
+
+		void run (unsigned int& timestamp, unsigned int seconds)
+		{
+			for (unsigned int s = 0; s < seconds; s++)
+			{
+				while (deliver (timestamp))
+					;
+				timestamp += 1000;
+				for (test_bridge* b : all())
+					STP_OnOneSecondTick (*b, timestamp);
+			}
+		}
+	};
+
+	void expect_same_state (star& one_by_one, star& batched)
+	{
+		auto a = one_by_one.all();
+		auto b = batched.all();
+		for (size_t bi = 0; bi < a.size(); bi++)
+		{
+			for (unsigned int port_index = 0; port_index < STP_GetPortCount(*a[bi]); port_index++)
+			{
+				for (unsigned int tree_index = 0; tree_index <= STP_GetMstiCount(*a[bi]); tree_index++)
+				{
+					SCOPED_TRACE(testing::Message() << "bridge " << bi << ", port " << port_index << ", tree " << tree_index);
+					EXPECT_EQ (STP_GetPortRole(*a[bi], port_index, tree_index), STP_GetPortRole(*b[bi], port_index, tree_index));
+					EXPECT_EQ (STP_GetPortLearning(*a[bi], port_index, tree_index), STP_GetPortLearning(*b[bi], port_index, tree_index));
+					EXPECT_EQ (STP_GetPortForwarding(*a[bi], port_index, tree_index), STP_GetPortForwarding(*b[bi], port_index, tree_index));
+				}
+			}
+		}
+	}
+
+	// The center receives the same BPDUs one by one in one network and as one batch in the other.
+	// Right after that, the center of each network must have the same roles and states. (Not necessarily the same
+	// last transmitted BPDU: one by one, the center may reach the Transmit Hold Count before sending the newest info.)
+	// After both networks converge, all bridges must end in the same state, and the center must transmit
+	// the same BPDUs during a few more Hello Times.
+	void expect_same_reception (star& one_by_one, star& batched, const star::received_bpdus& bpdus, unsigned int& timestamp)
+	{
+		ASSERT_GT (bpdus.size(), 1u);
+		one_by_one.receive (bpdus, timestamp);
+		batched.receive (bpdus, timestamp);
+		expect_same_state (one_by_one, batched);
+
+		for (star* s : { &one_by_one, &batched })
+		{
+			unsigned int ts = timestamp;
+			s->run (ts, 60);
+			for (auto& t : s->center_transmitted)
+				t.clear();
+			s->run (ts, 4);
+		}
+
+		expect_same_state (one_by_one, batched);
+		for (size_t port_index = 0; port_index < one_by_one.neighbors.size(); port_index++)
+		{
+			SCOPED_TRACE(testing::Message() << "port " << port_index);
+			if (STP_GetPortRole(batched.center, (unsigned int)port_index, 0) == STP_PORT_ROLE_DESIGNATED)
+			{
+				EXPECT_FALSE (batched.center_transmitted[port_index].empty());
+			}
+			EXPECT_EQ (one_by_one.center_transmitted[port_index], batched.center_transmitted[port_index]);
+		}
+	}
+
+	// Enables all links of both networks and lets them converge, delivering BPDUs one by one in both;
+	// only then does the second network switch to batches.
+	void converge (star& one_by_one, star& batched, unsigned int& timestamp)
+	{
+		for (star* s : { &one_by_one, &batched })
+		{
+			for (size_t port_index = 0; port_index < s->neighbors.size(); port_index++)
+				s->enable_port (port_index, timestamp);
+			s->enable_neighbor_links (timestamp);
+			unsigned int ts = timestamp;
+			s->run (ts, 60);
+		}
+
+		timestamp += 60000;
+		batched.batched = true;
+	}
+}
+
+// Several BPDUs on one port: a neighbor changes its priority a few times before the center gets to its BPDUs.
+TEST(receive_tests, several_bpdus_on_one_port)
+{
+	for (STP_VERSION version : { STP_VERSION_RSTP, STP_VERSION_MSTP })
+	{
+		SCOPED_TRACE(version);
+		unsigned int timestamp = 0;
+		star one_by_one (4, 2, version);
+		star batched (4, 2, version);
+		converge (one_by_one, batched, timestamp);
+
+		star::received_bpdus bpdus;
+		for (unsigned short priority : { 0x7000, 0x5000, 0x1000 })
+		{
+			for (star* s : { &one_by_one, &batched })
+				for (unsigned int tree_index = 0; tree_index <= 2; tree_index++)
+					STP_SetBridgePriority (*s->neighbors[3], tree_index, priority, timestamp);
+			auto b = one_by_one.take_from_neighbors();
+			EXPECT_EQ (b, batched.take_from_neighbors());
+			bpdus.insert (bpdus.end(), b.begin(), b.end());
+		}
+
+		expect_same_reception (one_by_one, batched, bpdus, timestamp);
+		EXPECT_EQ (STP_PORT_ROLE_ROOT, STP_GetPortRole(batched.center, 3, 0));
+	}
+}
+
+// BPDUs on many ports: the center and its neighbors start together, and the center gets all their first BPDUs at once.
+TEST(receive_tests, bpdus_on_many_ports)
+{
+	for (STP_VERSION version : { STP_VERSION_LEGACY_STP, STP_VERSION_RSTP, STP_VERSION_MSTP })
+	{
+		SCOPED_TRACE(version);
+		unsigned int timestamp = 0;
+		star one_by_one (8, 2, version);
+		star batched (8, 2, version);
+		batched.batched = true;
+		for (star* s : { &one_by_one, &batched })
+		{
+			for (size_t port_index = 0; port_index < 8; port_index++)
+				s->enable_port (port_index, timestamp);
+			s->enable_neighbor_links (timestamp);
+		}
+
+		auto bpdus = one_by_one.take_from_neighbors();
+		EXPECT_EQ (bpdus, batched.take_from_neighbors());
+		expect_same_reception (one_by_one, batched, bpdus, timestamp);
+	}
+}
+
+// The updtInfo-pending case: a BPDU whose Message Age has reached Max Age ages out the port's information as soon
+// as it is recorded. PortInformation then waits in AGED for Port Role Selection, which STP_OnBpdusReceived defers
+// to the end of the batch, so a second BPDU on the same port finds rcvdMsg still set from the first.
+TEST(receive_tests, aged_bpdus_while_updt_info_pending)
+{
+	for (STP_VERSION version : { STP_VERSION_RSTP, STP_VERSION_MSTP })
+	{
+		SCOPED_TRACE(version);
+		unsigned int timestamp = 0;
+		star one_by_one (4, 2, version);
+		star batched (4, 2, version);
+		converge (one_by_one, batched, timestamp);
+
+		// Neighbor 0 is the root, so these are the BPDUs of the center's root port. Make them aged on arrival.
+		ASSERT_EQ (STP_PORT_ROLE_ROOT, STP_GetPortRole(one_by_one.center, 0, 0));
+		auto bpdus = one_by_one.take_from_neighbors();
+		EXPECT_EQ (bpdus, batched.take_from_neighbors());
+		star::received_bpdus aged;
+		for (auto& b : bpdus)
+		{
+			if (b.first != 0)
+				continue;
+			ASSERT_GE (b.second.size(), 35u);
+			b.second[27] = b.second[29];
+			b.second[28] = b.second[30];
+			if (b.second[2] >= 3)
+				b.second[101] = 1; // CIST Remaining Hops, which ages the information of internal ports
+			aged.push_back (b);
+			aged.push_back (b);
+		}
+
+		expect_same_reception (one_by_one, batched, aged, timestamp);
+	}
+}
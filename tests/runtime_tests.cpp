@@ -0,0 +1,366 @@
+// This file is part of the mstp-lib library, available at https://github.com/adigostin/mstp-lib
+// Copyright (c) 2011-2020 Adi Gostin, distributed under Apache License v2.0.
+
+// Tests of the multi-bridge runtime in mstp-lib/runtime. Worth running also under ThreadSanitizer:
+// cmake -DCMAKE_BUILD_TYPE=Debug -DMSTP_LIB_SANITIZE=thread
+
+#include "test_helpers.h"
+#include "stp_runtime.h"
+#include <gtest/gtest.h>
+#include <atomic>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+
+namespace
+{
+	const unsigned int thread_counts[] = { 1, 2, 4, 16 };
+
+	// RSTP bridges added to a runtime; the bridges are started, with all their ports enabled.
+	class bridges_on_runtime
+	{
+	public:
+		STP_RUNTIME* runtime;
+		std::vector<std::unique_ptr<test_bridge>> bridges;
+		std::vector<STP_RUNTIME_BRIDGE*> runtime_bridges;
+
+		bridges_on_runtime (unsigned int thread_count, size_t bridge_count, size_t port_count)
+		{
+			runtime = STP_CreateRuntime (thread_count);
+			for (size_t i = 0; i < bridge_count; i++)
+			{
+				auto b = std::make_unique<test_bridge>(port_count, 0, 0, std::array<uint8_t, 6>{ 0x02, 0, 0, 0, (uint8_t)(i >> 8), (uint8_t)i });
+				STP_SetStpVersion (*b, STP_VERSION_RSTP, 0);
+				STP_StartBridge (*b, 0);
+				for (unsigned int port_index = 0; port_index < port_count; port_index++)
+					STP_OnPortEnabled (*b, port_index, 100, true, 0);
+				runtime_bridges.push_back (STP_RuntimeAddBridge (runtime, *b));
+				bridges.push_back (std::move(b));
+			}
+		}
+
+		~bridges_on_runtime()
+		{
+			for (STP_RUNTIME_BRIDGE* rb : runtime_bridges)
+				STP_RuntimeRemoveBridge (rb);
+			STP_DestroyRuntime (runtime);
+		}
+
+		STP_RUNTIME_BRIDGE* operator[] (size_t i) const { return runtime_bridges[i]; }
+	};
+
+	// An RST BPDU from a designated bridge with address 06-00-00-00-00-01 on its port 1,
+	// giving as root a bridge with the given priority and the given two last address bytes.
+	std::vector<uint8_t> make_rst_bpdu (uint16_t root_priority, uint16_t root_address_low)
+	{
+		return std::vector<uint8_t> {
+			0, 0,
+			2, // protocolVersionId RSTP
+			2, // RST BPDU
+			0x0C, // cistFlags: designated port role
+			(uint8_t)(root_priority >> 8), (uint8_t)root_priority, 0x02, 0, 0, 0, (uint8_t)(root_address_low >> 8), (uint8_t)root_address_low, // cistRootId
+			0, 0, 0, 20, // cistExternalPathCost
+			0x80, 0x00, 0x06, 0, 0, 0, 0, 1, // cistRegionalRootId (designated bridge)
+			0x80, 0x01, // cistPortId
+			0, 0, // MessageAge
+			20, 0, // MaxAge
+			2, 0, // HelloTime
+			15, 0, // ForwardDelay
+			0, // Version1Length
+		};
+	}
+
+	// State kept per bridge by the calls posted in the ordering test. Only the calls running for a bridge access it.
+	struct call_record
+	{
+		std::vector<unsigned int> next_seq; // per posting thread
+		unsigned int calls = 0;
+		unsigned int out_of_order = 0;
+		unsigned int overlapping = 0;
+		unsigned int wrong_root = 0;
+		unsigned int wrong_port_enabled = 0;
+		std::atomic<bool> running { false };
+	};
+
+	struct call_context
+	{
+		call_record* record;
+		unsigned int poster;
+		unsigned int seq;
+		int check_root_address_low; // -1 for no check
+		int check_port_index;       // -1 for no check
+		bool check_port_enabled;
+	};
+
+	void check_call (STP_BRIDGE* bridge, void* context, unsigned int timestamp)
+	{
+		std::unique_ptr<call_context> c (static_cast<call_context*>(context));
+		call_record* r = c->record;
+		if (r->running.exchange(true))
+			r->overlapping++;
+
+		if (c->seq != r->next_seq[c->poster])
+			r->out_of_order++;
+		r->next_seq[c->poster] = c->seq + 1;
+
+		if (c->check_root_address_low >= 0)
+		{
+			unsigned char root_vector[36];
+			STP_GetRootPriorityVector (bridge, 0, root_vector);
+			if ((root_vector[6] << 8 | root_vector[7]) != c->check_root_address_low)
+				r->wrong_root++;
+		}
+
+		if ((c->check_port_index >= 0) && (STP_GetPortEnabled(bridge, c->check_port_index) != c->check_port_enabled))
+			r->wrong_port_enabled++;
+
+		r->calls++;
+		r->running = false;
+	}
+}
+
+// Several threads post interleaved BPDUs, port events and calls to many bridges, while the main thread posts ticks.
+// The events of each bridge must run one at a time and in the order each thread posted them; BPDUs posted
+// back to back are batched, and the calls posted after them see the information of the last one.
+TEST(runtime_tests, events_of_each_bridge_run_in_posted_order)
+{
+	const size_t bridge_count = 32;
+	const unsigned int poster_count = 3;
+	const unsigned int rounds = 100;
+
+	for (unsigned int thread_count : thread_counts)
+	{
+		SCOPED_TRACE(testing::Message() << thread_count << " threads");
+		bridges_on_runtime rbs (thread_count, bridge_count, poster_count);
+		ASSERT_EQ (thread_count, STP_GetRuntimeThreadCount(rbs.runtime));
+
+		std::vector<call_record> records (bridge_count);
+		for (auto& r : records)
+			r.next_seq.resize (poster_count);
+
+		auto post = [&rbs, &records](unsigned int poster)
+		{
+			std::vector<unsigned int> seqs (bridge_count); // per bridge
+			for (unsigned int round = 0; round < rounds; round++)
+			{
+				for (size_t i = 0; i < bridge_count; i++)
+				{
+					size_t bi = (i + poster * 7) % bridge_count;
+					STP_RUNTIME_BRIDGE* rb = rbs[bi];
+					call_record* r = &records[bi];
+					unsigned int& seq = seqs[bi];
+					if (poster == 0)
+					{
+						// Three BPDUs on port 0 with a root better than all bridges, the first two with the same timestamp.
+						for (unsigned int k = 0; k < 3; k++)
+						{
+							auto bpdu = make_rst_bpdu (0x1000, (uint16_t)(3 * round + k));
+							STP_RuntimePostBpdu (rb, 0, bpdu.data(), (unsigned int)bpdu.size(), 1000 * round + (k == 2));
+						}
+
+						STP_RuntimePostCall (rb, check_call, new call_context { r, poster, seq++, (int)(3 * round + 2), -1, false }, 1000 * round + 1);
+					}
+					else
+					{
+						// BPDUs with a root worse than all bridges, port down and up again.
+						auto bpdu = make_rst_bpdu (0xF000, (uint16_t)round);
+						STP_RuntimePostBpdu (rb, poster, bpdu.data(), (unsigned int)bpdu.size(), 1000 * round);
+						STP_RuntimePostCall (rb, check_call, new call_context { r, poster, seq++, -1, -1, false }, 1000 * round);
+						if (round % 5 == poster)
+						{
+							STP_RuntimePostPortDisabled (rb, poster, 1000 * round);
+							STP_RuntimePostCall (rb, check_call, new call_context { r, poster, seq++, -1, (int)poster, false }, 1000 * round);
+							STP_RuntimePostPortEnabled (rb, poster, 100, true, 1000 * round);
+							STP_RuntimePostCall (rb, check_call, new call_context { r, poster, seq++, -1, (int)poster, true }, 1000 * round);
+						}
+					}
+				}
+			}
+		};
+
+		std::vector<std::thread> posters;
+		for (unsigned int poster = 0; poster < poster_count; poster++)
+			posters.emplace_back (post, poster);
+
+		// Fewer ticks than needed to age out the information received on port 0.
+		for (unsigned int tick = 1; tick <= 3; tick++)
+		{
+			std::this_thread::yield();
+			STP_RuntimeOnOneSecondTick (rbs.runtime, 1000 * tick);
+		}
+
+		for (auto& t : posters)
+			t.join();
+
+		STP_RuntimeWaitIdle (rbs.runtime);
+
+		for (size_t bi = 0; bi < bridge_count; bi++)
+		{
+			SCOPED_TRACE(testing::Message() << "bridge " << bi);
+			call_record& r = records[bi];
+			EXPECT_EQ (rounds + 2 * rounds + 2 * (rounds / 5) * 2, r.calls);
+			EXPECT_EQ (0u, r.out_of_order);
+			EXPECT_EQ (0u, r.overlapping);
+			EXPECT_EQ (0u, r.wrong_root);
+			EXPECT_EQ (0u, r.wrong_port_enabled);
+			EXPECT_TRUE (STP_GetPortEnabled(*rbs.bridges[bi], 1));
+			EXPECT_TRUE (STP_GetPortEnabled(*rbs.bridges[bi], 2));
+		}
+	}
+}
+
+namespace
+{
+	// Each call posts two more to other bridges, until the given depth. This from the worker threads.
+	struct fan_out
+	{
+		bridges_on_runtime* rbs;
+		std::atomic<unsigned int> calls { 0 };
+		static const unsigned int depth = 12;
+
+		struct context
+		{
+			fan_out* f;
+			size_t bridge_index;
+			unsigned int level;
+		};
+
+		static void call (STP_BRIDGE* bridge, void* ctx, unsigned int timestamp)
+		{
+			std::unique_ptr<context> c (static_cast<context*>(ctx));
+			c->f->calls++;
+			if (c->level + 1 < depth)
+			{
+				size_t count = c->f->rbs->bridges.size();
+				for (size_t i = 1; i <= 2; i++)
+				{
+					size_t next = (c->bridge_index * 2 + i) % count;
+					STP_RuntimePostCall ((*c->f->rbs)[next], call, new context { c->f, next, c->level + 1 }, timestamp);
+				}
+			}
+		}
+	};
+}
+
+// STP_RuntimeWaitIdle must also wait for the events posted from the worker threads while it waits.
+TEST(runtime_tests, wait_idle_waits_for_events_posted_by_workers)
+{
+	for (unsigned int thread_count : thread_counts)
+	{
+		SCOPED_TRACE(testing::Message() << thread_count << " threads");
+		bridges_on_runtime rbs (thread_count, 10, 1);
+		fan_out f;
+		f.rbs = &rbs;
+		for (unsigned int repeat = 0; repeat < 5; repeat++)
+		{
+			f.calls = 0;
+			STP_RuntimePostCall (rbs[0], fan_out::call, new fan_out::context { &f, 0, 0 }, 0);
+			STP_RuntimeWaitIdle (rbs.runtime);
+			EXPECT_EQ ((1u << fan_out::depth) - 1, f.calls.load());
+		}
+	}
+}
+
+// A ring of bridges whose BPDUs are posted to the runtime by the main thread, one tick at a time.
+// It must end as the same ring run without the runtime: the lowest address as root, one alternate port.
+TEST(runtime_tests, ring_converges)
+{
+	const size_t bridge_count = 16;
+	for (unsigned int thread_count : thread_counts)
+	{
+		SCOPED_TRACE(testing::Message() << thread_count << " threads");
+		bridges_on_runtime rbs (thread_count, bridge_count, 2);
+		// Called while the runtime is idle. Takes all BPDUs before posting any, since the bridges run as soon as they're posted to.
+		auto deliver = [&rbs](unsigned int timestamp)
+		{
+			std::vector<std::pair<size_t, std::vector<uint8_t>>> to_post[2]; // per receiving port
+			for (size_t bi = 0; bi < bridge_count; bi++)
+			{
+				for (size_t port_index = 0; port_index < 2; port_index++)
+				{
+					size_t peer = (port_index == 0) ? (bi + 1) % bridge_count : (bi + bridge_count - 1) % bridge_count;
+					auto& queue = rbs.bridges[bi]->tx_queues[port_index];
+					for (; !queue.empty(); queue.pop())
+						to_post[1 - port_index].push_back ({ peer, std::move(queue.front()) });
+				}
+			}
+
+			for (unsigned int port_index = 0; port_index < 2; port_index++)
+			{
+				for (auto& p : to_post[port_index])
+					STP_RuntimePostBpdu (rbs[p.first], port_index, p.second.data(), (unsigned int)p.second.size(), timestamp);
+			}
+
+			return !to_post[0].empty() || !to_post[1].empty();
+		};
+
+		for (unsigned int tick = 1; tick <= 30; tick++)
+		{
+			do
+				STP_RuntimeWaitIdle (rbs.runtime);
+			while (deliver (1000 * tick));
+			STP_RuntimeOnOneSecondTick (rbs.runtime, 1000 * tick);
+		}
+
+		STP_RuntimeWaitIdle (rbs.runtime);
+
+		size_t root_ports = 0, alternate_ports = 0, forwarding_ports = 0;
+		for (auto& b : rbs.bridges)
+		{
+			for (unsigned int port_index = 0; port_index < 2; port_index++)
+			{
+				root_ports += (STP_GetPortRole(*b, port_index, 0) == STP_PORT_ROLE_ROOT);
+				alternate_ports += (STP_GetPortRole(*b, port_index, 0) == STP_PORT_ROLE_ALTERNATE);
+				forwarding_ports += STP_GetPortForwarding(*b, port_index, 0);
+			}
+		}
+
+		EXPECT_EQ (STP_PORT_ROLE_DESIGNATED, STP_GetPortRole(*rbs.bridges[0], 0, 0));
+		EXPECT_EQ (STP_PORT_ROLE_DESIGNATED, STP_GetPortRole(*rbs.bridges[0], 1, 0));
+		EXPECT_EQ (bridge_count - 1, root_ports);
+		EXPECT_EQ (1u, alternate_ports);
+		EXPECT_EQ (2 * bridge_count - 1, forwarding_ports);
+	}
+}
+
+// BPDUs queued back to back with different timestamps are not batched together;
+// each is received - and logged - with its own timestamp.
+TEST(runtime_tests, bpdus_received_with_their_own_timestamps)
+{
+#if STP_USE_BINARY_LOG
+	GTEST_SKIP() << "Needs the text log.";
+#endif
+
+	for (unsigned int thread_count : thread_counts)
+	{
+		SCOPED_TRACE(testing::Message() << thread_count << " threads");
+		bridges_on_runtime rbs (thread_count, 1, 2);
+		std::string log;
+		STP_EnableLogging (*rbs.bridges[0], true);
+		rbs.bridges[0]->debug_str_out = [&log](int portIndex, int treeIndex, const char* str, unsigned int length)
+		{
+			log.append (str, length);
+		};
+
+		// Keep the bridge busy while posting, so the runtime finds all BPDUs in the queue at once.
+		std::promise<void> release;
+		std::shared_future<void> released = release.get_future().share();
+		STP_RuntimePostCall (rbs[0], [](STP_BRIDGE*, void* context, unsigned int) { static_cast<std::shared_future<void>*>(context)->wait(); }, &released, 0);
+
+		auto a = make_rst_bpdu (0x3000, 1);
+		auto b = make_rst_bpdu (0x2000, 2);
+		auto c = make_rst_bpdu (0x1000, 3);
+		STP_RuntimePostBpdu (rbs[0], 0, a.data(), (unsigned int)a.size(), 100);
+		STP_RuntimePostBpdu (rbs[0], 1, b.data(), (unsigned int)b.size(), 200);
+		STP_RuntimePostBpdu (rbs[0], 0, c.data(), (unsigned int)c.size(), 200);
+		release.set_value();
+		STP_RuntimeWaitIdle (rbs.runtime);
+
+		EXPECT_NE (std::string::npos, log.find("0.100: BPDU received on Port 1:"));
+		EXPECT_NE (std::string::npos, log.find("0.200: BPDU received on Port 2:"));
+		EXPECT_NE (std::string::npos, log.find("0.200: BPDU received on Port 1:"));
+		EXPECT_EQ (std::string::npos, log.find("0.100: BPDU received on Port 2:"));
+		EXPECT_EQ (STP_PORT_ROLE_ROOT, STP_GetPortRole(*rbs.bridges[0], 0, 0));
+	}
+}
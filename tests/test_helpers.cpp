@@ -0,0 +1,169 @@
+
+// This file is part of the mstp-lib library, available at https://github.com/adigostin/mstp-lib
+// Copyright (c) 2011-2020 Adi Gostin, distributed under Apache License v2.0.
+
+#include "test_helpers.h"
+#include <cstdlib>
+#include <cstring>
+
+int test_bridge::live_memory_blocks = 0;
+
+void* test_bridge::StpCallback_AllocAndZeroMemory (unsigned int size)
+{
+	void* res = malloc(size);
+	memset (res, 0, size);
+	live_memory_blocks++;
+	return res;
+}
+
+void test_bridge::StpCallback_FreeMemory (void* p)
+{
+	live_memory_blocks--;
+	free(p);
+}
+
+void* test_bridge::StpCallback_TransmitGetBuffer (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int bpduSize, unsigned int timestamp)
+{
+	test_bridge* tb = static_cast<test_bridge*>(STP_GetApplicationContext(bridge));
+	tb->tx_buffer_port_index = portIndex;
+	tb->tx_buffer.resize(bpduSize);
+	return tb->tx_buffer.data();
+}
+
+void test_bridge::StpCallback_TransmitReleaseBuffer (const STP_BRIDGE* bridge, void* bufferReturnedByGetBuffer)
+{
+	test_bridge* tb = static_cast<test_bridge*>(STP_GetApplicationContext(bridge));
+	tb->tx_queues[tb->tx_buffer_port_index].push(std::move(tb->tx_buffer));
+}
+
+void test_bridge::StpCallback_TransmitGather (const STP_BRIDGE* bridge, unsigned int portIndex, const STP_TX_FRAGMENT* fragments, unsigned int fragmentCount, unsigned int timestamp)
+{
+	test_bridge* tb = static_cast<test_bridge*>(STP_GetApplicationContext(bridge));
+	std::vector<uint8_t> frame;
+	for (unsigned int i = 0; i < fragmentCount; i++)
+	{
+		auto data = static_cast<const uint8_t*>(fragments[i].data);
+		frame.insert (frame.end(), data, data + fragments[i].size);
+	}
+
+	tb->tx_queues[portIndex].push(std::vector<uint8_t>(frame.begin() + fragments[0].size, frame.end()));
+	tb->tx_frames[portIndex].push(std::move(frame));
+}
+
+static void StpCallback_EnableBpduTrapping (const STP_BRIDGE* bridge, bool enable, unsigned int timestamp)
+{
+}
+
+static void StpCallback_EnableLearning (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex, bool enable, unsigned int timestamp)
+{
+}
+
+static void StpCallback_EnableForwarding (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex, bool enable, unsigned int timestamp)
+{
+}
+
+static void StpCallback_FlushFdb (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex, enum STP_FLUSH_FDB_TYPE flushType, unsigned int timestamp)
+{
+}
+
+void test_bridge::StpCallback_DebugStrOut (const STP_BRIDGE* bridge, int portIndex, int treeIndex, const char* nullTerminatedString, unsigned int stringLength, unsigned int flush)
+{
+	test_bridge* tb = static_cast<test_bridge*>(STP_GetApplicationContext(bridge));
+	if (tb->debug_str_out)
+		tb->debug_str_out (portIndex, treeIndex, nullTerminatedString, stringLength);
+}
+
+unsigned int test_bridge::StpCallback_ReadClock (const STP_BRIDGE* bridge)
+{
+	test_bridge* tb = static_cast<test_bridge*>(STP_GetApplicationContext(bridge));
+	return tb->read_clock ? tb->read_clock() : 0;
+}
+
+static void StpCallback_OnTopologyChange (const STP_BRIDGE* bridge, unsigned int treeIndex, unsigned int timestamp)
+{
+}
+
+void test_bridge::StpCallback_OnPortRoleChanged (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex, STP_PORT_ROLE role, unsigned int timestamp)
+{
+	test_bridge* tb = static_cast<test_bridge*>(STP_GetApplicationContext(bridge));
+	if (tb->port_role_changed)
+		tb->port_role_changed (portIndex, treeIndex, role);
+}
+
+const STP_CALLBACKS test_bridge::callbacks =
+{
+	&StpCallback_EnableBpduTrapping,
+	&StpCallback_EnableLearning,
+	&StpCallback_EnableForwarding,
+	&StpCallback_TransmitGetBuffer,
+	&StpCallback_TransmitReleaseBuffer,
+	&StpCallback_FlushFdb,
+	&StpCallback_DebugStrOut,
+	&StpCallback_OnTopologyChange,
+	&StpCallback_OnPortRoleChanged,
+	&StpCallback_AllocAndZeroMemory,
+	&StpCallback_FreeMemory,
+	nullptr, // transmitGather
+	&StpCallback_ReadClock,
+};
+
+const STP_CALLBACKS test_bridge::gather_callbacks =
+{
+	&StpCallback_EnableBpduTrapping,
+	&StpCallback_EnableLearning,
+	&StpCallback_EnableForwarding,
+	nullptr, // transmitGetBuffer
+	nullptr, // transmitReleaseBuffer
+	&StpCallback_FlushFdb,
+	&StpCallback_DebugStrOut,
+	&StpCallback_OnTopologyChange,
+	&StpCallback_OnPortRoleChanged,
+	&StpCallback_AllocAndZeroMemory,
+	&StpCallback_FreeMemory,
+	&StpCallback_TransmitGather,
+	&StpCallback_ReadClock,
+};
+
+test_bridge::test_bridge (size_t port_count, size_t msti_count, uint16_t max_vlan_number, const std::array<uint8_t, 6>& bridge_address, bool transmit_gather)
+{
+	stp_bridge = STP_CreateBridge ((unsigned int)port_count, (unsigned int)msti_count, max_vlan_number, transmit_gather ? &gather_callbacks : &callbacks, bridge_address.data(), 256);
+	STP_SetApplicationContext (stp_bridge, this);
+}
+
+test_bridge::test_bridge (size_t port_count, size_t msti_count, uint16_t max_vlan_number, const std::array<uint8_t, 6>& bridge_address, void* buffer, size_t buffer_size)
+{
+	stp_bridge = STP_CreateBridgeInBuffer (buffer, (unsigned int)buffer_size, (unsigned int)port_count, (unsigned int)msti_count, max_vlan_number, &callbacks, bridge_address.data(), 256);
+	STP_SetApplicationContext (stp_bridge, this);
+}
+
+test_bridge::~test_bridge()
+{
+	STP_DestroyBridge (stp_bridge);
+	stp_bridge = nullptr;
+}
+
+// BPDUs are delivered in the order they were transmitted.
+bool exchange_bpdus (test_bridge& one, size_t one_port, test_bridge& other, size_t other_port)
+{
+	bool exchanged = false;
+	while (true)
+	{
+		if (!one.tx_queues[one_port].empty())
+		{
+			auto bpdu = std::move(one.tx_queues[one_port].front());
+			one.tx_queues[one_port].pop();
+			STP_OnBpduReceived (other, (unsigned int)other_port, bpdu.data(), (unsigned int) bpdu.size(), 0);
+			exchanged = true;
+		}
+		else if (!other.tx_queues[other_port].empty())
+		{
+			auto bpdu = std::move(other.tx_queues[other_port].front());
+			other.tx_queues[other_port].pop();
+			STP_OnBpduReceived (one, (unsigned int)one_port, bpdu.data(), (unsigned int) bpdu.size(), 0);
+			exchanged = true;
+		}
+		else
+			break;
+	}
+	return exchanged;
+}
@@ -0,0 +1,63 @@
+
+// This file is part of the mstp-lib library, available at https://github.com/adigostin/mstp-lib
+// Copyright (c) 2011-2020 Adi Gostin, distributed under Apache License v2.0.
+
+// Headless version of simulator/tests/test_helpers.h, for the tests built with CMake.
+
+#pragma once
+#include "stp.h"
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <queue>
+#include <unordered_map>
+#include <vector>
+
+// Lets GoogleTest print port roles by name.
+inline void PrintTo (STP_PORT_ROLE role, std::ostream* os)
+{
+	*os << STP_GetPortRoleString(role);
+}
+
+class test_bridge
+{
+	STP_BRIDGE* stp_bridge;
+
+	static void* StpCallback_AllocAndZeroMemory (unsigned int size);
+	static void  StpCallback_FreeMemory (void* p);
+	static void* StpCallback_TransmitGetBuffer (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int bpduSize, unsigned int timestamp);
+	static void  StpCallback_TransmitReleaseBuffer (const STP_BRIDGE* bridge, void* bufferReturnedByGetBuffer);
+	static void  StpCallback_TransmitGather (const STP_BRIDGE* bridge, unsigned int portIndex, const STP_TX_FRAGMENT* fragments, unsigned int fragmentCount, unsigned int timestamp);
+	static void  StpCallback_OnPortRoleChanged (const STP_BRIDGE* bridge, unsigned int portIndex, unsigned int treeIndex, STP_PORT_ROLE role, unsigned int timestamp);
+	static void  StpCallback_DebugStrOut (const STP_BRIDGE* bridge, int portIndex, int treeIndex, const char* nullTerminatedString, unsigned int stringLength, unsigned int flush);
+	static unsigned int StpCallback_ReadClock (const STP_BRIDGE* bridge);
+	static const STP_CALLBACKS callbacks;
+	static const STP_CALLBACKS gather_callbacks;
+
+	std::vector<uint8_t> tx_buffer;
+	size_t tx_buffer_port_index;
+
+public:
+	// With transmit_gather, the bridge transmits through the transmitGather callback instead of transmitGetBuffer.
+	test_bridge (size_t port_count, size_t msti_count, uint16_t max_vlan_number, const std::array<uint8_t, 6>& bridge_address, bool transmit_gather = false);
+	// Creates the bridge in a buffer owned by the caller, with STP_CreateBridgeInBuffer.
+	test_bridge (size_t port_count, size_t msti_count, uint16_t max_vlan_number, const std::array<uint8_t, 6>& bridge_address, void* buffer, size_t buffer_size);
+	test_bridge (const test_bridge&) = delete;
+	test_bridge& operator= (const test_bridge&) = delete;
+	~test_bridge();
+
+	operator STP_BRIDGE* () const { return stp_bridge; }
+
+	using tx_queue = std::queue<std::vector<uint8_t>>;
+	std::unordered_map<size_t, tx_queue> tx_queues;
+	std::unordered_map<size_t, tx_queue> tx_frames; // with transmit_gather only: the BPDUs of tx_queues with the Ethernet and LLC headers
+	std::function<void(size_t portIndex, size_t treeIndex, STP_PORT_ROLE role)> port_role_changed;
+	std::function<void(int portIndex, int treeIndex, const char* str, unsigned int length)> debug_str_out;
+	std::function<unsigned int()> read_clock; // the clock reads zero when this isn't set
+
+	// Blocks allocated with the allocAndZeroMemory callback and not yet freed, by all bridges.
+	static int live_memory_blocks;
+};
+
+bool exchange_bpdus (test_bridge& one, size_t one_port, test_bridge& other, size_t other_port);